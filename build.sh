@@ -18,11 +18,12 @@ make
 
 source env.sh
 
-for srpcf in `cat tools/templates/cmds.txt`
+for srpcf in `awk -v out=names -f tools/gen_registry.awk libsrpcf/cmds/*.c`
 do
 	ln -s srpcfsh/srpcfsh $srpcf
 done
 ln -s srpcfsh/srpcfsh xrHelloWorld
+ln -s srpcfsh/srpcfsh xrHelloCounter
 
 ./srpcfsvr/srpcfsvr -c &
 
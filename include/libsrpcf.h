@@ -16,6 +16,9 @@
  *
  */
 
+#include <pthread.h>
+
+
 //
 // Definitions
 //
@@ -26,8 +29,24 @@
 
 #define LIBSRPCF_MSG_RETRY_TIME		50000
 #define LIBSRPCF_MSG_RETRY_MSEC		500
-#define LIBSRPCF_MSG_DELAY			500
 #define LIBSRPCF_MSG_RETRY_CLEAN		10
+#define LIBSRPCF_SESSION_MARGIN		1
+#define LIBSRPCF_ASYNC_EVENTS		64
+#define LIBSRPCF_ASYNC_OUTPUT		4
+#define LIBSRPCF_POOL_IDLE			8
+#define LIBSRPCF_POOL_TOTAL			64
+#define LIBSRPCF_POOL_PROBE			1
+#define LIBSRPCF_FRAME_LOCKS		1024
+#define LIBSRPCF_FRAME_SIZE			65536
+#define LIBSRPCF_FRAME_MORE			0x80000000
+#define LIBSRPCF_MSG_LIMIT			(16 * 1024 * 1024)
+#define LIBSRPCF_MAPPED_MIN			(64 * 1024)
+#define LIBSRPCF_CHUNK_HDRLEN		(sizeof( srpcfSvrRspExecute_t ) - sizeof( s8 * ))
+#define LIBSRPCF_CHUNK_SIZE			(LIBSRPCF_MSG_SIZE - LIBSRPCF_CHUNK_HDRLEN)
+#define LIBSRPCF_IOV_MAX			8
+#define LIBSRPCF_RELAY_ADDR_MAX		64
+#define LIBSRPCF_RELAY_DEPTH		8
+#define LIBSRPCF_RELAY_DELIM		", \t\n"
 
 #define LIBSRPCF_FILE_PMODE			0640
 #define LIBSRPCF_FILE_CMODE			(O_RDWR | O_CREAT)
@@ -38,6 +57,7 @@
 #define LIBSRPCF_MAX_WRITE_PACKAGE	256
 #define LIBSRPCF_PLUGIN_PATH		"plugins"
 #define LIBSRPCF_PLUGIN_SUFFIX		".srpcf"
+#define LIBSRPCF_PLUGIN_NONE		0xFFFFFFFF
 #define LIBSRPCF_BPL				16
 
 #define LIBSRPCF_MAC_STR_LEN		12
@@ -74,6 +94,19 @@
 //
 // Macros
 //
+#define LIBSRPCF_FRAME_LEN( LEN )				((LEN) & ~LIBSRPCF_FRAME_MORE)
+
+// Each level of a relay tree gets three quarters of the time it was given,
+// so its answer is back before the level above gives up on it
+#define LIBSRPCF_RELAY_DEADLINE( MSEC )			((MSEC) - (MSEC) / 4)
+
+
+// Built-in commands only, the build collects these lines into srpcf_cmds.h
+// and the descriptor table. Numbers go over the wire, never reuse one.
+#define LIBSRPCF_REGISTER( NAME, NUMBER ) \
+    _Static_assert( NAME == NUMBER, #NAME " is registered as " #NUMBER )
+
+
 #define LIBSRPCF_HELPER_TEXT( DESC )			static s8 *__tmp_help_text = DESC;
 
 
@@ -89,6 +122,21 @@
 #define LIBSRPCF_SERVER_IMPLEMENT( NAME ) \
     s8 *srpcfExecutor_##NAME( cmdOpt_t *pCmdOpt, u32 numOpts, u32 *errorCode )
 
+#define LIBSRPCF_STREAM_IMPLEMENT( NAME ) \
+    void srpcfStreamer_##NAME( cmdOpt_t *pCmdOpt, u32 numOpts, srpcfSink_t *pSink, u32 *errorCode )
+
+// Extended ABI, all optional: set up per-plugin state when the plugin is loaded,
+// hand it to every call, and tear it down when the plugin is unloaded.
+// Calls run concurrently, the plugin serializes access to its own state.
+#define LIBSRPCF_INIT_FUNC( NAME ) \
+    bool srpcfInit_##NAME( void **ppContext )
+
+#define LIBSRPCF_FINI_FUNC( NAME ) \
+    void srpcfFini_##NAME( void *pContext )
+
+#define LIBSRPCF_CONTEXT_IMPLEMENT( NAME ) \
+    s8 *srpcfContextExecutor_##NAME( void *pContext, cmdOpt_t *pCmdOpt, u32 numOpts, u32 *errorCode )
+
 #define LIBSRPCF_SRPCF_FOREACH \
     cmdOpt_t *ppCmdOpt; \
     	ForeachLinkList( pCmdOpt, ppCmdOpt )
@@ -102,6 +150,10 @@ typedef enum _srpcfReqOpCode {
     SRPCF_REQ_QUERY_SUPPORT = 1,
 	SRPCF_REQ_EXECUTE,
 	SRPCF_REQ_EXECUTE_PLUGIN,
+	SRPCF_REQ_EXECUTE_BATCH,
+	SRPCF_REQ_EXECUTE_PLUGIN_ID,
+	SRPCF_REQ_QUERY_GENERATION,
+	SRPCF_REQ_EXECUTE_RELAY,
 
 } srpcfReqOpCode_t;
 
@@ -111,20 +163,28 @@ typedef enum _srpcfRspOpCode {
     SRPCF_RSP_QUERY_SUPPORT = 1,
 	SRPCF_RSP_EXECUTE,
 	SRPCF_RSP_EXECUTE_PLUGIN,
+	SRPCF_RSP_EXECUTE_BATCH,
+	SRPCF_RSP_EXECUTE_CHUNK,
+	SRPCF_RSP_QUERY_GENERATION,
+	SRPCF_RSP_EXECUTE_MAPPED,
 
 } srpcfRspOpCode_t;
 
 
+typedef enum _srpcfCapFlags {
+
+	SRPCF_CAP_SESSION			= 0x00000001,
+	SRPCF_CAP_STREAM			= 0x00000002,
+	SRPCF_CAP_PLUGIN_ID			= 0x00000004,
+	SRPCF_CAP_MAPPED			= 0x00000008,
+
+} srpcfCapFlags_t;
+
+
 //
 // Structures
 //
-typedef struct _srpcfSupported {
-
-    u32			srpcfCmdNo;
-    bool		enabled;
-    s8			*srpcfFuncName;
-
-} srpcfSupported_t;
+struct iovec;
 
 
 typedef struct PACKED _srpcfSupportedNum {
@@ -134,6 +194,16 @@ typedef struct PACKED _srpcfSupportedNum {
 } srpcfSupportedNum_t;
 
 
+// Follows the command list when plugin IDs are granted, after a u32 count
+typedef struct PACKED _srpcfSupportedPlugin {
+
+    u32			srpcfPluginId;
+    u32			nameLength;
+    s8			*namePtr;
+
+} srpcfSupportedPlugin_t;
+
+
 typedef struct PACKED _cmdOpt {
 
     union {
@@ -151,10 +221,13 @@ typedef struct PACKED _cmdOpt {
 } cmdOpt_t;
 
 
+// Every frame starts with this. The header is 12 bytes since spec 2.0, there
+// is no negotiation, both ends must be built from the same spec.
 typedef struct PACKED _srpcfSvrCommHdr {
 
     srpcfReqOpCode_t	srpcfOpCode;
     u32               	srpcfPktLen;
+    u32               	srpcfReqId;
 
 } srpcfSvrCommHdr_t;
 
@@ -173,15 +246,37 @@ typedef struct PACKED _srpcfSvrRspPkt {
 } srpcfSvrRspPkt_t;
 
 
+typedef struct PACKED _srpcfSvrReqSupport {
+
+    srpcfSvrCommHdr_t	srpcfSvrCommHdr;
+    u32               	srpcfCapFlags;
+
+} srpcfSvrReqSupport_t;
+
+
 typedef struct PACKED _srpcfSvrSupportedSrpcf {
 
     srpcfSvrCommHdr_t	srpcfSvrCommHdr;
+    u32               	srpcfCapFlags;
+    u32               	srpcfIdleTimeout;
     u32               	numOfSupportedSrpcfs;
     srpcfSupportedNum_t	*listOfSupportedSrpcfs;
 
 } srpcfSvrSupportedSrpcf_t;
 
 
+// Negotiates like a support query, clients holding a copy of the
+// support response compare generations instead of fetching it again
+typedef struct PACKED _srpcfSvrRspGeneration {
+
+    srpcfSvrCommHdr_t	srpcfSvrCommHdr;
+    u32               	srpcfCapFlags;
+    u32               	srpcfIdleTimeout;
+    u32               	srpcfGeneration;
+
+} srpcfSvrRspGeneration_t;
+
+
 typedef struct PACKED _srpcfSvrReqExecute {
 
 	srpcfSvrCommHdr_t	srpcfSvrCommHdr;
@@ -213,6 +308,71 @@ typedef struct PACKED _srpcfSvrReqExecutePlugin {
 } srpcfSvrReqExecutePlugin_t;
 
 
+typedef struct PACKED _srpcfSvrReqExecutePluginId {
+
+	srpcfSvrCommHdr_t	srpcfSvrCommHdr;
+	u32					srpcfPluginId;
+	u32					numOfCmdOptList;
+	cmdOpt_t			*listOfCmdOpt;
+
+} srpcfSvrReqExecutePluginId_t;
+
+
+typedef struct PACKED _srpcfBatchEntry {
+
+	u32					entryLength;
+	u32					srpcfCmdNo;
+	s8					srpcfName[ SRPCF_FUNC_MAXLEN ];
+	u32					numOfCmdOptList;
+	cmdOpt_t			*listOfCmdOpt;
+
+} srpcfBatchEntry_t;
+
+
+typedef struct PACKED _srpcfSvrReqExecuteBatch {
+
+	srpcfSvrCommHdr_t	srpcfSvrCommHdr;
+	u32					numOfEntries;
+	srpcfBatchEntry_t	*listOfEntries;
+
+} srpcfSvrReqExecuteBatch_t;
+
+
+// Runs one command on every target of the list. A target followed by its
+// own list in brackets relays it further down. The response is a batch
+// with one result per leaf, in the order the leaves are listed.
+typedef struct PACKED _srpcfSvrReqExecuteRelay {
+
+	srpcfSvrCommHdr_t	srpcfSvrCommHdr;
+	u32					srpcfDeadline;
+	u32					srpcfCmdNo;
+	s8					srpcfName[ SRPCF_FUNC_MAXLEN ];
+	u32					numOfCmdOptList;
+	u32					targetLength;
+	s8					*targetPtr;
+
+} srpcfSvrReqExecuteRelay_t;
+
+
+typedef struct PACKED _srpcfBatchResult {
+
+	u32					resultLength;
+	u32					srpcfErrorCode;
+	u32					dataLength;
+	s8					*dataPtr;
+
+} srpcfBatchResult_t;
+
+
+typedef struct PACKED _srpcfSvrRspExecuteBatch {
+
+	srpcfSvrCommHdr_t	srpcfSvrCommHdr;
+	u32					numOfResults;
+	srpcfBatchResult_t	*listOfResults;
+
+} srpcfSvrRspExecuteBatch_t;
+
+
 typedef struct PACKED _srpcfSvrCommPkt {
 
     union {
@@ -220,19 +380,180 @@ typedef struct PACKED _srpcfSvrCommPkt {
 		srpcfSvrCommHdr_t			srpcfSvrCommHdr;
         srpcfSvrReqPkt_t     		srpcfSvrReqPkt;
         srpcfSvrRspPkt_t     		srpcfSvrRspPkt;
+		srpcfSvrReqSupport_t		srpcfSvrReqSupport;
 		srpcfSvrReqExecute_t		srpcfSvrReqExecute;
 		srpcfSvrReqExecutePlugin_t	srpcfSvrReqExecutePlugin;
+		srpcfSvrReqExecutePluginId_t	srpcfSvrReqExecutePluginId;
 		srpcfSvrRspExecute_t		srpcfSvrRspExecute;
+		srpcfSvrReqExecuteBatch_t	srpcfSvrReqExecuteBatch;
+		srpcfSvrRspExecuteBatch_t	srpcfSvrRspExecuteBatch;
+		srpcfSvrReqExecuteRelay_t	srpcfSvrReqExecuteRelay;
     };
 
 } srpcfSvrCommPkt_t;
 
 
+typedef struct _srpcfBatch {
+
+    u32							srpcfCmdNo;
+    s8							*srpcfName;
+    cmdOpt_t					*pCmdOpt;
+
+} srpcfBatch_t;
+
+
+// One entry of a relay target list, pointing into the list itself
+typedef struct _srpcfRelayTarget {
+
+    s8							addr[ LIBSRPCF_RELAY_ADDR_MAX ];
+    s32							port;
+    const s8					*name;
+    u32							nameLength;
+    const s8					*subTargets;
+    u32							subLength;
+    u32							numOfLeaves;
+
+} srpcfRelayTarget_t;
+
+
+typedef struct _srpcfRing {
+
+    s8							*buffer;
+    u32							bufferSize;
+    u32							head;
+    u32							tail;
+    s8							*storage;
+    u32							storageSize;
+    s8							*message;
+    u32							messageLen;
+    bool						messageDone;
+
+} srpcfRing_t;
+
+
+typedef struct _srpcfSink {
+
+    s32							*pMxqFd;
+    u32							srpcfReqId;
+    bool						stream;
+    bool						failed;
+    s8							*data;
+    u32							dataLength;
+    u32							dataSize;
+
+} srpcfSink_t;
+
+
+typedef struct _srpcfDispatch {
+
+    s8							*(*srpcfFuncExecutor)(cmdOpt_t *, u32, u32 *);
+    void						(*srpcfFuncStreamer)(cmdOpt_t *, u32, srpcfSink_t *, u32 *);
+    s8							*(*srpcfFuncContextExecutor)(void *, cmdOpt_t *, u32, u32 *);
+    bool						(*srpcfFuncInit)(void **);
+    void						(*srpcfFuncFini)(void *);
+    bool						(*srpcfFuncParser)(cmdOpt_t *, u32);
+    s8							*(*srpcfFuncHelper)(void);
+    void						(*srpcfFuncError)(s32);
+
+} srpcfDispatch_t;
+
+
+// Generated into cmdtbl.c by tools/gen_registry.awk
+typedef struct _srpcfCmdDesc {
+
+    u32							srpcfCmdNo;
+    const s8					*srpcfFuncName;
+    srpcfDispatch_t				dispatch;
+
+} srpcfCmdDesc_t;
+
+
+typedef struct _srpcfPending {
+
+    struct _srpcfPending		*next;
+    u32							srpcfReqId;
+    srpcfSvrRspExecute_t		*pSrpcfSvrRspExecute;
+
+} srpcfPending_t;
+
+
+typedef void (*srpcfAsyncFunc_t)( void *pArg, u32 srpcfReqId, srpcfSvrRspExecute_t *pSrpcfSvrRspExecute );
+
+
+typedef struct _srpcfAsyncCall {
+
+    struct _srpcfAsyncCall		*next;
+    u32							srpcfReqId;
+    srpcfAsyncFunc_t			pFunc;
+    void						*pArg;
+
+} srpcfAsyncCall_t;
+
+
+typedef struct _srpcfAsync {
+
+    s32							efd;
+    u32							numOfCalls;
+    u64							numOfCompleted;
+
+} srpcfAsync_t;
+
+
+typedef struct _srpcfSession {
+
+    s8							*addr;
+    s32							port;
+    s32							cfd;
+    bool						connected;
+    bool						connecting;
+    bool						handshaking;
+    u32							supportReqId;
+    u32							srpcfCapFlags;
+    u32							srpcfIdleTimeout;
+    u64							lastUsed;
+    u32							numOfInflight;
+    srpcfPending_t				*pendingHead;
+    srpcfSvrSupportedSrpcf_t	*pSrpcfSvrSupportedSrpcf;
+    srpcfAsync_t				*pSrpcfAsync;
+    s32							asyncFd;
+    bool						asyncBusy;
+    bool						asyncStale;
+    srpcfRing_t					*pRing;
+    srpcfAsyncCall_t			*callHead;
+
+} srpcfSession_t;
+
+
+typedef struct _srpcfPool {
+
+    s8							*addr;
+    s32							port;
+    u32							maxIdle;
+    u32							maxTotal;
+    u32							numOfTotal;
+    u32							numOfWaiters;
+    srpcfSession_t				**idleTbl;
+    pthread_mutex_t				lock;
+    pthread_cond_t				cond;
+
+} srpcfPool_t;
+
+
 //
 // Prototypes
 //
+void configureSrpcfFrame( u32 srpcfFrameSize, u32 srpcfMsgLimit );
+u32 limitOfSrpcfMessage( void );
 bool transferSrpcfFrame( s32 *pMxqFd, const void *pktBuf, const s32 length );
+bool transferSrpcfVector( s32 *pMxqFd, const struct iovec *iov, s32 iovcnt );
+bool transferSrpcfRights( s32 *pMxqFd, const void *pktBuf, const u32 length, s32 passFd );
 void *receiveSrpcfFrame( s32 *pMxqFd );
+void initializeSrpcfRing( srpcfRing_t *pRing, s8 *storage, u32 size );
+s32 fillSrpcfRing( s32 fd, srpcfRing_t *pRing );
+srpcfSvrCommPkt_t *nextSrpcfRing( srpcfRing_t *pRing, bool *pInvalid );
+srpcfSvrCommPkt_t *detachSrpcfRing( srpcfRing_t *pRing, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt );
+srpcfSvrCommPkt_t *receiveSrpcfRing( s32 *pMxqFd, srpcfRing_t *pRing );
+void releaseSrpcfRing( srpcfRing_t *pRing );
 
 s32 findBasename( const s8 *str );
 s32 countCharacter( const s8 *str, const s8 c );
@@ -244,17 +565,85 @@ commonLinklist_t *removeLinklist( commonLinklist_t **head, commonLinklist_t *tgt
 void freeLinklist( commonLinklist_t *head );
 
 bool sendSrpcfPacket( s32 *pMxqFd, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt );
+bool sendSrpcfPacketData( s32 *pMxqFd, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt, u32 hdrLen, const void *data, u32 dataLen );
 srpcfSvrCommPkt_t *recvSrpcfPacket( s32 *pMxqFd );
-srpcfSvrRspPkt_t *requestSrpcfSupport( s32 *pMsqFd, s32 *pMcqFd );
-bool responseSrpcfSupport( s32 *pMxqFd, srpcfSupported_t *pSrpcfSupported );
+u32 allocateSrpcfReqId( void );
+u32 sendSrpcfSupport( s32 *pMsqFd, u32 srpcfCapFlags );
+bool checkSrpcfSupport( srpcfSvrCommPkt_t *pSrpcfSvrCommPkt, u32 srpcfReqId );
+srpcfSvrRspPkt_t *requestSrpcfSupport( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCapFlags );
+bool responseSrpcfSupport( s32 *pMxqFd, u32 srpcfReqId, u32 srpcfCapFlags, u32 srpcfIdleTimeout, const s8 *pluginList, u32 pluginListLen );
+srpcfSvrRspPkt_t *requestSrpcfGeneration( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCapFlags );
+bool responseSrpcfGeneration( s32 *pMxqFd, u32 srpcfReqId, u32 srpcfCapFlags, u32 srpcfIdleTimeout, u32 srpcfGeneration );
+u32 findSrpcfPluginId( srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf, const s8 *srpcfName );
+s32 countCmdOptList( cmdOpt_t *pCmdOpt );
+void freeCmdOptList( cmdOpt_t *pCmdOpt );
+cmdOpt_t *copyCmdOptList( cmdOpt_t *pCmdOpt );
+u32 sizeOfCmdOptObject( cmdOpt_t *pCmdOpt );
 u32 serializeCmdOptObject( cmdOpt_t *pCmdOpt, cmdOpt_t *pCmdOptPkt );
-bool deserializeCmdOptObject( cmdOpt_t *pCmdOptPkt, u32 numOfCmdOpt );
+bool deserializeCmdOptObject( cmdOpt_t *pCmdOptPkt, u32 numOfCmdOpt, const s8 *end );
+bool sendSrpcfExecute( s32 *pMsqFd, u32 srpcfReqId, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt );
+bool sendSrpcfExecutePlugin( s32 *pMsqFd, u32 srpcfReqId, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName );
+bool sendSrpcfExecutePluginId( s32 *pMsqFd, u32 srpcfReqId, u32 srpcfPluginId, cmdOpt_t *pCmdOpt );
+srpcfSvrRspExecute_t *recvSrpcfExecute( s32 *pMcqFd );
 srpcfSvrRspExecute_t *requestSrpcfExecute( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt );
 srpcfSvrRspExecute_t *requestSrpcfExecutePlugin( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName );
-bool responseSrpcfExecute( s32 *pMxqFd, u32 srpcfCmdNo, u32 errorCode, s8 *dataRst );
-
-u32 countSupportedSRPCFs( const srpcfSupported_t *pSrpcfSupported );
-u32 checkSrpcfCmdEnabled( const s8 *srpcfStr, const srpcfSupported_t *pSrpcfSupported_t );
+bool responseSrpcfExecute( s32 *pMxqFd, u32 srpcfReqId, u32 srpcfCmdNo, u32 errorCode, s8 *dataRst );
+bool responseSrpcfExecuteMapped( s32 *pMxqFd, u32 srpcfReqId, u32 srpcfCmdNo, u32 errorCode, s8 *dataRst );
+void *mapSrpcfResponse( s32 passFd, srpcfSvrCommHdr_t *pSrpcfSvrCommHdr );
+void releaseSrpcfResponse( void *pRsp );
+srpcfSvrRspExecute_t *requestSrpcfExecuteStream( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName, void (*pChunkFunc)(const s8 *, u32) );
+srpcfSvrRspExecute_t *requestSrpcfExecutePluginId( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfPluginId, cmdOpt_t *pCmdOpt, void (*pChunkFunc)(const s8 *, u32) );
+bool responseSrpcfChunk( s32 *pMxqFd, u32 srpcfReqId, const s8 *data, u32 length );
+bool sendSrpcfExecuteBatch( s32 *pMsqFd, u32 srpcfReqId, srpcfBatch_t *pSrpcfBatch, u32 numOfBatch );
+srpcfSvrRspExecuteBatch_t *requestSrpcfExecuteBatch( s32 *pMsqFd, s32 *pMcqFd, srpcfBatch_t *pSrpcfBatch, u32 numOfBatch );
+srpcfBatchEntry_t *nextSrpcfBatchEntry( srpcfSvrReqExecuteBatch_t *pSrpcfSvrReqExecuteBatch, srpcfBatchEntry_t *pSrpcfBatchEntry );
+bool appendSrpcfBatchResult( srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch, u32 size, u32 errorCode, s8 *dataRst );
+srpcfBatchResult_t *nextSrpcfBatchResult( srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch, srpcfBatchResult_t *pSrpcfBatchResult );
+bool sendSrpcfExecuteRelay( s32 *pMsqFd, u32 srpcfReqId, const s8 *targets, u32 targetLength, u32 srpcfDeadline, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName );
+srpcfSvrRspExecuteBatch_t *requestSrpcfExecuteRelay( s32 *pMsqFd, s32 *pMcqFd, const s8 *targets, u32 targetLength, u32 srpcfDeadline, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName );
+bool parseSrpcfRelayTarget( const s8 **pCursor, const s8 *end, srpcfRelayTarget_t *pTarget );
+u32 countSrpcfRelayLeaves( const s8 *targets, u32 targetLength );
+
+srpcfSession_t *createSrpcfSession( s8 *addr, s32 port );
+srpcfSession_t *openSrpcfSession( s8 *addr, s32 port );
+u32 submitSrpcfSession( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt );
+u32 submitSrpcfSessionPlugin( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName );
+u32 submitSrpcfSessionBatch( srpcfSession_t *pSrpcfSession, srpcfBatch_t *pSrpcfBatch, u32 numOfBatch );
+u32 submitSrpcfSessionRelay( srpcfSession_t *pSrpcfSession, const s8 *targets, u32 targetLength, u32 srpcfDeadline, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName );
+srpcfSvrRspExecute_t *waitSrpcfSession( srpcfSession_t *pSrpcfSession, u32 srpcfReqId );
+void probeSrpcfSession( srpcfSession_t *pSrpcfSession );
+srpcfSvrRspExecute_t *executeSrpcfSession( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt );
+srpcfSvrRspExecute_t *executeSrpcfSessionPlugin( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName );
+srpcfSvrRspExecuteBatch_t *executeSrpcfSessionBatch( srpcfSession_t *pSrpcfSession, srpcfBatch_t *pSrpcfBatch, u32 numOfBatch );
+void closeSrpcfSession( srpcfSession_t *pSrpcfSession );
+srpcfPool_t *createSrpcfPool( s8 *addr, s32 port, u32 maxIdle, u32 maxTotal );
+void destroySrpcfPool( srpcfPool_t *pSrpcfPool );
+srpcfSession_t *checkoutSrpcfPool( srpcfPool_t *pSrpcfPool, s32 msec );
+void checkinSrpcfPool( srpcfPool_t *pSrpcfPool, srpcfSession_t *pSrpcfSession );
+srpcfAsync_t *createSrpcfAsync( void );
+void destroySrpcfAsync( srpcfAsync_t *pSrpcfAsync );
+s32 descriptorOfSrpcfAsync( srpcfAsync_t *pSrpcfAsync );
+bool attachSrpcfAsync( srpcfAsync_t *pSrpcfAsync, srpcfSession_t *pSrpcfSession );
+void detachSrpcfAsync( srpcfSession_t *pSrpcfSession );
+u32 submitSrpcfAsync( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, srpcfAsyncFunc_t pFunc, void *pArg );
+u32 submitSrpcfAsyncPlugin( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName, srpcfAsyncFunc_t pFunc, void *pArg );
+u32 submitSrpcfAsyncRelay( srpcfSession_t *pSrpcfSession, const s8 *targets, u32 targetLength, u32 srpcfDeadline, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName, srpcfAsyncFunc_t pFunc, void *pArg );
+s32 dispatchSrpcfAsync( srpcfAsync_t *pSrpcfAsync, s32 msec );
+
+void openSrpcfSink( srpcfSink_t *pSink, s32 *pMxqFd, u32 srpcfReqId, bool stream );
+bool emitSrpcfChunk( srpcfSink_t *pSink, const s8 *data, u32 length );
+bool printSrpcfChunk( srpcfSink_t *pSink, const s8 *fmt, ... );
+bool flushSrpcfSink( srpcfSink_t *pSink );
+s8 *closeSrpcfSink( srpcfSink_t *pSink );
+
+u32 numOfSrpcfCmds( void );
+const srpcfCmdDesc_t *indexSrpcfCmd( u32 idx );
+const srpcfCmdDesc_t *lookupSrpcfCmd( u32 srpcfCmdNo );
+const srpcfCmdDesc_t *findSrpcfCmd( const s8 *srpcfFuncName );
+void enableSrpcfCmd( u32 srpcfCmdNo );
+bool isSrpcfCmdEnabled( u32 srpcfCmdNo );
+u32 checkSrpcfCmdEnabled( const s8 *srpcfStr );
+void resolveSrpcfDispatch( void *handle, const s8 *srpcfFuncName, srpcfDispatch_t *pSrpcfDispatch );
 bool checkSrpcfCmdParam( const s8 *param, s8 **compare, s32 size );
 s8 *readFileToNewBuffer( const s8 *basePath, const s8 *restPath );
 bool writeFileWithText( const s8 *basePath, const s8 *restPath, const s8 *text );
@@ -263,6 +652,7 @@ s8 *readRedirectFileToNewBuffer( const s8 *basePath, const s8 *restPath );
 bool writeRedirectFileWithText( const s8 *basePath, const s8 *restPath, const s8 *text );
 bool writeEitherWayFileWithInteger( const s8 *basePath, const s8 *restPath, const s32 value, const bool direct, const bool hex );
 s8 *readFileToNewHugeBuffer( const s8 *basePath, const s8 *restPath, u32 size );
+s8 *readWholeFileToNewBuffer( const s8 *basePath, const s8 *restPath );
 s8 *readRedirectFileToNewHugeBuffer( const s8 *basePath, const s8 *restPath, u32 size );
 s8 *readFileToBuffer( const s8 *path, s32 seek, s8 *buf, u32 size );
 bool writeBufferToFile( const s8 *path, s32 seek, s8 *buf, u32 size );
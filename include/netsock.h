@@ -20,16 +20,101 @@
 // Definitions
 //
 #define SRPCF_DEF_PORT				8989
+#define SRPCF_UNIX_NAME				"@srpcf-%d"
+#define SRPCF_UNIX_NAME_MAX			108
+
+// In-process loopback, "loop:<name>"
+#define SRPCF_LOOP_PREFIX			"loop:"
+#define SRPCF_LOOP_FDS				4096
+#define SRPCF_LOOP_CHUNK			4096
+#define SRPCF_LOOP_BUFFER			(256 * 1024)
+
+// Shared memory rings handed out over "shm:<local address>", "shm:" alone
+// is the server's default name. Readers drain until EAGAIN before polling.
+#define SRPCF_SHM_PREFIX			"shm:"
+#define SRPCF_SHM_NAME				"@srpcf-shm-%d"
+#define SRPCF_SHM_MAGIC				0x4d485353
+#define SRPCF_SHM_FDS				4096
+#define SRPCF_SHM_RING				(1024 * 1024)
+#define SRPCF_SHM_CACHELINE			64
+#define SRPCF_SHM_SPIN				4096
+#define SRPCF_SHM_BACKOFF_US		50
+
+// Per-descriptor output queues of sockets driven by an event loop
+#define SRPCF_OUTPUT_FDS			65536
+
+
+//
+// Structures
+//
+struct iovec;
+
+// Every handle is a descriptor poll() and epoll can wait on
+typedef struct _srpcfTransport {
+
+	const s8	*name;
+	s32			(*listen)( s32 *fd, const s8 *addr, s32 port );
+	s32			(*connect)( s32 *fd, const s8 *addr, s32 port );
+	s32			(*accept)( s32 fd, s32 *apsd );
+	s32			(*send)( s32 fd, struct iovec *iov, s32 iovcnt, s32 *wByte );
+	s32			(*sendSome)( s32 fd, const struct iovec *iov, s32 iovcnt );
+	s32			(*recv)( s32 fd, void *pktBuf, const u32 length );
+	s32			(*readiness)( s32 fd, s16 events, s32 msec );
+	s32			(*timeout)( s32 fd, u32 seconds );
+	void		(*shutdown)( s32 fd );
+	void		(*close)( s32 fd );
+
+} srpcfTransport_t;
+
+
+//
+// Transports
+//
+extern const srpcfTransport_t srpcfTcpTransport;
+extern const srpcfTransport_t srpcfUnixTransport;
+extern const srpcfTransport_t srpcfLoopTransport;
+extern const srpcfTransport_t srpcfShmTransport;
 
 
 //
 // Prototypes
 //
+const srpcfTransport_t *selectSrpcfTransport( const s8 *addr );
+const srpcfTransport_t *lookupSrpcfTransport( s32 fd );
+bool isLoopSocketAddress( const s8 *addr );
+bool isLoopSocket( s32 fd );
+bool isShmSocketAddress( const s8 *addr );
+bool isShmSocket( s32 fd );
+void configureSrpcfShm( u32 spin );
 s32 initializeSocket( s32 *fd, s8 *addr, s32 port );
 s32 connectSocket( s32 *fd, s8 *addr, s32 port );
+s32 startConnectSocket( s32 *fd, s8 *addr, s32 port );
+s32 finishConnectSocket( s32 fd );
 void deinitializeSocket( s32 fd );
 s32 acceptSocket( s32 fd, s32 *apsd );
+s32 setNonblockSocket( s32 fd );
+s32 setTimeoutSocket( s32 fd, u32 seconds );
+s32 pollSocket( s32 fd, s16 events, s32 msec );
+void shutdownSocket( s32 fd );
 s32 transferSocket( s32 fd, const void *pktBuf, const u32 length, s32 *wByte );
+s32 transferVectorSocket( s32 fd, struct iovec *iov, s32 iovcnt, s32 *wByte );
 s32 receiveSocket( s32 fd, void *pktBuf, const u32 length, s32 *rByte );
+s32 receiveSomeSocket( s32 fd, void *pktBuf, const u32 length );
+bool canPassRightsSocket( s32 fd );
+s32 transferRightsSocket( s32 fd, struct iovec *iov, s32 iovcnt, s32 passFd, s32 *wByte );
+s32 receiveRightsSocket( s32 fd, void *pktBuf, const u32 length, s32 *rByte, s32 *pPassFd );
+s32 transferSomeSocket( s32 fd, const struct iovec *iov, s32 iovcnt );
+s32 transferSomeRightsSocket( s32 fd, const struct iovec *iov, s32 iovcnt, s32 passFd );
+
+// output.c
+bool attachSrpcfOutput( s32 fd, u64 limit, bool canWait, void (*notify)( void *, bool ), void *arg );
+void detachSrpcfOutput( s32 fd );
+bool hasSrpcfOutput( s32 fd );
+void configureSrpcfOutputThread( bool canWait );
+s32 transferSrpcfOutput( s32 fd, struct iovec *iov, s32 iovcnt, s32 passFd, s32 *wByte );
+s32 flushSrpcfOutput( s32 fd );
+void holdSrpcfOutput( s32 fd, bool hold );
+void lingerSrpcfOutput( s32 fd );
+void abortSrpcfOutput( s32 fd );
 
 
@@ -20,42 +20,23 @@
 // Definitions
 //
 #define SRPCF_CODE_REVISION			"1.0.0"
-#define SRPCF_SPEC_REVISION			"1.0.0"
+// 2.0 added srpcfReqId to the common header, 1.x peers cannot talk to 2.x
+#define SRPCF_SPEC_REVISION			"2.0.0"
 
 #define SRPCF_FUNC_MAXLEN          	100
 #define SRPCF_HELPER_PREFIX    		"srpcfHelper_"
 #define SRPCF_ERROR_PREFIX			"srpcfError_"
 #define SRPCF_PARSER_PREFIX    		"srpcfParser_"
 #define SRPCF_EXECUTOR_PREFIX		"srpcfExecutor_"
-
-#define SRPCF_SUPPORT( NAME )		{ NAME, FALSE, #NAME }
-#define SRPCF_SUPPORT_END			{ XR_END_SRPCF, FALSE, NULL }
+#define SRPCF_STREAMER_PREFIX		"srpcfStreamer_"
+#define SRPCF_CONTEXT_PREFIX		"srpcfContextExecutor_"
+#define SRPCF_INIT_PREFIX			"srpcfInit_"
+#define SRPCF_FINI_PREFIX			"srpcfFini_"
 
 
 //
-// Enumernations
+// Built-in commands, generated from libsrpcf/cmds
 //
-typedef enum _srpcfCmds {
-
-	// Start of SRPCF commands
-	XR_START_SRPCF = 0,
-
-	// Help
-	xrHelp,
-
-	// Others
-	xrCpuInfo,
-	xrPciList,
-	xrRtcDateSet,
-	xrRtcDateShow,
-	xrRtcSet,
-	xrRtcShow,
-	xrDateShow,
-	xrTimeShow,
-
-	// End of SRPCF commands
-	XR_END_SRPCF,
-
-} srpcfCmds;
+#include "srpcf_cmds.h"
 
 
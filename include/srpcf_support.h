@@ -1,37 +0,0 @@
-/*
- * SRPCF - Simple Remote Procedire Command Framework
- * File: srpcf_support.h
- *
- * Licensed under the Apache License, Version 2.0 (the "License");
- * you may not use this file except in compliance with the License.
- * You may obtain a copy of the License at
- *
- *      http://www.apache.org/licenses/LICENSE-2.0
- *
- * Unless required by applicable law or agreed to in writing, software
- * distributed under the License is distributed on an "AS IS" BASIS,
- * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
- * See the License for the specific language governing permissions and
- * limitations under the License.
- *
- */
-
-//
-// Global variables
-//
-static srpcfSupported_t srpcfSupportedTbl[] = {
-
-	SRPCF_SUPPORT( xrHelp ),
-	SRPCF_SUPPORT( xrCpuInfo ),
-	SRPCF_SUPPORT( xrPciList ),
-	SRPCF_SUPPORT( xrRtcDateSet ),
-	SRPCF_SUPPORT( xrRtcDateShow ),
-	SRPCF_SUPPORT( xrRtcSet ),
-	SRPCF_SUPPORT( xrRtcShow ),
-	SRPCF_SUPPORT( xrDateShow ),
-	SRPCF_SUPPORT( xrTimeShow ),
-	
-    SRPCF_SUPPORT_END,
-};
-
-
@@ -22,6 +22,19 @@
 #define SRPCFSH_REVISION			SRPCF_CODE_REVISION
 #define SRPCFSH_CMDBUF_LEN		1024
 #define SRPCFSH_PROMPT			"srpcf > "
+#define SRPCFSH_CAPS			(SRPCF_CAP_STREAM | SRPCF_CAP_PLUGIN_ID | SRPCF_CAP_MAPPED)
+
+#define SRPCFSH_CACHE_MAGIC		0x43465253
+#define SRPCFSH_CACHE_VERSION	1
+#define SRPCFSH_CACHE_FILE		"srpcfsh-%u-%s-%d.cache"
+#define SRPCFSH_TIMING_ENV		"SRPCFSH_TIMING"
+
+#define SRPCFSH_HOSTS_ENV		"SRPCFSH_HOSTS"
+#define SRPCFSH_PARALLEL_ENV	"SRPCFSH_PARALLEL"
+#define SRPCFSH_PARALLEL_DEF	32
+#define SRPCFSH_DEADLINE_ENV	"SRPCFSH_DEADLINE"
+#define SRPCFSH_DEADLINE_DEF	10000
+#define SRPCFSH_WATCH_MSEC		20
 
 
 //
@@ -36,3 +49,62 @@ typedef struct _srpcfFuncs {
 } srpcfFuncs_t;
 
 
+typedef enum _srpcfshHostState {
+
+	SRPCFSH_HOST_PENDING = 0,
+	SRPCFSH_HOST_RUNNING,
+	SRPCFSH_HOST_DONE,
+	SRPCFSH_HOST_FAILED,
+	SRPCFSH_HOST_EXPIRED,
+
+} srpcfshHostState_t;
+
+
+typedef struct _srpcfshHost {
+
+    s8					*label;
+    s8					*addr;
+    s32					port;
+    s8					*subTargets;
+    s32					cfd;
+    u64					start;
+    srpcfshHostState_t	state;
+
+} srpcfshHost_t;
+
+
+typedef struct _srpcfshFanout {
+
+    srpcfshHost_t		*hostTbl;
+    u32					numOfHosts;
+    u32					nextHost;
+    u32					numOfFinished;
+    u32					numOfFailed;
+    u32					deadline;
+    u32					srpcfCmdNo;
+    s8					*srpcfName;
+    cmdOpt_t			*pCmdOpt;
+    pthread_mutex_t		lock;
+    pthread_cond_t		cond;
+
+} srpcfshFanout_t;
+
+
+// Saved support response, good for as long as the server generation holds
+typedef struct _srpcfshCache {
+
+    u32			magic;
+    u32			version;
+    u32			srpcfCapFlags;
+    u32			srpcfGeneration;
+    u32			length;
+
+} srpcfshCache_t;
+
+
+//
+// Prototypes
+//
+s32 runSrpcfshFanout( const s8 *hosts, u32 srpcfCmdNo, s8 *srpcfName, cmdOpt_t *pCmdOpt );
+
+
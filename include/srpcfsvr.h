@@ -21,6 +21,49 @@
 //
 #define SRPCFSVR_REVISION		SRPCF_CODE_REVISION
 #define SRPCFSVR_SLEEP_MS		100
+#define SRPCFSVR_EVLOOP_DEF		2
+#define SRPCFSVR_EVLOOP_MAX		64
+#define SRPCFSVR_EVENTS_MAX		64
+#define SRPCFSVR_WORKER_MAX		256
+#define SRPCFSVR_QUEUE_DEF		1024
+#define SRPCFSVR_CACHELINE		64
+#define SRPCFSVR_IDLE_DEF		30
+#define SRPCFSVR_SWEEP_MS		1000
+#define SRPCFSVR_RETRY_MS		1
+#define SRPCFSVR_OUTPUT_MSGS	2
+#define SRPCFSVR_CAPS			(SRPCF_CAP_SESSION | SRPCF_CAP_STREAM | SRPCF_CAP_PLUGIN_ID | SRPCF_CAP_MAPPED)
+#define SRPCFSVR_PLUGIN_BUCKETS	64
+#define SRPCFSVR_PLUGIN_MAX		1024
+#define SRPCFSVR_PLUGIN_STAGE	LIBSRPCF_PLUGIN_PATH "/.%s.XXXXXX"
+#define SRPCFSVR_PLUGIN_MEMFD	"/proc/self/fd/%d"
+#define SRPCFSVR_NOTIFY_BUF		4096
+#define SRPCFSVR_LISTEN_MAX		4
+#define SRPCFSVR_BENCH_ADDR		"loop:srpcfsvr"
+#define SRPCFSVR_BENCH_DEPTH	64
+#define SRPCFSVR_RELAY_BUCKETS	64
+#define SRPCFSVR_RELAY_POOLS	1024
+#define SRPCFSVR_RELAY_IDLE		4
+#define SRPCFSVR_RELAY_TOTAL	16
+#define SRPCFSVR_RELAY_DEADLINE_DEF	10000
+
+
+//
+// Enumernations
+//
+typedef enum _srpcfSvrMode {
+
+	SRPCFSVR_MODE_THREAD = 0,
+	SRPCFSVR_MODE_EPOLL,
+
+} srpcfSvrMode_t;
+
+
+typedef enum _srpcfSvrSchedType {
+
+	SRPCFSVR_SCHED_SHARED = 0,
+	SRPCFSVR_SCHED_STEAL,
+
+} srpcfSvrSchedType_t;
 
 
 //
@@ -33,7 +76,11 @@ typedef struct _srpcfSvrThd {
     pthread_t           pth;
     s32                 cfd;
     s8                  packet[ LIBSRPCF_MSG_SIZE ];
-    s32                 rwByte;
+    srpcfRing_t         ring;
+    u32                 capFlags;
+    pthread_mutex_t     doneLock;
+    pthread_cond_t      done;
+    u32                 numOfPending;
 
 } srpcfSvrThd_t;
 
@@ -42,7 +89,188 @@ typedef struct _srpcfSvrTask {
 
     struct _srpcfSvrTask 	*next;
     srpcfSvrCommPkt_t		*pktData;
+    s32						*pMxqFd;
+    u32						capFlags;
+    bool					term;
+    void					(*complete)( struct _srpcfSvrTask * );
+    void					*priv;
 
 } srpcfSvrTask_t;
 
 
+typedef struct _srpcfSvrQueueCell {
+
+    u64						sequence;
+    srpcfSvrTask_t			*pTask;
+
+} srpcfSvrQueueCell_t;
+
+
+typedef struct _srpcfSvrQueue {
+
+    srpcfSvrQueueCell_t		*cells;
+    u64						mask;
+    u64						enqueuePos __attribute__((aligned( SRPCFSVR_CACHELINE )));
+    u64						dequeuePos __attribute__((aligned( SRPCFSVR_CACHELINE )));
+    u64						highWater __attribute__((aligned( SRPCFSVR_CACHELINE )));
+    u64						numOfFull;
+
+} srpcfSvrQueue_t;
+
+
+typedef struct _srpcfSvrSched {
+
+    bool					(*initialize)( s32 numOfWorkers, u32 queueDepth );
+    bool					(*submit)( srpcfSvrTask_t *pSrpcfSvrTask );
+    void					(*dump)( FILE *fp );
+    void					(*deinitialize)( void );
+
+} srpcfSvrSched_t;
+
+
+typedef struct _srpcfSvrDeque {
+
+    pthread_spinlock_t		lock;
+    srpcfSvrTask_t			**tasks;
+    u32						mask;
+    u32						head;
+    u32						tail;
+
+} srpcfSvrDeque_t;
+
+
+typedef struct _srpcfSvrStealer {
+
+    pthread_t				pth;
+    s32						id;
+    u32						seed;
+    srpcfSvrDeque_t			deque;
+    s32						sleeping;
+    pthread_mutex_t			sleepLock;
+    pthread_cond_t			sleepCond;
+    u64						numOfLocal;
+    u64						numOfStolen;
+    u64						numOfMissed;
+
+} __attribute__((aligned( SRPCFSVR_CACHELINE ))) srpcfSvrStealer_t;
+
+
+typedef struct _srpcfSvrConn {
+
+    struct _srpcfSvrConn	*next;
+    struct _srpcfSvrConn	*prev;
+
+    s32                 	cfd;
+    s32						loop;
+    s32						refCount;
+    u32						capFlags;
+    u64						lastActive;
+    bool					pollOut;
+    bool					closing;
+    s8                  	packet[ LIBSRPCF_MSG_SIZE ];
+    srpcfRing_t				ring;
+
+} srpcfSvrConn_t;
+
+
+typedef struct _srpcfSvrLoop {
+
+    pthread_t           	pth;
+    s32                 	efd;
+    s32						id;
+    pthread_mutex_t			connLock;
+    srpcfSvrConn_t			*connHead;
+    u64						lastSweep;
+    s32						wfd;
+    u32						numOfStalled;
+
+} srpcfSvrLoop_t;
+
+
+typedef struct _srpcfSvrPlugin {
+
+    struct _srpcfSvrPlugin	*next;
+
+    s8						name[ SRPCF_FUNC_MAXLEN ];
+    u32						id;
+    void					*handle;
+    s32						stageFd;
+    srpcfDispatch_t			dispatch;
+    void					*pContext;
+    s32						refCount;
+
+} srpcfSvrPlugin_t;
+
+
+typedef struct _srpcfSvrPluginSlot {
+
+    s8						name[ SRPCF_FUNC_MAXLEN ];
+    srpcfSvrPlugin_t		*pSrpcfSvrPlugin;
+
+} srpcfSvrPluginSlot_t;
+
+
+typedef struct _srpcfSvrRelayPool {
+
+    struct _srpcfSvrRelayPool	*next;
+
+    s8						addr[ LIBSRPCF_RELAY_ADDR_MAX ];
+    s32						port;
+    srpcfPool_t				*pSrpcfPool;
+    u32						numOfUsers;
+    u64						lastUsed;
+
+} srpcfSvrRelayPool_t;
+
+
+typedef struct _srpcfSvrRelayCall {
+
+    srpcfRelayTarget_t		target;
+    srpcfSvrRelayPool_t		*pSrpcfSvrRelayPool;
+    srpcfSession_t			*pSrpcfSession;
+    u32						*pNumOfWaiting;
+    bool					done;
+    u32						errorCode;
+    srpcfSvrCommPkt_t		*pRsp;
+
+} srpcfSvrRelayCall_t;
+
+
+//
+// Prototypes
+//
+bool dispatchSrpcfRequest( s32 *pMxqFd, u32 *pCapFlags, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt );
+bool isSrpcfSvrOffload( srpcfSvrCommPkt_t *pSrpcfSvrCommPkt );
+srpcfSvrRspExecuteBatch_t *createSrpcfSvrBatch( u32 srpcfReqId, u32 *pSize );
+srpcfSvrRspExecuteBatch_t *appendSrpcfSvrBatch( srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch, u32 *pSize, u32 errorCode, s8 *rstData );
+
+bool initializeSrpcfSvrLoops( s32 numOfLoops, u32 idleTimeout );
+bool attachSrpcfSvrLoop( s32 cfd );
+void deinitializeSrpcfSvrLoops( void );
+
+bool initializeSrpcfSvrWorkers( s32 numOfWorkers, u32 queueDepth, srpcfSvrSchedType_t type );
+bool submitSrpcfSvrTask( srpcfSvrTask_t *pSrpcfSvrTask );
+void runSrpcfSvrTask( srpcfSvrTask_t *pSrpcfSvrTask );
+bool isSrpcfSvrWorkersEnabled( void );
+void dumpSrpcfSvrWorkers( FILE *fp );
+void deinitializeSrpcfSvrWorkers( void );
+
+bool initializeSrpcfSvrPlugins( void );
+srpcfSvrPlugin_t *acquireSrpcfSvrPlugin( const s8 *srpcfName );
+srpcfSvrPlugin_t *acquireSrpcfSvrPluginById( u32 srpcfPluginId );
+s8 *listSrpcfSvrPlugins( u32 *pLength );
+u32 generationOfSrpcfSvrPlugins( void );
+void releaseSrpcfSvrPlugin( srpcfSvrPlugin_t *pSrpcfSvrPlugin );
+void deinitializeSrpcfSvrPlugins( void );
+
+bool initializeSrpcfSvrRelay( u32 fanout );
+bool executeSrpcfRelay( s32 *pMxqFd, srpcfSvrReqExecuteRelay_t *pSrpcfSvrReqExecuteRelay );
+void deinitializeSrpcfSvrRelay( void );
+
+
+//
+// Schedulers
+//
+extern srpcfSvrSched_t srpcfSvrStealSched;
+
+
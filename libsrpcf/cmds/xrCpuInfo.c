@@ -19,6 +19,10 @@
 #include "srpcf_plugin.h"
 
 
+// SRPCF Registration
+LIBSRPCF_REGISTER( xrCpuInfo, 2 );
+
+
 // SRPCF Shell Help
 LIBSRPCF_HELPER_TEXT( "\
 SYNTAX:\n\
@@ -46,7 +50,7 @@ LIBSRPCF_SERVER_IMPLEMENT( xrCpuInfo ) {
 
 	s8 *p;
 
-	p = readFileToNewBuffer( "/proc/", "cpuinfo" );
+	p = readWholeFileToNewBuffer( "/proc/", "cpuinfo" );
 	if( !p ) {
 
 		*errorCode = SRPCF_FAILED_NODEV;
@@ -33,6 +33,10 @@
 #include "srpcfsh.h"
 
 
+// SRPCF Registration
+LIBSRPCF_REGISTER( xrHelp, 1 );
+
+
 // SRPCF Shell Help
 LIBSRPCF_HELPER_TEXT( "\
 SYNTAX:\n\
@@ -51,10 +55,7 @@ LIBSRPCF_ERROR_FUNC( xrHelp ) {}
 // SRPCF Shell Implementation
 LIBSRPCF_SHELL_IMPLEMENT( xrHelp ) {
 
-	s8 *(*srpcfFuncHelper)(void);
-	srpcfSupported_t *(*funcSrpcfSupported)(void);
-	void *handle;
-	s8 helper[ SRPCF_FUNC_MAXLEN ];
+	const srpcfCmdDesc_t *pSrpcfCmdDesc;
 
 	// Only allow i parameter
 	if( numOpts != 1 )
@@ -62,39 +63,17 @@ LIBSRPCF_SHELL_IMPLEMENT( xrHelp ) {
 
 	LIBSRPCF_SRPCF_FOREACH {
 
-	    // Open instance itself
-   		handle = dlopen( NULL, RTLD_LAZY );
-    	if( !handle ) {
-
-			dlclose( handle );
-			return FALSE;
-    	}
-
-		// Find supportedSrpcf structure
-		funcSrpcfSupported = dlsym( handle, "retriveSrpcfSupported" );
-		if( !funcSrpcfSupported ) {
-
-			dlclose( handle );
-			return FALSE;
-		}
-
         // Check for this SRPCF command
-        if( checkSrpcfCmdEnabled( ppCmdOpt->value, funcSrpcfSupported() ) == XR_END_SRPCF )
+        pSrpcfCmdDesc = findSrpcfCmd( ppCmdOpt->value );
+        if( !pSrpcfCmdDesc || isSrpcfCmdEnabled( pSrpcfCmdDesc->srpcfCmdNo ) == FALSE )
             return FALSE;
 
-		// Lookup for symbol
-		snprintf( helper, SRPCF_FUNC_MAXLEN, SRPCF_HELPER_PREFIX "%s", ppCmdOpt->value );
-		srpcfFuncHelper = dlsym( handle, helper );
-
-		// Close resource
-		dlclose( handle );
-
 		// Cannot find symbol
-		if( !srpcfFuncHelper )
+		if( !pSrpcfCmdDesc->dispatch.srpcfFuncHelper )
 			return FALSE;
 
 		// Print out help text
-		printf( "%s", srpcfFuncHelper() );
+		printf( "%s", pSrpcfCmdDesc->dispatch.srpcfFuncHelper() );
 		break;
 	}
 
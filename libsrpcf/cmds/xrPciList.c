@@ -20,11 +20,14 @@
 #include <dirent.h>
 
 
+// SRPCF Registration
+LIBSRPCF_REGISTER( xrPciList, 3 );
+
+
 #define SYSFS_PCI_LIST_PATH	"/sys/bus/pci/devices"
 #define PCI_LIST_TITLE		"PCI DEVICE\tDEVICE ID\tVENDOR ID\tREVISION ID\tFUNCTION #\n"
 #define PCI_LIST_FMT		"%-16s %4.4X\t\t%4.4X\t\t0x%2.2X\t\t0x%2.2X\n"
 #define SMALL_BUF			20
-#define BIG_BUF				2048
 
 
 typedef struct _pciClassName {
@@ -81,10 +84,9 @@ LIBSRPCF_SHELL_IMPLEMENT( xrPciList ) {
 }
 
 
-// SRPCF Server Implementation
-LIBSRPCF_SERVER_IMPLEMENT( xrPciList ) {
+// SRPCF Server Implementation, one line per device as it is found
+LIBSRPCF_STREAM_IMPLEMENT( xrPciList ) {
 
-	s8 *p = NULL, *orig;
 	DIR *top;
 	struct dirent *dir;
 
@@ -95,13 +97,6 @@ LIBSRPCF_SERVER_IMPLEMENT( xrPciList ) {
 	s8 *name;
 
 
-	// Allocate buffer
-	orig = p = malloc( BIG_BUF );
-	if( !p )
-		goto ErrExit;
-	memset( p, 0, BIG_BUF );
-
-
 	// Open the top directory
 	top = opendir( SYSFS_PCI_LIST_PATH );
 	if( !top )
@@ -109,7 +104,8 @@ LIBSRPCF_SERVER_IMPLEMENT( xrPciList ) {
 
 
 	// Print title
-	p += snprintf( p, BIG_BUF - (p - orig), PCI_LIST_TITLE );
+	if( printSrpcfChunk( pSink, PCI_LIST_TITLE ) == FALSE )
+		goto SinkExit;
 
 
 	// Walk through all subdir
@@ -186,14 +182,14 @@ LIBSRPCF_SERVER_IMPLEMENT( xrPciList ) {
 			
 
 		// Print PCI device
-		p += snprintf( p,
-			BIG_BUF - (p - orig), 
-			PCI_LIST_FMT,
-			name, 
-			devid, 
-			venid, 
-			rev, 
-			func );
+		if( printSrpcfChunk( pSink,
+				PCI_LIST_FMT,
+				name, 
+				devid, 
+				venid, 
+				rev, 
+				func ) == FALSE )
+			goto SinkExit;
 	}
 
 
@@ -202,15 +198,18 @@ LIBSRPCF_SERVER_IMPLEMENT( xrPciList ) {
 
 	// Return
     *errorCode = SRPCF_SUCCESSFUL;
-	return orig;
+	return;
 
-ErrExit:
+SinkExit:
+
+	// The sink could not take the list, the client got part of it at most
+	closedir( top );
+	*errorCode = SRPCF_FAILED_NOMEM;
+	return;
 
-	if( orig )
-		free( orig );
+ErrExit:
 
 	*errorCode = SRPCF_FAILED_NODEV;
-	return NULL;
 }
 
 
@@ -19,6 +19,10 @@
 #include "srpcf_plugin.h"
 
 
+// SRPCF Registration
+LIBSRPCF_REGISTER( xrRtcDateShow, 5 );
+
+
 // SRPCF Shell Help
 LIBSRPCF_HELPER_TEXT( "\
 SYNTAX:\n\
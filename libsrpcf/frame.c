@@ -27,6 +27,10 @@
 #include <dirent.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "srpcf_types.h"
 #include "srpcf.h"
@@ -37,12 +41,39 @@
 #include "netsock.h"
 
 
-bool transferSrpcfFrame( s32 *pMxqFd, const void *pktBuf, const s32 length ) {
+//
+// Global variables
+//
+static pthread_mutex_t frameLockTbl[ LIBSRPCF_FRAME_LOCKS ] = {
+
+	[ 0 ... LIBSRPCF_FRAME_LOCKS - 1 ] = PTHREAD_MUTEX_INITIALIZER
+};
+static u32 srpcfFrameSize = LIBSRPCF_FRAME_SIZE;
+static u32 srpcfMsgLimit = LIBSRPCF_MSG_LIMIT;
+
+
+void configureSrpcfFrame( u32 frameSize, u32 msgLimit ) {
+
+	// A frame must carry some payload beside its header
+	if( frameSize > sizeof( srpcfSvrCommHdr_t ) && frameSize < LIBSRPCF_FRAME_MORE )
+		srpcfFrameSize = frameSize;
+
+	if( msgLimit >= LIBSRPCF_MSG_SIZE && msgLimit < LIBSRPCF_FRAME_MORE )
+		srpcfMsgLimit = msgLimit;
+}
+
+
+u32 limitOfSrpcfMessage( void ) {
+
+	return srpcfMsgLimit;
+}
+
+
+static bool transferSrpcfPieces( s32 fd, struct iovec *iov, s32 iovcnt ) {
 
 	s32 wByte;
 
-	// Transfer data from client to server
-	transferSocket( *pMxqFd, pktBuf, length, &wByte );
+	transferVectorSocket( fd, iov, iovcnt, &wByte );
 	if( wByte < 0 ) {
     
         DBGPRINT( "Cannot send out the packet\n" );
@@ -53,40 +84,495 @@ bool transferSrpcfFrame( s32 *pMxqFd, const void *pktBuf, const s32 length ) {
 }
 
 
+static s32 sliceSrpcfVector( const struct iovec *iov, s32 iovcnt, u32 off, u32 length, struct iovec *pSlice ) {
+
+	s32 i, num = 0;
+	u32 take;
+
+	// Collect the pieces covering [off, off + length) of the packet
+	for( i = 0 ; i < iovcnt && length ; i++ ) {
+
+		if( off >= iov[ i ].iov_len ) {
+
+			off -= iov[ i ].iov_len;
+			continue;
+		}
+
+		take = iov[ i ].iov_len - off;
+		if( take > length )
+			take = length;
+
+		pSlice[ num ].iov_base = (s8 *)iov[ i ].iov_base + off;
+		pSlice[ num ].iov_len = take;
+		num++;
+
+		length -= take;
+		off = 0;
+	}
+
+	return num;
+}
+
+
+// A packet larger than the frame size goes out as its own head, marked with
+// LIBSRPCF_FRAME_MORE, followed by continuation frames carrying the rest of
+// the body. Every frame describes its own length, so only the sender needs
+// to know the frame size. The packet may be scattered over several pieces,
+// the first one starting with the header, and each frame is sent with one
+// gather write straight from where the pieces live.
+bool transferSrpcfVector( s32 *pMxqFd, const struct iovec *iov, s32 iovcnt ) {
+
+	pthread_mutex_t *pLock = &frameLockTbl[ (u32)*pMxqFd % LIBSRPCF_FRAME_LOCKS ];
+	srpcfSvrCommHdr_t srpcfSvrCommHdr;
+	struct iovec frameIov[ LIBSRPCF_IOV_MAX ];
+	bool ret = TRUE;
+	u32 length = 0, off, chunk;
+	s32 i, num;
+
+	if( iovcnt < 1 || iovcnt >= LIBSRPCF_IOV_MAX || iov[ 0 ].iov_len < sizeof( srpcfSvrCommHdr_t ) )
+		return FALSE;
+
+	for( i = 0 ; i < iovcnt ; i++ )
+		length += iov[ i ].iov_len;
+
+	// Responses of pipelined requests may be sent from several threads,
+	// keep each packet and its continuations in one piece on the wire
+	pthread_mutex_lock( pLock );
+
+	if( length <= srpcfFrameSize ) {
+
+		memcpy( frameIov, iov, sizeof( struct iovec ) * iovcnt );
+		ret = transferSrpcfPieces( *pMxqFd, frameIov, iovcnt );
+		goto Exit;
+	}
+
+	// The head frame
+	memcpy( &srpcfSvrCommHdr, iov[ 0 ].iov_base, sizeof( srpcfSvrCommHdr_t ) );
+	srpcfSvrCommHdr.srpcfPktLen = srpcfFrameSize | LIBSRPCF_FRAME_MORE;
+	frameIov[ 0 ].iov_base = &srpcfSvrCommHdr;
+	frameIov[ 0 ].iov_len = sizeof( srpcfSvrCommHdr_t );
+	num = sliceSrpcfVector( iov, iovcnt,
+			sizeof( srpcfSvrCommHdr_t ),
+			srpcfFrameSize - sizeof( srpcfSvrCommHdr_t ),
+			&frameIov[ 1 ] );
+
+	if( transferSrpcfPieces( *pMxqFd, frameIov, num + 1 ) == FALSE ) {
+
+		ret = FALSE;
+		goto Exit;
+	}
+
+	// Continuation frames
+	for( off = srpcfFrameSize ; off < length ; off += chunk ) {
+
+		chunk = length - off;
+		if( chunk > (srpcfFrameSize - sizeof( srpcfSvrCommHdr_t )) )
+			chunk = srpcfFrameSize - sizeof( srpcfSvrCommHdr_t );
+
+		srpcfSvrCommHdr.srpcfPktLen = chunk + sizeof( srpcfSvrCommHdr_t );
+		if( (off + chunk) < length )
+			srpcfSvrCommHdr.srpcfPktLen |= LIBSRPCF_FRAME_MORE;
+
+		frameIov[ 0 ].iov_base = &srpcfSvrCommHdr;
+		frameIov[ 0 ].iov_len = sizeof( srpcfSvrCommHdr_t );
+		num = sliceSrpcfVector( iov, iovcnt, off, chunk, &frameIov[ 1 ] );
+
+		if( transferSrpcfPieces( *pMxqFd, frameIov, num + 1 ) == FALSE ) {
+
+			ret = FALSE;
+			break;
+		}
+	}
+
+Exit:
+
+	pthread_mutex_unlock( pLock );
+    return ret;
+}
+
+
+bool transferSrpcfFrame( s32 *pMxqFd, const void *pktBuf, const s32 length ) {
+
+	struct iovec iov;
+
+	iov.iov_base = (void *)pktBuf;
+	iov.iov_len = length;
+
+	return transferSrpcfVector( pMxqFd, &iov, 1 );
+}
+
+
+// A single frame carrying a descriptor, over a Unix-domain socket only
+bool transferSrpcfRights( s32 *pMxqFd, const void *pktBuf, const u32 length, s32 passFd ) {
+
+	pthread_mutex_t *pLock = &frameLockTbl[ (u32)*pMxqFd % LIBSRPCF_FRAME_LOCKS ];
+	struct iovec iov;
+	s32 wByte;
+
+	if( length < sizeof( srpcfSvrCommHdr_t ) || length > srpcfFrameSize )
+		return FALSE;
+
+	iov.iov_base = (void *)pktBuf;
+	iov.iov_len = length;
+
+	pthread_mutex_lock( pLock );
+	transferRightsSocket( *pMxqFd, &iov, 1, passFd, &wByte );
+	pthread_mutex_unlock( pLock );
+
+	if( wByte < 0 ) {
+
+        DBGPRINT( "Cannot send out the packet\n" );
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
 void *receiveSrpcfFrame( s32 *pMxqFd ) {
 
-	void *packet;
-    s8 pBuf[ LIBSRPCF_MSG_SIZE ];
-    srpcfSvrCommHdr_t *pSrpcfSvrCommHdr = (srpcfSvrCommHdr_t *)pBuf;
-	s32 rByte;
+	s8 *packet = NULL, *pNew;
+    srpcfSvrCommHdr_t srpcfSvrCommHdr;
+	s32 rByte, passFd;
+	u32 frameLen, total;
+	bool more;
 
-	// Receive data from client
-	receiveSocket( *pMxqFd, pBuf, LIBSRPCF_MSG_SIZE, &rByte );
-	if( rByte <= 0 ) {
+	// Receive exactly one header, frames may be queued back to back.
+	// A mapped result brings its descriptor along with the header.
+	if( receiveRightsSocket( *pMxqFd, &srpcfSvrCommHdr, sizeof( srpcfSvrCommHdr_t ), &rByte, &passFd ) == FALSE ) {
 
         DBGPRINT( "Cannot receive a packet\n" );
         return NULL;
     }
 
-    if( pSrpcfSvrCommHdr->srpcfPktLen < sizeof( srpcfSvrCommHdr_t ) ) {
+    frameLen = LIBSRPCF_FRAME_LEN( srpcfSvrCommHdr.srpcfPktLen );
+    if( frameLen < sizeof( srpcfSvrCommHdr_t ) || frameLen > srpcfMsgLimit ) {
 
         DBGPRINT( "Invalid packet content\n" );
-        return NULL;
+        goto ErrExit;
     }
 
     // Allocate memory for receiving a packet
-    packet = malloc( pSrpcfSvrCommHdr->srpcfPktLen );
+    packet = malloc( frameLen );
     if( !packet ) {
 
         DBGPRINT( "Out of memory\n" );
-        return NULL;
+        goto ErrExit;
+    }
+
+    // Copy the header, then receive the rest of the frame
+    memcpy( packet, &srpcfSvrCommHdr, sizeof( srpcfSvrCommHdr_t ) );
+    if( frameLen > sizeof( srpcfSvrCommHdr_t )
+        && receiveSocket( *pMxqFd,
+            packet + sizeof( srpcfSvrCommHdr_t ),
+            frameLen - sizeof( srpcfSvrCommHdr_t ),
+            &rByte ) == FALSE )
+        goto ErrExit;
+
+    // Append the bodies of continuation frames
+    total = frameLen;
+    more = (srpcfSvrCommHdr.srpcfPktLen & LIBSRPCF_FRAME_MORE) ? TRUE : FALSE;
+    while( more == TRUE ) {
+
+        if( receiveSocket( *pMxqFd, &srpcfSvrCommHdr, sizeof( srpcfSvrCommHdr_t ), &rByte ) == FALSE )
+            goto ErrExit;
+
+        frameLen = LIBSRPCF_FRAME_LEN( srpcfSvrCommHdr.srpcfPktLen );
+        more = (srpcfSvrCommHdr.srpcfPktLen & LIBSRPCF_FRAME_MORE) ? TRUE : FALSE;
+        if( frameLen <= sizeof( srpcfSvrCommHdr_t )
+            || srpcfSvrCommHdr.srpcfReqId != ((srpcfSvrCommHdr_t *)packet)->srpcfReqId
+            || (total + frameLen - sizeof( srpcfSvrCommHdr_t )) > srpcfMsgLimit ) {
+
+            DBGPRINT( "Invalid continuation frame\n" );
+            goto ErrExit;
+        }
+
+        pNew = realloc( packet, total + frameLen - sizeof( srpcfSvrCommHdr_t ) );
+        if( !pNew ) {
+
+            DBGPRINT( "Out of memory\n" );
+            goto ErrExit;
+        }
+        packet = pNew;
+
+        if( receiveSocket( *pMxqFd, packet + total, frameLen - sizeof( srpcfSvrCommHdr_t ), &rByte ) == FALSE )
+            goto ErrExit;
+        total += frameLen - sizeof( srpcfSvrCommHdr_t );
     }
 
-    // Copy the header
-    memcpy( packet, pBuf, pSrpcfSvrCommHdr->srpcfPktLen );
+    // From here on the length covers the whole packet
+    ((srpcfSvrCommHdr_t *)packet)->srpcfPktLen = total;
+
+    // The frame only announced the result, the descriptor holds all of it
+    if( (u32)((srpcfSvrCommHdr_t *)packet)->srpcfOpCode == SRPCF_RSP_EXECUTE_MAPPED ) {
+
+        pNew = (passFd >= 0) ? mapSrpcfResponse( passFd, (srpcfSvrCommHdr_t *)packet ) : NULL;
+        if( !pNew )
+            goto ErrExit;
+
+        close( passFd );
+        free( packet );
+        return pNew;
+    }
+
+    // Nobody asked for this one
+    if( passFd >= 0 )
+        close( passFd );
 
     // Return the pointer of a packet
     return packet;
+
+ErrExit:
+
+    DBGPRINT( "Cannot receive a packet\n" );
+    if( passFd >= 0 )
+        close( passFd );
+    free( packet );
+    return NULL;
 }
 
 
+void initializeSrpcfRing( srpcfRing_t *pRing, s8 *storage, u32 size ) {
+
+	// The storage belongs to the caller, usually embedded in a connection
+	pRing->buffer = pRing->storage = storage;
+	pRing->bufferSize = pRing->storageSize = size;
+	pRing->head = 0;
+	pRing->tail = 0;
+	pRing->message = NULL;
+	pRing->messageLen = 0;
+	pRing->messageDone = FALSE;
+}
+
+
+static bool reserveSrpcfRing( srpcfRing_t *pRing, u32 length ) {
+
+	s8 *pNew;
+	u32 pending = pRing->tail - pRing->head;
+
+	// The frame already fits where it starts
+	if( (pRing->head + length) <= pRing->bufferSize )
+		return TRUE;
+
+	// Slide the pending bytes to the front
+	if( length <= pRing->bufferSize ) {
+
+		memmove( pRing->buffer, pRing->buffer + pRing->head, pending );
+		pRing->head = 0;
+		pRing->tail = pending;
+		return TRUE;
+	}
+
+	// Only a frame larger than the buffer needs the heap
+	pNew = (s8 *)malloc( length );
+	if( !pNew )
+		return FALSE;
+
+	memcpy( pNew, pRing->buffer + pRing->head, pending );
+	if( pRing->buffer != pRing->storage )
+		free( pRing->buffer );
+
+	pRing->buffer = pNew;
+	pRing->bufferSize = length;
+	pRing->head = 0;
+	pRing->tail = pending;
+
+	return TRUE;
+}
+
+
+s32 fillSrpcfRing( s32 fd, srpcfRing_t *pRing ) {
+
+	s32 rByte;
+	u32 length = sizeof( srpcfSvrCommHdr_t );
+
+	// Everything is consumed, start over and give back a large buffer
+	if( pRing->head == pRing->tail ) {
+
+		pRing->head = 0;
+		pRing->tail = 0;
+		if( pRing->buffer != pRing->storage ) {
+
+			free( pRing->buffer );
+			pRing->buffer = pRing->storage;
+			pRing->bufferSize = pRing->storageSize;
+		}
+	}
+
+	// Make room for the whole frame once its header is in
+	if( (pRing->tail - pRing->head) >= sizeof( srpcfSvrCommHdr_t ) )
+		length = LIBSRPCF_FRAME_LEN( ((srpcfSvrCommHdr_t *)(pRing->buffer + pRing->head))->srpcfPktLen );
+
+	if( length < sizeof( srpcfSvrCommHdr_t ) || length > srpcfMsgLimit ) {
+
+		errno = EPROTO;
+		return -1;
+	}
+
+	if( reserveSrpcfRing( pRing, length ) == FALSE ) {
+
+		errno = ENOMEM;
+		return -1;
+	}
+
+	// Take whatever has arrived, pipelined frames come in with one call
+	rByte = receiveSomeSocket( fd, pRing->buffer + pRing->tail, pRing->bufferSize - pRing->tail );
+	if( rByte > 0 )
+		pRing->tail += rByte;
+
+	return rByte;
+}
+
+
+// The returned packet points into the ring, or at a message reassembled from
+// continuation frames, and stays valid until the next call on the same ring.
+srpcfSvrCommPkt_t *nextSrpcfRing( srpcfRing_t *pRing, bool *pInvalid ) {
+
+	srpcfSvrCommHdr_t *pSrpcfSvrCommHdr;
+	s8 *pNew;
+	u32 frameLen, bodyLen;
+
+	*pInvalid = FALSE;
+
+	// The message handed out last time is done with
+	if( pRing->messageDone == TRUE ) {
+
+		free( pRing->message );
+		pRing->message = NULL;
+		pRing->messageDone = FALSE;
+	}
+
+	for( ; ; ) {
+
+		// Wait for a complete frame
+		if( (pRing->tail - pRing->head) < sizeof( srpcfSvrCommHdr_t ) )
+			return NULL;
+
+		pSrpcfSvrCommHdr = (srpcfSvrCommHdr_t *)(pRing->buffer + pRing->head);
+		frameLen = LIBSRPCF_FRAME_LEN( pSrpcfSvrCommHdr->srpcfPktLen );
+		if( frameLen < sizeof( srpcfSvrCommHdr_t ) || frameLen > srpcfMsgLimit ) {
+
+			DBGPRINT( "Invalid packet content\n" );
+			*pInvalid = TRUE;
+			return NULL;
+		}
+
+		if( (pRing->tail - pRing->head) < frameLen )
+			return NULL;
+		pRing->head += frameLen;
+
+		// A single frame is decoded where it landed
+		if( !pRing->message && !(pSrpcfSvrCommHdr->srpcfPktLen & LIBSRPCF_FRAME_MORE) )
+			return (srpcfSvrCommPkt_t *)pSrpcfSvrCommHdr;
+
+		// Continued messages are put together on the heap
+		if( !pRing->message ) {
+
+			pRing->message = (s8 *)malloc( frameLen );
+			if( !pRing->message ) {
+
+				DBGPRINT( "Out of memory\n" );
+				*pInvalid = TRUE;
+				return NULL;
+			}
+
+			memcpy( pRing->message, pSrpcfSvrCommHdr, frameLen );
+			pRing->messageLen = frameLen;
+		}
+		else {
+
+			bodyLen = frameLen - sizeof( srpcfSvrCommHdr_t );
+			if( pSrpcfSvrCommHdr->srpcfReqId != ((srpcfSvrCommHdr_t *)pRing->message)->srpcfReqId
+				|| !bodyLen
+				|| (pRing->messageLen + bodyLen) > srpcfMsgLimit ) {
+
+				DBGPRINT( "Invalid continuation frame\n" );
+				*pInvalid = TRUE;
+				return NULL;
+			}
+
+			pNew = (s8 *)realloc( pRing->message, pRing->messageLen + bodyLen );
+			if( !pNew ) {
+
+				DBGPRINT( "Out of memory\n" );
+				*pInvalid = TRUE;
+				return NULL;
+			}
+			pRing->message = pNew;
+
+			memcpy( pRing->message + pRing->messageLen,
+				((s8 *)pSrpcfSvrCommHdr) + sizeof( srpcfSvrCommHdr_t ),
+				bodyLen );
+			pRing->messageLen += bodyLen;
+		}
+
+		if( pSrpcfSvrCommHdr->srpcfPktLen & LIBSRPCF_FRAME_MORE )
+			continue;
+
+		// From here on the length covers the whole message
+		((srpcfSvrCommHdr_t *)pRing->message)->srpcfPktLen = pRing->messageLen;
+		pRing->messageDone = TRUE;
+
+		return (srpcfSvrCommPkt_t *)pRing->message;
+	}
+}
+
+
+srpcfSvrCommPkt_t *detachSrpcfRing( srpcfRing_t *pRing, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt ) {
+
+	srpcfSvrCommPkt_t *pCopy;
+
+	// A reassembled message is handed over as it is
+	if( (s8 *)pSrpcfSvrCommPkt == pRing->message ) {
+
+		pRing->message = NULL;
+		pRing->messageDone = FALSE;
+		return pSrpcfSvrCommPkt;
+	}
+
+	// A view into the ring needs its own copy to outlive the next call
+	pCopy = (srpcfSvrCommPkt_t *)malloc( pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfPktLen );
+	if( !pCopy )
+		return NULL;
+	memcpy( pCopy, pSrpcfSvrCommPkt, pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfPktLen );
+
+	return pCopy;
+}
+
+
+srpcfSvrCommPkt_t *receiveSrpcfRing( s32 *pMxqFd, srpcfRing_t *pRing ) {
+
+	srpcfSvrCommPkt_t *pSrpcfSvrCommPkt;
+	bool invalid;
+	s32 rByte;
+
+	for( ; ; ) {
+
+		// Hand out what is already buffered first
+		pSrpcfSvrCommPkt = nextSrpcfRing( pRing, &invalid );
+		if( pSrpcfSvrCommPkt )
+			return pSrpcfSvrCommPkt;
+
+		if( invalid == TRUE )
+			return NULL;
+
+		rByte = fillSrpcfRing( *pMxqFd, pRing );
+		if( rByte > 0 || (rByte < 0 && errno == EINTR) )
+			continue;
+
+		// Peer has gone, an error occurred or the receive timed out
+		return NULL;
+	}
+}
+
+
+void releaseSrpcfRing( srpcfRing_t *pRing ) {
+
+	if( pRing->message )
+		free( pRing->message );
+
+	if( pRing->buffer != pRing->storage )
+		free( pRing->buffer );
+
+	initializeSrpcfRing( pRing, pRing->storage, pRing->storageSize );
+}
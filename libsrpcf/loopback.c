@@ -0,0 +1,717 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: loopback.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+
+#include "netsock.h"
+
+
+//
+// Structures
+//
+// Handles are eventfds, so poll() and epoll see them like sockets. An end
+// stays readable while it has data queued, has been shut down or lost its peer.
+typedef struct _srpcfLoopEnd {
+
+	s32							fd;
+	bool						signaled;
+	bool						shut;
+	bool						closed;
+	u32							timeout;
+
+	// Inbound bytes
+	s8							*data;
+	u32							head;
+	u32							tail;
+	u32							size;
+
+	struct _srpcfLoopPair		*pPair;
+	struct _srpcfLoopEnd		*peer;
+
+	// Accept queue of the listener
+	struct _srpcfLoopEnd		*next;
+
+} srpcfLoopEnd_t;
+
+
+typedef struct _srpcfLoopPair {
+
+	pthread_mutex_t				lock;
+	pthread_cond_t				cond;
+	srpcfLoopEnd_t				end[ 2 ];
+
+} srpcfLoopPair_t;
+
+
+typedef struct _srpcfLoopListener {
+
+	s32							fd;
+	bool						signaled;
+	s8							*name;
+
+	srpcfLoopEnd_t				*pendHead;
+	srpcfLoopEnd_t				*pendTail;
+
+	struct _srpcfLoopListener	*next;
+
+} srpcfLoopListener_t;
+
+
+typedef struct _srpcfLoopHandle {
+
+	srpcfLoopListener_t			*pListener;
+	srpcfLoopEnd_t				*pEnd;
+
+} srpcfLoopHandle_t;
+
+
+//
+// Global variables
+//
+static srpcfLoopHandle_t srpcfLoopHandleTbl[ SRPCF_LOOP_FDS ];
+static srpcfLoopListener_t *srpcfLoopListenerHead = NULL;
+static pthread_mutex_t srpcfLoopLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t srpcfLoopCond = PTHREAD_COND_INITIALIZER;
+
+
+static void raiseSrpcfLoopFd( s32 fd, bool *pSignaled ) {
+
+	u64 one = 1;
+
+	if( *pSignaled == TRUE )
+		return;
+
+	if( write( fd, &one, sizeof( one ) ) == sizeof( one ) )
+		*pSignaled = TRUE;
+}
+
+
+static void lowerSrpcfLoopFd( s32 fd, bool *pSignaled ) {
+
+	u64 count;
+
+	// The counter is known to be set, so this never blocks
+	if( *pSignaled == FALSE )
+		return;
+
+	if( read( fd, &count, sizeof( count ) ) == sizeof( count ) )
+		*pSignaled = FALSE;
+}
+
+
+static bool isNonblockSrpcfLoopFd( s32 fd ) {
+
+	s32 flags;
+
+	flags = fcntl( fd, F_GETFL, 0 );
+	return (flags >= 0 && (flags & O_NONBLOCK)) ? TRUE : FALSE;
+}
+
+
+static srpcfLoopEnd_t *lookupSrpcfLoopEnd( s32 fd ) {
+
+	if( fd < 0 || fd >= SRPCF_LOOP_FDS )
+		return NULL;
+
+	return __atomic_load_n( &srpcfLoopHandleTbl[ fd ].pEnd, __ATOMIC_ACQUIRE );
+}
+
+
+static srpcfLoopListener_t *lookupSrpcfLoopListener( s32 fd ) {
+
+	if( fd < 0 || fd >= SRPCF_LOOP_FDS )
+		return NULL;
+
+	return __atomic_load_n( &srpcfLoopHandleTbl[ fd ].pListener, __ATOMIC_ACQUIRE );
+}
+
+
+// Caller holds the pair lock
+static bool isEofSrpcfLoopEnd( srpcfLoopEnd_t *pEnd ) {
+
+	return (pEnd->shut || pEnd->peer->shut || pEnd->peer->closed) ? TRUE : FALSE;
+}
+
+
+// Caller holds the pair lock
+static void updateSrpcfLoopEnd( srpcfLoopEnd_t *pEnd ) {
+
+	if( pEnd->closed )
+		return;
+
+	if( pEnd->tail != pEnd->head || isEofSrpcfLoopEnd( pEnd ) == TRUE )
+		raiseSrpcfLoopFd( pEnd->fd, &pEnd->signaled );
+	else
+		lowerSrpcfLoopFd( pEnd->fd, &pEnd->signaled );
+}
+
+
+// Caller holds the pair lock
+static bool reserveSrpcfLoopEnd( srpcfLoopEnd_t *pEnd, u32 length ) {
+
+	s8 *pNew;
+	u32 size;
+
+	if( pEnd->size - pEnd->tail >= length )
+		return TRUE;
+
+	// Slide what is left to the front first
+	if( pEnd->head ) {
+
+		memmove( pEnd->data, pEnd->data + pEnd->head, pEnd->tail - pEnd->head );
+		pEnd->tail -= pEnd->head;
+		pEnd->head = 0;
+	}
+
+	if( pEnd->size - pEnd->tail >= length )
+		return TRUE;
+
+	for( size = pEnd->size ? pEnd->size : SRPCF_LOOP_CHUNK ; size - pEnd->tail < length ; size *= 2 );
+	pNew = (s8 *)realloc( pEnd->data, size );
+	if( !pNew )
+		return FALSE;
+
+	pEnd->data = pNew;
+	pEnd->size = size;
+
+	return TRUE;
+}
+
+
+static const s8 *nameOfSrpcfLoopAddress( const s8 *addr ) {
+
+	return addr + strlen( SRPCF_LOOP_PREFIX );
+}
+
+
+// Caller holds srpcfLoopLock
+static srpcfLoopListener_t *findSrpcfLoopListener( const s8 *name ) {
+
+	srpcfLoopListener_t *pListener;
+
+	for( pListener = srpcfLoopListenerHead ; pListener ; pListener = pListener->next )
+		if( !strcmp( pListener->name, name ) )
+			return pListener;
+
+	return NULL;
+}
+
+
+static s32 openSrpcfLoopFd( void ) {
+
+	s32 fd;
+
+	fd = eventfd( 0, EFD_CLOEXEC );
+	if( fd < 0 )
+		return -1;
+
+	// The handle table is indexed by descriptor
+	if( fd >= SRPCF_LOOP_FDS ) {
+
+		close( fd );
+		errno = EMFILE;
+		return -1;
+	}
+
+	return fd;
+}
+
+
+static s32 listenLoopSocket( s32 *fd, const s8 *addr, s32 port ) {
+
+	srpcfLoopListener_t *pListener;
+
+	pListener = (srpcfLoopListener_t *)calloc( 1, sizeof( srpcfLoopListener_t ) );
+	if( !pListener )
+		return -1;
+
+	pListener->name = mallocStringBuffer( nameOfSrpcfLoopAddress( addr ) );
+	pListener->fd = openSrpcfLoopFd();
+	if( !pListener->name || pListener->fd < 0 )
+		goto ErrExit;
+
+	// One listener per name, like a bound port
+	pthread_mutex_lock( &srpcfLoopLock );
+	if( findSrpcfLoopListener( pListener->name ) ) {
+
+		pthread_mutex_unlock( &srpcfLoopLock );
+		errno = EADDRINUSE;
+		goto ErrExit;
+	}
+	pListener->next = srpcfLoopListenerHead;
+	srpcfLoopListenerHead = pListener;
+	__atomic_store_n( &srpcfLoopHandleTbl[ pListener->fd ].pListener, pListener, __ATOMIC_RELEASE );
+	pthread_mutex_unlock( &srpcfLoopLock );
+
+	*fd = pListener->fd;
+	return 0;
+
+ErrExit:
+	if( pListener->fd >= 0 )
+		close( pListener->fd );
+	if( pListener->name )
+		free( pListener->name );
+	free( pListener );
+	return -1;
+}
+
+
+static s32 connectLoopSocket( s32 *fd, const s8 *addr, s32 port ) {
+
+	srpcfLoopListener_t *pListener;
+	srpcfLoopPair_t *pPair;
+	pthread_condattr_t attr;
+	s32 i;
+
+	pPair = (srpcfLoopPair_t *)calloc( 1, sizeof( srpcfLoopPair_t ) );
+	if( !pPair )
+		return -1;
+
+	// Timeouts should not jump with the wall clock
+	pthread_condattr_init( &attr );
+	pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+	pthread_cond_init( &pPair->cond, &attr );
+	pthread_condattr_destroy( &attr );
+	pthread_mutex_init( &pPair->lock, NULL );
+
+	for( i = 0 ; i < 2 ; i++ ) {
+
+		pPair->end[ i ].pPair = pPair;
+		pPair->end[ i ].peer = &pPair->end[ 1 - i ];
+		pPair->end[ i ].fd = openSrpcfLoopFd();
+	}
+
+	if( pPair->end[ 0 ].fd < 0 || pPair->end[ 1 ].fd < 0 )
+		goto ErrExit;
+
+	pthread_mutex_lock( &srpcfLoopLock );
+	pListener = findSrpcfLoopListener( nameOfSrpcfLoopAddress( addr ) );
+	if( !pListener ) {
+
+		pthread_mutex_unlock( &srpcfLoopLock );
+		errno = ECONNREFUSED;
+		goto ErrExit;
+	}
+
+	for( i = 0 ; i < 2 ; i++ )
+		__atomic_store_n( &srpcfLoopHandleTbl[ pPair->end[ i ].fd ].pEnd, &pPair->end[ i ], __ATOMIC_RELEASE );
+
+	// Queue the far end for accept
+	if( pListener->pendTail )
+		pListener->pendTail->next = &pPair->end[ 1 ];
+	else
+		pListener->pendHead = &pPair->end[ 1 ];
+	pListener->pendTail = &pPair->end[ 1 ];
+	raiseSrpcfLoopFd( pListener->fd, &pListener->signaled );
+	pthread_cond_broadcast( &srpcfLoopCond );
+	pthread_mutex_unlock( &srpcfLoopLock );
+
+	*fd = pPair->end[ 0 ].fd;
+	return 0;
+
+ErrExit:
+	for( i = 0 ; i < 2 ; i++ )
+		if( pPair->end[ i ].fd >= 0 )
+			close( pPair->end[ i ].fd );
+	pthread_cond_destroy( &pPair->cond );
+	pthread_mutex_destroy( &pPair->lock );
+	free( pPair );
+	return -1;
+}
+
+
+static s32 acceptLoopSocket( s32 fd, s32 *apsd ) {
+
+	srpcfLoopListener_t *pListener;
+	srpcfLoopEnd_t *pEnd;
+
+	pListener = lookupSrpcfLoopListener( fd );
+	if( !pListener ) {
+
+		errno = EINVAL;
+		return FALSE;
+	}
+
+	pthread_mutex_lock( &srpcfLoopLock );
+	while( !pListener->pendHead ) {
+
+		if( isNonblockSrpcfLoopFd( fd ) == TRUE ) {
+
+			pthread_mutex_unlock( &srpcfLoopLock );
+			errno = EAGAIN;
+			return FALSE;
+		}
+
+		pthread_cond_wait( &srpcfLoopCond, &srpcfLoopLock );
+	}
+
+	pEnd = pListener->pendHead;
+	pListener->pendHead = pEnd->next;
+	if( !pListener->pendHead ) {
+
+		pListener->pendTail = NULL;
+		lowerSrpcfLoopFd( pListener->fd, &pListener->signaled );
+	}
+	pthread_mutex_unlock( &srpcfLoopLock );
+
+	pEnd->next = NULL;
+	*apsd = pEnd->fd;
+
+	return TRUE;
+}
+
+
+// Without wait, stop where the peer's buffer is full
+static s32 pushSrpcfLoopEnd( s32 fd, struct iovec *iov, s32 iovcnt, bool wait, s32 *wByte ) {
+
+	srpcfLoopEnd_t *pEnd, *pPeer;
+	srpcfLoopPair_t *pPair;
+	u32 len, queued;
+
+	pEnd = lookupSrpcfLoopEnd( fd );
+	if( !pEnd ) {
+
+		errno = EBADF;
+		*wByte = -1;
+		return FALSE;
+	}
+	pPair = pEnd->pPair;
+	pPeer = pEnd->peer;
+
+	pthread_mutex_lock( &pPair->lock );
+	for( *wByte = 0 ; iovcnt ; ) {
+
+		if( !iov->iov_len ) {
+
+			iov++;
+			iovcnt--;
+			continue;
+		}
+
+		if( pEnd->shut || pPeer->shut || pPeer->closed ) {
+
+			pthread_mutex_unlock( &pPair->lock );
+			errno = EPIPE;
+			*wByte = -1;
+			return FALSE;
+		}
+
+		// Hold the writer back while the reader is behind, like a full socket buffer
+		queued = pPeer->tail - pPeer->head;
+		if( queued >= SRPCF_LOOP_BUFFER ) {
+
+			if( wait == FALSE )
+				break;
+
+			pthread_cond_wait( &pPair->cond, &pPair->lock );
+			continue;
+		}
+
+		len = SRPCF_LOOP_BUFFER - queued;
+		if( len > iov->iov_len )
+			len = iov->iov_len;
+
+		if( reserveSrpcfLoopEnd( pPeer, len ) == FALSE ) {
+
+			pthread_mutex_unlock( &pPair->lock );
+			errno = ENOMEM;
+			*wByte = -1;
+			return FALSE;
+		}
+
+		memcpy( pPeer->data + pPeer->tail, iov->iov_base, len );
+		pPeer->tail += len;
+		*wByte += len;
+
+		iov->iov_base = (s8 *)iov->iov_base + len;
+		iov->iov_len -= len;
+
+		updateSrpcfLoopEnd( pPeer );
+		pthread_cond_broadcast( &pPair->cond );
+	}
+	pthread_mutex_unlock( &pPair->lock );
+
+	return TRUE;
+}
+
+
+static s32 sendLoopSocket( s32 fd, struct iovec *iov, s32 iovcnt, s32 *wByte ) {
+
+	return pushSrpcfLoopEnd( fd, iov, iovcnt, TRUE, wByte );
+}
+
+
+static s32 sendSomeLoopSocket( s32 fd, const struct iovec *iov, s32 iovcnt ) {
+
+	struct iovec vec[ LIBSRPCF_IOV_MAX ];
+	s32 wByte;
+
+	// The caller's vector stays as it was
+	if( iovcnt > LIBSRPCF_IOV_MAX )
+		iovcnt = LIBSRPCF_IOV_MAX;
+	memcpy( vec, iov, sizeof( struct iovec ) * iovcnt );
+
+	if( pushSrpcfLoopEnd( fd, vec, iovcnt, FALSE, &wByte ) == FALSE )
+		return -1;
+
+	return wByte;
+}
+
+
+static s32 recvLoopSocket( s32 fd, void *pktBuf, const u32 length ) {
+
+	srpcfLoopEnd_t *pEnd;
+	srpcfLoopPair_t *pPair;
+	struct timespec deadline;
+	u32 len;
+
+	pEnd = lookupSrpcfLoopEnd( fd );
+	if( !pEnd ) {
+
+		errno = EBADF;
+		return -1;
+	}
+	pPair = pEnd->pPair;
+
+	if( pEnd->timeout ) {
+
+		clock_gettime( CLOCK_MONOTONIC, &deadline );
+		deadline.tv_sec += pEnd->timeout;
+	}
+
+	pthread_mutex_lock( &pPair->lock );
+	for( ; ; ) {
+
+		len = pEnd->tail - pEnd->head;
+		if( len ) {
+
+			if( len > length )
+				len = length;
+
+			memcpy( pktBuf, pEnd->data + pEnd->head, len );
+			pEnd->head += len;
+			if( pEnd->head == pEnd->tail )
+				pEnd->head = pEnd->tail = 0;
+
+			// Readiness follows the queue, and a writer may be waiting for room
+			updateSrpcfLoopEnd( pEnd );
+			pthread_cond_broadcast( &pPair->cond );
+			pthread_mutex_unlock( &pPair->lock );
+			return len;
+		}
+
+		// Drained and nothing more will come
+		if( isEofSrpcfLoopEnd( pEnd ) == TRUE ) {
+
+			pthread_mutex_unlock( &pPair->lock );
+			return 0;
+		}
+
+		if( isNonblockSrpcfLoopFd( fd ) == TRUE ) {
+
+			pthread_mutex_unlock( &pPair->lock );
+			errno = EAGAIN;
+			return -1;
+		}
+
+		if( !pEnd->timeout ) {
+
+			pthread_cond_wait( &pPair->cond, &pPair->lock );
+			continue;
+		}
+
+		if( pthread_cond_timedwait( &pPair->cond, &pPair->lock, &deadline ) == ETIMEDOUT ) {
+
+			pthread_mutex_unlock( &pPair->lock );
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+}
+
+
+static s32 pollLoopSocket( s32 fd, s16 events, s32 msec ) {
+
+	struct pollfd pfd;
+
+	// Writing never has to wait for the handle itself
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+
+	return poll( &pfd, 1, msec );
+}
+
+
+static s32 timeoutLoopSocket( s32 fd, u32 seconds ) {
+
+	srpcfLoopEnd_t *pEnd;
+
+	pEnd = lookupSrpcfLoopEnd( fd );
+	if( !pEnd ) {
+
+		errno = EBADF;
+		return -1;
+	}
+
+	pthread_mutex_lock( &pEnd->pPair->lock );
+	pEnd->timeout = seconds;
+	pthread_mutex_unlock( &pEnd->pPair->lock );
+
+	return 0;
+}
+
+
+static void shutdownLoopSocket( s32 fd ) {
+
+	srpcfLoopEnd_t *pEnd;
+	srpcfLoopPair_t *pPair;
+
+	pEnd = lookupSrpcfLoopEnd( fd );
+	if( !pEnd )
+		return;
+	pPair = pEnd->pPair;
+
+	// Both sides read an end of stream from now on
+	pthread_mutex_lock( &pPair->lock );
+	pEnd->shut = TRUE;
+	updateSrpcfLoopEnd( pEnd );
+	updateSrpcfLoopEnd( pEnd->peer );
+	pthread_cond_broadcast( &pPair->cond );
+	pthread_mutex_unlock( &pPair->lock );
+}
+
+
+static void closeLoopListener( srpcfLoopListener_t *pListener ) {
+
+	srpcfLoopListener_t **ppListener;
+	srpcfLoopEnd_t *pEnd, *pNext;
+
+	pthread_mutex_lock( &srpcfLoopLock );
+	for( ppListener = &srpcfLoopListenerHead ; *ppListener ; ppListener = &(*ppListener)->next ) {
+
+		if( *ppListener == pListener ) {
+
+			*ppListener = pListener->next;
+			break;
+		}
+	}
+	__atomic_store_n( &srpcfLoopHandleTbl[ pListener->fd ].pListener, NULL, __ATOMIC_RELEASE );
+	pEnd = pListener->pendHead;
+	pthread_mutex_unlock( &srpcfLoopLock );
+
+	// Connections nobody accepted are refused
+	for( ; pEnd ; pEnd = pNext ) {
+
+		pNext = pEnd->next;
+		srpcfLoopTransport.close( pEnd->fd );
+	}
+
+	close( pListener->fd );
+	free( pListener->name );
+	free( pListener );
+}
+
+
+static void closeLoopSocket( s32 fd ) {
+
+	srpcfLoopListener_t *pListener;
+	srpcfLoopEnd_t *pEnd;
+	srpcfLoopPair_t *pPair;
+	bool last;
+
+	pListener = lookupSrpcfLoopListener( fd );
+	if( pListener ) {
+
+		closeLoopListener( pListener );
+		return;
+	}
+
+	pEnd = lookupSrpcfLoopEnd( fd );
+	if( !pEnd )
+		return;
+	pPair = pEnd->pPair;
+
+	// Forget the handle before the descriptor can be reused
+	__atomic_store_n( &srpcfLoopHandleTbl[ fd ].pEnd, NULL, __ATOMIC_RELEASE );
+
+	pthread_mutex_lock( &pPair->lock );
+	pEnd->closed = TRUE;
+	free( pEnd->data );
+	pEnd->data = NULL;
+	pEnd->head = pEnd->tail = pEnd->size = 0;
+	updateSrpcfLoopEnd( pEnd->peer );
+	pthread_cond_broadcast( &pPair->cond );
+	last = pEnd->peer->closed;
+	pthread_mutex_unlock( &pPair->lock );
+
+	close( fd );
+
+	// The last one out frees the pair
+	if( last == TRUE ) {
+
+		pthread_cond_destroy( &pPair->cond );
+		pthread_mutex_destroy( &pPair->lock );
+		free( pPair );
+	}
+}
+
+
+bool isLoopSocketAddress( const s8 *addr ) {
+
+	return (addr && !strncmp( addr, SRPCF_LOOP_PREFIX, strlen( SRPCF_LOOP_PREFIX ) )) ? TRUE : FALSE;
+}
+
+
+bool isLoopSocket( s32 fd ) {
+
+	return (lookupSrpcfLoopEnd( fd ) || lookupSrpcfLoopListener( fd )) ? TRUE : FALSE;
+}
+
+
+const srpcfTransport_t srpcfLoopTransport = {
+
+	.name = "loop",
+	.listen = listenLoopSocket,
+	.connect = connectLoopSocket,
+	.accept = acceptLoopSocket,
+	.send = sendLoopSocket,
+	.sendSome = sendSomeLoopSocket,
+	.recv = recvLoopSocket,
+	.readiness = pollLoopSocket,
+	.timeout = timeoutLoopSocket,
+	.shutdown = shutdownLoopSocket,
+	.close = closeLoopSocket,
+};
+
+
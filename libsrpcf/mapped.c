@@ -0,0 +1,151 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: mapped.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// memfd_create() and file seals
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+
+
+// Large results are written once into a sealed memfd, which travels with a
+// header-only SRPCF_RSP_EXECUTE_MAPPED frame. The memfd holds the complete
+// response packet, so the client maps it and uses it like any other.
+bool responseSrpcfExecuteMapped( s32 *pMxqFd, u32 srpcfReqId, u32 srpcfCmdNo, u32 errorCode, s8 *dataRst ) {
+
+    srpcfSvrRspExecute_t srpcfSvrRspExecute;
+    struct iovec iov[ 2 ];
+    u32 hdrLen, strLen;
+    ssize_t wByte;
+    s32 mfd;
+    bool ret;
+
+    if( !dataRst )
+        goto Inline;
+
+    // Small results are cheaper to copy than to map
+    hdrLen = sizeof( srpcfSvrRspExecute_t ) - sizeof( srpcfSvrRspExecute.dataPtr );
+    strLen = strlen( dataRst ) + 1;
+    if( strLen < LIBSRPCF_MAPPED_MIN || (hdrLen + strLen) > limitOfSrpcfMessage() )
+        goto Inline;
+
+    mfd = memfd_create( "srpcf-result", MFD_CLOEXEC | MFD_ALLOW_SEALING );
+    if( mfd < 0 )
+        goto Inline;
+
+    // Fill in data
+    srpcfSvrRspExecute.srpcfSvrCommHdr.srpcfOpCode = SRPCF_RSP_EXECUTE_MAPPED;
+    srpcfSvrRspExecute.srpcfSvrCommHdr.srpcfPktLen = hdrLen + strLen;
+    srpcfSvrRspExecute.srpcfSvrCommHdr.srpcfReqId = srpcfReqId;
+    srpcfSvrRspExecute.srpcfErrorCode = errorCode;
+    srpcfSvrRspExecute.dataLength = strLen;
+
+    // One write, then nobody may change it under the client's mapping
+    iov[ 0 ].iov_base = &srpcfSvrRspExecute;
+    iov[ 0 ].iov_len = hdrLen;
+    iov[ 1 ].iov_base = dataRst;
+    iov[ 1 ].iov_len = strLen;
+    wByte = writev( mfd, iov, 2 );
+    if( wByte != (hdrLen + strLen)
+        || fcntl( mfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL ) < 0 ) {
+
+        DBGPRINT( "Cannot prepare a mapped result of %u bytes\n", strLen );
+        close( mfd );
+        goto Inline;
+    }
+
+    // Only the header goes on the wire
+    srpcfSvrRspExecute.srpcfSvrCommHdr.srpcfPktLen = hdrLen;
+    ret = transferSrpcfRights( pMxqFd, &srpcfSvrRspExecute, hdrLen, mfd );
+    close( mfd );
+
+    return ret;
+
+Inline:
+    return responseSrpcfExecute( pMxqFd, srpcfReqId, srpcfCmdNo, errorCode, dataRst );
+}
+
+
+// Takes the header-only frame and the descriptor that came with it
+void *mapSrpcfResponse( s32 passFd, srpcfSvrCommHdr_t *pSrpcfSvrCommHdr ) {
+
+    srpcfSvrCommHdr_t *pMapped;
+    struct stat st;
+    s32 seals;
+
+    // Unsealed, the sender could still truncate or rewrite it under us
+    seals = fcntl( passFd, F_GET_SEALS );
+    if( seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_WRITE)) != (F_SEAL_SHRINK | F_SEAL_WRITE) ) {
+
+        DBGPRINT( "Mapped result is not sealed\n" );
+        return NULL;
+    }
+
+    if( fstat( passFd, &st ) < 0
+        || st.st_size < (sizeof( srpcfSvrRspExecute_t ) - sizeof( s8 * ))
+        || st.st_size > limitOfSrpcfMessage() ) {
+
+        DBGPRINT( "Invalid mapped result\n" );
+        return NULL;
+    }
+
+    // Private, so the caller may still scribble on it
+    pMapped = (srpcfSvrCommHdr_t *)mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, passFd, 0 );
+    if( pMapped == MAP_FAILED )
+        return NULL;
+
+    if( (u32)pMapped->srpcfOpCode != SRPCF_RSP_EXECUTE_MAPPED
+        || pMapped->srpcfPktLen != st.st_size
+        || pMapped->srpcfReqId != pSrpcfSvrCommHdr->srpcfReqId ) {
+
+        DBGPRINT( "Mapped result does not match its frame\n" );
+        munmap( pMapped, st.st_size );
+        return NULL;
+    }
+
+    return pMapped;
+}
+
+
+// Responses are freed with this once SRPCF_CAP_MAPPED has been asked for
+void releaseSrpcfResponse( void *pRsp ) {
+
+    srpcfSvrCommHdr_t *pSrpcfSvrCommHdr = (srpcfSvrCommHdr_t *)pRsp;
+
+    if( !pRsp )
+        return;
+
+    if( (u32)pSrpcfSvrCommHdr->srpcfOpCode == SRPCF_RSP_EXECUTE_MAPPED )
+        munmap( pRsp, pSrpcfSvrCommHdr->srpcfPktLen );
+    else
+        free( pRsp );
+}
+
+
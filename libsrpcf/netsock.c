@@ -21,9 +21,17 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <stddef.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/time.h>
 
 #include "srpcf_types.h"
 #include "srpcf.h"
@@ -33,11 +41,109 @@
 #include "netsock.h"
 
 
-s32 initializeSocket( s32 *fd, s8 *addr, s32 port ) {
+static bool isUnixSocketAddress( const s8 *addr ) {
+
+    // "/path" is a socket file, "@name" lives in the abstract namespace
+    return (addr && (*addr == '/' || *addr == '@')) ? TRUE : FALSE;
+}
+
+
+static bool isLocalSocketAddress( const s8 *addr ) {
+
+    struct in_addr inaddr;
+
+    if( !addr || inet_aton( addr, &inaddr ) == 0 )
+        return FALSE;
+
+    return ((ntohl( inaddr.s_addr ) >> 24) == 127 || inaddr.s_addr == htonl( INADDR_ANY )) ? TRUE : FALSE;
+}
+
+
+static socklen_t fillUnixSocketAddress( const s8 *addr, struct sockaddr_un *pUnixAddr ) {
+
+    size_t len = strlen( addr );
+
+    memset( pUnixAddr, 0, sizeof( struct sockaddr_un ) );
+    pUnixAddr->sun_family = AF_UNIX;
+    if( len >= sizeof( pUnixAddr->sun_path ) )
+        return 0;
+    memcpy( pUnixAddr->sun_path, addr, len );
+
+    // Abstract names start with a NUL and are not terminated
+    if( *addr == '@' ) {
+
+        pUnixAddr->sun_path[ 0 ] = '\0';
+        return offsetof( struct sockaddr_un, sun_path ) + len;
+    }
+
+    return offsetof( struct sockaddr_un, sun_path ) + len + 1;
+}
+
+
+static s32 listenUnixSocket( s32 *fd, const s8 *addr, s32 port ) {
+
+    struct sockaddr_un unixaddr;
+    socklen_t len;
+
+    len = fillUnixSocketAddress( addr, &unixaddr );
+    if( !len )
+        return -1;
+
+    *fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( *fd < 0 )
+        return -1;
+
+    // A socket file left behind by an earlier run would block the bind
+    if( *addr == '/' )
+        unlink( addr );
+
+    if( bind( *fd, (struct sockaddr *)&unixaddr, len ) < 0
+        || listen( *fd, 5 ) < 0 ) {
+
+        close( *fd );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+// Without wait the socket is non-blocking, 1 tells the connect is under way
+static s32 dialUnixSocket( s32 *fd, const s8 *addr, bool wait ) {
+
+    struct sockaddr_un unixaddr;
+    socklen_t len;
 
-    s32 sts = 0;
+    len = fillUnixSocketAddress( addr, &unixaddr );
+    if( !len )
+        return -1;
+
+    *fd = socket( AF_UNIX, SOCK_STREAM | (wait ? 0 : SOCK_NONBLOCK), 0 );
+    if( *fd < 0 )
+        return -1;
+
+    // A local listener answers at once or not at all
+    if( connect( *fd, (struct sockaddr *)&unixaddr, len ) < 0 ) {
+
+        close( *fd );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static s32 connectUnixSocket( s32 *fd, const s8 *addr, s32 port ) {
+
+    return dialUnixSocket( fd, addr, TRUE );
+}
+
+
+static s32 listenTcpSocket( s32 *fd, const s8 *addr, s32 port ) {
+
+    s32 sts = 0, on = 1;
     struct sockaddr_in servaddr;
-    
+
     // Argument check
     if( !addr )
         addr = "0.0.0.0"; // Any
@@ -48,6 +154,9 @@ s32 initializeSocket( s32 *fd, s8 *addr, s32 port ) {
     *fd = socket( PF_INET, SOCK_STREAM, 0 );
     if( *fd < 0 )
         return -1;
+
+    // Allow restarting while old connections are still in TIME_WAIT
+    setsockopt( *fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
     
     // Default values of address & port
     if( port <= 0 )
@@ -86,11 +195,12 @@ ErrExit:
 }
 
 
-s32 connectSocket( s32 *fd, s8 *addr, s32 port ) {
+// Without wait the socket is non-blocking, 1 tells the connect is under way
+static s32 dialTcpSocket( s32 *fd, const s8 *addr, s32 port, bool wait ) {
     
-    s32 sts = 0;
+    s32 sts = 0, on = 1;
     struct sockaddr_in servaddr;
-    
+
     // Argument check
     if( !addr )
         addr = "0.0.0.0"; // Any
@@ -98,9 +208,12 @@ s32 connectSocket( s32 *fd, s8 *addr, s32 port ) {
         return -1;
     
     // Open a socket
-    *fd = socket( PF_INET, SOCK_STREAM, 0 );
+    *fd = socket( PF_INET, SOCK_STREAM | (wait ? 0 : SOCK_NONBLOCK), 0 );
     if( *fd < 0 )
         return -1;
+
+    // Pipelined requests are small, don't hold them back waiting for ACKs
+    setsockopt( *fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
     
     // Default values of address & port
     if( port <= 0 )
@@ -118,6 +231,9 @@ s32 connectSocket( s32 *fd, s8 *addr, s32 port ) {
     
     // Connect to network port
     if( connect( *fd, (struct sockaddr *)&servaddr, sizeof( struct sockaddr_in ) ) < 0 ) {
+
+        if( wait == FALSE && errno == EINPROGRESS )
+            return 1;
         
         sts = -1;
         goto ErrExit;
@@ -132,44 +248,548 @@ ErrExit:
 }
 
 
-void deinitializeSocket( s32 fd ) {
+static s32 connectTcpSocket( s32 *fd, const s8 *addr, s32 port ) {
 
-    close( fd );
+    return dialTcpSocket( fd, addr, port, TRUE );
 }
 
 
-s32 acceptSocket( s32 fd, s32 *apsd ) {
+static s32 acceptStreamSocket( s32 fd, s32 *apsd ) {
     
-    struct sockaddr_in cliaddr;
+    struct sockaddr_storage cliaddr;
     socklen_t clilen;
+    s32 on = 1;
     
     // Accept new connection
-    clilen = sizeof( struct sockaddr_in );
+    clilen = sizeof( struct sockaddr_storage );
     *apsd = accept( fd, (struct sockaddr *)&cliaddr, &clilen );
     if( *apsd < 0 )
         return FALSE;
+
+    // Responses of pipelined requests are small, don't hold them back waiting for ACKs
+    if( cliaddr.ss_family == AF_INET )
+        setsockopt( *apsd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
     
     return TRUE;
 }
 
 
+static s32 pollStreamSocket( s32 fd, s16 events, s32 msec ) {
+
+    struct pollfd pfd;
+
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+
+    return poll( &pfd, 1, msec );
+}
+
+
+// The vector is advanced past what has been sent, so it is consumed on return
+static s32 sendStreamSocket( s32 fd, struct iovec *iov, s32 iovcnt, s32 *wByte ) {
+
+    struct msghdr msg;
+    s32 len;
+
+    memset( &msg, 0, sizeof( msg ) );
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    // Send until every piece is out, a non-blocking socket may take several rounds
+    for( *wByte = 0 ; msg.msg_iovlen ; ) {
+
+        len = sendmsg( fd, &msg, MSG_NOSIGNAL );
+        if( len < 0 ) {
+
+            if( errno == EINTR )
+                continue;
+
+            if( errno != EAGAIN && errno != EWOULDBLOCK ) {
+
+                *wByte = -1;
+                return FALSE;
+            }
+
+            // Wait for the socket to drain
+            pollStreamSocket( fd, POLLOUT, -1 );
+            continue;
+        }
+        *wByte += len;
+
+        // Skip the pieces that went out, and the part of the one cut short
+        while( msg.msg_iovlen && len >= msg.msg_iov->iov_len ) {
+
+            len -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+
+        if( msg.msg_iovlen ) {
+
+            msg.msg_iov->iov_base = (s8 *)msg.msg_iov->iov_base + len;
+            msg.msg_iov->iov_len -= len;
+        }
+    }
+
+    return TRUE;
+}
+
+
+static s32 sendSomeStreamSocket( s32 fd, const struct iovec *iov, s32 iovcnt ) {
+
+    struct msghdr msg;
+    s32 len;
+
+    memset( &msg, 0, sizeof( msg ) );
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = iovcnt;
+
+    for( ; ; ) {
+
+        len = sendmsg( fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT );
+        if( len >= 0 )
+            return len;
+
+        if( errno == EINTR )
+            continue;
+
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+}
+
+
+static s32 recvStreamSocket( s32 fd, void *pktBuf, const u32 length ) {
+
+    return recv( fd, pktBuf, length, 0 );
+}
+
+
+static s32 timeoutStreamSocket( s32 fd, u32 seconds ) {
+
+    struct timeval tv;
+
+    // Receiving gives up after this long without data
+    tv.tv_sec = seconds;
+    tv.tv_usec = 0;
+
+    return setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+}
+
+
+static void shutdownStreamSocket( s32 fd ) {
+
+    shutdown( fd, SHUT_RDWR );
+}
+
+
+static void closeStreamSocket( s32 fd ) {
+
+    close( fd );
+}
+
+
+// TCP and local sockets only differ in how they are set up
+const srpcfTransport_t srpcfTcpTransport = {
+
+    .name = "tcp",
+    .listen = listenTcpSocket,
+    .connect = connectTcpSocket,
+    .accept = acceptStreamSocket,
+    .send = sendStreamSocket,
+    .sendSome = sendSomeStreamSocket,
+    .recv = recvStreamSocket,
+    .readiness = pollStreamSocket,
+    .timeout = timeoutStreamSocket,
+    .shutdown = shutdownStreamSocket,
+    .close = closeStreamSocket,
+};
+
+
+const srpcfTransport_t srpcfUnixTransport = {
+
+    .name = "unix",
+    .listen = listenUnixSocket,
+    .connect = connectUnixSocket,
+    .accept = acceptStreamSocket,
+    .send = sendStreamSocket,
+    .sendSome = sendSomeStreamSocket,
+    .recv = recvStreamSocket,
+    .readiness = pollStreamSocket,
+    .timeout = timeoutStreamSocket,
+    .shutdown = shutdownStreamSocket,
+    .close = closeStreamSocket,
+};
+
+
+const srpcfTransport_t *selectSrpcfTransport( const s8 *addr ) {
+
+    if( isLoopSocketAddress( addr ) == TRUE )
+        return &srpcfLoopTransport;
+
+    if( isShmSocketAddress( addr ) == TRUE )
+        return &srpcfShmTransport;
+
+    if( isUnixSocketAddress( addr ) == TRUE )
+        return &srpcfUnixTransport;
+
+    return &srpcfTcpTransport;
+}
+
+
+// Anything that is not a loopback or ring handle is a kernel socket
+const srpcfTransport_t *lookupSrpcfTransport( s32 fd ) {
+
+    if( isLoopSocket( fd ) == TRUE )
+        return &srpcfLoopTransport;
+
+    if( isShmSocket( fd ) == TRUE )
+        return &srpcfShmTransport;
+
+    return &srpcfTcpTransport;
+}
+
+
+s32 initializeSocket( s32 *fd, s8 *addr, s32 port ) {
+
+    return selectSrpcfTransport( addr )->listen( fd, addr, port );
+}
+
+
+s32 connectSocket( s32 *fd, s8 *addr, s32 port ) {
+
+    const srpcfTransport_t *pTransport;
+    s8 unixName[ SRPCF_UNIX_NAME_MAX ];
+
+    pTransport = selectSrpcfTransport( addr );
+    if( pTransport != &srpcfTcpTransport )
+        return pTransport->connect( fd, addr, port );
+
+    // A server on this host also listens locally, that skips the TCP stack
+    // and leaves no TIME_WAIT behind. Older servers only have the port.
+    if( !addr || isLocalSocketAddress( addr ) == TRUE ) {
+
+        snprintf( unixName, sizeof( unixName ), SRPCF_UNIX_NAME, (port <= 0) ? SRPCF_DEF_PORT : port );
+        if( !srpcfUnixTransport.connect( fd, unixName, port ) )
+            return 0;
+    }
+
+    return pTransport->connect( fd, addr, port );
+}
+
+
+// Same as connectSocket(), but a kernel socket comes back non-blocking and
+// may still be connecting. Returns 1 then, the socket turns writable once
+// finishConnectSocket() can tell how it went.
+s32 startConnectSocket( s32 *fd, s8 *addr, s32 port ) {
+
+    const srpcfTransport_t *pTransport;
+    s8 unixName[ SRPCF_UNIX_NAME_MAX ];
+
+    pTransport = selectSrpcfTransport( addr );
+    if( pTransport == &srpcfUnixTransport )
+        return dialUnixSocket( fd, addr, FALSE );
+
+    // In-process and shared memory peers answer right away
+    if( pTransport != &srpcfTcpTransport )
+        return pTransport->connect( fd, addr, port );
+
+    if( !addr || isLocalSocketAddress( addr ) == TRUE ) {
+
+        snprintf( unixName, sizeof( unixName ), SRPCF_UNIX_NAME, (port <= 0) ? SRPCF_DEF_PORT : port );
+        if( !dialUnixSocket( fd, unixName, FALSE ) )
+            return 0;
+    }
+
+    return dialTcpSocket( fd, addr, port, FALSE );
+}
+
+
+s32 finishConnectSocket( s32 fd ) {
+
+    s32 err = 0;
+    socklen_t len = sizeof( err );
+
+    if( getsockopt( fd, SOL_SOCKET, SO_ERROR, &err, &len ) < 0 )
+        return -1;
+
+    if( err ) {
+
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void deinitializeSocket( s32 fd ) {
+
+    lookupSrpcfTransport( fd )->close( fd );
+}
+
+
+s32 acceptSocket( s32 fd, s32 *apsd ) {
+
+    return lookupSrpcfTransport( fd )->accept( fd, apsd );
+}
+
+
+s32 setNonblockSocket( s32 fd ) {
+
+    s32 flags;
+
+    flags = fcntl( fd, F_GETFL, 0 );
+    if( flags < 0 )
+        return -1;
+
+    return fcntl( fd, F_SETFL, flags | O_NONBLOCK );
+}
+
+
+s32 setTimeoutSocket( s32 fd, u32 seconds ) {
+
+    return lookupSrpcfTransport( fd )->timeout( fd, seconds );
+}
+
+
+s32 pollSocket( s32 fd, s16 events, s32 msec ) {
+
+    return lookupSrpcfTransport( fd )->readiness( fd, events, msec );
+}
+
+
+void shutdownSocket( s32 fd ) {
+
+    lookupSrpcfTransport( fd )->shutdown( fd );
+}
+
+
 s32 transferSocket( s32 fd, const void *pktBuf, const u32 length, s32 *wByte ) {
 
-	*wByte = send( fd, pktBuf, length, 0 );
-    if( *wByte != length )
+    struct iovec iov;
+
+    iov.iov_base = (void *)pktBuf;
+    iov.iov_len = length;
+
+    return transferVectorSocket( fd, &iov, 1, wByte );
+}
+
+
+// The vector is advanced past what has been sent, so it is consumed on return
+s32 transferVectorSocket( s32 fd, struct iovec *iov, s32 iovcnt, s32 *wByte ) {
+
+    // Sockets of an event loop queue what does not fit
+    if( hasSrpcfOutput( fd ) == TRUE )
+        return transferSrpcfOutput( fd, iov, iovcnt, -1, wByte );
+
+    return lookupSrpcfTransport( fd )->send( fd, iov, iovcnt, wByte );
+}
+
+
+// Takes what fits without waiting, returns the bytes taken, 0 if full
+s32 transferSomeSocket( s32 fd, const struct iovec *iov, s32 iovcnt ) {
+
+    return lookupSrpcfTransport( fd )->sendSome( fd, iov, iovcnt );
+}
+
+
+s32 receiveSocket( s32 fd, void *pktBuf, const u32 length, s32 *rByte ) {
+
+    const srpcfTransport_t *pTransport = lookupSrpcfTransport( fd );
+    s32 len;
+
+    // Receive until the whole buffer is filled
+    for( *rByte = 0 ; *rByte < length ; *rByte += len ) {
+
+        len = pTransport->recv( fd, (s8 *)pktBuf + *rByte, length - *rByte );
+        if( len > 0 )
+            continue;
+
+        if( len < 0 && errno == EINTR ) {
+
+            len = 0;
+            continue;
+        }
+
+        // Peer has gone, an error occurred or the receive timed out
         return FALSE;
-    
+    }
+
     return TRUE;
 }
 
 
-s32 receiveSocket( s32 fd, void *pktBuf, const u32 length, s32 *rByte ) {
+// One read of whatever has arrived, like recv()
+s32 receiveSomeSocket( s32 fd, void *pktBuf, const u32 length ) {
+
+    return lookupSrpcfTransport( fd )->recv( fd, pktBuf, length );
+}
+
+
+// Descriptors only travel over kernel Unix-domain sockets
+bool canPassRightsSocket( s32 fd ) {
 
-	*rByte = recv( fd, pktBuf, length, 0 );
-    if( *rByte != length )
+    socklen_t len = sizeof( s32 );
+    s32 domain;
+
+    if( lookupSrpcfTransport( fd ) != &srpcfTcpTransport )
         return FALSE;
-    
+
+    if( getsockopt( fd, SOL_SOCKET, SO_DOMAIN, &domain, &len ) < 0 )
+        return FALSE;
+
+    return (domain == AF_UNIX) ? TRUE : FALSE;
+}
+
+
+// One non-blocking sendmsg() with passFd riding on the first byte, returns
+// what went out, 0 if the socket is full
+s32 transferSomeRightsSocket( s32 fd, const struct iovec *iov, s32 iovcnt, s32 passFd ) {
+
+    s8 cmsgBuf[ CMSG_SPACE( sizeof( s32 ) ) ];
+    struct cmsghdr *pCmsg;
+    struct msghdr msg;
+    s32 len;
+
+    memset( cmsgBuf, 0, sizeof( cmsgBuf ) );
+    memset( &msg, 0, sizeof( msg ) );
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = iovcnt;
+    msg.msg_control = cmsgBuf;
+    msg.msg_controllen = sizeof( cmsgBuf );
+
+    pCmsg = CMSG_FIRSTHDR( &msg );
+    pCmsg->cmsg_level = SOL_SOCKET;
+    pCmsg->cmsg_type = SCM_RIGHTS;
+    pCmsg->cmsg_len = CMSG_LEN( sizeof( s32 ) );
+    memcpy( CMSG_DATA( pCmsg ), &passFd, sizeof( s32 ) );
+
+    for( ; ; ) {
+
+        len = sendmsg( fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT );
+        if( len >= 0 )
+            return len;
+
+        if( errno == EINTR )
+            continue;
+
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+}
+
+
+// Same as transferVectorSocket(), with passFd riding on the first byte
+s32 transferRightsSocket( s32 fd, struct iovec *iov, s32 iovcnt, s32 passFd, s32 *wByte ) {
+
+    s32 len;
+
+    // Sockets of an event loop queue what does not fit
+    if( hasSrpcfOutput( fd ) == TRUE )
+        return transferSrpcfOutput( fd, iov, iovcnt, passFd, wByte );
+
+    // Nothing has gone until the first sendmsg() succeeds
+    for( *wByte = 0 ; ; ) {
+
+        len = transferSomeRightsSocket( fd, iov, iovcnt, passFd );
+        if( len > 0 )
+            break;
+
+        if( len < 0 ) {
+
+            *wByte = -1;
+            return FALSE;
+        }
+
+        pollStreamSocket( fd, POLLOUT, -1 );
+    }
+    *wByte = len;
+
+    // The descriptor is across, the rest is ordinary data
+    while( iovcnt && len >= iov->iov_len ) {
+
+        len -= iov->iov_len;
+        iov++;
+        iovcnt--;
+    }
+
+    if( !iovcnt )
+        return TRUE;
+
+    iov->iov_base = (s8 *)iov->iov_base + len;
+    iov->iov_len -= len;
+    if( !sendStreamSocket( fd, iov, iovcnt, &len ) ) {
+
+        *wByte = -1;
+        return FALSE;
+    }
+    *wByte += len;
+
     return TRUE;
 }
 
 
+// Same as receiveSocket(), a descriptor sent along comes back in pPassFd
+s32 receiveRightsSocket( s32 fd, void *pktBuf, const u32 length, s32 *rByte, s32 *pPassFd ) {
+
+    s8 cmsgBuf[ CMSG_SPACE( sizeof( s32 ) ) ];
+    struct cmsghdr *pCmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    s32 len, passFd;
+
+    *pPassFd = -1;
+
+    // Loopback and ring handles cannot carry descriptors
+    if( lookupSrpcfTransport( fd ) != &srpcfTcpTransport )
+        return receiveSocket( fd, pktBuf, length, rByte );
+
+    for( *rByte = 0 ; *rByte < length ; *rByte += len ) {
+
+        memset( &msg, 0, sizeof( msg ) );
+        iov.iov_base = (s8 *)pktBuf + *rByte;
+        iov.iov_len = length - *rByte;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cmsgBuf;
+        msg.msg_controllen = sizeof( cmsgBuf );
+
+        len = recvmsg( fd, &msg, MSG_CMSG_CLOEXEC );
+        if( len <= 0 ) {
+
+            if( len < 0 && errno == EINTR ) {
+
+                len = 0;
+                continue;
+            }
+
+            // Peer has gone, an error occurred or the receive timed out
+            goto ErrExit;
+        }
+
+        // Keep the first descriptor, nobody asked for more
+        for( pCmsg = CMSG_FIRSTHDR( &msg ) ; pCmsg ; pCmsg = CMSG_NXTHDR( &msg, pCmsg ) ) {
+
+            if( pCmsg->cmsg_level != SOL_SOCKET || pCmsg->cmsg_type != SCM_RIGHTS )
+                continue;
+
+            memcpy( &passFd, CMSG_DATA( pCmsg ), sizeof( s32 ) );
+            if( *pPassFd < 0 )
+                *pPassFd = passFd;
+            else
+                close( passFd );
+        }
+    }
+
+    return TRUE;
+
+ErrExit:
+
+    if( *pPassFd >= 0 ) {
+
+        close( *pPassFd );
+        *pPassFd = -1;
+    }
+
+    return FALSE;
+}
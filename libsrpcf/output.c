@@ -0,0 +1,441 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: output.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+
+#include "netsock.h"
+
+
+//
+// Structures
+//
+// Bytes the socket did not take yet, a descriptor rides on the first one
+typedef struct _srpcfOutputChunk {
+
+	struct _srpcfOutputChunk	*next;
+	s32							passFd;
+	u32							length;
+	u32							off;
+	s8							data[ 0 ];
+
+} srpcfOutputChunk_t;
+
+
+// Sending never waits on the socket, whatever does not fit is queued and
+// flushed by the event loop once the socket turns writable. The loop is told
+// through notify when the queue fills up and when it has drained.
+typedef struct _srpcfOutput {
+
+	pthread_mutex_t				lock;
+	pthread_cond_t				cond;
+	srpcfOutputChunk_t			*head;
+	srpcfOutputChunk_t			*tail;
+	u64							pending;
+	u64							limit;
+	bool						canWait;
+	bool						held;
+	bool						broken;
+	bool						linger;
+
+	void						(*notify)( void *, bool );
+	void						*arg;
+
+} srpcfOutput_t;
+
+
+//
+// Global variables
+//
+static srpcfOutput_t *srpcfOutputTbl[ SRPCF_OUTPUT_FDS ];
+static __thread bool srpcfOutputNoWait = FALSE;
+
+
+static srpcfOutput_t *lookupSrpcfOutput( s32 fd ) {
+
+	if( fd < 0 || fd >= SRPCF_OUTPUT_FDS )
+		return NULL;
+
+	return __atomic_load_n( &srpcfOutputTbl[ fd ], __ATOMIC_ACQUIRE );
+}
+
+
+// Caller holds the lock
+static void dropSrpcfOutput( srpcfOutput_t *pOutput ) {
+
+	srpcfOutputChunk_t *pChunk;
+
+	while( (pChunk = pOutput->head) ) {
+
+		pOutput->head = pChunk->next;
+		if( pChunk->passFd >= 0 )
+			close( pChunk->passFd );
+		free( pChunk );
+	}
+	pOutput->tail = NULL;
+
+	if( pOutput->pending )
+		pOutput->notify( pOutput->arg, FALSE );
+	pOutput->pending = 0;
+}
+
+
+// Caller holds the lock, the peer only sees an end of stream
+static void breakSrpcfOutput( s32 fd, srpcfOutput_t *pOutput ) {
+
+	pOutput->broken = TRUE;
+	dropSrpcfOutput( pOutput );
+	pthread_cond_broadcast( &pOutput->cond );
+	shutdownSocket( fd );
+}
+
+
+static s32 sendSrpcfOutput( s32 fd, const struct iovec *iov, s32 iovcnt, s32 passFd ) {
+
+	if( passFd >= 0 )
+		return transferSomeRightsSocket( fd, iov, iovcnt, passFd );
+
+	return transferSomeSocket( fd, iov, iovcnt );
+}
+
+
+// Caller holds the lock
+static bool queueSrpcfOutput( srpcfOutput_t *pOutput, const struct iovec *iov, s32 iovcnt, u32 skip, u32 length, s32 passFd ) {
+
+	srpcfOutputChunk_t *pChunk;
+	u32 off = 0, take;
+	s32 i;
+
+	pChunk = (srpcfOutputChunk_t *)malloc( sizeof( srpcfOutputChunk_t ) + length );
+	if( !pChunk )
+		return FALSE;
+
+	pChunk->next = NULL;
+	pChunk->passFd = -1;
+	pChunk->length = length;
+	pChunk->off = 0;
+
+	// Copy what the socket did not take
+	for( i = 0 ; i < iovcnt ; i++ ) {
+
+		if( skip >= iov[ i ].iov_len ) {
+
+			skip -= iov[ i ].iov_len;
+			continue;
+		}
+
+		take = iov[ i ].iov_len - skip;
+		memcpy( pChunk->data + off, (s8 *)iov[ i ].iov_base + skip, take );
+		off += take;
+		skip = 0;
+	}
+
+	// The descriptor has not gone along yet, the caller keeps its own
+	if( passFd >= 0 ) {
+
+		pChunk->passFd = fcntl( passFd, F_DUPFD_CLOEXEC, 0 );
+		if( pChunk->passFd < 0 ) {
+
+			free( pChunk );
+			return FALSE;
+		}
+	}
+
+	if( pOutput->tail )
+		pOutput->tail->next = pChunk;
+	else
+		pOutput->head = pChunk;
+	pOutput->tail = pChunk;
+
+	if( !pOutput->pending )
+		pOutput->notify( pOutput->arg, TRUE );
+	pOutput->pending += length;
+
+	return TRUE;
+}
+
+
+// Without canWait no sender ever waits for room, the one thread that sends
+// also flushes
+bool attachSrpcfOutput( s32 fd, u64 limit, bool canWait, void (*notify)( void *, bool ), void *arg ) {
+
+	srpcfOutput_t *pOutput;
+
+	if( fd < 0 || fd >= SRPCF_OUTPUT_FDS )
+		return FALSE;
+
+	pOutput = (srpcfOutput_t *)calloc( 1, sizeof( srpcfOutput_t ) );
+	if( !pOutput )
+		return FALSE;
+
+	pthread_mutex_init( &pOutput->lock, NULL );
+	pthread_cond_init( &pOutput->cond, NULL );
+	pOutput->limit = limit;
+	pOutput->canWait = canWait;
+	pOutput->notify = notify;
+	pOutput->arg = arg;
+
+	__atomic_store_n( &srpcfOutputTbl[ fd ], pOutput, __ATOMIC_RELEASE );
+
+	return TRUE;
+}
+
+
+// Nobody may send on the descriptor any more
+void detachSrpcfOutput( s32 fd ) {
+
+	srpcfOutput_t *pOutput;
+
+	pOutput = lookupSrpcfOutput( fd );
+	if( !pOutput )
+		return;
+
+	__atomic_store_n( &srpcfOutputTbl[ fd ], NULL, __ATOMIC_RELEASE );
+
+	pthread_mutex_lock( &pOutput->lock );
+	dropSrpcfOutput( pOutput );
+	pthread_mutex_unlock( &pOutput->lock );
+
+	pthread_mutex_destroy( &pOutput->lock );
+	pthread_cond_destroy( &pOutput->cond );
+	free( pOutput );
+}
+
+
+bool hasSrpcfOutput( s32 fd ) {
+
+	return lookupSrpcfOutput( fd ) ? TRUE : FALSE;
+}
+
+
+// Over the limit, other threads wait for the loop to flush. The loop itself
+// must not, it gives up on the connection instead.
+void configureSrpcfOutputThread( bool canWait ) {
+
+	srpcfOutputNoWait = canWait ? FALSE : TRUE;
+}
+
+
+// Same as transferVectorSocket(), but never waits on the socket
+s32 transferSrpcfOutput( s32 fd, struct iovec *iov, s32 iovcnt, s32 passFd, s32 *wByte ) {
+
+	srpcfOutput_t *pOutput;
+	u32 length = 0;
+	s32 i, len = 0;
+
+	pOutput = lookupSrpcfOutput( fd );
+	if( !pOutput ) {
+
+		errno = EBADF;
+		*wByte = -1;
+		return FALSE;
+	}
+
+	for( i = 0 ; i < iovcnt ; i++ )
+		length += iov[ i ].iov_len;
+
+	pthread_mutex_lock( &pOutput->lock );
+
+	// Room is made by the loop, only threads other than the loop wait for it
+	while( pOutput->broken == FALSE && pOutput->pending
+		&& pOutput->pending + length > pOutput->limit
+		&& pOutput->canWait == TRUE && srpcfOutputNoWait == FALSE )
+		pthread_cond_wait( &pOutput->cond, &pOutput->lock );
+
+	if( pOutput->broken == TRUE ) {
+
+		pthread_mutex_unlock( &pOutput->lock );
+		errno = EPIPE;
+		*wByte = -1;
+		return FALSE;
+	}
+
+	// Straight out while nothing is queued, bytes must not overtake
+	if( !pOutput->head && pOutput->held == FALSE ) {
+
+		len = sendSrpcfOutput( fd, iov, iovcnt, passFd );
+		if( len < 0 ) {
+
+			breakSrpcfOutput( fd, pOutput );
+			pthread_mutex_unlock( &pOutput->lock );
+			*wByte = -1;
+			return FALSE;
+		}
+	}
+
+	if( len < length ) {
+
+		// A reader that stopped reading does not get to pile up memory
+		if( pOutput->pending + (length - len) > pOutput->limit ) {
+
+			DBGPRINT( "Output of socket %d over the limit, giving up\n", fd );
+			breakSrpcfOutput( fd, pOutput );
+			pthread_mutex_unlock( &pOutput->lock );
+			errno = ENOBUFS;
+			*wByte = -1;
+			return FALSE;
+		}
+
+		if( queueSrpcfOutput( pOutput, iov, iovcnt, len, length - len, len ? -1 : passFd ) == FALSE ) {
+
+			breakSrpcfOutput( fd, pOutput );
+			pthread_mutex_unlock( &pOutput->lock );
+			errno = ENOMEM;
+			*wByte = -1;
+			return FALSE;
+		}
+	}
+
+	pthread_mutex_unlock( &pOutput->lock );
+	*wByte = length;
+
+	return TRUE;
+}
+
+
+// Called by the loop, returns 1 while bytes are left, 0 once drained and -1
+// if the connection broke
+s32 flushSrpcfOutput( s32 fd ) {
+
+	srpcfOutput_t *pOutput;
+	srpcfOutputChunk_t *pChunk;
+	struct iovec iov;
+	s32 len, ret;
+
+	pOutput = lookupSrpcfOutput( fd );
+	if( !pOutput )
+		return 0;
+
+	pthread_mutex_lock( &pOutput->lock );
+	if( !pOutput->head || pOutput->held == TRUE ) {
+
+		ret = pOutput->head ? 1 : 0;
+		pthread_mutex_unlock( &pOutput->lock );
+		return ret;
+	}
+
+	while( (pChunk = pOutput->head) ) {
+
+		iov.iov_base = pChunk->data + pChunk->off;
+		iov.iov_len = pChunk->length - pChunk->off;
+		len = sendSrpcfOutput( fd, &iov, 1, pChunk->off ? -1 : pChunk->passFd );
+		if( len < 0 ) {
+
+			breakSrpcfOutput( fd, pOutput );
+			pthread_mutex_unlock( &pOutput->lock );
+			return -1;
+		}
+
+		if( !len )
+			break;
+
+		// The descriptor went along with the first byte
+		if( pChunk->passFd >= 0 ) {
+
+			close( pChunk->passFd );
+			pChunk->passFd = -1;
+		}
+		pChunk->off += len;
+		pOutput->pending -= len;
+		if( pChunk->off < pChunk->length )
+			break;
+
+		pOutput->head = pChunk->next;
+		if( !pOutput->head )
+			pOutput->tail = NULL;
+		free( pChunk );
+	}
+
+	// Let waiting senders in, and tell the loop once there is nothing left
+	pthread_cond_broadcast( &pOutput->cond );
+	ret = pOutput->head ? 1 : 0;
+	if( !ret ) {
+
+		pOutput->notify( pOutput->arg, FALSE );
+		if( pOutput->linger == TRUE )
+			shutdownSocket( fd );
+	}
+
+	pthread_mutex_unlock( &pOutput->lock );
+
+	return ret;
+}
+
+
+// Queue everything until released, e.g. while the socket is still connecting
+void holdSrpcfOutput( s32 fd, bool hold ) {
+
+	srpcfOutput_t *pOutput;
+
+	pOutput = lookupSrpcfOutput( fd );
+	if( !pOutput )
+		return;
+
+	pthread_mutex_lock( &pOutput->lock );
+	pOutput->held = hold;
+	pthread_mutex_unlock( &pOutput->lock );
+}
+
+
+// Hang up once everything queued has gone out
+void lingerSrpcfOutput( s32 fd ) {
+
+	srpcfOutput_t *pOutput;
+
+	pOutput = lookupSrpcfOutput( fd );
+	if( !pOutput ) {
+
+		shutdownSocket( fd );
+		return;
+	}
+
+	pthread_mutex_lock( &pOutput->lock );
+	if( pOutput->head )
+		pOutput->linger = TRUE;
+	else
+		shutdownSocket( fd );
+	pthread_mutex_unlock( &pOutput->lock );
+}
+
+
+// The loop stopped watching, release senders waiting for room
+void abortSrpcfOutput( s32 fd ) {
+
+	srpcfOutput_t *pOutput;
+
+	pOutput = lookupSrpcfOutput( fd );
+	if( !pOutput )
+		return;
+
+	pthread_mutex_lock( &pOutput->lock );
+	pOutput->broken = TRUE;
+	dropSrpcfOutput( pOutput );
+	pthread_cond_broadcast( &pOutput->cond );
+	pthread_mutex_unlock( &pOutput->lock );
+}
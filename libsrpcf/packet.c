@@ -23,6 +23,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 
 #include "srpcf_types.h"
 #include "srpcf.h"
@@ -38,41 +39,94 @@ bool sendSrpcfPacket( s32 *pMxqFd, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt ) {
 }
 
 
+bool sendSrpcfPacketData( s32 *pMxqFd, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt, u32 hdrLen, const void *data, u32 dataLen ) {
+
+    struct iovec iov[ 2 ];
+
+    // The fixed part and the payload go out from where they are
+    iov[ 0 ].iov_base = pSrpcfSvrCommPkt;
+    iov[ 0 ].iov_len = hdrLen;
+    iov[ 1 ].iov_base = (void *)data;
+    iov[ 1 ].iov_len = dataLen;
+
+    return transferSrpcfVector( pMxqFd, iov, (data && dataLen) ? 2 : 1 );
+}
+
+
 srpcfSvrCommPkt_t *recvSrpcfPacket( s32 *pMxqFd ) {
 
     return (srpcfSvrCommPkt_t *)receiveSrpcfFrame( pMxqFd );
 }
 
 
-static void delayForMoment( void ) {
+//
+// Global variables
+//
+static u32 nextSrpcfReqId = 0;
+
+
+u32 allocateSrpcfReqId( void ) {
+
+	u32 srpcfReqId;
+
+	// Zero is never handed out, callers use it for failure
+	do {
 
-	usleep( LIBSRPCF_MSG_DELAY );
+		srpcfReqId = __atomic_add_fetch( &nextSrpcfReqId, 1, __ATOMIC_RELAXED );
+	} while( !srpcfReqId );
+
+	return srpcfReqId;
 }
 
 
-srpcfSvrRspPkt_t *requestSrpcfSupport( s32 *pMsqFd, s32 *pMcqFd ) {
+// Returns the request ID to match the answer with, 0 on failure
+u32 sendSrpcfSupport( s32 *pMsqFd, u32 srpcfCapFlags ) {
 
-    srpcfSvrReqPkt_t srpcfSvrReqPkt;
-    srpcfSvrRspPkt_t *pSrpcfSvrRspPkt;
+    srpcfSvrReqSupport_t srpcfSvrReqSupport;
 
     // Assemble packets
-    srpcfSvrReqPkt.srpcfSvrCommHdr.srpcfOpCode = SRPCF_REQ_QUERY_SUPPORT;
-    srpcfSvrReqPkt.srpcfSvrCommHdr.srpcfPktLen = sizeof( srpcfSvrRspPkt_t );
+    srpcfSvrReqSupport.srpcfSvrCommHdr.srpcfOpCode = SRPCF_REQ_QUERY_SUPPORT;
+    srpcfSvrReqSupport.srpcfSvrCommHdr.srpcfPktLen = sizeof( srpcfSvrReqSupport_t );
+    srpcfSvrReqSupport.srpcfSvrCommHdr.srpcfReqId = allocateSrpcfReqId();
+    srpcfSvrReqSupport.srpcfCapFlags = srpcfCapFlags;
 
     // Send the request
-    if( sendSrpcfPacket( pMsqFd, (srpcfSvrCommPkt_t *)&srpcfSvrReqPkt ) == FALSE ) {
+    if( sendSrpcfPacket( pMsqFd, (srpcfSvrCommPkt_t *)&srpcfSvrReqSupport ) == FALSE )
+        return 0;
 
-        goto ErrExit;
-    }
+    return srpcfSvrReqSupport.srpcfSvrCommHdr.srpcfReqId;
+}
 
-    // Delay for a moment
-	delayForMoment();
+
+bool checkSrpcfSupport( srpcfSvrCommPkt_t *pSrpcfSvrCommPkt, u32 srpcfReqId ) {
+
+    if( pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfPktLen
+			< (sizeof( srpcfSvrSupportedSrpcf_t ) - sizeof( srpcfSupportedNum_t * ))
+        || pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfReqId != srpcfReqId )
+        return FALSE;
+
+    return TRUE;
+}
+
+
+srpcfSvrRspPkt_t *requestSrpcfSupport( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCapFlags ) {
+
+    srpcfSvrRspPkt_t *pSrpcfSvrRspPkt;
+    u32 srpcfReqId;
+
+    // Send the request
+    srpcfReqId = sendSrpcfSupport( pMsqFd, srpcfCapFlags );
+    if( !srpcfReqId )
+        goto ErrExit;
 
     // Receive the response
     pSrpcfSvrRspPkt = (srpcfSvrRspPkt_t *)recvSrpcfPacket( pMcqFd );
-    if( !pSrpcfSvrRspPkt
-        || pSrpcfSvrRspPkt->srpcfSvrCommHdr.srpcfPktLen < sizeof( srpcfSvrRspPkt_t ) ) {
+    if( !pSrpcfSvrRspPkt )
+        goto ErrExit;
+
+    if( checkSrpcfSupport( (srpcfSvrCommPkt_t *)pSrpcfSvrRspPkt, srpcfReqId ) == FALSE ) {
 
+        free( pSrpcfSvrRspPkt );
         goto ErrExit;
     }
 
@@ -84,44 +138,198 @@ ErrExit:
 }
 
 
-bool responseSrpcfSupport( s32 *pMxqFd, srpcfSupported_t *pSrpcfSupported ) {
+bool responseSrpcfSupport( s32 *pMxqFd, u32 srpcfReqId, u32 srpcfCapFlags, u32 srpcfIdleTimeout, const s8 *pluginList, u32 pluginListLen ) {
 
-    bool ret = TRUE;
-    s32 pktSize, srpcfSize, numSrpcfs, sum;
-	s8 *pBuf[ LIBSRPCF_MSG_SIZE ];
-    srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf
-		= (srpcfSvrSupportedSrpcf_t *)pBuf;
+    bool ret;
+    struct iovec iov[ 3 ];
+    s32 numSrpcfs, sum;
+    srpcfSvrSupportedSrpcf_t srpcfSvrSupportedSrpcf;
+    srpcfSupportedNum_t srpcfSupportedNum[ LIBSRPCF_MSG_SIZE / sizeof( srpcfSupportedNum_t ) ];
+    srpcfSupportedNum_t *pSrpcfSupportedNum = srpcfSupportedNum;
+    u32 hdrLen = sizeof( srpcfSvrSupportedSrpcf_t ) - sizeof( srpcfSupportedNum_t * );
 
-	srpcfSupportedNum_t *pSrpcfSupportedNum
-		= (srpcfSupportedNum_t *)&pSrpcfSvrSupportedSrpcf->listOfSupportedSrpcfs;
+    // Collect information, only huge tables need the heap
+    numSrpcfs = numOfSrpcfCmds();
+    if( numSrpcfs > ARRAY_SIZE( srpcfSupportedNum ) ) {
 
-    // Collect information
-    numSrpcfs = countSupportedSRPCFs( pSrpcfSupported );
-    srpcfSize = sizeof( srpcfSupportedNum_t ) * numSrpcfs;
-    pktSize = sizeof( srpcfSvrSupportedSrpcf_t ) + srpcfSize - sizeof( srpcfSupportedNum_t * );
-
-    // Allocate a packet
-	memset( pBuf, 0, LIBSRPCF_MSG_SIZE );
+        pSrpcfSupportedNum = (srpcfSupportedNum_t *)malloc( sizeof( srpcfSupportedNum_t ) * numSrpcfs );
+        if( !pSrpcfSupportedNum )
+            return FALSE;
+    }
 
     // Fill in data
-    pSrpcfSvrSupportedSrpcf->srpcfSvrCommHdr.srpcfOpCode = SRPCF_RSP_QUERY_SUPPORT;
-    pSrpcfSvrSupportedSrpcf->srpcfSvrCommHdr.srpcfPktLen = pktSize;
-    pSrpcfSvrSupportedSrpcf->numOfSupportedSrpcfs = numSrpcfs;
-	for( sum = 0 ; (pSrpcfSupported + sum)->srpcfCmdNo != XR_END_SRPCF ; sum++ ) {
-
-		(pSrpcfSupportedNum + sum)->srpcfCmdNo = (pSrpcfSupported + sum )->srpcfCmdNo;
+    srpcfSvrSupportedSrpcf.srpcfSvrCommHdr.srpcfOpCode = SRPCF_RSP_QUERY_SUPPORT;
+    srpcfSvrSupportedSrpcf.srpcfSvrCommHdr.srpcfPktLen = hdrLen + sizeof( srpcfSupportedNum_t ) * numSrpcfs + pluginListLen;
+    srpcfSvrSupportedSrpcf.srpcfSvrCommHdr.srpcfReqId = srpcfReqId;
+    srpcfSvrSupportedSrpcf.srpcfCapFlags = srpcfCapFlags;
+    srpcfSvrSupportedSrpcf.srpcfIdleTimeout = srpcfIdleTimeout;
+    srpcfSvrSupportedSrpcf.numOfSupportedSrpcfs = numSrpcfs;
+	for( sum = 0 ; sum < numSrpcfs ; sum++ ) {
+
+		(pSrpcfSupportedNum + sum)->srpcfCmdNo = indexSrpcfCmd( sum )->srpcfCmdNo;
 	}
 
-    // Send out the packet
-    if( !sendSrpcfPacket( pMxqFd, (srpcfSvrCommPkt_t *)pSrpcfSvrSupportedSrpcf ) ) {
+    // Send out the packet, the plugin list rides behind the commands
+    iov[ 0 ].iov_base = &srpcfSvrSupportedSrpcf;
+    iov[ 0 ].iov_len = hdrLen;
+    iov[ 1 ].iov_base = pSrpcfSupportedNum;
+    iov[ 1 ].iov_len = sizeof( srpcfSupportedNum_t ) * numSrpcfs;
+    iov[ 2 ].iov_base = (void *)pluginList;
+    iov[ 2 ].iov_len = pluginListLen;
+    ret = transferSrpcfVector( pMxqFd, iov, (pluginList && pluginListLen) ? 3 : 2 );
 
-        ret = FALSE;
-    }
+    if( pSrpcfSupportedNum != srpcfSupportedNum )
+        free( pSrpcfSupportedNum );
 
     return ret;
 }
 
 
+srpcfSvrRspPkt_t *requestSrpcfGeneration( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCapFlags ) {
+
+    srpcfSvrReqSupport_t srpcfSvrReqSupport;
+    srpcfSvrRspPkt_t *pSrpcfSvrRspPkt;
+
+    // Same request as a support query, only the answer is shorter
+    srpcfSvrReqSupport.srpcfSvrCommHdr.srpcfOpCode = SRPCF_REQ_QUERY_GENERATION;
+    srpcfSvrReqSupport.srpcfSvrCommHdr.srpcfPktLen = sizeof( srpcfSvrReqSupport_t );
+    srpcfSvrReqSupport.srpcfSvrCommHdr.srpcfReqId = allocateSrpcfReqId();
+    srpcfSvrReqSupport.srpcfCapFlags = srpcfCapFlags;
+
+    if( sendSrpcfPacket( pMsqFd, (srpcfSvrCommPkt_t *)&srpcfSvrReqSupport ) == FALSE )
+        return NULL;
+
+    // Older servers hang up on opcodes they don't know
+    pSrpcfSvrRspPkt = (srpcfSvrRspPkt_t *)recvSrpcfPacket( pMcqFd );
+    if( !pSrpcfSvrRspPkt )
+        return NULL;
+
+    if( (u32)pSrpcfSvrRspPkt->srpcfSvrCommHdr.srpcfOpCode != SRPCF_RSP_QUERY_GENERATION
+        || pSrpcfSvrRspPkt->srpcfSvrCommHdr.srpcfPktLen < sizeof( srpcfSvrRspGeneration_t )
+        || pSrpcfSvrRspPkt->srpcfSvrCommHdr.srpcfReqId != srpcfSvrReqSupport.srpcfSvrCommHdr.srpcfReqId ) {
+
+        free( pSrpcfSvrRspPkt );
+        return NULL;
+    }
+
+    return pSrpcfSvrRspPkt;
+}
+
+
+bool responseSrpcfGeneration( s32 *pMxqFd, u32 srpcfReqId, u32 srpcfCapFlags, u32 srpcfIdleTimeout, u32 srpcfGeneration ) {
+
+    srpcfSvrRspGeneration_t srpcfSvrRspGeneration;
+
+    srpcfSvrRspGeneration.srpcfSvrCommHdr.srpcfOpCode = SRPCF_RSP_QUERY_GENERATION;
+    srpcfSvrRspGeneration.srpcfSvrCommHdr.srpcfPktLen = sizeof( srpcfSvrRspGeneration_t );
+    srpcfSvrRspGeneration.srpcfSvrCommHdr.srpcfReqId = srpcfReqId;
+    srpcfSvrRspGeneration.srpcfCapFlags = srpcfCapFlags;
+    srpcfSvrRspGeneration.srpcfIdleTimeout = srpcfIdleTimeout;
+    srpcfSvrRspGeneration.srpcfGeneration = srpcfGeneration;
+
+    return sendSrpcfPacket( pMxqFd, (srpcfSvrCommPkt_t *)&srpcfSvrRspGeneration );
+}
+
+
+u32 findSrpcfPluginId( srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf, const s8 *srpcfName ) {
+
+    srpcfSupportedPlugin_t *pSrpcfSupportedPlugin;
+    s8 *p, *end;
+    u32 i, numOfPlugins;
+
+    // Older servers only know plugins by name
+    if( !pSrpcfSvrSupportedSrpcf || !(pSrpcfSvrSupportedSrpcf->srpcfCapFlags & SRPCF_CAP_PLUGIN_ID) )
+        return LIBSRPCF_PLUGIN_NONE;
+
+    p = (s8 *)&pSrpcfSvrSupportedSrpcf->listOfSupportedSrpcfs
+        + sizeof( srpcfSupportedNum_t ) * pSrpcfSvrSupportedSrpcf->numOfSupportedSrpcfs;
+    end = (s8 *)pSrpcfSvrSupportedSrpcf + pSrpcfSvrSupportedSrpcf->srpcfSvrCommHdr.srpcfPktLen;
+    if( p + sizeof( u32 ) > end )
+        return LIBSRPCF_PLUGIN_NONE;
+
+    numOfPlugins = *(u32 *)p;
+    p += sizeof( u32 );
+
+    // Walk the list, never past the packet
+    for( i = 0 ; i < numOfPlugins ; i++ ) {
+
+        pSrpcfSupportedPlugin = (srpcfSupportedPlugin_t *)p;
+        if( p + sizeof( srpcfSupportedPlugin_t ) - sizeof( s8 * ) > end
+            || !pSrpcfSupportedPlugin->nameLength
+            || (s8 *)&pSrpcfSupportedPlugin->namePtr + pSrpcfSupportedPlugin->nameLength > end )
+            break;
+
+        if( !strncmp( (s8 *)&pSrpcfSupportedPlugin->namePtr, srpcfName, pSrpcfSupportedPlugin->nameLength ) )
+            return pSrpcfSupportedPlugin->srpcfPluginId;
+
+        p = (s8 *)&pSrpcfSupportedPlugin->namePtr + pSrpcfSupportedPlugin->nameLength;
+    }
+
+    return LIBSRPCF_PLUGIN_NONE;
+}
+
+
+s32 countCmdOptList( cmdOpt_t *pCmdOpt ) {
+
+	s32 i;
+
+	for( i = 0 ; pCmdOpt ; pCmdOpt = pCmdOpt->next, i++ );
+	return i;
+}
+
+
+void freeCmdOptList( cmdOpt_t *pCmdOpt ) {
+
+	cmdOpt_t *prev;
+
+	// Values belong to the caller, only the nodes are freed
+	for( ; pCmdOpt ; ) {
+
+		prev = pCmdOpt;
+		pCmdOpt = pCmdOpt->next;
+		free( prev );
+	}
+}
+
+
+cmdOpt_t *copyCmdOptList( cmdOpt_t *pCmdOpt ) {
+
+	cmdOpt_t *head = NULL, *tail = NULL, *pCopy;
+
+	// Sending consumes the list, the copy shares the values
+	for( ; pCmdOpt ; pCmdOpt = pCmdOpt->next ) {
+
+		pCopy = (cmdOpt_t *)calloc( 1, sizeof( cmdOpt_t ) );
+		if( !pCopy ) {
+
+			freeCmdOptList( head );
+			return NULL;
+		}
+
+		pCopy->value = pCmdOpt->value;
+		if( tail )
+			tail->next = pCopy;
+		else
+			head = pCopy;
+		tail = pCopy;
+	}
+
+	return head;
+}
+
+
+u32 sizeOfCmdOptObject( cmdOpt_t *pCmdOpt ) {
+
+	u32 sz = 0;
+
+	// Same layout as serializeCmdOptObject() produces
+	for( ; pCmdOpt ; pCmdOpt = pCmdOpt->next )
+		sz += strlen( pCmdOpt->value ) + 1 + sizeof( pCmdOpt->dataLength );
+
+	return sz;
+}
+
+
 u32 serializeCmdOptObject( cmdOpt_t *pCmdOpt, cmdOpt_t *pCmdOptPkt ) {
 
 	u32 sz = 0;
@@ -144,17 +352,26 @@ u32 serializeCmdOptObject( cmdOpt_t *pCmdOpt, cmdOpt_t *pCmdOptPkt ) {
 }
 
 
-bool deserializeCmdOptObject( cmdOpt_t *pCmdOptPkt, u32 numOfCmdOpt ) {
+// Links the serialized options in place. Every option must be terminated and
+// lie before end, the end of the frame or batch entry holding them.
+bool deserializeCmdOptObject( cmdOpt_t *pCmdOptPkt, u32 numOfCmdOpt, const s8 *end ) {
 
-	s32 i;
+	s8 *pData;
+	u64 dataLength;
+	u32 i;
 
 	for( i = 0 ; i < numOfCmdOpt ; i++ ) {
 
+		pData = (s8 *)&pCmdOptPkt->dataPtr;
+		if( pData > end )
+			return FALSE;
+
+		dataLength = pCmdOptPkt->dataLength;
+		if( !dataLength || dataLength > (u64)(end - pData) || pData[ dataLength - 1 ] != '\0' )
+			return FALSE;
+
 		if( (i + 1) < numOfCmdOpt )
-			pCmdOptPkt->next = 
-				(cmdOpt_t *)(((s8 *)pCmdOptPkt) 
-				+ pCmdOptPkt->dataLength 
-				+ sizeof( pCmdOptPkt->dataLength ));
+			pCmdOptPkt->next = (cmdOpt_t *)(pData + dataLength);
 		else
 			pCmdOptPkt->next = NULL;
 
@@ -165,140 +382,536 @@ bool deserializeCmdOptObject( cmdOpt_t *pCmdOptPkt, u32 numOfCmdOpt ) {
 }
 
 
-srpcfSvrRspExecute_t *requestSrpcfExecute( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt ) {
+bool sendSrpcfExecute( s32 *pMsqFd, u32 srpcfReqId, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt ) {
 
-	s8 *pBuf[ LIBSRPCF_MSG_SIZE ];
+	bool ret;
+	s8 pBuf[ LIBSRPCF_MSG_SIZE ];
 	srpcfSvrReqExecute_t *pSrpcfSvrReqExecute = (srpcfSvrReqExecute_t *)pBuf;
-	srpcfSvrRspExecute_t *pSrpcfSvrRspExecute;
-	cmdOpt_t *pCmdOptPkt = (cmdOpt_t *)&pSrpcfSvrReqExecute->listOfCmdOpt;
+	cmdOpt_t *pCmdOptPkt;
+	u32 pktSize;
 
-	// Collect information
-	memset( pBuf, 0, LIBSRPCF_MSG_SIZE );
+	// Collect information, only long option lists need the heap
+	pktSize = sizeof( srpcfSvrReqExecute_t ) + sizeOfCmdOptObject( pCmdOpt );
+	if( pktSize > LIBSRPCF_MSG_SIZE ) {
+
+		pSrpcfSvrReqExecute = (srpcfSvrReqExecute_t *)malloc( pktSize );
+		if( !pSrpcfSvrReqExecute ) {
+
+			freeCmdOptList( pCmdOpt );
+			return FALSE;
+		}
+	}
+	pCmdOptPkt = (cmdOpt_t *)&pSrpcfSvrReqExecute->listOfCmdOpt;
 
     // Assemble packets
     pSrpcfSvrReqExecute->srpcfSvrCommHdr.srpcfOpCode = SRPCF_REQ_EXECUTE;
     pSrpcfSvrReqExecute->srpcfSvrCommHdr.srpcfPktLen =
 		sizeof( srpcfSvrReqExecute_t ) + serializeCmdOptObject( pCmdOpt, pCmdOptPkt ) - sizeof( cmdOpt_t * );
+    pSrpcfSvrReqExecute->srpcfSvrCommHdr.srpcfReqId = srpcfReqId;
 	pSrpcfSvrReqExecute->srpcfCmdNo = srpcfCmdNo;
-	pSrpcfSvrReqExecute->numOfCmdOptList = countLinklist( (commonLinklist_t *)pCmdOpt );
+	pSrpcfSvrReqExecute->numOfCmdOptList = countCmdOptList( pCmdOpt );
 	if( !pSrpcfSvrReqExecute->numOfCmdOptList ) {
 
+		pSrpcfSvrReqExecute->listOfCmdOpt = NULL;
 		pSrpcfSvrReqExecute->srpcfSvrCommHdr.srpcfPktLen += sizeof( cmdOpt_t * );
 	}
 
 	// Free the CmdOpt linklist here, there has been a serialized copy.
-	freeLinklist( (commonLinklist_t *)pCmdOpt );
+	freeCmdOptList( pCmdOpt );
 
     // Send the request
-    if( sendSrpcfPacket( pMsqFd, (srpcfSvrCommPkt_t *)pSrpcfSvrReqExecute ) == FALSE ) {
-
-        goto ErrExit;
-    }
+    ret = sendSrpcfPacket( pMsqFd, (srpcfSvrCommPkt_t *)pSrpcfSvrReqExecute );
 
-    // Delay for a moment
-    delayForMoment();
+	if( (s8 *)pSrpcfSvrReqExecute != pBuf )
+		free( pSrpcfSvrReqExecute );
 
-    // Receive the response
-    pSrpcfSvrRspExecute = (srpcfSvrRspExecute_t *)recvSrpcfPacket( pMcqFd );
-    if( !pSrpcfSvrRspExecute
-        || pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfPktLen < (sizeof( srpcfSvrCommHdr_t ) + sizeof( u32 ) * 2) ) {
-
-        goto ErrExit;
-    }
-
-    return pSrpcfSvrRspExecute;
-
-ErrExit:
-
-    return NULL;
+	return ret;
 }
 
 
-srpcfSvrRspExecute_t *requestSrpcfExecutePlugin( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName ) {
+bool sendSrpcfExecutePlugin( s32 *pMsqFd, u32 srpcfReqId, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName ) {
 
-	s8 *pBuf[ LIBSRPCF_MSG_SIZE ];
+	bool ret;
+	s8 pBuf[ LIBSRPCF_MSG_SIZE ];
 	srpcfSvrReqExecutePlugin_t *pSrpcfSvrReqExecutePlugin = (srpcfSvrReqExecutePlugin_t *)pBuf;
-	srpcfSvrRspExecute_t *pSrpcfSvrRspExecute;
-	cmdOpt_t *pCmdOptPkt = (cmdOpt_t *)&pSrpcfSvrReqExecutePlugin->listOfCmdOpt;
+	cmdOpt_t *pCmdOptPkt;
+	u32 pktSize;
 
-	// Collect information
-	memset( pBuf, 0, LIBSRPCF_MSG_SIZE );
+	// Collect information, only long option lists need the heap
+	pktSize = sizeof( srpcfSvrReqExecutePlugin_t ) + sizeOfCmdOptObject( pCmdOpt );
+	if( pktSize > LIBSRPCF_MSG_SIZE ) {
+
+		pSrpcfSvrReqExecutePlugin = (srpcfSvrReqExecutePlugin_t *)malloc( pktSize );
+		if( !pSrpcfSvrReqExecutePlugin ) {
+
+			freeCmdOptList( pCmdOpt );
+			return FALSE;
+		}
+	}
+	pCmdOptPkt = (cmdOpt_t *)&pSrpcfSvrReqExecutePlugin->listOfCmdOpt;
 
     // Assemble packets
     pSrpcfSvrReqExecutePlugin->srpcfSvrCommHdr.srpcfOpCode = SRPCF_REQ_EXECUTE_PLUGIN;
     pSrpcfSvrReqExecutePlugin->srpcfSvrCommHdr.srpcfPktLen =
 		sizeof( srpcfSvrReqExecutePlugin_t ) + serializeCmdOptObject( pCmdOpt, pCmdOptPkt ) - sizeof( cmdOpt_t * );
+    pSrpcfSvrReqExecutePlugin->srpcfSvrCommHdr.srpcfReqId = srpcfReqId;
 	pSrpcfSvrReqExecutePlugin->srpcfCmdNo = srpcfCmdNo;
-	pSrpcfSvrReqExecutePlugin->numOfCmdOptList = countLinklist( (commonLinklist_t *)pCmdOpt );
+	pSrpcfSvrReqExecutePlugin->numOfCmdOptList = countCmdOptList( pCmdOpt );
 
-	strncpy( pSrpcfSvrReqExecutePlugin->srpcfName, srpcfName, SRPCF_FUNC_MAXLEN );
+	strncpy( pSrpcfSvrReqExecutePlugin->srpcfName, srpcfName, SRPCF_FUNC_MAXLEN - 1 );
+	pSrpcfSvrReqExecutePlugin->srpcfName[ SRPCF_FUNC_MAXLEN - 1 ] = '\0';
 
 	if( !pSrpcfSvrReqExecutePlugin->numOfCmdOptList ) {
 
+		pSrpcfSvrReqExecutePlugin->listOfCmdOpt = NULL;
 		pSrpcfSvrReqExecutePlugin->srpcfSvrCommHdr.srpcfPktLen += sizeof( cmdOpt_t * );
 	}
 
 	// Free the CmdOpt linklist here, there has been a serialized copy.
-	freeLinklist( (commonLinklist_t *)pCmdOpt );
+	freeCmdOptList( pCmdOpt );
 
     // Send the request
-    if( sendSrpcfPacket( pMsqFd, (srpcfSvrCommPkt_t *)pSrpcfSvrReqExecutePlugin ) == FALSE ) {
+    ret = sendSrpcfPacket( pMsqFd, (srpcfSvrCommPkt_t *)pSrpcfSvrReqExecutePlugin );
 
-        goto ErrExit;
-    }
+	if( (s8 *)pSrpcfSvrReqExecutePlugin != pBuf )
+		free( pSrpcfSvrReqExecutePlugin );
 
-    // Delay for a moment
-    delayForMoment();
+	return ret;
+}
 
-    // Receive the response
+
+bool sendSrpcfExecutePluginId( s32 *pMsqFd, u32 srpcfReqId, u32 srpcfPluginId, cmdOpt_t *pCmdOpt ) {
+
+	bool ret;
+	s8 pBuf[ LIBSRPCF_MSG_SIZE ];
+	srpcfSvrReqExecutePluginId_t *pSrpcfSvrReqExecutePluginId = (srpcfSvrReqExecutePluginId_t *)pBuf;
+	cmdOpt_t *pCmdOptPkt;
+	u32 pktSize;
+
+	// Collect information, only long option lists need the heap
+	pktSize = sizeof( srpcfSvrReqExecutePluginId_t ) + sizeOfCmdOptObject( pCmdOpt );
+	if( pktSize > LIBSRPCF_MSG_SIZE ) {
+
+		pSrpcfSvrReqExecutePluginId = (srpcfSvrReqExecutePluginId_t *)malloc( pktSize );
+		if( !pSrpcfSvrReqExecutePluginId ) {
+
+			freeCmdOptList( pCmdOpt );
+			return FALSE;
+		}
+	}
+	pCmdOptPkt = (cmdOpt_t *)&pSrpcfSvrReqExecutePluginId->listOfCmdOpt;
+
+    // Assemble packets
+    pSrpcfSvrReqExecutePluginId->srpcfSvrCommHdr.srpcfOpCode = SRPCF_REQ_EXECUTE_PLUGIN_ID;
+    pSrpcfSvrReqExecutePluginId->srpcfSvrCommHdr.srpcfPktLen =
+		sizeof( srpcfSvrReqExecutePluginId_t ) + serializeCmdOptObject( pCmdOpt, pCmdOptPkt ) - sizeof( cmdOpt_t * );
+    pSrpcfSvrReqExecutePluginId->srpcfSvrCommHdr.srpcfReqId = srpcfReqId;
+	pSrpcfSvrReqExecutePluginId->srpcfPluginId = srpcfPluginId;
+	pSrpcfSvrReqExecutePluginId->numOfCmdOptList = countCmdOptList( pCmdOpt );
+	if( !pSrpcfSvrReqExecutePluginId->numOfCmdOptList ) {
+
+		pSrpcfSvrReqExecutePluginId->listOfCmdOpt = NULL;
+		pSrpcfSvrReqExecutePluginId->srpcfSvrCommHdr.srpcfPktLen += sizeof( cmdOpt_t * );
+	}
+
+	// Free the CmdOpt linklist here, there has been a serialized copy.
+	freeCmdOptList( pCmdOpt );
+
+    // Send the request
+    ret = sendSrpcfPacket( pMsqFd, (srpcfSvrCommPkt_t *)pSrpcfSvrReqExecutePluginId );
+
+	if( (s8 *)pSrpcfSvrReqExecutePluginId != pBuf )
+		free( pSrpcfSvrReqExecutePluginId );
+
+	return ret;
+}
+
+
+srpcfSvrRspExecute_t *recvSrpcfExecute( s32 *pMcqFd ) {
+
+	srpcfSvrRspExecute_t *pSrpcfSvrRspExecute;
+
+    // Receive the response, whichever request it belongs to
     pSrpcfSvrRspExecute = (srpcfSvrRspExecute_t *)recvSrpcfPacket( pMcqFd );
-    if( !pSrpcfSvrRspExecute
-        || pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfPktLen < (sizeof( srpcfSvrCommHdr_t ) + sizeof( u32 ) * 2) ) {
+    if( !pSrpcfSvrRspExecute )
+        return NULL;
 
-        goto ErrExit;
+    if( pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfPktLen
+			< (((u32)pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfOpCode == SRPCF_RSP_EXECUTE_BATCH)
+				? (sizeof( srpcfSvrRspExecuteBatch_t ) - sizeof( srpcfBatchResult_t * ))
+				: (sizeof( srpcfSvrRspExecute_t ) - sizeof( pSrpcfSvrRspExecute->dataPtr ))) ) {
+
+        free( pSrpcfSvrRspExecute );
+        return NULL;
     }
 
     return pSrpcfSvrRspExecute;
+}
+
+
+static srpcfSvrRspExecute_t *waitSrpcfExecute( s32 *pMcqFd, u32 srpcfReqId, void (*pChunkFunc)(const s8 *, u32) ) {
+
+	srpcfSvrRspExecute_t *pSrpcfSvrRspExecute;
+
+    for( ; ; ) {
+
+        // Nothing else is outstanding on this socket, so the IDs must match
+        pSrpcfSvrRspExecute = recvSrpcfExecute( pMcqFd );
+        if( !pSrpcfSvrRspExecute )
+            return NULL;
+
+        if( pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfReqId != srpcfReqId ) {
+
+            DBGPRINT( "Response for request %u while waiting for %u\n",
+                pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfReqId, srpcfReqId );
+            releaseSrpcfResponse( pSrpcfSvrRspExecute );
+            return NULL;
+        }
+
+        // Anything but a chunk completes the request
+        if( (u32)pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfOpCode != SRPCF_RSP_EXECUTE_CHUNK )
+            return pSrpcfSvrRspExecute;
+
+        if( pSrpcfSvrRspExecute->dataLength > (pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfPktLen
+                - (sizeof( srpcfSvrRspExecute_t ) - sizeof( pSrpcfSvrRspExecute->dataPtr ))) ) {
+
+            DBGPRINT( "Invalid chunk of %u bytes\n", pSrpcfSvrRspExecute->dataLength );
+            free( pSrpcfSvrRspExecute );
+            return NULL;
+        }
+
+        // Hand over the chunk as it arrives
+        if( pChunkFunc )
+            pChunkFunc( (s8 *)&pSrpcfSvrRspExecute->dataPtr, pSrpcfSvrRspExecute->dataLength );
+        free( pSrpcfSvrRspExecute );
+    }
+}
+
+
+srpcfSvrRspExecute_t *requestSrpcfExecute( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt ) {
+
+	u32 srpcfReqId = allocateSrpcfReqId();
+
+    // Send the request
+    if( sendSrpcfExecute( pMsqFd, srpcfReqId, srpcfCmdNo, pCmdOpt ) == FALSE )
+        return NULL;
+
+    // Receive the response
+    return waitSrpcfExecute( pMcqFd, srpcfReqId, NULL );
+}
+
+
+srpcfSvrRspExecute_t *requestSrpcfExecutePlugin( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName ) {
+
+	u32 srpcfReqId = allocateSrpcfReqId();
+
+    // Send the request
+    if( sendSrpcfExecutePlugin( pMsqFd, srpcfReqId, srpcfCmdNo, pCmdOpt, srpcfName ) == FALSE )
+        return NULL;
+
+    // Receive the response
+    return waitSrpcfExecute( pMcqFd, srpcfReqId, NULL );
+}
+
+
+srpcfSvrRspExecute_t *requestSrpcfExecuteStream( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName, void (*pChunkFunc)(const s8 *, u32) ) {
+
+	bool ret;
+	u32 srpcfReqId = allocateSrpcfReqId();
+
+    // Send the request, plugins are called by name
+    if( srpcfName )
+        ret = sendSrpcfExecutePlugin( pMsqFd, srpcfReqId, srpcfCmdNo, pCmdOpt, srpcfName );
+    else
+        ret = sendSrpcfExecute( pMsqFd, srpcfReqId, srpcfCmdNo, pCmdOpt );
+
+    if( ret == FALSE )
+        return NULL;
+
+    // Receive chunks until the final response
+    return waitSrpcfExecute( pMcqFd, srpcfReqId, pChunkFunc );
+}
+
+
+bool responseSrpcfExecute( s32 *pMxqFd, u32 srpcfReqId, u32 srpcfCmdNo, u32 errorCode, s8 *dataRst ) {
+
+    u32 hdrLen, strLen = 0;
+    srpcfSvrRspExecute_t srpcfSvrRspExecute;
+
+    // Collect information
+    if( dataRst )
+        strLen = strlen( dataRst ) + 1;
+
+    hdrLen = sizeof( srpcfSvrRspExecute_t ) - sizeof( srpcfSvrRspExecute.dataPtr );
+
+    // Tell the client rather than let the receiver drop the connection
+    if( (hdrLen + strLen) > limitOfSrpcfMessage() ) {
+
+        DBGPRINT( "Result of %u bytes exceeds the message limit\n", strLen );
+        strLen = 0;
+        dataRst = NULL;
+        errorCode = SRPCF_FAILED_NOMEM;
+    }
+
+    // Fill in data
+    srpcfSvrRspExecute.srpcfSvrCommHdr.srpcfOpCode = SRPCF_RSP_EXECUTE;
+    srpcfSvrRspExecute.srpcfSvrCommHdr.srpcfPktLen = hdrLen + strLen;
+    srpcfSvrRspExecute.srpcfSvrCommHdr.srpcfReqId = srpcfReqId;
+    srpcfSvrRspExecute.srpcfErrorCode = errorCode;
+    srpcfSvrRspExecute.dataLength = strLen;
+
+    // Send out the packet, the result goes out of the executor's buffer
+    return sendSrpcfPacketData( pMxqFd, (srpcfSvrCommPkt_t *)&srpcfSvrRspExecute, hdrLen, dataRst, strLen );
+}
+
+
+bool responseSrpcfChunk( s32 *pMxqFd, u32 srpcfReqId, const s8 *data, u32 length ) {
+
+    u32 hdrLen;
+    srpcfSvrRspExecute_t srpcfSvrRspExecute;
+
+    hdrLen = sizeof( srpcfSvrRspExecute_t ) - sizeof( srpcfSvrRspExecute.dataPtr );
+
+    // Fill in data, a chunk is raw bytes without a terminator
+    srpcfSvrRspExecute.srpcfSvrCommHdr.srpcfOpCode = SRPCF_RSP_EXECUTE_CHUNK;
+    srpcfSvrRspExecute.srpcfSvrCommHdr.srpcfPktLen = hdrLen + length;
+    srpcfSvrRspExecute.srpcfSvrCommHdr.srpcfReqId = srpcfReqId;
+    srpcfSvrRspExecute.srpcfErrorCode = SRPCF_SUCCESSFUL;
+    srpcfSvrRspExecute.dataLength = length;
+
+    // Send out the packet
+    return sendSrpcfPacketData( pMxqFd, (srpcfSvrCommPkt_t *)&srpcfSvrRspExecute, hdrLen, data, length );
+}
+
+
+bool sendSrpcfExecuteBatch( s32 *pMsqFd, u32 srpcfReqId, srpcfBatch_t *pSrpcfBatch, u32 numOfBatch ) {
+
+	bool ret = FALSE;
+	s8 pBuf[ LIBSRPCF_MSG_SIZE ];
+	srpcfSvrReqExecuteBatch_t *pSrpcfSvrReqExecuteBatch = (srpcfSvrReqExecuteBatch_t *)pBuf;
+	srpcfBatchEntry_t *pSrpcfBatchEntry;
+	u32 i, pktLen, entryLength;
+
+	// Collect information, only large batches need the heap
+	pktLen = sizeof( srpcfSvrReqExecuteBatch_t );
+	for( i = 0 ; i < numOfBatch ; i++ )
+		pktLen += sizeof( srpcfBatchEntry_t ) + sizeOfCmdOptObject( pSrpcfBatch[ i ].pCmdOpt );
+
+	if( pktLen > LIBSRPCF_MSG_SIZE ) {
+
+		pSrpcfSvrReqExecuteBatch = (srpcfSvrReqExecuteBatch_t *)malloc( pktLen );
+		if( !pSrpcfSvrReqExecuteBatch )
+			goto ErrExit;
+	}
+	memset( pSrpcfSvrReqExecuteBatch, 0, pktLen );
+	pSrpcfBatchEntry = (srpcfBatchEntry_t *)&pSrpcfSvrReqExecuteBatch->listOfEntries;
+	pktLen = sizeof( srpcfSvrReqExecuteBatch_t ) - sizeof( srpcfBatchEntry_t * );
+
+	// Entries are packed back to back, each one knows its own length
+	for( i = 0 ; i < numOfBatch ; i++ ) {
+
+		entryLength = sizeof( srpcfBatchEntry_t ) - sizeof( cmdOpt_t * )
+			+ sizeOfCmdOptObject( pSrpcfBatch[ i ].pCmdOpt );
+
+		pSrpcfBatchEntry->entryLength = entryLength;
+		pSrpcfBatchEntry->srpcfCmdNo = pSrpcfBatch[ i ].srpcfCmdNo;
+		pSrpcfBatchEntry->numOfCmdOptList = countCmdOptList( pSrpcfBatch[ i ].pCmdOpt );
+		if( pSrpcfBatch[ i ].srpcfName )
+			strncpy( pSrpcfBatchEntry->srpcfName, pSrpcfBatch[ i ].srpcfName, SRPCF_FUNC_MAXLEN - 1 );
+		serializeCmdOptObject( pSrpcfBatch[ i ].pCmdOpt, (cmdOpt_t *)&pSrpcfBatchEntry->listOfCmdOpt );
+
+		// Move to next offset
+		pktLen += entryLength;
+		pSrpcfBatchEntry = (srpcfBatchEntry_t *)(((s8 *)pSrpcfBatchEntry) + entryLength);
+	}
+
+    // Assemble packets
+    pSrpcfSvrReqExecuteBatch->srpcfSvrCommHdr.srpcfOpCode = SRPCF_REQ_EXECUTE_BATCH;
+    pSrpcfSvrReqExecuteBatch->srpcfSvrCommHdr.srpcfPktLen = pktLen;
+    pSrpcfSvrReqExecuteBatch->srpcfSvrCommHdr.srpcfReqId = srpcfReqId;
+	pSrpcfSvrReqExecuteBatch->numOfEntries = numOfBatch;
+
+    // Send the request
+    ret = sendSrpcfPacket( pMsqFd, (srpcfSvrCommPkt_t *)pSrpcfSvrReqExecuteBatch );
+
+	if( (s8 *)pSrpcfSvrReqExecuteBatch != pBuf )
+		free( pSrpcfSvrReqExecuteBatch );
 
 ErrExit:
 
-    return NULL;
+	// Free the CmdOpt linklists here, there have been serialized copies.
+	for( i = 0 ; i < numOfBatch ; i++ ) {
+
+		freeCmdOptList( pSrpcfBatch[ i ].pCmdOpt );
+		pSrpcfBatch[ i ].pCmdOpt = NULL;
+	}
+
+	return ret;
 }
 
 
-bool responseSrpcfExecute( s32 *pMxqFd, u32 srpcfCmdNo, u32 errorCode, s8 *dataRst ) {
+srpcfSvrRspExecuteBatch_t *requestSrpcfExecuteBatch( s32 *pMsqFd, s32 *pMcqFd, srpcfBatch_t *pSrpcfBatch, u32 numOfBatch ) {
+
+	u32 srpcfReqId = allocateSrpcfReqId();
 
-    bool ret = TRUE;
-    s32 pktSize, strLen = 0;
-    s8 *pBuf[ LIBSRPCF_MSG_SIZE ];
-	srpcfSvrRspExecute_t *pSrpcfSvrRspExecute = (srpcfSvrRspExecute_t *)pBuf;
+    // Send the request
+    if( sendSrpcfExecuteBatch( pMsqFd, srpcfReqId, pSrpcfBatch, numOfBatch ) == FALSE )
+        return NULL;
+
+    // Receive the response
+    return (srpcfSvrRspExecuteBatch_t *)waitSrpcfExecute( pMcqFd, srpcfReqId, NULL );
+}
+
+
+srpcfBatchEntry_t *nextSrpcfBatchEntry( srpcfSvrReqExecuteBatch_t *pSrpcfSvrReqExecuteBatch, srpcfBatchEntry_t *pSrpcfBatchEntry ) {
+
+	s8 *pEnd = ((s8 *)pSrpcfSvrReqExecuteBatch) + pSrpcfSvrReqExecuteBatch->srpcfSvrCommHdr.srpcfPktLen;
+	u32 minLength = sizeof( srpcfBatchEntry_t ) - sizeof( cmdOpt_t * );
+
+	// Start from the first entry, or step over the current one
+	if( !pSrpcfBatchEntry )
+		pSrpcfBatchEntry = (srpcfBatchEntry_t *)&pSrpcfSvrReqExecuteBatch->listOfEntries;
+	else
+		pSrpcfBatchEntry = (srpcfBatchEntry_t *)(((s8 *)pSrpcfBatchEntry) + pSrpcfBatchEntry->entryLength);
+
+	// The entry must lie within the frame
+	if( (((s8 *)pSrpcfBatchEntry) + minLength) > pEnd
+		|| pSrpcfBatchEntry->entryLength < minLength
+		|| (((s8 *)pSrpcfBatchEntry) + pSrpcfBatchEntry->entryLength) > pEnd ) {
+
+		DBGPRINT( "Invalid batch entry\n" );
+		return NULL;
+	}
+
+	// Never trust the peer to terminate the name
+	pSrpcfBatchEntry->srpcfName[ SRPCF_FUNC_MAXLEN - 1 ] = '\0';
+
+	return pSrpcfBatchEntry;
+}
+
+
+bool appendSrpcfBatchResult( srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch, u32 size, u32 errorCode, s8 *dataRst ) {
+
+	srpcfBatchResult_t *pSrpcfBatchResult;
+	u32 resultLength, strLen = 0;
 
     // Collect information
 	if( dataRst )
 		strLen = strlen( dataRst ) + 1;
 
-    pktSize = sizeof( srpcfSvrRspExecute_t ) 
-				- sizeof( pSrpcfSvrRspExecute->dataPtr ) + strLen;
-	if( pktSize > LIBSRPCF_MSG_SIZE )
+	resultLength = sizeof( srpcfBatchResult_t ) - sizeof( pSrpcfBatchResult->dataPtr ) + strLen;
+	if( (pSrpcfSvrRspExecuteBatch->srpcfSvrCommHdr.srpcfPktLen + resultLength) > size )
 		return FALSE;
 
-    // Allocate a packet
-    memset( pBuf, 0, LIBSRPCF_MSG_SIZE );
+	// Fill in data at the end of the frame
+	pSrpcfBatchResult = (srpcfBatchResult_t *)(((s8 *)pSrpcfSvrRspExecuteBatch)
+		+ pSrpcfSvrRspExecuteBatch->srpcfSvrCommHdr.srpcfPktLen);
+	pSrpcfBatchResult->resultLength = resultLength;
+	pSrpcfBatchResult->srpcfErrorCode = errorCode;
+	pSrpcfBatchResult->dataLength = strLen;
+	if( dataRst )
+		memcpy( &pSrpcfBatchResult->dataPtr, dataRst, strLen );
 
-    // Fill in data
-    pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfOpCode = SRPCF_RSP_EXECUTE;
-    pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfPktLen = pktSize;
-    pSrpcfSvrRspExecute->srpcfErrorCode = errorCode;
-	pSrpcfSvrRspExecute->dataLength = strLen;
+	pSrpcfSvrRspExecuteBatch->srpcfSvrCommHdr.srpcfPktLen += resultLength;
+	pSrpcfSvrRspExecuteBatch->numOfResults++;
 
-	if( dataRst )
-		memcpy( &pSrpcfSvrRspExecute->dataPtr, dataRst, strLen );
+	return TRUE;
+}
 
-    // Send out the packet
-    if( !sendSrpcfPacket( pMxqFd, (srpcfSvrCommPkt_t *)pSrpcfSvrRspExecute ) )
-        ret = FALSE;
 
-    return ret;
+srpcfBatchResult_t *nextSrpcfBatchResult( srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch, srpcfBatchResult_t *pSrpcfBatchResult ) {
+
+	s8 *pEnd = ((s8 *)pSrpcfSvrRspExecuteBatch) + pSrpcfSvrRspExecuteBatch->srpcfSvrCommHdr.srpcfPktLen;
+	u32 minLength = sizeof( srpcfBatchResult_t ) - sizeof( pSrpcfBatchResult->dataPtr );
+
+	// Start from the first result, or step over the current one
+	if( !pSrpcfBatchResult )
+		pSrpcfBatchResult = (srpcfBatchResult_t *)&pSrpcfSvrRspExecuteBatch->listOfResults;
+	else
+		pSrpcfBatchResult = (srpcfBatchResult_t *)(((s8 *)pSrpcfBatchResult) + pSrpcfBatchResult->resultLength);
+
+	// The result must lie within the frame
+	if( (((s8 *)pSrpcfBatchResult) + minLength) > pEnd
+		|| pSrpcfBatchResult->resultLength < (minLength + pSrpcfBatchResult->dataLength)
+		|| (((s8 *)pSrpcfBatchResult) + pSrpcfBatchResult->resultLength) > pEnd )
+		return NULL;
+
+	return pSrpcfBatchResult;
+}
+
+
+srpcfSvrRspExecute_t *requestSrpcfExecutePluginId( s32 *pMsqFd, s32 *pMcqFd, u32 srpcfPluginId, cmdOpt_t *pCmdOpt, void (*pChunkFunc)(const s8 *, u32) ) {
+
+	u32 srpcfReqId = allocateSrpcfReqId();
+
+    // Send the request
+    if( sendSrpcfExecutePluginId( pMsqFd, srpcfReqId, srpcfPluginId, pCmdOpt ) == FALSE )
+        return NULL;
+
+    // Receive chunks until the final response
+    return waitSrpcfExecute( pMcqFd, srpcfReqId, pChunkFunc );
+}
+
+
+bool sendSrpcfExecuteRelay( s32 *pMsqFd, u32 srpcfReqId, const s8 *targets, u32 targetLength, u32 srpcfDeadline, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName ) {
+
+	bool ret = FALSE;
+	s8 pBuf[ LIBSRPCF_MSG_SIZE ];
+	srpcfSvrReqExecuteRelay_t *pSrpcfSvrReqExecuteRelay = (srpcfSvrReqExecuteRelay_t *)pBuf;
+	s8 *pTargets;
+	u32 pktLen;
+
+	// Collect information, only long target lists need the heap
+	pktLen = sizeof( srpcfSvrReqExecuteRelay_t ) - sizeof( s8 * )
+		+ targetLength + 1 + sizeOfCmdOptObject( pCmdOpt );
+	if( pktLen > LIBSRPCF_MSG_SIZE ) {
+
+		pSrpcfSvrReqExecuteRelay = (srpcfSvrReqExecuteRelay_t *)malloc( pktLen );
+		if( !pSrpcfSvrReqExecuteRelay )
+			goto ErrExit;
+	}
+	memset( pSrpcfSvrReqExecuteRelay, 0, sizeof( srpcfSvrReqExecuteRelay_t ) );
+
+	// The target list is terminated, the options follow it
+	pTargets = (s8 *)&pSrpcfSvrReqExecuteRelay->targetPtr;
+	memcpy( pTargets, targets, targetLength );
+	pTargets[ targetLength ] = '\0';
+	serializeCmdOptObject( pCmdOpt, (cmdOpt_t *)(pTargets + targetLength + 1) );
+
+    // Assemble packets
+    pSrpcfSvrReqExecuteRelay->srpcfSvrCommHdr.srpcfOpCode = SRPCF_REQ_EXECUTE_RELAY;
+    pSrpcfSvrReqExecuteRelay->srpcfSvrCommHdr.srpcfPktLen = pktLen;
+    pSrpcfSvrReqExecuteRelay->srpcfSvrCommHdr.srpcfReqId = srpcfReqId;
+	pSrpcfSvrReqExecuteRelay->srpcfDeadline = srpcfDeadline;
+	pSrpcfSvrReqExecuteRelay->srpcfCmdNo = srpcfCmdNo;
+	pSrpcfSvrReqExecuteRelay->numOfCmdOptList = countCmdOptList( pCmdOpt );
+	pSrpcfSvrReqExecuteRelay->targetLength = targetLength + 1;
+	if( srpcfName )
+		strncpy( pSrpcfSvrReqExecuteRelay->srpcfName, srpcfName, SRPCF_FUNC_MAXLEN - 1 );
+
+    // Send the request
+    ret = sendSrpcfPacket( pMsqFd, (srpcfSvrCommPkt_t *)pSrpcfSvrReqExecuteRelay );
+
+	if( (s8 *)pSrpcfSvrReqExecuteRelay != pBuf )
+		free( pSrpcfSvrReqExecuteRelay );
+
+ErrExit:
+
+	// Free the CmdOpt linklist here, there has been a serialized copy.
+	freeCmdOptList( pCmdOpt );
+
+	return ret;
 }
 
 
+srpcfSvrRspExecuteBatch_t *requestSrpcfExecuteRelay( s32 *pMsqFd, s32 *pMcqFd, const s8 *targets, u32 targetLength, u32 srpcfDeadline, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName ) {
+
+	u32 srpcfReqId = allocateSrpcfReqId();
+
+    // Send the request
+    if( sendSrpcfExecuteRelay( pMsqFd, srpcfReqId, targets, targetLength, srpcfDeadline, srpcfCmdNo, pCmdOpt, srpcfName ) == FALSE )
+        return NULL;
+
+    // Receive the merged response
+    return (srpcfSvrRspExecuteBatch_t *)waitSrpcfExecute( pMcqFd, srpcfReqId, NULL );
+}
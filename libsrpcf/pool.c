@@ -0,0 +1,280 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: pool.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+
+
+//
+// A pool hands out sessions to one server, each owned by a single thread
+// between checkout and checkin. Idle sessions sit in a fixed table whose
+// slots are taken and filled with atomic exchanges, so threads only meet
+// on the lock once the pool is exhausted and they have to wait.
+//
+static u64 getMonotonicSeconds( void ) {
+
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec;
+}
+
+
+static srpcfSession_t *takeIdleSrpcfPool( srpcfPool_t *pSrpcfPool ) {
+
+	srpcfSession_t *pSrpcfSession;
+	u32 i;
+
+	for( i = 0 ; i < pSrpcfPool->maxIdle ; i++ ) {
+
+		if( !__atomic_load_n( &pSrpcfPool->idleTbl[ i ], __ATOMIC_RELAXED ) )
+			continue;
+
+		pSrpcfSession = __atomic_exchange_n( &pSrpcfPool->idleTbl[ i ], NULL, __ATOMIC_ACQUIRE );
+		if( pSrpcfSession )
+			return pSrpcfSession;
+	}
+
+	return NULL;
+}
+
+
+static bool putIdleSrpcfPool( srpcfPool_t *pSrpcfPool, srpcfSession_t *pSrpcfSession ) {
+
+	srpcfSession_t *pEmpty;
+	u32 i;
+
+	for( i = 0 ; i < pSrpcfPool->maxIdle ; i++ ) {
+
+		pEmpty = NULL;
+		if( __atomic_compare_exchange_n( &pSrpcfPool->idleTbl[ i ], &pEmpty, pSrpcfSession,
+				FALSE, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) )
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+static bool reserveSrpcfPool( srpcfPool_t *pSrpcfPool ) {
+
+	u32 numOfTotal = __atomic_load_n( &pSrpcfPool->numOfTotal, __ATOMIC_RELAXED );
+
+	// Count it before creating it, so the limit holds under contention
+	do {
+
+		if( numOfTotal >= pSrpcfPool->maxTotal )
+			return FALSE;
+	} while( !__atomic_compare_exchange_n( &pSrpcfPool->numOfTotal, &numOfTotal, numOfTotal + 1,
+				TRUE, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) );
+
+	return TRUE;
+}
+
+
+static void wakeSrpcfPool( srpcfPool_t *pSrpcfPool, bool locked ) {
+
+	// Waiters announce themselves under the lock before their last look
+	if( !__atomic_load_n( &pSrpcfPool->numOfWaiters, __ATOMIC_SEQ_CST ) )
+		return;
+
+	if( locked == TRUE ) {
+
+		pthread_cond_broadcast( &pSrpcfPool->cond );
+		return;
+	}
+
+	pthread_mutex_lock( &pSrpcfPool->lock );
+	pthread_cond_broadcast( &pSrpcfPool->cond );
+	pthread_mutex_unlock( &pSrpcfPool->lock );
+}
+
+
+static srpcfSession_t *obtainSrpcfPool( srpcfPool_t *pSrpcfPool, bool locked ) {
+
+	srpcfSession_t *pSrpcfSession;
+
+	pSrpcfSession = takeIdleSrpcfPool( pSrpcfPool );
+	if( pSrpcfSession )
+		return pSrpcfSession;
+
+	if( reserveSrpcfPool( pSrpcfPool ) == FALSE )
+		return NULL;
+
+	// Connected by its first request, capabilities are kept with it
+	pSrpcfSession = createSrpcfSession( pSrpcfPool->addr, pSrpcfPool->port );
+	if( !pSrpcfSession ) {
+
+		__atomic_fetch_sub( &pSrpcfPool->numOfTotal, 1, __ATOMIC_SEQ_CST );
+		wakeSrpcfPool( pSrpcfPool, locked );
+	}
+
+	return pSrpcfSession;
+}
+
+
+static srpcfSession_t *probeIdleSrpcfPool( srpcfSession_t *pSrpcfSession ) {
+
+	// The server may have hung up while it sat idle, checked outside the lock
+	if( pSrpcfSession && pSrpcfSession->lastUsed + LIBSRPCF_POOL_PROBE <= getMonotonicSeconds() )
+		probeSrpcfSession( pSrpcfSession );
+
+	return pSrpcfSession;
+}
+
+
+srpcfPool_t *createSrpcfPool( s8 *addr, s32 port, u32 maxIdle, u32 maxTotal ) {
+
+	srpcfPool_t *pSrpcfPool;
+	pthread_condattr_t attr;
+
+	// Allocate a pool
+	pSrpcfPool = (srpcfPool_t *)malloc( sizeof( srpcfPool_t ) );
+	if( !pSrpcfPool )
+		return NULL;
+	memset( pSrpcfPool, 0, sizeof( srpcfPool_t ) );
+
+	// Fill in the data
+	pSrpcfPool->port = port;
+	pSrpcfPool->maxTotal = maxTotal ? maxTotal : LIBSRPCF_POOL_TOTAL;
+	pSrpcfPool->maxIdle = maxIdle ? maxIdle : LIBSRPCF_POOL_IDLE;
+	if( pSrpcfPool->maxIdle > pSrpcfPool->maxTotal )
+		pSrpcfPool->maxIdle = pSrpcfPool->maxTotal;
+
+	pSrpcfPool->addr = mallocStringBuffer( addr );
+
+	pSrpcfPool->idleTbl = (srpcfSession_t **)calloc( pSrpcfPool->maxIdle, sizeof( srpcfSession_t * ) );
+	if( !pSrpcfPool->idleTbl )
+		goto ErrExit;
+
+	// Waits are measured on the monotonic clock
+	pthread_mutex_init( &pSrpcfPool->lock, NULL );
+	pthread_condattr_init( &attr );
+	pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+	pthread_cond_init( &pSrpcfPool->cond, &attr );
+	pthread_condattr_destroy( &attr );
+
+	return pSrpcfPool;
+
+ErrExit:
+
+	if( pSrpcfPool->addr )
+		free( pSrpcfPool->addr );
+	free( pSrpcfPool );
+	return NULL;
+}
+
+
+// Every session checked out must be checked in first
+void destroySrpcfPool( srpcfPool_t *pSrpcfPool ) {
+
+	srpcfSession_t *pSrpcfSession;
+
+	if( !pSrpcfPool )
+		return;
+
+	while( (pSrpcfSession = takeIdleSrpcfPool( pSrpcfPool )) )
+		closeSrpcfSession( pSrpcfSession );
+
+	// Free resource
+	pthread_cond_destroy( &pSrpcfPool->cond );
+	pthread_mutex_destroy( &pSrpcfPool->lock );
+	free( pSrpcfPool->idleTbl );
+	if( pSrpcfPool->addr )
+		free( pSrpcfPool->addr );
+	free( pSrpcfPool );
+}
+
+
+// Waits up to msec for a session once maxTotal are out, forever if negative
+srpcfSession_t *checkoutSrpcfPool( srpcfPool_t *pSrpcfPool, s32 msec ) {
+
+	srpcfSession_t *pSrpcfSession;
+	struct timespec ts;
+	s32 ret = 0;
+
+	// The common case never takes the lock
+	pSrpcfSession = obtainSrpcfPool( pSrpcfPool, FALSE );
+	if( pSrpcfSession || !msec )
+		return probeIdleSrpcfPool( pSrpcfSession );
+
+	if( msec > 0 ) {
+
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		ts.tv_sec += msec / 1000;
+		ts.tv_nsec += (msec % 1000) * 1000000;
+		if( ts.tv_nsec >= 1000000000 ) {
+
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock( &pSrpcfPool->lock );
+	__atomic_fetch_add( &pSrpcfPool->numOfWaiters, 1, __ATOMIC_SEQ_CST );
+
+	// Look again after announcing, a checkin may have slipped in between
+	while( !(pSrpcfSession = obtainSrpcfPool( pSrpcfPool, TRUE )) && ret != ETIMEDOUT ) {
+
+		if( msec > 0 )
+			ret = pthread_cond_timedwait( &pSrpcfPool->cond, &pSrpcfPool->lock, &ts );
+		else
+			pthread_cond_wait( &pSrpcfPool->cond, &pSrpcfPool->lock );
+	}
+
+	__atomic_fetch_sub( &pSrpcfPool->numOfWaiters, 1, __ATOMIC_SEQ_CST );
+	pthread_mutex_unlock( &pSrpcfPool->lock );
+
+	return probeIdleSrpcfPool( pSrpcfSession );
+}
+
+
+void checkinSrpcfPool( srpcfPool_t *pSrpcfPool, srpcfSession_t *pSrpcfSession ) {
+
+	if( !pSrpcfSession )
+		return;
+
+	// Responses still owed would end up with the next borrower
+	if( pSrpcfSession->numOfInflight || pSrpcfSession->pendingHead || pSrpcfSession->pSrpcfAsync )
+		goto Discard;
+
+	// A broken session stays, it reconnects on its next request
+	if( putIdleSrpcfPool( pSrpcfPool, pSrpcfSession ) == TRUE )
+		goto Exit;
+
+Discard:
+
+	// Over maxIdle, or unfit to share
+	closeSrpcfSession( pSrpcfSession );
+	__atomic_fetch_sub( &pSrpcfPool->numOfTotal, 1, __ATOMIC_SEQ_CST );
+
+Exit:
+
+	wakeSrpcfPool( pSrpcfPool, FALSE );
+}
+
+
@@ -0,0 +1,137 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: relay.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+#include "netsock.h"
+
+
+//
+// Relay target lists are separated by commas or white space. Each entry is
+// host[:port], a relay is followed by the list it forwards to in brackets:
+//
+//     10.0.0.1[10.0.1.1,10.0.1.2:9000],10.0.0.2
+//
+// Lists come from the wire as well, nothing is assumed to be terminated.
+//
+static bool isSrpcfRelayDelim( s8 c ) {
+
+	return (!c || strchr( LIBSRPCF_RELAY_DELIM, c )) ? TRUE : FALSE;
+}
+
+
+bool parseSrpcfRelayTarget( const s8 **pCursor, const s8 *end, srpcfRelayTarget_t *pTarget ) {
+
+	const s8 *cursor = *pCursor, *colon = NULL, *open;
+	u32 addrLength, depth, maxDepth;
+	s32 port = 0;
+
+	// Step over separators, nothing left is the end of the list
+	while( cursor < end && isSrpcfRelayDelim( *cursor ) == TRUE )
+		cursor++;
+	if( cursor >= end )
+		return FALSE;
+
+	memset( pTarget, 0, sizeof( srpcfRelayTarget_t ) );
+	pTarget->name = cursor;
+	for( ; cursor < end && *cursor != '[' && *cursor != ']' && isSrpcfRelayDelim( *cursor ) == FALSE ; cursor++ )
+		if( *cursor == ':' )
+			colon = cursor;
+	pTarget->nameLength = cursor - pTarget->name;
+
+	// The port is optional
+	addrLength = colon ? (colon - pTarget->name) : pTarget->nameLength;
+	if( !addrLength || addrLength >= LIBSRPCF_RELAY_ADDR_MAX )
+		return FALSE;
+	memcpy( pTarget->addr, pTarget->name, addrLength );
+	pTarget->addr[ addrLength ] = '\0';
+
+	pTarget->port = SRPCF_DEF_PORT;
+	if( colon ) {
+
+		for( open = colon + 1 ; open < cursor ; open++ ) {
+
+			if( *open < '0' || *open > '9' )
+				return FALSE;
+
+			port = port * 10 + (*open - '0');
+			if( port > 65535 )
+				return FALSE;
+		}
+
+		if( !port )
+			return FALSE;
+		pTarget->port = port;
+	}
+
+	// A relay carries the list it forwards to
+	pTarget->numOfLeaves = 1;
+	if( cursor < end && *cursor == '[' ) {
+
+		open = ++cursor;
+		for( depth = maxDepth = 1 ; cursor < end && depth ; cursor++ ) {
+
+			if( *cursor == '[' && ++depth > maxDepth )
+				maxDepth = depth;
+			else if( *cursor == ']' )
+				depth--;
+		}
+
+		if( depth || maxDepth > LIBSRPCF_RELAY_DEPTH )
+			return FALSE;
+
+		pTarget->subTargets = open;
+		pTarget->subLength = (cursor - 1) - open;
+		pTarget->numOfLeaves = countSrpcfRelayLeaves( pTarget->subTargets, pTarget->subLength );
+		if( !pTarget->numOfLeaves )
+			return FALSE;
+	}
+
+	// Whatever follows must start the next entry
+	if( cursor < end && isSrpcfRelayDelim( *cursor ) == FALSE )
+		return FALSE;
+
+	*pCursor = cursor;
+	return TRUE;
+}
+
+
+// Returns 0 for an empty or malformed list
+u32 countSrpcfRelayLeaves( const s8 *targets, u32 targetLength ) {
+
+	const s8 *cursor = targets, *end = targets + targetLength;
+	srpcfRelayTarget_t srpcfRelayTarget;
+	u32 num = 0;
+
+	while( parseSrpcfRelayTarget( &cursor, end, &srpcfRelayTarget ) == TRUE )
+		num += srpcfRelayTarget.numOfLeaves;
+
+	// One bad entry spoils the list, the order of the results depends on it
+	while( cursor < end && isSrpcfRelayDelim( *cursor ) == TRUE )
+		cursor++;
+
+	return (cursor < end) ? 0 : num;
+}
+
+
@@ -0,0 +1,942 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: session.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <poll.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+#include "netsock.h"
+
+
+static u64 getMonotonicSeconds( void ) {
+
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec;
+}
+
+
+static void failSrpcfAsyncCalls( srpcfSession_t *pSrpcfSession ) {
+
+	srpcfAsyncCall_t *pSrpcfAsyncCall, *pNext;
+
+	// Take the list first, a callback may submit again
+	pSrpcfAsyncCall = pSrpcfSession->callHead;
+	pSrpcfSession->callHead = NULL;
+
+	for( ; pSrpcfAsyncCall ; pSrpcfAsyncCall = pNext ) {
+
+		pNext = pSrpcfAsyncCall->next;
+
+		pSrpcfSession->pSrpcfAsync->numOfCalls--;
+		pSrpcfSession->pSrpcfAsync->numOfCompleted++;
+		pSrpcfAsyncCall->pFunc( pSrpcfAsyncCall->pArg, pSrpcfAsyncCall->srpcfReqId, NULL );
+		free( pSrpcfAsyncCall );
+	}
+}
+
+
+static void disconnectSrpcfSession( srpcfSession_t *pSrpcfSession ) {
+
+	srpcfPending_t *pSrpcfPending;
+
+	if( pSrpcfSession->connected == FALSE )
+		return;
+
+	// Stop watching it before the descriptor goes away
+	if( pSrpcfSession->asyncFd >= 0 ) {
+
+		epoll_ctl( pSrpcfSession->pSrpcfAsync->efd, EPOLL_CTL_DEL, pSrpcfSession->asyncFd, NULL );
+		pSrpcfSession->asyncFd = -1;
+	}
+
+	// Requests that did not go out yet go with it
+	detachSrpcfOutput( pSrpcfSession->cfd );
+	deinitializeSocket( pSrpcfSession->cfd );
+	pSrpcfSession->connected = FALSE;
+	pSrpcfSession->connecting = FALSE;
+	pSrpcfSession->handshaking = FALSE;
+
+	// Whatever was still in flight is lost with the connection
+	while( (pSrpcfPending = (srpcfPending_t *)retriveFirstLinklist(
+			(commonLinklist_t **)&pSrpcfSession->pendingHead )) ) {
+
+		free( pSrpcfPending->pSrpcfSvrRspExecute );
+		free( pSrpcfPending );
+	}
+	pSrpcfSession->numOfInflight = 0;
+
+	// Calls driven by an event loop complete without a response
+	if( pSrpcfSession->callHead )
+		failSrpcfAsyncCalls( pSrpcfSession );
+}
+
+
+static void keepSrpcfSupport( srpcfSession_t *pSrpcfSession, srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf ) {
+
+	// Keep the latest capabilities
+	if( pSrpcfSession->pSrpcfSvrSupportedSrpcf )
+		free( pSrpcfSession->pSrpcfSvrSupportedSrpcf );
+	pSrpcfSession->pSrpcfSvrSupportedSrpcf = pSrpcfSvrSupportedSrpcf;
+	pSrpcfSession->srpcfCapFlags = pSrpcfSvrSupportedSrpcf->srpcfCapFlags;
+	pSrpcfSession->srpcfIdleTimeout = pSrpcfSvrSupportedSrpcf->srpcfIdleTimeout;
+}
+
+
+static bool connectSrpcfSession( srpcfSession_t *pSrpcfSession ) {
+
+	srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf;
+
+	// Open a socket
+	if( connectSocket( &pSrpcfSession->cfd, pSrpcfSession->addr, pSrpcfSession->port ) ) {
+
+		DBGPRINT( "Cannot connect to SRPCF server\n" );
+		return FALSE;
+	}
+	pSrpcfSession->connected = TRUE;
+
+	// Ask the server to keep this connection open and to number its plugins
+	pSrpcfSvrSupportedSrpcf = (srpcfSvrSupportedSrpcf_t *)requestSrpcfSupport(
+			&pSrpcfSession->cfd, &pSrpcfSession->cfd, SRPCF_CAP_SESSION | SRPCF_CAP_PLUGIN_ID );
+	if( !pSrpcfSvrSupportedSrpcf ) {
+
+		DBGPRINT( "Cannot query for supported SRPCFs\n" );
+		disconnectSrpcfSession( pSrpcfSession );
+		return FALSE;
+	}
+
+	keepSrpcfSupport( pSrpcfSession, pSrpcfSvrSupportedSrpcf );
+	pSrpcfSession->lastUsed = getMonotonicSeconds();
+
+	return TRUE;
+}
+
+
+// Keeps the loop watching for writable only while it matters
+static void notifySrpcfAsync( void *arg, bool pending ) {
+
+	srpcfSession_t *pSrpcfSession = (srpcfSession_t *)arg;
+	struct epoll_event event;
+
+	// Not watched anymore
+	if( pSrpcfSession->asyncFd < 0 )
+		return;
+
+	memset( &event, 0, sizeof( event ) );
+	event.events = EPOLLIN | EPOLLRDHUP;
+	if( pending == TRUE || pSrpcfSession->connecting == TRUE )
+		event.events |= EPOLLOUT;
+	event.data.ptr = pSrpcfSession;
+	epoll_ctl( pSrpcfSession->pSrpcfAsync->efd, EPOLL_CTL_MOD, pSrpcfSession->asyncFd, &event );
+}
+
+
+static void followSrpcfAsync( srpcfSession_t *pSrpcfSession ) {
+
+	struct epoll_event event;
+
+	if( !pSrpcfSession->pSrpcfAsync
+		|| pSrpcfSession->connected == FALSE
+		|| pSrpcfSession->asyncFd == pSrpcfSession->cfd )
+		return;
+
+	// Bytes of the old connection are worthless, unless a callback still reads them
+	if( pSrpcfSession->asyncBusy == TRUE )
+		pSrpcfSession->asyncStale = TRUE;
+	else
+		releaseSrpcfRing( pSrpcfSession->pRing );
+
+	// Requests of kernel sockets are queued rather than block the loop, memory
+	// transports take them in place. Nothing leaves before the connect is done.
+	if( setNonblockSocket( pSrpcfSession->cfd ) < 0
+		|| (lookupSrpcfTransport( pSrpcfSession->cfd ) == &srpcfTcpTransport
+			&& attachSrpcfOutput( pSrpcfSession->cfd, LIBSRPCF_ASYNC_OUTPUT * (u64)limitOfSrpcfMessage(),
+				FALSE, notifySrpcfAsync, pSrpcfSession ) == FALSE) ) {
+
+		DBGPRINT( "Cannot queue requests of socket %d\n", pSrpcfSession->cfd );
+		disconnectSrpcfSession( pSrpcfSession );
+		return;
+	}
+	if( pSrpcfSession->connecting == TRUE )
+		holdSrpcfOutput( pSrpcfSession->cfd, TRUE );
+
+	// Watch the new connection without ever blocking on it
+	memset( &event, 0, sizeof( event ) );
+	event.events = EPOLLIN | EPOLLRDHUP;
+	if( pSrpcfSession->connecting == TRUE )
+		event.events |= EPOLLOUT;
+	event.data.ptr = pSrpcfSession;
+	if( epoll_ctl( pSrpcfSession->pSrpcfAsync->efd, EPOLL_CTL_ADD, pSrpcfSession->cfd, &event ) < 0 ) {
+
+		DBGPRINT( "Cannot watch socket %d\n", pSrpcfSession->cfd );
+		disconnectSrpcfSession( pSrpcfSession );
+		return;
+	}
+	pSrpcfSession->asyncFd = pSrpcfSession->cfd;
+}
+
+
+// A session of an event loop never waits for the server. The support query
+// is queued ahead of the first requests, those name their plugins until the
+// answer is in. Every server of this revision keeps sessions open.
+static bool connectSrpcfAsync( srpcfSession_t *pSrpcfSession ) {
+
+	s32 ret;
+
+	ret = startConnectSocket( &pSrpcfSession->cfd, pSrpcfSession->addr, pSrpcfSession->port );
+	if( ret < 0 ) {
+
+		DBGPRINT( "Cannot connect to SRPCF server\n" );
+		return FALSE;
+	}
+	pSrpcfSession->connected = TRUE;
+	pSrpcfSession->connecting = ret ? TRUE : FALSE;
+
+	followSrpcfAsync( pSrpcfSession );
+	if( pSrpcfSession->connected == FALSE )
+		return FALSE;
+
+	pSrpcfSession->supportReqId = sendSrpcfSupport( &pSrpcfSession->cfd, SRPCF_CAP_SESSION | SRPCF_CAP_PLUGIN_ID );
+	if( !pSrpcfSession->supportReqId ) {
+
+		DBGPRINT( "Cannot query for supported SRPCFs\n" );
+		disconnectSrpcfSession( pSrpcfSession );
+		return FALSE;
+	}
+	pSrpcfSession->handshaking = TRUE;
+	pSrpcfSession->lastUsed = getMonotonicSeconds();
+
+	return TRUE;
+}
+
+
+static bool prepareSrpcfSession( srpcfSession_t *pSrpcfSession ) {
+
+	// Don't race the server's idle timer, reconnect a little early
+	if( pSrpcfSession->connected == TRUE
+		&& !pSrpcfSession->numOfInflight
+		&& !pSrpcfSession->pendingHead
+		&& pSrpcfSession->srpcfIdleTimeout
+		&& (getMonotonicSeconds() - pSrpcfSession->lastUsed + LIBSRPCF_SESSION_MARGIN)
+			>= pSrpcfSession->srpcfIdleTimeout )
+		disconnectSrpcfSession( pSrpcfSession );
+
+	if( pSrpcfSession->connected == TRUE ) {
+
+		// Servers without session support take one request per connection
+		if( !(pSrpcfSession->srpcfCapFlags & SRPCF_CAP_SESSION)
+			&& pSrpcfSession->handshaking == FALSE
+			&& pSrpcfSession->numOfInflight ) {
+
+			DBGPRINT( "Server cannot pipeline requests\n" );
+			return FALSE;
+		}
+
+		return TRUE;
+	}
+
+	if( pSrpcfSession->pSrpcfAsync )
+		return connectSrpcfAsync( pSrpcfSession );
+
+	return connectSrpcfSession( pSrpcfSession );
+}
+
+
+static void finishSrpcfSession( srpcfSession_t *pSrpcfSession, srpcfSvrRspExecute_t *pSrpcfSvrRspExecute ) {
+
+	// Servers without session support hang up after every execution
+	if( !pSrpcfSvrRspExecute
+		|| (!(pSrpcfSession->srpcfCapFlags & SRPCF_CAP_SESSION) && pSrpcfSession->handshaking == FALSE) ) {
+
+		disconnectSrpcfSession( pSrpcfSession );
+		return;
+	}
+
+	pSrpcfSession->lastUsed = getMonotonicSeconds();
+}
+
+
+// The first request connects it
+srpcfSession_t *createSrpcfSession( s8 *addr, s32 port ) {
+
+	srpcfSession_t *pSrpcfSession;
+
+	// Allocate a session
+	pSrpcfSession = (srpcfSession_t *)malloc( sizeof( srpcfSession_t ) );
+	if( !pSrpcfSession )
+		return NULL;
+	memset( pSrpcfSession, 0, sizeof( srpcfSession_t ) );
+
+	// Fill in the data
+	pSrpcfSession->addr = mallocStringBuffer( addr );
+	pSrpcfSession->port = port;
+	pSrpcfSession->connected = FALSE;
+	pSrpcfSession->asyncFd = -1;
+
+	return pSrpcfSession;
+}
+
+
+srpcfSession_t *openSrpcfSession( s8 *addr, s32 port ) {
+
+	srpcfSession_t *pSrpcfSession;
+
+	pSrpcfSession = createSrpcfSession( addr, port );
+	if( !pSrpcfSession )
+		return NULL;
+
+	// Connect now so callers see an unreachable server right away
+	if( connectSrpcfSession( pSrpcfSession ) == FALSE ) {
+
+		closeSrpcfSession( pSrpcfSession );
+		return NULL;
+	}
+
+	return pSrpcfSession;
+}
+
+
+u32 submitSrpcfSession( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt ) {
+
+	u32 srpcfReqId;
+
+	if( prepareSrpcfSession( pSrpcfSession ) == FALSE ) {
+
+		freeCmdOptList( pCmdOpt );
+		return 0;
+	}
+
+	// Send it without waiting, the response is matched by ID later
+	srpcfReqId = allocateSrpcfReqId();
+	if( sendSrpcfExecute( &pSrpcfSession->cfd, srpcfReqId, srpcfCmdNo, pCmdOpt ) == FALSE ) {
+
+		disconnectSrpcfSession( pSrpcfSession );
+		return 0;
+	}
+	pSrpcfSession->numOfInflight++;
+
+	return srpcfReqId;
+}
+
+
+u32 submitSrpcfSessionPlugin( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName ) {
+
+	u32 srpcfReqId, srpcfPluginId;
+	bool ret;
+
+	if( prepareSrpcfSession( pSrpcfSession ) == FALSE ) {
+
+		freeCmdOptList( pCmdOpt );
+		return 0;
+	}
+
+	// Send it without waiting, plugins the server numbered go by ID, newer ones
+	// and all of them before this connection's numbers are in go by name
+	srpcfReqId = allocateSrpcfReqId();
+	srpcfPluginId = LIBSRPCF_PLUGIN_NONE;
+	if( pSrpcfSession->handshaking == FALSE )
+		srpcfPluginId = findSrpcfPluginId( pSrpcfSession->pSrpcfSvrSupportedSrpcf, srpcfName );
+	if( srpcfPluginId != LIBSRPCF_PLUGIN_NONE )
+		ret = sendSrpcfExecutePluginId( &pSrpcfSession->cfd, srpcfReqId, srpcfPluginId, pCmdOpt );
+	else
+		ret = sendSrpcfExecutePlugin( &pSrpcfSession->cfd, srpcfReqId, srpcfCmdNo, pCmdOpt, srpcfName );
+
+	if( ret == FALSE ) {
+
+		disconnectSrpcfSession( pSrpcfSession );
+		return 0;
+	}
+	pSrpcfSession->numOfInflight++;
+
+	return srpcfReqId;
+}
+
+
+u32 submitSrpcfSessionBatch( srpcfSession_t *pSrpcfSession, srpcfBatch_t *pSrpcfBatch, u32 numOfBatch ) {
+
+	u32 srpcfReqId, i;
+
+	if( prepareSrpcfSession( pSrpcfSession ) == FALSE ) {
+
+		for( i = 0 ; i < numOfBatch ; i++ ) {
+
+			freeCmdOptList( pSrpcfBatch[ i ].pCmdOpt );
+			pSrpcfBatch[ i ].pCmdOpt = NULL;
+		}
+		return 0;
+	}
+
+	// Send it without waiting, the response is matched by ID later
+	srpcfReqId = allocateSrpcfReqId();
+	if( sendSrpcfExecuteBatch( &pSrpcfSession->cfd, srpcfReqId, pSrpcfBatch, numOfBatch ) == FALSE ) {
+
+		disconnectSrpcfSession( pSrpcfSession );
+		return 0;
+	}
+	pSrpcfSession->numOfInflight++;
+
+	return srpcfReqId;
+}
+
+
+// The response is a batch with one result per leaf
+u32 submitSrpcfSessionRelay( srpcfSession_t *pSrpcfSession, const s8 *targets, u32 targetLength, u32 srpcfDeadline, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName ) {
+
+	u32 srpcfReqId;
+
+	if( prepareSrpcfSession( pSrpcfSession ) == FALSE ) {
+
+		freeCmdOptList( pCmdOpt );
+		return 0;
+	}
+
+	// Send it without waiting, the response is matched by ID later
+	srpcfReqId = allocateSrpcfReqId();
+	if( sendSrpcfExecuteRelay( &pSrpcfSession->cfd, srpcfReqId, targets, targetLength,
+			srpcfDeadline, srpcfCmdNo, pCmdOpt, srpcfName ) == FALSE ) {
+
+		disconnectSrpcfSession( pSrpcfSession );
+		return 0;
+	}
+	pSrpcfSession->numOfInflight++;
+
+	return srpcfReqId;
+}
+
+
+srpcfSvrRspExecute_t *waitSrpcfSession( srpcfSession_t *pSrpcfSession, u32 srpcfReqId ) {
+
+	srpcfPending_t *pSrpcfPending;
+	srpcfSvrRspExecute_t *pSrpcfSvrRspExecute;
+
+	// Responses of an attached session only come through its event loop
+	if( pSrpcfSession->pSrpcfAsync ) {
+
+		DBGPRINT( "Session is driven by an event loop\n" );
+		return NULL;
+	}
+
+	// It may have arrived while waiting for another one
+	for( pSrpcfPending = pSrpcfSession->pendingHead ; pSrpcfPending ; pSrpcfPending = pSrpcfPending->next ) {
+
+		if( pSrpcfPending->srpcfReqId != srpcfReqId )
+			continue;
+
+		removeLinklist( (commonLinklist_t **)&pSrpcfSession->pendingHead, (commonLinklist_t *)pSrpcfPending );
+		pSrpcfSvrRspExecute = pSrpcfPending->pSrpcfSvrRspExecute;
+		free( pSrpcfPending );
+
+		finishSrpcfSession( pSrpcfSession, pSrpcfSvrRspExecute );
+		return pSrpcfSvrRspExecute;
+	}
+
+	while( pSrpcfSession->connected == TRUE && pSrpcfSession->numOfInflight ) {
+
+		// Responses come back in completion order
+		pSrpcfSvrRspExecute = recvSrpcfExecute( &pSrpcfSession->cfd );
+		if( !pSrpcfSvrRspExecute )
+			break;
+		pSrpcfSession->numOfInflight--;
+
+		if( pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfReqId == srpcfReqId ) {
+
+			finishSrpcfSession( pSrpcfSession, pSrpcfSvrRspExecute );
+			return pSrpcfSvrRspExecute;
+		}
+
+		// Keep it for whoever asks for it
+		pSrpcfPending = (srpcfPending_t *)malloc( sizeof( srpcfPending_t ) );
+		if( !pSrpcfPending ) {
+
+			free( pSrpcfSvrRspExecute );
+			break;
+		}
+		pSrpcfPending->next = NULL;
+		pSrpcfPending->srpcfReqId = pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfReqId;
+		pSrpcfPending->pSrpcfSvrRspExecute = pSrpcfSvrRspExecute;
+		appendLinklist( (commonLinklist_t **)&pSrpcfSession->pendingHead, (commonLinklist_t *)pSrpcfPending );
+	}
+
+	// The connection is broken if anything is still owed, otherwise the ID was unknown
+	if( pSrpcfSession->numOfInflight )
+		disconnectSrpcfSession( pSrpcfSession );
+
+	return NULL;
+}
+
+
+// An idle connection has nothing to say, anything readable means the server hung up
+void probeSrpcfSession( srpcfSession_t *pSrpcfSession ) {
+
+	if( pSrpcfSession->connected == FALSE
+		|| pSrpcfSession->numOfInflight
+		|| pSrpcfSession->pendingHead
+		|| pSrpcfSession->pSrpcfAsync )
+		return;
+
+	if( pollSocket( pSrpcfSession->cfd, POLLIN, 0 ) > 0 ) {
+
+		DBGPRINT( "Server closed idle socket %d\n", pSrpcfSession->cfd );
+		disconnectSrpcfSession( pSrpcfSession );
+	}
+}
+
+
+srpcfSvrRspExecute_t *executeSrpcfSession( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt ) {
+
+	u32 srpcfReqId;
+
+	srpcfReqId = submitSrpcfSession( pSrpcfSession, srpcfCmdNo, pCmdOpt );
+	if( !srpcfReqId )
+		return NULL;
+
+	return waitSrpcfSession( pSrpcfSession, srpcfReqId );
+}
+
+
+srpcfSvrRspExecute_t *executeSrpcfSessionPlugin( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName ) {
+
+	u32 srpcfReqId;
+
+	srpcfReqId = submitSrpcfSessionPlugin( pSrpcfSession, srpcfCmdNo, pCmdOpt, srpcfName );
+	if( !srpcfReqId )
+		return NULL;
+
+	return waitSrpcfSession( pSrpcfSession, srpcfReqId );
+}
+
+
+srpcfSvrRspExecuteBatch_t *executeSrpcfSessionBatch( srpcfSession_t *pSrpcfSession, srpcfBatch_t *pSrpcfBatch, u32 numOfBatch ) {
+
+	u32 srpcfReqId;
+
+	srpcfReqId = submitSrpcfSessionBatch( pSrpcfSession, pSrpcfBatch, numOfBatch );
+	if( !srpcfReqId )
+		return NULL;
+
+	return (srpcfSvrRspExecuteBatch_t *)waitSrpcfSession( pSrpcfSession, srpcfReqId );
+}
+
+
+void closeSrpcfSession( srpcfSession_t *pSrpcfSession ) {
+
+	if( !pSrpcfSession )
+		return;
+
+	detachSrpcfAsync( pSrpcfSession );
+	disconnectSrpcfSession( pSrpcfSession );
+
+	// Free resource
+	if( pSrpcfSession->pSrpcfSvrSupportedSrpcf )
+		free( pSrpcfSession->pSrpcfSvrSupportedSrpcf );
+	if( pSrpcfSession->addr )
+		free( pSrpcfSession->addr );
+	free( pSrpcfSession );
+}
+
+
+//
+// Sessions driven by the caller's event loop. Every accepted call completes
+// exactly once through its callback, with NULL if the connection was lost.
+// The response lives in the session's receive ring and is only valid during
+// the callback. Callbacks may submit more calls, but must not detach or close
+// any session of the same loop.
+//
+static u32 queueSrpcfAsync( srpcfSession_t *pSrpcfSession, srpcfAsyncCall_t *pSrpcfAsyncCall, u32 srpcfReqId, srpcfAsyncFunc_t pFunc, void *pArg ) {
+
+	if( srpcfReqId ) {
+
+		// A fresh connection must be watched before its response can arrive
+		followSrpcfAsync( pSrpcfSession );
+		if( pSrpcfSession->connected == FALSE )
+			srpcfReqId = 0;
+	}
+
+	if( !srpcfReqId ) {
+
+		free( pSrpcfAsyncCall );
+		return 0;
+	}
+
+	// Fill in the data
+	pSrpcfAsyncCall->next = NULL;
+	pSrpcfAsyncCall->srpcfReqId = srpcfReqId;
+	pSrpcfAsyncCall->pFunc = pFunc;
+	pSrpcfAsyncCall->pArg = pArg;
+	appendLinklist( (commonLinklist_t **)&pSrpcfSession->callHead, (commonLinklist_t *)pSrpcfAsyncCall );
+	pSrpcfSession->pSrpcfAsync->numOfCalls++;
+
+	return srpcfReqId;
+}
+
+
+static void completeSrpcfAsync( srpcfSession_t *pSrpcfSession, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt ) {
+
+	srpcfAsyncCall_t **ppSrpcfAsyncCall, *pSrpcfAsyncCall;
+	srpcfSvrRspExecute_t *pSrpcfSvrRspExecute = (srpcfSvrRspExecute_t *)pSrpcfSvrCommPkt;
+	u32 srpcfReqId = pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfReqId;
+
+	// Find who asked for it
+	for( ppSrpcfAsyncCall = &pSrpcfSession->callHead ; *ppSrpcfAsyncCall ; ppSrpcfAsyncCall = &(*ppSrpcfAsyncCall)->next ) {
+
+		if( (*ppSrpcfAsyncCall)->srpcfReqId == srpcfReqId )
+			break;
+	}
+
+	pSrpcfAsyncCall = *ppSrpcfAsyncCall;
+	if( !pSrpcfAsyncCall ) {
+
+		DBGPRINT( "Response for unknown request %u\n", srpcfReqId );
+		return;
+	}
+	*ppSrpcfAsyncCall = pSrpcfAsyncCall->next;
+
+	pSrpcfSession->numOfInflight--;
+	pSrpcfSession->pSrpcfAsync->numOfCalls--;
+	pSrpcfSession->pSrpcfAsync->numOfCompleted++;
+
+	// Too short to be a response
+	if( pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfPktLen
+		< (sizeof( srpcfSvrRspExecute_t ) - sizeof( pSrpcfSvrRspExecute->dataPtr )) )
+		pSrpcfSvrRspExecute = NULL;
+
+	// Settle the session first, the callback may submit again
+	finishSrpcfSession( pSrpcfSession, pSrpcfSvrRspExecute );
+
+	pSrpcfSession->asyncBusy = TRUE;
+	pSrpcfAsyncCall->pFunc( pSrpcfAsyncCall->pArg, srpcfReqId, pSrpcfSvrRspExecute );
+	pSrpcfSession->asyncBusy = FALSE;
+
+	free( pSrpcfAsyncCall );
+}
+
+
+// The answer to the support query, kept beyond the ring
+static bool acceptSrpcfSupport( srpcfSession_t *pSrpcfSession, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt ) {
+
+	srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf;
+
+	if( checkSrpcfSupport( pSrpcfSvrCommPkt, pSrpcfSession->supportReqId ) == FALSE ) {
+
+		DBGPRINT( "Cannot query for supported SRPCFs\n" );
+		return FALSE;
+	}
+
+	pSrpcfSvrSupportedSrpcf = (srpcfSvrSupportedSrpcf_t *)malloc( pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfPktLen );
+	if( !pSrpcfSvrSupportedSrpcf )
+		return FALSE;
+	memcpy( pSrpcfSvrSupportedSrpcf, pSrpcfSvrCommPkt, pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfPktLen );
+
+	keepSrpcfSupport( pSrpcfSession, pSrpcfSvrSupportedSrpcf );
+	pSrpcfSession->handshaking = FALSE;
+
+	return TRUE;
+}
+
+
+// The connect finished one way or the other, let the queued requests go
+static bool completeSrpcfConnect( srpcfSession_t *pSrpcfSession, u32 events ) {
+
+	if( !(events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) )
+		return TRUE;
+
+	if( finishConnectSocket( pSrpcfSession->cfd ) < 0 ) {
+
+		DBGPRINT( "Cannot connect to SRPCF server\n" );
+		return FALSE;
+	}
+
+	pSrpcfSession->connecting = FALSE;
+	holdSrpcfOutput( pSrpcfSession->cfd, FALSE );
+
+	// Nothing left to wait for, stop watching for writable
+	if( !flushSrpcfOutput( pSrpcfSession->cfd ) )
+		notifySrpcfAsync( pSrpcfSession, FALSE );
+
+	return TRUE;
+}
+
+
+static void drainSrpcfAsync( srpcfSession_t *pSrpcfSession, u32 events ) {
+
+	srpcfSvrCommPkt_t *pSrpcfSvrCommPkt;
+	bool invalid;
+	s32 rByte, cfd = pSrpcfSession->asyncFd;
+
+	// Lost since the event was reported
+	if( cfd < 0 )
+		return;
+
+	if( pSrpcfSession->connecting == TRUE ) {
+
+		if( completeSrpcfConnect( pSrpcfSession, events ) == FALSE )
+			goto ErrExit;
+
+		if( pSrpcfSession->connecting == TRUE )
+			return;
+	}
+
+	// Push out whatever the socket did not take before
+	if( flushSrpcfOutput( cfd ) < 0 )
+		goto ErrExit;
+
+	for( ; ; ) {
+
+		// Complete every response in the ring
+		while( (pSrpcfSvrCommPkt = nextSrpcfRing( pSrpcfSession->pRing, &invalid )) ) {
+
+			// The support query was answered
+			if( pSrpcfSession->handshaking == TRUE
+				&& pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfReqId == pSrpcfSession->supportReqId ) {
+
+				if( acceptSrpcfSupport( pSrpcfSession, pSrpcfSvrCommPkt ) == FALSE )
+					goto ErrExit;
+				continue;
+			}
+
+			completeSrpcfAsync( pSrpcfSession, pSrpcfSvrCommPkt );
+
+			// The connection went away or was replaced meanwhile
+			if( pSrpcfSession->asyncFd != cfd || pSrpcfSession->asyncStale == TRUE ) {
+
+				pSrpcfSession->asyncStale = FALSE;
+				releaseSrpcfRing( pSrpcfSession->pRing );
+				return;
+			}
+		}
+
+		if( invalid == TRUE )
+			break;
+
+		// Drain the socket into the ring
+		rByte = fillSrpcfRing( cfd, pSrpcfSession->pRing );
+		if( rByte > 0 )
+			continue;
+
+		if( rByte < 0 ) {
+
+			if( errno == EINTR )
+				continue;
+
+			if( errno == EAGAIN || errno == EWOULDBLOCK )
+				return;
+		}
+
+		// Peer has gone or an error occurred
+		break;
+	}
+
+ErrExit:
+	disconnectSrpcfSession( pSrpcfSession );
+}
+
+
+srpcfAsync_t *createSrpcfAsync( void ) {
+
+	srpcfAsync_t *pSrpcfAsync;
+
+	pSrpcfAsync = (srpcfAsync_t *)malloc( sizeof( srpcfAsync_t ) );
+	if( !pSrpcfAsync )
+		return NULL;
+	memset( pSrpcfAsync, 0, sizeof( srpcfAsync_t ) );
+
+	// The caller may put this one into its own epoll set
+	pSrpcfAsync->efd = epoll_create1( EPOLL_CLOEXEC );
+	if( pSrpcfAsync->efd < 0 ) {
+
+		DBGPRINT( "Cannot create epoll instance\n" );
+		free( pSrpcfAsync );
+		return NULL;
+	}
+
+	return pSrpcfAsync;
+}
+
+
+// Every session must be detached or closed first
+void destroySrpcfAsync( srpcfAsync_t *pSrpcfAsync ) {
+
+	if( !pSrpcfAsync )
+		return;
+
+	close( pSrpcfAsync->efd );
+	free( pSrpcfAsync );
+}
+
+
+// Readable whenever dispatchSrpcfAsync() has something to do
+s32 descriptorOfSrpcfAsync( srpcfAsync_t *pSrpcfAsync ) {
+
+	return pSrpcfAsync->efd;
+}
+
+
+bool attachSrpcfAsync( srpcfAsync_t *pSrpcfAsync, srpcfSession_t *pSrpcfSession ) {
+
+	if( pSrpcfSession->pSrpcfAsync )
+		return (pSrpcfSession->pSrpcfAsync == pSrpcfAsync) ? TRUE : FALSE;
+
+	// Synchronous calls still owed would be taken for asynchronous ones
+	if( pSrpcfSession->numOfInflight || pSrpcfSession->pendingHead ) {
+
+		DBGPRINT( "Session still has requests in flight\n" );
+		return FALSE;
+	}
+
+	// Responses are collected here, a frame at a time
+	pSrpcfSession->pRing = (srpcfRing_t *)malloc( sizeof( srpcfRing_t ) + LIBSRPCF_MSG_SIZE );
+	if( !pSrpcfSession->pRing )
+		return FALSE;
+	initializeSrpcfRing( pSrpcfSession->pRing, (s8 *)(pSrpcfSession->pRing + 1), LIBSRPCF_MSG_SIZE );
+
+	pSrpcfSession->pSrpcfAsync = pSrpcfAsync;
+	pSrpcfSession->asyncFd = -1;
+	pSrpcfSession->asyncBusy = FALSE;
+	pSrpcfSession->asyncStale = FALSE;
+	pSrpcfSession->callHead = NULL;
+
+	// A session that is down gets watched once it reconnects
+	followSrpcfAsync( pSrpcfSession );
+
+	return TRUE;
+}
+
+
+void detachSrpcfAsync( srpcfSession_t *pSrpcfSession ) {
+
+	s32 flags;
+
+	if( !pSrpcfSession->pSrpcfAsync )
+		return;
+
+	// Their responses would confuse synchronous calls, start over. So would a
+	// connection that is not set up yet.
+	if( pSrpcfSession->callHead
+		|| pSrpcfSession->connecting == TRUE
+		|| pSrpcfSession->handshaking == TRUE )
+		disconnectSrpcfSession( pSrpcfSession );
+
+	if( pSrpcfSession->asyncFd >= 0 ) {
+
+		epoll_ctl( pSrpcfSession->pSrpcfAsync->efd, EPOLL_CTL_DEL, pSrpcfSession->asyncFd, NULL );
+		pSrpcfSession->asyncFd = -1;
+
+		// Nothing is queued any more, synchronous calls send in place
+		detachSrpcfOutput( pSrpcfSession->cfd );
+
+		// Synchronous calls block again
+		flags = fcntl( pSrpcfSession->cfd, F_GETFL, 0 );
+		if( flags >= 0 )
+			fcntl( pSrpcfSession->cfd, F_SETFL, flags & ~O_NONBLOCK );
+	}
+
+	releaseSrpcfRing( pSrpcfSession->pRing );
+	free( pSrpcfSession->pRing );
+	pSrpcfSession->pRing = NULL;
+	pSrpcfSession->pSrpcfAsync = NULL;
+}
+
+
+u32 submitSrpcfAsync( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, srpcfAsyncFunc_t pFunc, void *pArg ) {
+
+	srpcfAsyncCall_t *pSrpcfAsyncCall = NULL;
+
+	if( pSrpcfSession->pSrpcfAsync && pFunc )
+		pSrpcfAsyncCall = (srpcfAsyncCall_t *)malloc( sizeof( srpcfAsyncCall_t ) );
+
+	if( !pSrpcfAsyncCall ) {
+
+		freeCmdOptList( pCmdOpt );
+		return 0;
+	}
+
+	return queueSrpcfAsync( pSrpcfSession, pSrpcfAsyncCall,
+			submitSrpcfSession( pSrpcfSession, srpcfCmdNo, pCmdOpt ),
+			pFunc, pArg );
+}
+
+
+u32 submitSrpcfAsyncPlugin( srpcfSession_t *pSrpcfSession, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName, srpcfAsyncFunc_t pFunc, void *pArg ) {
+
+	srpcfAsyncCall_t *pSrpcfAsyncCall = NULL;
+
+	if( pSrpcfSession->pSrpcfAsync && pFunc )
+		pSrpcfAsyncCall = (srpcfAsyncCall_t *)malloc( sizeof( srpcfAsyncCall_t ) );
+
+	if( !pSrpcfAsyncCall ) {
+
+		freeCmdOptList( pCmdOpt );
+		return 0;
+	}
+
+	return queueSrpcfAsync( pSrpcfSession, pSrpcfAsyncCall,
+			submitSrpcfSessionPlugin( pSrpcfSession, srpcfCmdNo, pCmdOpt, srpcfName ),
+			pFunc, pArg );
+}
+
+
+// The callback gets the merged batch, cast from the execute response
+u32 submitSrpcfAsyncRelay( srpcfSession_t *pSrpcfSession, const s8 *targets, u32 targetLength, u32 srpcfDeadline, u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, s8 *srpcfName, srpcfAsyncFunc_t pFunc, void *pArg ) {
+
+	srpcfAsyncCall_t *pSrpcfAsyncCall = NULL;
+
+	if( pSrpcfSession->pSrpcfAsync && pFunc )
+		pSrpcfAsyncCall = (srpcfAsyncCall_t *)malloc( sizeof( srpcfAsyncCall_t ) );
+
+	if( !pSrpcfAsyncCall ) {
+
+		freeCmdOptList( pCmdOpt );
+		return 0;
+	}
+
+	return queueSrpcfAsync( pSrpcfSession, pSrpcfAsyncCall,
+			submitSrpcfSessionRelay( pSrpcfSession, targets, targetLength, srpcfDeadline, srpcfCmdNo, pCmdOpt, srpcfName ),
+			pFunc, pArg );
+}
+
+
+// Completes whatever has arrived, waiting up to msec for something to
+// arrive first. Returns the number of calls completed.
+s32 dispatchSrpcfAsync( srpcfAsync_t *pSrpcfAsync, s32 msec ) {
+
+	struct epoll_event events[ LIBSRPCF_ASYNC_EVENTS ];
+	u64 numOfCompleted = pSrpcfAsync->numOfCompleted;
+	s32 i, num;
+
+	num = epoll_wait( pSrpcfAsync->efd, events, LIBSRPCF_ASYNC_EVENTS, msec );
+	if( num < 0 )
+		return (errno == EINTR) ? 0 : -1;
+
+	for( i = 0 ; i < num ; i++ )
+		drainSrpcfAsync( (srpcfSession_t *)events[ i ].data.ptr, events[ i ].events );
+
+	return pSrpcfAsync->numOfCompleted - numOfCompleted;
+}
@@ -0,0 +1,814 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: shmring.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// memfd_create()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+
+#include "netsock.h"
+
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define SRPCF_SHM_RELAX()			__builtin_ia32_pause()
+#else
+#define SRPCF_SHM_RELAX()			__asm__ __volatile__( "" ::: "memory" )
+#endif
+
+
+//
+// Structures
+//
+// One direction of a connection. Positions run freely, the reader owns the
+// head and the writer the tail, each on its own cache line. The peer can
+// write anything here, each end keeps its own position privately and checks
+// the peer's against the ring size.
+typedef struct _srpcfShmRing {
+
+	// Reader side
+	u64						head __attribute__((aligned( SRPCF_SHM_CACHELINE )));
+	u32						armed;
+	u32						readerClosed;
+
+	// Writer side
+	u64						tail __attribute__((aligned( SRPCF_SHM_CACHELINE )));
+	u32						writerClosed;
+
+} srpcfShmRing_t;
+
+
+// Start of the memfd, the ring data follows
+typedef struct _srpcfShmHdr {
+
+	u32						magic;
+	u32						ringSize;
+
+	// Client to server, then server to client
+	srpcfShmRing_t			ring[ 2 ];
+
+} srpcfShmHdr_t;
+
+
+// The handle is a private epoll instance holding the inbound eventfd and
+// the control socket, so it turns readable on data and when the peer dies.
+typedef struct _srpcfShmEnd {
+
+	s32						fd;
+	s32						ctrl;
+	s32						rxEfd;
+	s32						txEfd;
+
+	srpcfShmHdr_t			*pHdr;
+	u32						mapSize;
+	srpcfShmRing_t			*pRx;
+	srpcfShmRing_t			*pTx;
+	s8						*rxData;
+	s8						*txData;
+	u32						ringMask;
+	u64						rxHead;
+	u64						txTail;
+
+	bool					shut;
+	u32						timeout;
+
+} srpcfShmEnd_t;
+
+
+typedef struct _srpcfShmHandle {
+
+	bool					listener;
+	srpcfShmEnd_t			*pEnd;
+
+} srpcfShmHandle_t;
+
+
+//
+// Global variables
+//
+static srpcfShmHandle_t srpcfShmHandleTbl[ SRPCF_SHM_FDS ];
+static u32 srpcfShmSpin = SRPCF_SHM_SPIN;
+static bool srpcfShmSpinSet = FALSE;
+
+
+void configureSrpcfShm( u32 spin ) {
+
+	srpcfShmSpin = spin;
+	srpcfShmSpinSet = TRUE;
+}
+
+
+static srpcfShmEnd_t *lookupSrpcfShmEnd( s32 fd ) {
+
+	if( fd < 0 || fd >= SRPCF_SHM_FDS )
+		return NULL;
+
+	return __atomic_load_n( &srpcfShmHandleTbl[ fd ].pEnd, __ATOMIC_ACQUIRE );
+}
+
+
+static void formatSrpcfShmAddress( const s8 *addr, s32 port, s8 *unixName, u32 size ) {
+
+	addr += strlen( SRPCF_SHM_PREFIX );
+
+	// "shm:" alone is the server's default name
+	if( *addr )
+		snprintf( unixName, size, "%s", addr );
+	else
+		snprintf( unixName, size, SRPCF_SHM_NAME, (port <= 0) ? SRPCF_DEF_PORT : port );
+}
+
+
+static void signalSrpcfShmFd( s32 efd ) {
+
+	u64 one = 1;
+
+	if( write( efd, &one, sizeof( one ) ) < 0 )
+		DBGPRINT( "Cannot signal eventfd %d\n", efd );
+}
+
+
+// A crashed peer leaves no flag behind, only its control socket says so
+static bool isPeerGoneSrpcfShmEnd( srpcfShmEnd_t *pEnd ) {
+
+	s8 c;
+
+	return (recv( pEnd->ctrl, &c, 1, MSG_PEEK | MSG_DONTWAIT ) == 0) ? TRUE : FALSE;
+}
+
+
+// A peer position more than a ring away is garbage, the connection is lost
+static bool isSaneSrpcfShmEnd( srpcfShmEnd_t *pEnd, u64 head, u64 tail ) {
+
+	if( (tail - head) <= (u64)pEnd->ringMask + 1 )
+		return TRUE;
+
+	DBGPRINT( "Shared ring corrupted by the peer\n" );
+	errno = EPROTO;
+	return FALSE;
+}
+
+
+// Only the user the server runs as, or root, gets to share memory with it
+static bool isTrustedSrpcfShmPeer( s32 ctrl ) {
+
+	struct ucred cred;
+	socklen_t len = sizeof( cred );
+
+	if( getsockopt( ctrl, SOL_SOCKET, SO_PEERCRED, &cred, &len ) < 0 )
+		return FALSE;
+
+	return (cred.uid == geteuid() || cred.uid == 0) ? TRUE : FALSE;
+}
+
+
+static bool isNonblockSrpcfShmFd( s32 fd ) {
+
+	s32 flags;
+
+	flags = fcntl( fd, F_GETFL, 0 );
+	return (flags >= 0 && (flags & O_NONBLOCK)) ? TRUE : FALSE;
+}
+
+
+static srpcfShmEnd_t *attachSrpcfShmEnd( s32 ctrl, s32 mfd, s32 rxEfd, s32 txEfd, bool server ) {
+
+	srpcfShmEnd_t *pEnd;
+	struct epoll_event event;
+	struct stat st;
+	u32 ringSize;
+	s32 seals;
+
+	pEnd = (srpcfShmEnd_t *)calloc( 1, sizeof( srpcfShmEnd_t ) );
+	if( !pEnd )
+		return NULL;
+
+	// With one CPU the peer cannot run while we spin
+	if( srpcfShmSpinSet == FALSE && sysconf( _SC_NPROCESSORS_ONLN ) < 2 )
+		configureSrpcfShm( 0 );
+
+	pEnd->fd = -1;
+	pEnd->ctrl = ctrl;
+	pEnd->rxEfd = rxEfd;
+	pEnd->txEfd = txEfd;
+
+	// Map both rings, the memfd itself is not needed afterwards. A size the
+	// server can still change would fault us on access.
+	seals = fcntl( mfd, F_GET_SEALS );
+	if( seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW) )
+		goto ErrExit;
+	if( fstat( mfd, &st ) < 0 || st.st_size < sizeof( srpcfShmHdr_t ) )
+		goto ErrExit;
+	pEnd->mapSize = st.st_size;
+	pEnd->pHdr = (srpcfShmHdr_t *)mmap( NULL, pEnd->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, mfd, 0 );
+	if( pEnd->pHdr == MAP_FAILED ) {
+
+		pEnd->pHdr = NULL;
+		goto ErrExit;
+	}
+
+	// Read the layout once, the peer may change it under us
+	ringSize = __atomic_load_n( &pEnd->pHdr->ringSize, __ATOMIC_RELAXED );
+	if( pEnd->pHdr->magic != SRPCF_SHM_MAGIC
+		|| !ringSize
+		|| ringSize & (ringSize - 1)
+		|| sizeof( srpcfShmHdr_t ) + 2ULL * ringSize > pEnd->mapSize )
+		goto ErrExit;
+
+	pEnd->ringMask = ringSize - 1;
+	pEnd->pRx = &pEnd->pHdr->ring[ server ? 0 : 1 ];
+	pEnd->pTx = &pEnd->pHdr->ring[ server ? 1 : 0 ];
+	pEnd->rxData = (s8 *)(pEnd->pHdr + 1) + (server ? 0 : ringSize);
+	pEnd->txData = (s8 *)(pEnd->pHdr + 1) + (server ? ringSize : 0);
+
+	pEnd->fd = epoll_create1( EPOLL_CLOEXEC );
+	if( pEnd->fd < 0 || pEnd->fd >= SRPCF_SHM_FDS )
+		goto ErrExit;
+
+	memset( &event, 0, sizeof( event ) );
+	event.events = EPOLLIN;
+	event.data.fd = rxEfd;
+	if( epoll_ctl( pEnd->fd, EPOLL_CTL_ADD, rxEfd, &event ) < 0 )
+		goto ErrExit;
+
+	event.events = EPOLLIN | EPOLLRDHUP;
+	event.data.fd = ctrl;
+	if( epoll_ctl( pEnd->fd, EPOLL_CTL_ADD, ctrl, &event ) < 0 )
+		goto ErrExit;
+
+	__atomic_store_n( &srpcfShmHandleTbl[ pEnd->fd ].pEnd, pEnd, __ATOMIC_RELEASE );
+
+	return pEnd;
+
+ErrExit:
+	if( pEnd->fd >= 0 )
+		close( pEnd->fd );
+	if( pEnd->pHdr )
+		munmap( pEnd->pHdr, pEnd->mapSize );
+	free( pEnd );
+	return NULL;
+}
+
+
+static s32 listenShmSocket( s32 *fd, const s8 *addr, s32 port ) {
+
+	s8 unixName[ SRPCF_UNIX_NAME_MAX ];
+
+	// Clients ask for their rings over a local socket
+	formatSrpcfShmAddress( addr, port, unixName, sizeof( unixName ) );
+	if( srpcfUnixTransport.listen( fd, unixName, 0 ) )
+		return -1;
+
+	if( *fd >= SRPCF_SHM_FDS ) {
+
+		close( *fd );
+		errno = EMFILE;
+		return -1;
+	}
+
+	srpcfShmHandleTbl[ *fd ].listener = TRUE;
+	return 0;
+}
+
+
+static s32 connectShmSocket( s32 *fd, const s8 *addr, s32 port ) {
+
+	s8 unixName[ SRPCF_UNIX_NAME_MAX ];
+	s8 cmsgBuf[ CMSG_SPACE( sizeof( s32 ) * 3 ) ];
+	struct msghdr msg;
+	struct cmsghdr *pCmsg;
+	struct iovec iov;
+	srpcfShmEnd_t *pEnd;
+	s32 ctrl, fds[ 3 ], i;
+	ssize_t len;
+	s8 c;
+
+	formatSrpcfShmAddress( addr, port, unixName, sizeof( unixName ) );
+	if( srpcfUnixTransport.connect( &ctrl, unixName, 0 ) )
+		return -1;
+
+	// Anyone can take an abstract name first, share memory only with our own server
+	if( isTrustedSrpcfShmPeer( ctrl ) == FALSE ) {
+
+		DBGPRINT( "Shared memory server runs as a foreign user\n" );
+		close( ctrl );
+		errno = EPERM;
+		return -1;
+	}
+
+	// The server answers with the memfd and both eventfds
+	memset( &msg, 0, sizeof( msg ) );
+	memset( cmsgBuf, 0, sizeof( cmsgBuf ) );
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgBuf;
+	msg.msg_controllen = sizeof( cmsgBuf );
+	len = recvmsg( ctrl, &msg, MSG_CMSG_CLOEXEC );
+	if( len != 1 ) {
+
+		close( ctrl );
+		return -1;
+	}
+
+	// Whatever descriptors did arrive must not leak
+	pCmsg = CMSG_FIRSTHDR( &msg );
+	if( !pCmsg || pCmsg->cmsg_level != SOL_SOCKET || pCmsg->cmsg_type != SCM_RIGHTS
+		|| pCmsg->cmsg_len != CMSG_LEN( sizeof( fds ) ) ) {
+
+		if( pCmsg && pCmsg->cmsg_level == SOL_SOCKET && pCmsg->cmsg_type == SCM_RIGHTS )
+			for( i = 0 ; i < (pCmsg->cmsg_len - CMSG_LEN( 0 )) / sizeof( s32 ) ; i++ )
+				close( ((s32 *)CMSG_DATA( pCmsg ))[ i ] );
+		close( ctrl );
+		return -1;
+	}
+	memcpy( fds, CMSG_DATA( pCmsg ), sizeof( fds ) );
+
+	// Server to client is our inbound direction
+	pEnd = attachSrpcfShmEnd( ctrl, fds[ 0 ], fds[ 2 ], fds[ 1 ], FALSE );
+	close( fds[ 0 ] );
+	if( !pEnd ) {
+
+		close( fds[ 1 ] );
+		close( fds[ 2 ] );
+		close( ctrl );
+		return -1;
+	}
+
+	*fd = pEnd->fd;
+	return 0;
+}
+
+
+static s32 acceptShmSocket( s32 fd, s32 *apsd ) {
+
+	s8 cmsgBuf[ CMSG_SPACE( sizeof( s32 ) * 3 ) ];
+	struct msghdr msg;
+	struct cmsghdr *pCmsg;
+	struct iovec iov;
+	srpcfShmHdr_t *pHdr;
+	srpcfShmEnd_t *pEnd = NULL;
+	s32 ctrl, mfd = -1, fds[ 3 ] = { -1, -1, -1 };
+	u32 mapSize;
+	s8 c = 0;
+
+	ctrl = accept4( fd, NULL, NULL, SOCK_CLOEXEC );
+	if( ctrl < 0 )
+		return FALSE;
+
+	// The abstract name is open to every local user
+	if( isTrustedSrpcfShmPeer( ctrl ) == FALSE ) {
+
+		DBGPRINT( "Shared memory refused to a foreign user\n" );
+		goto ErrExit;
+	}
+
+	// Both rings live in one memfd, its size is sealed so neither side can fault the other
+	mapSize = sizeof( srpcfShmHdr_t ) + 2 * SRPCF_SHM_RING;
+	mfd = memfd_create( "srpcf-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING );
+	if( mfd < 0 || ftruncate( mfd, mapSize ) < 0
+		|| fcntl( mfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL ) < 0 )
+		goto ErrExit;
+
+	pHdr = (srpcfShmHdr_t *)mmap( NULL, sizeof( srpcfShmHdr_t ), PROT_READ | PROT_WRITE, MAP_SHARED, mfd, 0 );
+	if( pHdr == MAP_FAILED )
+		goto ErrExit;
+	pHdr->magic = SRPCF_SHM_MAGIC;
+	pHdr->ringSize = SRPCF_SHM_RING;
+	pHdr->ring[ 0 ].armed = 1;
+	pHdr->ring[ 1 ].armed = 1;
+	munmap( pHdr, sizeof( srpcfShmHdr_t ) );
+
+	// Client to server, server to client
+	fds[ 0 ] = mfd;
+	fds[ 1 ] = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+	fds[ 2 ] = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+	if( fds[ 1 ] < 0 || fds[ 2 ] < 0 )
+		goto ErrExit;
+
+	memset( &msg, 0, sizeof( msg ) );
+	memset( cmsgBuf, 0, sizeof( cmsgBuf ) );
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgBuf;
+	msg.msg_controllen = sizeof( cmsgBuf );
+	pCmsg = CMSG_FIRSTHDR( &msg );
+	pCmsg->cmsg_level = SOL_SOCKET;
+	pCmsg->cmsg_type = SCM_RIGHTS;
+	pCmsg->cmsg_len = CMSG_LEN( sizeof( fds ) );
+	memcpy( CMSG_DATA( pCmsg ), fds, sizeof( fds ) );
+	if( sendmsg( ctrl, &msg, MSG_NOSIGNAL ) != 1 )
+		goto ErrExit;
+
+	pEnd = attachSrpcfShmEnd( ctrl, mfd, fds[ 1 ], fds[ 2 ], TRUE );
+	if( !pEnd )
+		goto ErrExit;
+	close( mfd );
+
+	*apsd = pEnd->fd;
+	return TRUE;
+
+ErrExit:
+	if( mfd >= 0 )
+		close( mfd );
+	if( fds[ 1 ] >= 0 )
+		close( fds[ 1 ] );
+	if( fds[ 2 ] >= 0 )
+		close( fds[ 2 ] );
+	close( ctrl );
+	return FALSE;
+}
+
+
+// Without wait, stop where the ring is full
+static s32 pushSrpcfShmEnd( s32 fd, struct iovec *iov, s32 iovcnt, bool wait, s32 *wByte ) {
+
+	srpcfShmEnd_t *pEnd;
+	srpcfShmRing_t *pTx;
+	u64 head, tail, start;
+	u32 len, off, first, spin = 0;
+
+	pEnd = lookupSrpcfShmEnd( fd );
+	if( !pEnd ) {
+
+		errno = EBADF;
+		*wByte = -1;
+		return FALSE;
+	}
+	pTx = pEnd->pTx;
+
+	tail = start = pEnd->txTail;
+	for( *wByte = 0 ; iovcnt ; ) {
+
+		if( !iov->iov_len ) {
+
+			iov++;
+			iovcnt--;
+			continue;
+		}
+
+		if( pEnd->shut || __atomic_load_n( &pTx->readerClosed, __ATOMIC_ACQUIRE ) ) {
+
+			errno = EPIPE;
+			*wByte = -1;
+			return FALSE;
+		}
+
+		// Full, let the reader see what is there and wait for room
+		head = __atomic_load_n( &pTx->head, __ATOMIC_ACQUIRE );
+		if( isSaneSrpcfShmEnd( pEnd, head, tail ) == FALSE ) {
+
+			*wByte = -1;
+			return FALSE;
+		}
+		len = pEnd->ringMask + 1 - (u32)(tail - head);
+		if( !len ) {
+
+			if( tail != start ) {
+
+				pEnd->txTail = tail;
+				__atomic_store_n( &pTx->tail, tail, __ATOMIC_RELEASE );
+				__atomic_thread_fence( __ATOMIC_SEQ_CST );
+				if( __atomic_load_n( &pTx->armed, __ATOMIC_RELAXED ) )
+					signalSrpcfShmFd( pEnd->txEfd );
+				start = tail;
+			}
+
+			if( wait == FALSE )
+				break;
+
+			if( spin++ < srpcfShmSpin ) {
+
+				SRPCF_SHM_RELAX();
+				continue;
+			}
+
+			if( isPeerGoneSrpcfShmEnd( pEnd ) == TRUE ) {
+
+				errno = EPIPE;
+				*wByte = -1;
+				return FALSE;
+			}
+			usleep( SRPCF_SHM_BACKOFF_US );
+			continue;
+		}
+		spin = 0;
+
+		if( len > iov->iov_len )
+			len = iov->iov_len;
+
+		// Copy in, wrapping around the end of the ring
+		off = tail & pEnd->ringMask;
+		first = pEnd->ringMask + 1 - off;
+		if( first > len )
+			first = len;
+		memcpy( pEnd->txData + off, iov->iov_base, first );
+		memcpy( pEnd->txData, (s8 *)iov->iov_base + first, len - first );
+
+		tail += len;
+		*wByte += len;
+		iov->iov_base = (s8 *)iov->iov_base + len;
+		iov->iov_len -= len;
+	}
+
+	if( tail == start )
+		return TRUE;
+
+	// Publish, then wake the reader only if it was idle and sleeps on the eventfd
+	pEnd->txTail = tail;
+	__atomic_store_n( &pTx->tail, tail, __ATOMIC_RELEASE );
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+	if( __atomic_load_n( &pTx->head, __ATOMIC_RELAXED ) == start
+		&& __atomic_load_n( &pTx->armed, __ATOMIC_RELAXED ) )
+		signalSrpcfShmFd( pEnd->txEfd );
+
+	return TRUE;
+}
+
+
+static s32 sendShmSocket( s32 fd, struct iovec *iov, s32 iovcnt, s32 *wByte ) {
+
+	return pushSrpcfShmEnd( fd, iov, iovcnt, TRUE, wByte );
+}
+
+
+static s32 sendSomeShmSocket( s32 fd, const struct iovec *iov, s32 iovcnt ) {
+
+	struct iovec vec[ LIBSRPCF_IOV_MAX ];
+	s32 wByte;
+
+	// The caller's vector stays as it was
+	if( iovcnt > LIBSRPCF_IOV_MAX )
+		iovcnt = LIBSRPCF_IOV_MAX;
+	memcpy( vec, iov, sizeof( struct iovec ) * iovcnt );
+
+	if( pushSrpcfShmEnd( fd, vec, iovcnt, FALSE, &wByte ) == FALSE )
+		return -1;
+
+	return wByte;
+}
+
+
+// Caller has seen data, copy out what fits
+static s32 takeSrpcfShmEnd( srpcfShmEnd_t *pEnd, void *pktBuf, const u32 length, u64 head, u64 tail ) {
+
+	u32 len, off, first;
+
+	if( isSaneSrpcfShmEnd( pEnd, head, tail ) == FALSE )
+		return -1;
+
+	len = tail - head;
+	if( len > length )
+		len = length;
+
+	off = head & pEnd->ringMask;
+	first = pEnd->ringMask + 1 - off;
+	if( first > len )
+		first = len;
+	memcpy( pktBuf, pEnd->rxData + off, first );
+	memcpy( (s8 *)pktBuf + first, pEnd->rxData, len - first );
+
+	pEnd->rxHead = head + len;
+	__atomic_store_n( &pEnd->pRx->head, pEnd->rxHead, __ATOMIC_RELEASE );
+
+	return len;
+}
+
+
+// The eventfd was cleared on the way here, raise it again if anything is still
+// queued so a reader waiting in poll() is not left behind
+static s32 takeClearedSrpcfShmEnd( srpcfShmEnd_t *pEnd, void *pktBuf, const u32 length, u64 head, u64 tail ) {
+
+	s32 len;
+
+	len = takeSrpcfShmEnd( pEnd, pktBuf, length, head, tail );
+	if( len < 0 )
+		return len;
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+	if( __atomic_load_n( &pEnd->pRx->tail, __ATOMIC_ACQUIRE ) != head + len )
+		signalSrpcfShmFd( pEnd->rxEfd );
+
+	return len;
+}
+
+
+static s32 recvShmSocket( s32 fd, void *pktBuf, const u32 length ) {
+
+	srpcfShmEnd_t *pEnd;
+	srpcfShmRing_t *pRx;
+	struct pollfd pfd;
+	u64 head, tail, count;
+	u32 spin;
+	s32 len;
+
+	pEnd = lookupSrpcfShmEnd( fd );
+	if( !pEnd ) {
+
+		errno = EBADF;
+		return -1;
+	}
+	pRx = pEnd->pRx;
+
+	for( ; ; ) {
+
+		if( pEnd->shut )
+			return 0;
+
+		// Fast path, no system call while data is queued
+		head = pEnd->rxHead;
+		tail = __atomic_load_n( &pRx->tail, __ATOMIC_ACQUIRE );
+		if( tail != head )
+			return takeSrpcfShmEnd( pEnd, pktBuf, length, head, tail );
+
+		// Drained and the writer is done
+		if( __atomic_load_n( &pRx->writerClosed, __ATOMIC_ACQUIRE ) )
+			return 0;
+
+		// Clear the wakeup, then look again so nothing slips in between. A clear
+		// eventfd means the control socket woke us, the peer may have died.
+		if( read( pEnd->rxEfd, &count, sizeof( count ) ) < 0 && isPeerGoneSrpcfShmEnd( pEnd ) == TRUE )
+			return 0;
+		__atomic_thread_fence( __ATOMIC_SEQ_CST );
+		tail = __atomic_load_n( &pRx->tail, __ATOMIC_ACQUIRE );
+		if( tail != head )
+			return takeClearedSrpcfShmEnd( pEnd, pktBuf, length, head, tail );
+
+		if( isNonblockSrpcfShmFd( fd ) == TRUE ) {
+
+			errno = EAGAIN;
+			return -1;
+		}
+
+		// Spin a little with the writer told not to bother with the eventfd
+		__atomic_store_n( &pRx->armed, 0, __ATOMIC_RELAXED );
+		for( spin = 0 ; spin < srpcfShmSpin ; spin++ ) {
+
+			tail = __atomic_load_n( &pRx->tail, __ATOMIC_ACQUIRE );
+			if( tail != head )
+				break;
+			SRPCF_SHM_RELAX();
+		}
+		__atomic_store_n( &pRx->armed, 1, __ATOMIC_RELAXED );
+		__atomic_thread_fence( __ATOMIC_SEQ_CST );
+		tail = __atomic_load_n( &pRx->tail, __ATOMIC_ACQUIRE );
+		if( tail != head )
+			return takeClearedSrpcfShmEnd( pEnd, pktBuf, length, head, tail );
+
+		// Sleep until the writer signals or the peer goes away
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		len = poll( &pfd, 1, pEnd->timeout ? pEnd->timeout * 1000 : -1 );
+		if( len < 0 )
+			return -1;
+
+		if( !len ) {
+
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+}
+
+
+static s32 pollShmSocket( s32 fd, s16 events, s32 msec ) {
+
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+
+	return poll( &pfd, 1, msec );
+}
+
+
+static s32 timeoutShmSocket( s32 fd, u32 seconds ) {
+
+	srpcfShmEnd_t *pEnd;
+
+	pEnd = lookupSrpcfShmEnd( fd );
+	if( !pEnd ) {
+
+		errno = EBADF;
+		return -1;
+	}
+
+	pEnd->timeout = seconds;
+	return 0;
+}
+
+
+static void shutdownShmSocket( s32 fd ) {
+
+	srpcfShmEnd_t *pEnd;
+
+	pEnd = lookupSrpcfShmEnd( fd );
+	if( !pEnd )
+		return;
+
+	// Both sides read an end of stream, the control socket wakes them
+	pEnd->shut = TRUE;
+	__atomic_store_n( &pEnd->pTx->writerClosed, 1, __ATOMIC_RELEASE );
+	__atomic_store_n( &pEnd->pRx->readerClosed, 1, __ATOMIC_RELEASE );
+	shutdown( pEnd->ctrl, SHUT_RDWR );
+}
+
+
+static void closeShmSocket( s32 fd ) {
+
+	srpcfShmEnd_t *pEnd;
+
+	if( fd >= 0 && fd < SRPCF_SHM_FDS && srpcfShmHandleTbl[ fd ].listener == TRUE ) {
+
+		srpcfShmHandleTbl[ fd ].listener = FALSE;
+		close( fd );
+		return;
+	}
+
+	pEnd = lookupSrpcfShmEnd( fd );
+	if( !pEnd )
+		return;
+
+	// Forget the handle before the descriptor can be reused
+	__atomic_store_n( &srpcfShmHandleTbl[ fd ].pEnd, NULL, __ATOMIC_RELEASE );
+
+	__atomic_store_n( &pEnd->pTx->writerClosed, 1, __ATOMIC_RELEASE );
+	__atomic_store_n( &pEnd->pRx->readerClosed, 1, __ATOMIC_RELEASE );
+	signalSrpcfShmFd( pEnd->txEfd );
+
+	close( pEnd->fd );
+	close( pEnd->ctrl );
+	close( pEnd->rxEfd );
+	close( pEnd->txEfd );
+	munmap( pEnd->pHdr, pEnd->mapSize );
+	free( pEnd );
+}
+
+
+bool isShmSocketAddress( const s8 *addr ) {
+
+	return (addr && !strncmp( addr, SRPCF_SHM_PREFIX, strlen( SRPCF_SHM_PREFIX ) )) ? TRUE : FALSE;
+}
+
+
+bool isShmSocket( s32 fd ) {
+
+	if( fd < 0 || fd >= SRPCF_SHM_FDS )
+		return FALSE;
+
+	return (srpcfShmHandleTbl[ fd ].listener || lookupSrpcfShmEnd( fd )) ? TRUE : FALSE;
+}
+
+
+const srpcfTransport_t srpcfShmTransport = {
+
+	.name = "shm",
+	.listen = listenShmSocket,
+	.connect = connectShmSocket,
+	.accept = acceptShmSocket,
+	.send = sendShmSocket,
+	.sendSome = sendSomeShmSocket,
+	.recv = recvShmSocket,
+	.readiness = pollShmSocket,
+	.timeout = timeoutShmSocket,
+	.shutdown = shutdownShmSocket,
+	.close = closeShmSocket,
+};
+
+
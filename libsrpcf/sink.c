@@ -0,0 +1,172 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: sink.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+
+
+static bool reserveSrpcfSink( srpcfSink_t *pSink, u32 length ) {
+
+	s8 *pNew;
+	u32 size;
+
+	// Keep room for the terminator of the final response
+	if( (pSink->dataLength + length + 1) <= pSink->dataSize )
+		return TRUE;
+
+	// Collected results are bound by the message limit
+	if( (pSink->dataLength + length + 1) > limitOfSrpcfMessage() ) {
+
+		DBGPRINT( "Result exceeds the message limit\n" );
+		return FALSE;
+	}
+
+	size = pSink->dataSize ? pSink->dataSize : LIBSRPCF_CHUNK_SIZE;
+	while( size < (pSink->dataLength + length + 1) )
+		size *= 2;
+	if( size > limitOfSrpcfMessage() )
+		size = limitOfSrpcfMessage();
+
+	pNew = (s8 *)realloc( pSink->data, size );
+	if( !pNew )
+		return FALSE;
+
+	pSink->data = pNew;
+	pSink->dataSize = size;
+	return TRUE;
+}
+
+
+void openSrpcfSink( srpcfSink_t *pSink, s32 *pMxqFd, u32 srpcfReqId, bool stream ) {
+
+	// Clients that cannot take chunks get everything in the final response
+	pSink->pMxqFd = pMxqFd;
+	pSink->srpcfReqId = srpcfReqId;
+	pSink->stream = stream;
+	pSink->failed = FALSE;
+	pSink->data = NULL;
+	pSink->dataLength = 0;
+	pSink->dataSize = 0;
+}
+
+
+bool flushSrpcfSink( srpcfSink_t *pSink ) {
+
+	if( pSink->failed == TRUE )
+		return FALSE;
+
+	if( pSink->stream == FALSE || !pSink->dataLength )
+		return TRUE;
+
+	// Send whatever is buffered as one chunk
+	if( responseSrpcfChunk( pSink->pMxqFd, pSink->srpcfReqId, pSink->data, pSink->dataLength ) == FALSE ) {
+
+		pSink->failed = TRUE;
+		return FALSE;
+	}
+	pSink->dataLength = 0;
+
+	return TRUE;
+}
+
+
+bool emitSrpcfChunk( srpcfSink_t *pSink, const s8 *data, u32 length ) {
+
+	if( pSink->failed == TRUE )
+		return FALSE;
+
+	// Large chunks go straight out, there is no point in copying them
+	if( pSink->stream == TRUE && length >= LIBSRPCF_CHUNK_SIZE ) {
+
+		if( flushSrpcfSink( pSink ) == FALSE )
+			return FALSE;
+
+		if( responseSrpcfChunk( pSink->pMxqFd, pSink->srpcfReqId, data, length ) == FALSE ) {
+
+			pSink->failed = TRUE;
+			return FALSE;
+		}
+
+		return TRUE;
+	}
+
+	// Small ones are coalesced
+	if( reserveSrpcfSink( pSink, length ) == FALSE ) {
+
+		pSink->failed = TRUE;
+		return FALSE;
+	}
+	memcpy( pSink->data + pSink->dataLength, data, length );
+	pSink->dataLength += length;
+
+	if( pSink->stream == TRUE && pSink->dataLength >= LIBSRPCF_CHUNK_SIZE )
+		return flushSrpcfSink( pSink );
+
+	return TRUE;
+}
+
+
+bool printSrpcfChunk( srpcfSink_t *pSink, const s8 *fmt, ... ) {
+
+	va_list ap;
+	s8 buf[ LIBSRPCF_MSG_SIZE ];
+	s32 length;
+
+	va_start( ap, fmt );
+	length = vsnprintf( buf, sizeof( buf ), fmt, ap );
+	va_end( ap );
+
+	if( length < 0 )
+		return FALSE;
+
+	// Longer lines are cut at the buffer
+	if( length >= sizeof( buf ) )
+		length = sizeof( buf ) - 1;
+
+	return emitSrpcfChunk( pSink, buf, length );
+}
+
+
+s8 *closeSrpcfSink( srpcfSink_t *pSink ) {
+
+	s8 *data = NULL;
+
+	// The rest goes out with the final response
+	if( pSink->failed == FALSE && pSink->dataLength ) {
+
+		data = pSink->data;
+		data[ pSink->dataLength ] = '\0';
+	}
+	else if( pSink->data )
+		free( pSink->data );
+
+	pSink->data = NULL;
+	pSink->dataLength = 0;
+	pSink->dataSize = 0;
+
+	return data;
+}
@@ -31,23 +31,130 @@
 #include "libsrpcf.h"
 
 
-u32 countSupportedSRPCFs( const srpcfSupported_t *pSrpcfSupported ) {
+//
+// Generated by tools/gen_registry.awk
+//
+extern const srpcfCmdDesc_t srpcfCmdDescTbl[];
+extern const u32 numOfSrpcfCmdDescs;
+extern const u32 srpcfCmdHashSeed;
+extern const u32 srpcfCmdHashSize;
+extern const s16 srpcfCmdHashTbl[];
+extern const s16 srpcfCmdNoTbl[];
 
-	u32 sum;
-	for( sum = 0 ; (pSrpcfSupported + sum)->srpcfCmdNo != XR_END_SRPCF ; sum++ );
-	return sum;
+
+//
+// Global variables
+//
+static bool srpcfCmdEnabledTbl[ XR_END_SRPCF ];
+
+
+static u32 hashSrpcfCmd( const s8 *srpcfFuncName ) {
+
+	u64 h = 0;
+
+	// Must match hash() in tools/gen_registry.awk, size is a power of two
+	for( ; *srpcfFuncName ; srpcfFuncName++ )
+		h = (h * srpcfCmdHashSeed + (u8)*srpcfFuncName) & (srpcfCmdHashSize - 1);
+
+	return (u32)h;
+}
+
+
+u32 numOfSrpcfCmds( void ) {
+
+	return numOfSrpcfCmdDescs;
+}
+
+
+const srpcfCmdDesc_t *indexSrpcfCmd( u32 idx ) {
+
+	// Descriptors are sorted by name
+	if( idx >= numOfSrpcfCmdDescs )
+		return NULL;
+
+	return &srpcfCmdDescTbl[ idx ];
+}
+
+
+const srpcfCmdDesc_t *lookupSrpcfCmd( u32 srpcfCmdNo ) {
+
+	if( srpcfCmdNo <= XR_START_SRPCF || srpcfCmdNo >= XR_END_SRPCF )
+		return NULL;
+
+	// Numbers may have gaps
+	if( srpcfCmdNoTbl[ srpcfCmdNo ] < 0 )
+		return NULL;
+
+	return &srpcfCmdDescTbl[ srpcfCmdNoTbl[ srpcfCmdNo ] ];
+}
+
+
+const srpcfCmdDesc_t *findSrpcfCmd( const s8 *srpcfFuncName ) {
+
+	s16 idx;
+
+	// The hash is perfect over the registered names, one compare settles it
+	idx = srpcfCmdHashTbl[ hashSrpcfCmd( srpcfFuncName ) ];
+	if( idx < 0 || strcmp( srpcfCmdDescTbl[ idx ].srpcfFuncName, srpcfFuncName ) )
+		return NULL;
+
+	return &srpcfCmdDescTbl[ idx ];
+}
+
+
+void enableSrpcfCmd( u32 srpcfCmdNo ) {
+
+	if( lookupSrpcfCmd( srpcfCmdNo ) )
+		srpcfCmdEnabledTbl[ srpcfCmdNo ] = TRUE;
+}
+
+
+bool isSrpcfCmdEnabled( u32 srpcfCmdNo ) {
+
+	if( srpcfCmdNo <= XR_START_SRPCF || srpcfCmdNo >= XR_END_SRPCF )
+		return FALSE;
+
+	return srpcfCmdEnabledTbl[ srpcfCmdNo ];
 }
 
 
-u32 checkSrpcfCmdEnabled( const s8 *srpcfStr, const srpcfSupported_t *pSrpcfSupported_t ) {
+u32 checkSrpcfCmdEnabled( const s8 *srpcfStr ) {
+
+	const srpcfCmdDesc_t *pSrpcfCmdDesc;
+
+	pSrpcfCmdDesc = findSrpcfCmd( srpcfStr );
+	if( !pSrpcfCmdDesc || isSrpcfCmdEnabled( pSrpcfCmdDesc->srpcfCmdNo ) == FALSE )
+		return XR_END_SRPCF;
+
+	return pSrpcfCmdDesc->srpcfCmdNo;
+}
+
+
+void resolveSrpcfDispatch( void *handle, const s8 *srpcfFuncName, srpcfDispatch_t *pSrpcfDispatch ) {
+
+	s8 symbol[ SRPCF_FUNC_MAXLEN ];
+
+	// Server side, a command either returns its result or streams it
+	snprintf( symbol, SRPCF_FUNC_MAXLEN, SRPCF_EXECUTOR_PREFIX "%s", srpcfFuncName );
+	pSrpcfDispatch->srpcfFuncExecutor = dlsym( handle, symbol );
+	snprintf( symbol, SRPCF_FUNC_MAXLEN, SRPCF_STREAMER_PREFIX "%s", srpcfFuncName );
+	pSrpcfDispatch->srpcfFuncStreamer = dlsym( handle, symbol );
 
-    s32 i;
-    for( i = 0 ; (pSrpcfSupported_t + i)->srpcfCmdNo != XR_END_SRPCF ; i++ )
-        if( ((pSrpcfSupported_t + i)->enabled == TRUE)
-            && !strcmp( (pSrpcfSupported_t + i)->srpcfFuncName, srpcfStr ) )
-            return (pSrpcfSupported_t + i)->srpcfCmdNo;
+	// Extended ABI, commands keeping state between calls
+	snprintf( symbol, SRPCF_FUNC_MAXLEN, SRPCF_CONTEXT_PREFIX "%s", srpcfFuncName );
+	pSrpcfDispatch->srpcfFuncContextExecutor = dlsym( handle, symbol );
+	snprintf( symbol, SRPCF_FUNC_MAXLEN, SRPCF_INIT_PREFIX "%s", srpcfFuncName );
+	pSrpcfDispatch->srpcfFuncInit = dlsym( handle, symbol );
+	snprintf( symbol, SRPCF_FUNC_MAXLEN, SRPCF_FINI_PREFIX "%s", srpcfFuncName );
+	pSrpcfDispatch->srpcfFuncFini = dlsym( handle, symbol );
 
-    return XR_END_SRPCF;
+	// Shell side
+	snprintf( symbol, SRPCF_FUNC_MAXLEN, SRPCF_PARSER_PREFIX "%s", srpcfFuncName );
+	pSrpcfDispatch->srpcfFuncParser = dlsym( handle, symbol );
+	snprintf( symbol, SRPCF_FUNC_MAXLEN, SRPCF_HELPER_PREFIX "%s", srpcfFuncName );
+	pSrpcfDispatch->srpcfFuncHelper = dlsym( handle, symbol );
+	snprintf( symbol, SRPCF_FUNC_MAXLEN, SRPCF_ERROR_PREFIX "%s", srpcfFuncName );
+	pSrpcfDispatch->srpcfFuncError = dlsym( handle, symbol );
 }
 
 
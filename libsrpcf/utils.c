@@ -356,6 +356,63 @@ s8 *readFileToNewHugeBuffer( const s8 *basePath, const s8 *restPath, u32 size )
 }
 
 
+s8 *readWholeFileToNewBuffer( const s8 *basePath, const s8 *restPath ) {
+
+    s32 fd, len, sum = 0, size = LIBSRPCF_MAX_PATH;
+    s8 *p, *pNew, path[ LIBSRPCF_MAX_PATH ];
+
+    // Get full path
+    snprintf( path, LIBSRPCF_MAX_PATH, "%s%s", basePath, restPath );
+
+    // Open the file
+    fd = open( path, O_RDONLY );
+    if( fd < 0 )
+        return NULL;
+
+    // Files under /proc report no size, grow the buffer until EOF
+    p = (s8 *)malloc( size );
+    if( !p )
+        goto ErrExit;
+
+    for( ; ; ) {
+
+        if( (size - sum) < 2 ) {
+
+            pNew = (s8 *)realloc( p, size * 2 );
+            if( !pNew )
+                goto ErrExit1;
+            p = pNew;
+            size *= 2;
+        }
+
+        len = read( fd, p + sum, size - sum - 1 );
+        if( len < 0 )
+            goto ErrExit1;
+        if( !len )
+            break;
+        sum += len;
+    }
+
+    if( !sum )
+        goto ErrExit1;
+    p[ sum ] = 0;
+
+    // Close
+    close( fd );
+    return p;
+
+ErrExit1:
+
+    free( p );
+    p = NULL;
+
+ErrExit:
+
+    close( fd );
+    return p;
+}
+
+
 s8 *readRedirectFileToNewHugeBuffer( const s8 *basePath, const s8 *restPath, u32 size ) {
     s8 path[ LIBSRPCF_MAX_PATH ];
 
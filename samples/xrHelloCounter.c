@@ -0,0 +1,102 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: xrHelloCounter.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "srpcf_plugin.h"
+
+
+//
+// Structures
+//
+typedef struct _helloCounter {
+
+	s8			hostName[ 64 ];
+	u32			numOfCalls;
+
+} helloCounter_t;
+
+
+// SRPCF Shell Help
+LIBSRPCF_HELPER_TEXT( "\
+SYNTAX:\n\
+\txrHelloCounter\n\
+USAGE:\n\
+\tHello from a plugin that counts its calls.\n\
+" );
+
+
+// SRPCF Shell Error Handle
+LIBSRPCF_ERROR_FUNC( xrHelloCounter ) {}
+
+
+// SRPCF Shell Implementation
+LIBSRPCF_SHELL_IMPLEMENT( xrHelloCounter ) {
+
+	return TRUE;
+}
+
+
+// SRPCF Server Initialization, runs once when the plugin is loaded
+LIBSRPCF_INIT_FUNC( xrHelloCounter ) {
+
+	helloCounter_t *pHelloCounter;
+
+	pHelloCounter = (helloCounter_t *)malloc( sizeof( helloCounter_t ) );
+	if( !pHelloCounter )
+		return FALSE;
+
+	// Work done here is not repeated on every call
+	if( gethostname( pHelloCounter->hostName, sizeof( pHelloCounter->hostName ) ) < 0 )
+		strcpy( pHelloCounter->hostName, "unknown" );
+	pHelloCounter->hostName[ sizeof( pHelloCounter->hostName ) - 1 ] = '\0';
+	pHelloCounter->numOfCalls = 0;
+
+	*ppContext = pHelloCounter;
+	return TRUE;
+}
+
+
+// SRPCF Server Shutdown, runs once the plugin is unloaded or replaced
+LIBSRPCF_FINI_FUNC( xrHelloCounter ) {
+
+	free( pContext );
+}
+
+
+// SRPCF Server Implementation
+LIBSRPCF_CONTEXT_IMPLEMENT( xrHelloCounter ) {
+
+	helloCounter_t *pHelloCounter = (helloCounter_t *)pContext;
+	s8 *p;
+	u32 calls;
+
+	// Calls may run on several workers at once
+	calls = __atomic_add_fetch( &pHelloCounter->numOfCalls, 1, __ATOMIC_RELAXED );
+
+	p = malloc( SRPCF_FUNC_MAXLEN * 2 );
+	if( !p ) {
+
+		*errorCode = SRPCF_FAILED_NOMEM;
+		return NULL;
+	}
+
+	snprintf( p, SRPCF_FUNC_MAXLEN * 2, "Hello from %s, call #%u\n", pHelloCounter->hostName, calls );
+
+    *errorCode = SRPCF_SUCCESSFUL;
+    return p;
+}
+
@@ -0,0 +1,443 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: fanout.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+#include "srpcfsh.h"
+#include "netsock.h"
+
+
+//
+// Global variables
+//
+static srpcfshFanout_t srpcfshFanout;
+
+
+//
+// The same command runs on every host of SRPCFSH_HOSTS, at most
+// SRPCFSH_PARALLEL at a time. Each result is printed as soon as its host
+// answers, every line tagged with the host. A host that has not answered
+// within SRPCFSH_DEADLINE milliseconds is reported and given up on, and
+// its worker is replaced so the others keep going. A host followed by a
+// list in brackets is a relay, it answers for every server on its list.
+//
+static u64 getMonotonicMilliseconds( void ) {
+
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (u64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static u32 readSrpcfshEnv( const s8 *name, u32 def ) {
+
+	s8 *value = getenv( name );
+	u32 num;
+
+	if( !value )
+		return def;
+
+	num = strtoul( value, NULL, 10 );
+	return num ? num : def;
+}
+
+
+static s8 *copySrpcfshString( const s8 *str, u32 len ) {
+
+	s8 *copy;
+
+	copy = (s8 *)malloc( len + 1 );
+	if( !copy )
+		return NULL;
+
+	memcpy( copy, str, len );
+	copy[ len ] = '\0';
+
+	return copy;
+}
+
+
+static u32 parseSrpcfshHosts( srpcfshFanout_t *pSrpcfshFanout, const s8 *hosts ) {
+
+	const s8 *cursor, *end = hosts + strlen( hosts );
+	srpcfRelayTarget_t srpcfRelayTarget;
+	srpcfshHost_t *pSrpcfshHost;
+	u32 num = 0;
+
+	// Results are matched to servers by position, a bad entry spoils them all
+	if( !countSrpcfRelayLeaves( hosts, end - hosts ) )
+		return 0;
+
+	for( cursor = hosts ; parseSrpcfRelayTarget( &cursor, end, &srpcfRelayTarget ) == TRUE ; num++ );
+
+	pSrpcfshFanout->hostTbl = (srpcfshHost_t *)calloc( num, sizeof( srpcfshHost_t ) );
+	if( !pSrpcfshFanout->hostTbl )
+		return 0;
+
+	for( cursor = hosts ; parseSrpcfRelayTarget( &cursor, end, &srpcfRelayTarget ) == TRUE ; ) {
+
+		pSrpcfshHost = &pSrpcfshFanout->hostTbl[ pSrpcfshFanout->numOfHosts++ ];
+		pSrpcfshHost->label = copySrpcfshString( srpcfRelayTarget.name, srpcfRelayTarget.nameLength );
+		pSrpcfshHost->addr = strdup( srpcfRelayTarget.addr );
+		pSrpcfshHost->port = srpcfRelayTarget.port;
+		pSrpcfshHost->cfd = -1;
+
+		// Relays are handed the list in brackets as it was written
+		if( srpcfRelayTarget.subTargets )
+			pSrpcfshHost->subTargets = copySrpcfshString( srpcfRelayTarget.subTargets, srpcfRelayTarget.subLength );
+	}
+
+	return pSrpcfshFanout->numOfHosts;
+}
+
+
+// Called with the lock held
+static void printSrpcfshLines( const s8 *label, u32 labelLength, u32 errorCode, const s8 *data, const s8 *error ) {
+
+	const s8 *line, *next;
+
+	if( error )
+		printf( "%.*s: ERROR: %s\n", (s32)labelLength, label, error );
+	else if( errorCode != SRPCF_SUCCESSFUL )
+		printf( "%.*s: ERROR: %d\n", (s32)labelLength, label, errorCode );
+	else if( !data || !*data )
+		printf( "%.*s: SUCCESSFUL\n", (s32)labelLength, label );
+	else {
+
+		// Tag every line, so interleaved hosts can be told apart
+		for( line = data ; *line ; line = next + 1 ) {
+
+			next = strchr( line, '\n' );
+			if( !next ) {
+
+				printf( "%.*s: %s\n", (s32)labelLength, label, line );
+				break;
+			}
+
+			printf( "%.*s: %.*s\n", (s32)labelLength, label, (s32)(next - line), line );
+		}
+	}
+}
+
+
+// Called with the lock held. A relay cannot tell an unreachable server from
+// a failing command, so any error below counts against it.
+static bool printSrpcfshRelay( const s8 *targets, u32 targetLength, srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch, srpcfBatchResult_t **ppSrpcfBatchResult, const s8 *error ) {
+
+	const s8 *cursor = targets, *data;
+	srpcfRelayTarget_t srpcfRelayTarget;
+	srpcfBatchResult_t *pSrpcfBatchResult;
+	bool ret = TRUE;
+
+	// The results come in the order the leaves are listed
+	while( parseSrpcfRelayTarget( &cursor, targets + targetLength, &srpcfRelayTarget ) == TRUE ) {
+
+		if( srpcfRelayTarget.subTargets ) {
+
+			if( printSrpcfshRelay( srpcfRelayTarget.subTargets, srpcfRelayTarget.subLength,
+					pSrpcfSvrRspExecuteBatch, ppSrpcfBatchResult, error ) == FALSE )
+				ret = FALSE;
+			continue;
+		}
+
+		pSrpcfBatchResult = NULL;
+		if( !error ) {
+
+			pSrpcfBatchResult = nextSrpcfBatchResult( pSrpcfSvrRspExecuteBatch, *ppSrpcfBatchResult );
+			*ppSrpcfBatchResult = pSrpcfBatchResult;
+		}
+
+		if( error || !pSrpcfBatchResult ) {
+
+			printSrpcfshLines( srpcfRelayTarget.name, srpcfRelayTarget.nameLength, 0, NULL, error ? error : "missing result" );
+			ret = FALSE;
+			continue;
+		}
+
+		// Only strings are printed
+		data = (const s8 *)&pSrpcfBatchResult->dataPtr;
+		if( !pSrpcfBatchResult->dataLength || data[ pSrpcfBatchResult->dataLength - 1 ] != '\0' )
+			data = NULL;
+
+		printSrpcfshLines( srpcfRelayTarget.name, srpcfRelayTarget.nameLength,
+				pSrpcfBatchResult->srpcfErrorCode, data, NULL );
+		if( pSrpcfBatchResult->srpcfErrorCode != SRPCF_SUCCESSFUL )
+			ret = FALSE;
+	}
+
+	return ret;
+}
+
+
+// Called with the lock held, returns FALSE if the host failed
+static bool printSrpcfshResult( srpcfshHost_t *pSrpcfshHost, srpcfSvrRspExecute_t *pSrpcfSvrRspExecute, const s8 *error ) {
+
+	srpcfBatchResult_t *pSrpcfBatchResult = NULL;
+	bool ret;
+
+	if( pSrpcfshHost->subTargets ) {
+
+		if( !error && (u32)pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfOpCode != SRPCF_RSP_EXECUTE_BATCH )
+			error = "not a relay";
+
+		ret = printSrpcfshRelay( pSrpcfshHost->subTargets, strlen( pSrpcfshHost->subTargets ),
+				(srpcfSvrRspExecuteBatch_t *)pSrpcfSvrRspExecute, &pSrpcfBatchResult, error );
+	}
+	else {
+
+		printSrpcfshLines( pSrpcfshHost->label, strlen( pSrpcfshHost->label ),
+				error ? 0 : pSrpcfSvrRspExecute->srpcfErrorCode,
+				(!error && pSrpcfSvrRspExecute->dataLength) ? (s8 *)&pSrpcfSvrRspExecute->dataPtr : NULL, error );
+		ret = error ? FALSE : TRUE;
+	}
+
+	fflush( stdout );
+	return ret;
+}
+
+
+// Called with the lock held
+static void finishSrpcfshHost( srpcfshFanout_t *pSrpcfshFanout, srpcfshHost_t *pSrpcfshHost, srpcfshHostState_t state ) {
+
+	pSrpcfshHost->state = state;
+	if( state != SRPCFSH_HOST_DONE )
+		pSrpcfshFanout->numOfFailed++;
+
+	pSrpcfshFanout->numOfFinished++;
+	pthread_cond_signal( &pSrpcfshFanout->cond );
+}
+
+
+static void *runSrpcfshWorker( void *arg ) {
+
+	srpcfshFanout_t *pSrpcfshFanout = (srpcfshFanout_t *)arg;
+	srpcfshHost_t *pSrpcfshHost;
+	srpcfSvrRspExecute_t *pSrpcfSvrRspExecute;
+	cmdOpt_t *pCmdOpt;
+	const s8 *error;
+	bool connected, retired, ok;
+	u32 idx;
+	s32 cfd;
+
+	for( ; ; ) {
+
+		// Pick up the next host
+		pthread_mutex_lock( &pSrpcfshFanout->lock );
+		idx = pSrpcfshFanout->nextHost;
+		if( idx >= pSrpcfshFanout->numOfHosts ) {
+
+			pthread_mutex_unlock( &pSrpcfshFanout->lock );
+			break;
+		}
+		pSrpcfshFanout->nextHost++;
+
+		pSrpcfshHost = &pSrpcfshFanout->hostTbl[ idx ];
+		pSrpcfshHost->state = SRPCFSH_HOST_RUNNING;
+		pSrpcfshHost->start = getMonotonicMilliseconds();
+		pthread_mutex_unlock( &pSrpcfshFanout->lock );
+
+		pSrpcfSvrRspExecute = NULL;
+		error = NULL;
+		connected = FALSE;
+
+		if( connectSocket( &cfd, pSrpcfshHost->addr, pSrpcfshHost->port ) ) {
+
+			error = "cannot connect";
+			goto Report;
+		}
+		connected = TRUE;
+
+		// From here on the watchdog may cut it short
+		pthread_mutex_lock( &pSrpcfshFanout->lock );
+		if( pSrpcfshHost->state == SRPCFSH_HOST_RUNNING )
+			pSrpcfshHost->cfd = cfd;
+		else
+			error = "deadline exceeded";
+		pthread_mutex_unlock( &pSrpcfshFanout->lock );
+
+		if( error )
+			goto Report;
+
+		setTimeoutSocket( cfd, (pSrpcfshFanout->deadline + 999) / 1000 );
+
+		pCmdOpt = copyCmdOptList( pSrpcfshFanout->pCmdOpt );
+		if( pSrpcfshFanout->pCmdOpt && !pCmdOpt )
+			error = "out of memory";
+		else {
+
+			// A relay has to answer before we give up on it
+			if( pSrpcfshHost->subTargets )
+				pSrpcfSvrRspExecute = (srpcfSvrRspExecute_t *)requestSrpcfExecuteRelay( &cfd, &cfd,
+						pSrpcfshHost->subTargets, strlen( pSrpcfshHost->subTargets ),
+						LIBSRPCF_RELAY_DEADLINE( pSrpcfshFanout->deadline ),
+						pSrpcfshFanout->srpcfCmdNo, pCmdOpt, pSrpcfshFanout->srpcfName );
+			else
+				pSrpcfSvrRspExecute = requestSrpcfExecuteStream( &cfd, &cfd,
+						pSrpcfshFanout->srpcfCmdNo, pCmdOpt, pSrpcfshFanout->srpcfName, NULL );
+			if( !pSrpcfSvrRspExecute )
+				error = "no response";
+		}
+
+Report:
+
+		pthread_mutex_lock( &pSrpcfshFanout->lock );
+
+		// Nothing more to say once the deadline was reported
+		retired = (pSrpcfshHost->state != SRPCFSH_HOST_RUNNING) ? TRUE : FALSE;
+		if( retired == FALSE ) {
+
+			ok = printSrpcfshResult( pSrpcfshHost, pSrpcfSvrRspExecute, error );
+			finishSrpcfshHost( pSrpcfshFanout, pSrpcfshHost, ok ? SRPCFSH_HOST_DONE : SRPCFSH_HOST_FAILED );
+		}
+		pSrpcfshHost->cfd = -1;
+		pthread_mutex_unlock( &pSrpcfshFanout->lock );
+
+		if( connected == TRUE )
+			deinitializeSocket( cfd );
+		releaseSrpcfResponse( pSrpcfSvrRspExecute );
+
+		// A replacement took over when this host expired
+		if( retired == TRUE )
+			break;
+	}
+
+	return NULL;
+}
+
+
+static bool startSrpcfshWorker( srpcfshFanout_t *pSrpcfshFanout ) {
+
+	pthread_attr_t attr;
+	pthread_t pth;
+	s32 ret;
+
+	// Nobody joins them, a worker stuck in connect() dies with the process
+	pthread_attr_init( &attr );
+	pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+	ret = pthread_create( &pth, &attr, runSrpcfshWorker, pSrpcfshFanout );
+	pthread_attr_destroy( &attr );
+
+	return ret ? FALSE : TRUE;
+}
+
+
+// Called with the lock held
+static void expireSrpcfshHosts( srpcfshFanout_t *pSrpcfshFanout ) {
+
+	srpcfshHost_t *pSrpcfshHost;
+	u64 now = getMonotonicMilliseconds();
+	u32 i;
+
+	for( i = 0 ; i < pSrpcfshFanout->nextHost ; i++ ) {
+
+		pSrpcfshHost = &pSrpcfshFanout->hostTbl[ i ];
+		if( pSrpcfshHost->state != SRPCFSH_HOST_RUNNING
+			|| (now - pSrpcfshHost->start) < pSrpcfshFanout->deadline )
+			continue;
+
+		printSrpcfshResult( pSrpcfshHost, NULL, "deadline exceeded" );
+		finishSrpcfshHost( pSrpcfshFanout, pSrpcfshHost, SRPCFSH_HOST_EXPIRED );
+
+		// Wake its worker up if it is waiting for the response
+		if( pSrpcfshHost->cfd >= 0 )
+			shutdownSocket( pSrpcfshHost->cfd );
+
+		if( pSrpcfshFanout->nextHost < pSrpcfshFanout->numOfHosts
+			&& startSrpcfshWorker( pSrpcfshFanout ) == FALSE )
+			DBGPRINT( "Cannot replace the worker of %s\n", pSrpcfshHost->label );
+	}
+}
+
+
+s32 runSrpcfshFanout( const s8 *hosts, u32 srpcfCmdNo, s8 *srpcfName, cmdOpt_t *pCmdOpt ) {
+
+	pthread_condattr_t attr;
+	struct timespec ts;
+	u32 i, numOfWorkers;
+
+	memset( &srpcfshFanout, 0, sizeof( srpcfshFanout_t ) );
+	srpcfshFanout.srpcfCmdNo = srpcfCmdNo;
+	srpcfshFanout.srpcfName = srpcfName;
+	srpcfshFanout.pCmdOpt = pCmdOpt;
+	srpcfshFanout.deadline = readSrpcfshEnv( SRPCFSH_DEADLINE_ENV, SRPCFSH_DEADLINE_DEF );
+	numOfWorkers = readSrpcfshEnv( SRPCFSH_PARALLEL_ENV, SRPCFSH_PARALLEL_DEF );
+
+	if( !parseSrpcfshHosts( &srpcfshFanout, hosts ) ) {
+
+		fprintf( stderr, "Internal Error: no hosts in " SRPCFSH_HOSTS_ENV "\n" );
+		return 1;
+	}
+
+	pthread_mutex_init( &srpcfshFanout.lock, NULL );
+	pthread_condattr_init( &attr );
+	pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+	pthread_cond_init( &srpcfshFanout.cond, &attr );
+	pthread_condattr_destroy( &attr );
+
+	if( numOfWorkers > srpcfshFanout.numOfHosts )
+		numOfWorkers = srpcfshFanout.numOfHosts;
+
+	pthread_mutex_lock( &srpcfshFanout.lock );
+
+	for( i = 0 ; i < numOfWorkers ; i++ ) {
+
+		if( startSrpcfshWorker( &srpcfshFanout ) == FALSE )
+			break;
+	}
+
+	if( !i ) {
+
+		pthread_mutex_unlock( &srpcfshFanout.lock );
+		fprintf( stderr, "Internal Error: cannot start workers\n" );
+		return 1;
+	}
+
+	// Watch the deadlines until every host is accounted for
+	while( srpcfshFanout.numOfFinished < srpcfshFanout.numOfHosts ) {
+
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		ts.tv_nsec += SRPCFSH_WATCH_MSEC * 1000000;
+		if( ts.tv_nsec >= 1000000000 ) {
+
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait( &srpcfshFanout.cond, &srpcfshFanout.lock, &ts );
+
+		expireSrpcfshHosts( &srpcfshFanout );
+	}
+
+	pthread_mutex_unlock( &srpcfshFanout.lock );
+
+	// Workers still stuck on expired hosts go away with the process, the
+	// state they share stays around until then
+	return srpcfshFanout.numOfFailed ? 1 : 0;
+}
+
+
@@ -26,12 +26,12 @@
 #include <dlfcn.h>
 #include <signal.h>
 #include <termios.h>
+#include <time.h>
 
 #include "srpcf_types.h"
 #include "srpcf.h"
 #include "srpcf_err.h"
 #include "libsrpcf.h"
-#include "srpcf_support.h"
 #include "srpcfsvr.h"
 #include "srpcfsh.h"
 #include "netsock.h"
@@ -42,6 +42,9 @@
 //
 static cmdOpt_t *cmdOptHead = NULL;
 static u32 numOfSrpcfParams = 0;
+static bool srpcfStreamed = FALSE;
+static bool srpcfshTiming = FALSE;
+static u64 srpcfshStart, srpcfshMark;
 
 #ifdef SRPCF_COMMAND_LINE
 static struct termios origTermSet, srpcfTermSet;
@@ -50,14 +53,15 @@ static struct termios origTermSet, srpcfTermSet;
 
 static void showSrpcfCmds( void ) {
 
+	const srpcfCmdDesc_t *pSrpcfCmdDesc;
 	s32 i;
 
 	printf( "Supported SRPCF Commands:\n" );
-	for( i = 0 ; srpcfSupportedTbl[ i ].srpcfCmdNo != XR_END_SRPCF ; i++ ) {
+	for( i = 0 ; (pSrpcfCmdDesc = indexSrpcfCmd( i )) ; i++ ) {
 
-		if( srpcfSupportedTbl[ i ].enabled == TRUE ) {
+		if( isSrpcfCmdEnabled( pSrpcfCmdDesc->srpcfCmdNo ) == TRUE ) {
 
-			printf( "\t%s\n", srpcfSupportedTbl[ i ].srpcfFuncName );
+			printf( "\t%s\n", pSrpcfCmdDesc->srpcfFuncName );
 		}
 	};
 	printf( "\n" );
@@ -71,9 +75,184 @@ static void copyright( void ) {
 }
 
 
-srpcfSupported_t *retriveSrpcfSupported( void ) {
+static void showSrpcfChunk( const s8 *data, u32 length ) {
 
-	return srpcfSupportedTbl;
+	// Show partial results right away
+	fwrite( data, 1, length, stdout );
+	fflush( stdout );
+	srpcfStreamed = TRUE;
+}
+
+
+static u64 getMonotonicMicroseconds( void ) {
+
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static void markSrpcfshPhase( const s8 *phase ) {
+
+	u64 now;
+
+	if( srpcfshTiming == FALSE )
+		return;
+
+	// Time spent since the previous mark, on stderr to keep results clean
+	now = getMonotonicMicroseconds();
+	fprintf( stderr, "srpcfsh: %-16s %8llu us\n", phase, now - srpcfshMark );
+	srpcfshMark = now;
+}
+
+
+static void pathOfSrpcfshCache( s8 *path, const s8 *addr, s32 port ) {
+
+	const s8 *dir;
+
+	// Per user and per server
+	dir = getenv( "XDG_RUNTIME_DIR" );
+	if( !dir || !*dir )
+		dir = P_tmpdir;
+
+	snprintf( path, LIBSRPCF_MAX_PATH, "%s/" SRPCFSH_CACHE_FILE, dir, (u32)getuid(), addr, port );
+}
+
+
+static srpcfSvrSupportedSrpcf_t *loadSrpcfshCache( const s8 *path, srpcfSvrRspGeneration_t *pSrpcfSvrRspGeneration ) {
+
+	srpcfshCache_t srpcfshCache;
+	srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf = NULL;
+	u32 hdrLen = sizeof( srpcfSvrSupportedSrpcf_t ) - sizeof( srpcfSupportedNum_t * );
+	struct stat cacheStat;
+	s32 fd;
+
+	// Other users could have planted the file
+	fd = open( path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC );
+	if( fd < 0 )
+		return NULL;
+
+	if( fstat( fd, &cacheStat ) < 0
+		|| !S_ISREG( cacheStat.st_mode )
+		|| cacheStat.st_uid != getuid()
+		|| read( fd, &srpcfshCache, sizeof( srpcfshCache ) ) != sizeof( srpcfshCache ) )
+		goto ErrExit;
+
+	// Only a copy taken under the same generation and capabilities will do
+	if( srpcfshCache.magic != SRPCFSH_CACHE_MAGIC
+		|| srpcfshCache.version != SRPCFSH_CACHE_VERSION
+		|| srpcfshCache.srpcfCapFlags != SRPCFSH_CAPS
+		|| srpcfshCache.srpcfGeneration != pSrpcfSvrRspGeneration->srpcfGeneration
+		|| srpcfshCache.length < hdrLen
+		|| srpcfshCache.length > LIBSRPCF_MSG_LIMIT
+		|| cacheStat.st_size != sizeof( srpcfshCache ) + srpcfshCache.length )
+		goto ErrExit;
+
+	pSrpcfSvrSupportedSrpcf = (srpcfSvrSupportedSrpcf_t *)malloc( srpcfshCache.length );
+	if( !pSrpcfSvrSupportedSrpcf )
+		goto ErrExit;
+
+	if( read( fd, pSrpcfSvrSupportedSrpcf, srpcfshCache.length ) != srpcfshCache.length )
+		goto ErrExit1;
+
+	// Sanity of the saved response itself
+	if( (u32)pSrpcfSvrSupportedSrpcf->srpcfSvrCommHdr.srpcfOpCode != SRPCF_RSP_QUERY_SUPPORT
+		|| pSrpcfSvrSupportedSrpcf->srpcfSvrCommHdr.srpcfPktLen != srpcfshCache.length
+		|| pSrpcfSvrSupportedSrpcf->srpcfCapFlags != pSrpcfSvrRspGeneration->srpcfCapFlags
+		|| pSrpcfSvrSupportedSrpcf->numOfSupportedSrpcfs
+			> (srpcfshCache.length - hdrLen) / sizeof( srpcfSupportedNum_t ) )
+		goto ErrExit1;
+
+	close( fd );
+	return pSrpcfSvrSupportedSrpcf;
+
+ErrExit1:
+	free( pSrpcfSvrSupportedSrpcf );
+	pSrpcfSvrSupportedSrpcf = NULL;
+
+ErrExit:
+	close( fd );
+	return NULL;
+}
+
+
+static void saveSrpcfshCache( const s8 *path, u32 srpcfGeneration, srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf ) {
+
+	srpcfshCache_t srpcfshCache;
+	s8 tmpPath[ LIBSRPCF_MAX_PATH ];
+	u32 length = pSrpcfSvrSupportedSrpcf->srpcfSvrCommHdr.srpcfPktLen;
+	s32 fd;
+
+	srpcfshCache.magic = SRPCFSH_CACHE_MAGIC;
+	srpcfshCache.version = SRPCFSH_CACHE_VERSION;
+	srpcfshCache.srpcfCapFlags = SRPCFSH_CAPS;
+	srpcfshCache.srpcfGeneration = srpcfGeneration;
+	srpcfshCache.length = length;
+
+	// Write aside and rename, concurrent shells only ever see whole files
+	if( snprintf( tmpPath, sizeof( tmpPath ), "%s.XXXXXX", path ) >= sizeof( tmpPath ) )
+		return;
+
+	fd = mkstemp( tmpPath );
+	if( fd < 0 )
+		return;
+
+	if( write( fd, &srpcfshCache, sizeof( srpcfshCache ) ) != sizeof( srpcfshCache )
+		|| write( fd, pSrpcfSvrSupportedSrpcf, length ) != length ) {
+
+		close( fd );
+		unlink( tmpPath );
+		return;
+	}
+	close( fd );
+
+	if( rename( tmpPath, path ) < 0 )
+		unlink( tmpPath );
+}
+
+
+static srpcfSvrSupportedSrpcf_t *querySrpcfSupported( s32 *pCfd, s8 *addr, s32 port, bool *pCached ) {
+
+	srpcfSvrRspGeneration_t *pSrpcfSvrRspGeneration;
+	srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf = NULL;
+	s8 path[ LIBSRPCF_MAX_PATH ];
+
+	*pCached = FALSE;
+	pathOfSrpcfshCache( path, addr, port );
+
+	// Ask for the generation only, it also grants this connection its capabilities
+	pSrpcfSvrRspGeneration = (srpcfSvrRspGeneration_t *)requestSrpcfGeneration( pCfd, pCfd, SRPCFSH_CAPS );
+	if( pSrpcfSvrRspGeneration ) {
+
+		pSrpcfSvrSupportedSrpcf = loadSrpcfshCache( path, pSrpcfSvrRspGeneration );
+		if( pSrpcfSvrSupportedSrpcf ) {
+
+			free( pSrpcfSvrRspGeneration );
+			*pCached = TRUE;
+			return pSrpcfSvrSupportedSrpcf;
+		}
+	}
+	else {
+
+		// Older servers hang up on the generation query, start over
+		deinitializeSocket( *pCfd );
+		if( connectSocket( pCfd, addr, port ) ) {
+
+			*pCfd = -1;
+			return NULL;
+		}
+	}
+
+	// Fetch the whole list, the generation asked first keeps the copy on the safe side
+	pSrpcfSvrSupportedSrpcf = (srpcfSvrSupportedSrpcf_t *)requestSrpcfSupport( pCfd, pCfd, SRPCFSH_CAPS );
+	if( pSrpcfSvrSupportedSrpcf && pSrpcfSvrRspGeneration )
+		saveSrpcfshCache( path, pSrpcfSvrRspGeneration->srpcfGeneration, pSrpcfSvrSupportedSrpcf );
+
+	if( pSrpcfSvrRspGeneration )
+		free( pSrpcfSvrRspGeneration );
+
+	return pSrpcfSvrSupportedSrpcf;
 }
 
 
@@ -138,42 +317,28 @@ static u32 handleSrpcfFunction( s8 *srpcfCmdStr, srpcfFuncs_t *pSrpcfShell ) {
 
 	u32 cmdNo;
 	s32 baseOff;
-	void *handle;
-	s8 parser[ SRPCF_FUNC_MAXLEN ], helper[ SRPCF_FUNC_MAXLEN ], error[ SRPCF_FUNC_MAXLEN ];
+	const srpcfCmdDesc_t *pSrpcfCmdDesc;
 
 	// Look for basename
 	baseOff = findBasename( srpcfCmdStr );
 
 	// Check for support & enable
-	cmdNo = checkSrpcfCmdEnabled( srpcfCmdStr + baseOff, srpcfSupportedTbl );
-	if( cmdNo == XR_END_SRPCF ) {
-
-		goto ErrExit;
-	}
-
-	// Open instance itself
-	handle = dlopen( NULL, RTLD_LAZY );
-	if( !handle ) {
+	cmdNo = checkSrpcfCmdEnabled( srpcfCmdStr + baseOff );
+	pSrpcfCmdDesc = lookupSrpcfCmd( cmdNo );
+	if( !pSrpcfCmdDesc ) {
 
 		goto ErrExit;
 	}
 
-	// Obtain function names
-	snprintf( parser, SRPCF_FUNC_MAXLEN, SRPCF_PARSER_PREFIX "%s", srpcfCmdStr + baseOff );
-	snprintf( helper, SRPCF_FUNC_MAXLEN, SRPCF_HELPER_PREFIX "%s", srpcfCmdStr + baseOff );
-	snprintf( error, SRPCF_FUNC_MAXLEN, SRPCF_ERROR_PREFIX "%s", srpcfCmdStr + baseOff );
-
-	// Lookup Symbols
-	pSrpcfShell->srpcfFuncHelper = dlsym( handle, helper );
-	pSrpcfShell->srpcfFuncParser = dlsym( handle, parser );
-	pSrpcfShell->srpcfFuncError = dlsym( handle, error );
+	// Functions were bound at link time
+	pSrpcfShell->srpcfFuncHelper = pSrpcfCmdDesc->dispatch.srpcfFuncHelper;
+	pSrpcfShell->srpcfFuncParser = pSrpcfCmdDesc->dispatch.srpcfFuncParser;
+	pSrpcfShell->srpcfFuncError = pSrpcfCmdDesc->dispatch.srpcfFuncError;
 	if( !(pSrpcfShell->srpcfFuncHelper && pSrpcfShell->srpcfFuncParser && pSrpcfShell->srpcfFuncError) ) {
 
-		cmdNo = XR_END_SRPCF;
+		goto ErrExit;
 	}
 
-	// Release resources
-	dlclose( handle );
 	return cmdNo;
 
 ErrExit:
@@ -185,9 +350,9 @@ ErrExit:
 static u32 srpcfPluginSearch( const s8 *reqSrpcfName, srpcfFuncs_t *pSrpcfFuncs, void **handle ) {
 
     s8 path[ LIBSRPCF_MAX_PATH ];
-    s8 parser[ SRPCF_FUNC_MAXLEN ], helper[ SRPCF_FUNC_MAXLEN ], error[ SRPCF_FUNC_MAXLEN ];
     s32 ret, baseOff;
     struct stat srpcfStat;
+    srpcfDispatch_t srpcfDispatch;
 
     // Look for basename
     baseOff = findBasename( reqSrpcfName );
@@ -205,15 +370,11 @@ static u32 srpcfPluginSearch( const s8 *reqSrpcfName, srpcfFuncs_t *pSrpcfFuncs,
     if( !*handle )
         return XR_END_SRPCF;
 
-    // Obtain function names
-    snprintf( parser, SRPCF_FUNC_MAXLEN, SRPCF_PARSER_PREFIX "%s", reqSrpcfName + baseOff );
-    snprintf( helper, SRPCF_FUNC_MAXLEN, SRPCF_HELPER_PREFIX "%s", reqSrpcfName + baseOff );
-    snprintf( error, SRPCF_FUNC_MAXLEN, SRPCF_ERROR_PREFIX "%s", reqSrpcfName + baseOff );
-
     // Lookup Symbols
-    pSrpcfFuncs->srpcfFuncHelper = dlsym( *handle, helper );
-    pSrpcfFuncs->srpcfFuncParser = dlsym( *handle, parser );
-    pSrpcfFuncs->srpcfFuncError = dlsym( *handle, error );
+    resolveSrpcfDispatch( *handle, reqSrpcfName + baseOff, &srpcfDispatch );
+    pSrpcfFuncs->srpcfFuncHelper = srpcfDispatch.srpcfFuncHelper;
+    pSrpcfFuncs->srpcfFuncParser = srpcfDispatch.srpcfFuncParser;
+    pSrpcfFuncs->srpcfFuncError = srpcfDispatch.srpcfFuncError;
     if( !(pSrpcfFuncs->srpcfFuncHelper && pSrpcfFuncs->srpcfFuncParser && pSrpcfFuncs->srpcfFuncError) ) {
 
         ret = XR_END_SRPCF;
@@ -230,8 +391,7 @@ ErrExit:
 static void installSupportedSrpcfs( srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf ) {
 
 	srpcfSupportedNum_t *pSrpcfSupportedNum;
-	s32 i, j;
-	bool found;
+	s32 i;
 
 	//DBGPRINT( "Supported %d SRPCF Commands\n", pSrpcfSvrSupportedSrpcf->numOfSupportedSrpcfs );
 	pSrpcfSupportedNum = (srpcfSupportedNum_t *)&(pSrpcfSvrSupportedSrpcf->listOfSupportedSrpcfs);
@@ -239,26 +399,24 @@ static void installSupportedSrpcfs( srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupported
 			i < pSrpcfSvrSupportedSrpcf->numOfSupportedSrpcfs ; 
 			i++, pSrpcfSupportedNum++ ) {
 
-		// Search SRPCF table
-		for( j = 0, found = FALSE ; srpcfSupportedTbl[ j ].srpcfCmdNo != XR_END_SRPCF ; j++ ) {
-
-			if( srpcfSupportedTbl[ j ].srpcfCmdNo == pSrpcfSupportedNum->srpcfCmdNo ) {
-
-				// Enable this SRPCF commands
-				srpcfSupportedTbl[ j ].enabled = TRUE;
-				found = TRUE;
-				break;
-			}
-		}
-
-		if( found == FALSE ) {
+		// Enable this SRPCF commands if we know it too
+		if( !lookupSrpcfCmd( pSrpcfSupportedNum->srpcfCmdNo ) ) {
 
 			DBGPRINT( "Cannot install SRPCF #%d\n", (s32)pSrpcfSupportedNum->srpcfCmdNo );
+			continue;
 		}
+		enableSrpcfCmd( pSrpcfSupportedNum->srpcfCmdNo );
 	}
+}
 
-	// Free memory
-	free( pSrpcfSvrSupportedSrpcf );
+
+// Fan-out asks no single server, each host answers for itself
+static void installKnownSrpcfs( void ) {
+
+	u32 i;
+
+	for( i = XR_START_SRPCF + 1 ; i < XR_END_SRPCF ; i++ )
+		enableSrpcfCmd( i );
 }
 
 
@@ -266,7 +424,7 @@ static void installSupportedSrpcfs( srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupported
 static void autoCompleteCommandLine( s8 *cmdBuf, s32 *index ) {
 
 	s32 i, sum = 0;
-	srpcfSupported_t *pSrpcfSupported;
+	const srpcfCmdDesc_t *pSrpcfCmdDesc, *pSrpcfSupported;
 	bool autoComp = FALSE;
 	bool nextSame;
 	s8 c;
@@ -280,30 +438,30 @@ static void autoCompleteCommandLine( s8 *cmdBuf, s32 *index ) {
 	write( 1, "\r\n", 2 );
 
 CheckAgain:
-	for( i = 0, c = '\0', nextSame = TRUE ; srpcfSupportedTbl[ i ].srpcfCmdNo != XR_END_SRPCF ; i++ ) {
+	for( i = 0, c = '\0', nextSame = TRUE ; (pSrpcfCmdDesc = indexSrpcfCmd( i )) ; i++ ) {
 
-		if( (srpcfSupportedTbl[ i ].enabled == TRUE)
-			&& (!strncmp( cmdBuf, srpcfSupportedTbl[ i ].srpcfFuncName, *index )) ) {
+		if( (isSrpcfCmdEnabled( pSrpcfCmdDesc->srpcfCmdNo ) == TRUE)
+			&& (!strncmp( cmdBuf, pSrpcfCmdDesc->srpcfFuncName, *index )) ) {
 
-			pSrpcfSupported = &srpcfSupportedTbl[ i ];
+			pSrpcfSupported = pSrpcfCmdDesc;
 			sum++;
 
-			if( *(srpcfSupportedTbl[ i ].srpcfFuncName + *index) == '\0' ) {
+			if( *(pSrpcfCmdDesc->srpcfFuncName + *index) == '\0' ) {
 
 				nextSame = FALSE;
 			}
-			else if( (c != '\0') && (c != *(srpcfSupportedTbl[ i ].srpcfFuncName + *index)) ) {
+			else if( (c != '\0') && (c != *(pSrpcfCmdDesc->srpcfFuncName + *index)) ) {
 				
 				nextSame = FALSE;
 			}
 			else if( c == '\0' ) {
 
-				c = *(srpcfSupportedTbl[ i ].srpcfFuncName + *index);
+				c = *(pSrpcfCmdDesc->srpcfFuncName + *index);
 				nextSame = TRUE;
 			}
 			if( autoComp == FALSE ) {
 
-				printf( "%s   ", srpcfSupportedTbl[ i ].srpcfFuncName );
+				printf( "%s   ", pSrpcfCmdDesc->srpcfFuncName );
 			}
 		}
 	}
@@ -462,14 +620,15 @@ static void srpcfCommandLine( void ) {
 s32 main( s32 argc, s8 **argv ) {
 
 	srpcfFuncs_t srpcfFuncs;
-	srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf;
+	srpcfSvrSupportedSrpcf_t *pSrpcfSvrSupportedSrpcf = NULL;
 	srpcfSvrRspExecute_t *pSrpcfSvrRspExecute;
-	s8 *pHelpStr;
+	s8 *pHelpStr, *fanoutHosts;
 	s32 ret = 0;
-	u32 srpcfCmdNo;
+	u32 srpcfCmdNo, srpcfPluginId;
 	void *handle = NULL;
-	s32 cfd;
+	s32 cfd = -1;
 	s8 ipAddr[] = "127.0.0.1";
+	bool cached;
 
 	// Check for argc
 	if( argc < 1 ) {
@@ -478,15 +637,31 @@ s32 main( s32 argc, s8 **argv ) {
 		return 1;
 	}
 
+	// Startup phases are timed on request
+	if( getenv( SRPCFSH_TIMING_ENV ) ) {
+
+		srpcfshTiming = TRUE;
+		srpcfshStart = srpcfshMark = getMonotonicMicroseconds();
+	}
+
+	// Run on a list of hosts instead of the local server
+	fanoutHosts = getenv( SRPCFSH_HOSTS_ENV );
+	if( fanoutHosts ) {
+
+		installKnownSrpcfs();
+		goto Lookup;
+	}
+
 	// Open a socket
 	if( connectSocket( &cfd, ipAddr, SRPCF_DEF_PORT ) ) {
 
 		fprintf( stderr, "Internal Error: cannot connect to SRPCF server\n" );
 		return 1;
 	}
+	markSrpcfshPhase( "connect" );
 
-	// Query support SRPCF commands
-	pSrpcfSvrSupportedSrpcf = (srpcfSvrSupportedSrpcf_t *)requestSrpcfSupport( &cfd, &cfd );
+	// Query support SRPCF commands, a saved copy is used while it is current
+	pSrpcfSvrSupportedSrpcf = querySrpcfSupported( &cfd, ipAddr, SRPCF_DEF_PORT, &cached );
 
 	if( !pSrpcfSvrSupportedSrpcf ) {
 
@@ -494,9 +669,13 @@ s32 main( s32 argc, s8 **argv ) {
 		fprintf( stderr, "Internal Error: cannot query for supported SRPCFs\n" );
 		goto ErrExit1;
 	}
+	markSrpcfshPhase( (cached == TRUE) ? "query (cached)" : "query" );
 
 	// Install SRPCF commands
 	installSupportedSrpcfs( pSrpcfSvrSupportedSrpcf );
+	markSrpcfshPhase( "install" );
+
+Lookup:
 
 	// Look for SRPCF function
 	srpcfCmdNo = handleSrpcfFunction( argv[ 0 ], &srpcfFuncs );
@@ -516,17 +695,37 @@ s32 main( s32 argc, s8 **argv ) {
 		}
 	}
 
+	markSrpcfshPhase( "lookup" );
+
 	// Parse command line Input
 	numOfSrpcfParams = handleParameters( argc, argv );
 
 	// Execute SRPCF command
 	if( srpcfFuncs.srpcfFuncParser( cmdOptHead, numOfSrpcfParams ) ) {
 
-		// Run this SRPCF command on server
-		if( srpcfCmdNo == XR_START_SRPCF )
-			pSrpcfSvrRspExecute = requestSrpcfExecutePlugin( &cfd, &cfd, srpcfCmdNo, cmdOptHead, argv[ 0 ] + findBasename( argv[ 0 ] ) );
+		markSrpcfshPhase( "parse" );
+
+		// Every host gets the same command, the results come back tagged
+		if( fanoutHosts ) {
+
+			ret = runSrpcfshFanout( fanoutHosts, srpcfCmdNo,
+					(srpcfCmdNo == XR_START_SRPCF) ? argv[ 0 ] + findBasename( argv[ 0 ] ) : NULL,
+					cmdOptHead );
+			markSrpcfshPhase( "fan-out" );
+			goto ErrExit1;
+		}
+
+		// Run this SRPCF command on server, streamed output is printed as it arrives
+		srpcfPluginId = (srpcfCmdNo == XR_START_SRPCF)
+			? findSrpcfPluginId( pSrpcfSvrSupportedSrpcf, argv[ 0 ] + findBasename( argv[ 0 ] ) )
+			: LIBSRPCF_PLUGIN_NONE;
+
+		if( srpcfPluginId != LIBSRPCF_PLUGIN_NONE )
+			pSrpcfSvrRspExecute = requestSrpcfExecutePluginId( &cfd, &cfd, srpcfPluginId, cmdOptHead, showSrpcfChunk );
 		else
-			pSrpcfSvrRspExecute = requestSrpcfExecute( &cfd, &cfd, srpcfCmdNo, cmdOptHead );
+			pSrpcfSvrRspExecute = requestSrpcfExecuteStream( &cfd, &cfd, srpcfCmdNo, cmdOptHead,
+					(srpcfCmdNo == XR_START_SRPCF) ? argv[ 0 ] + findBasename( argv[ 0 ] ) : NULL,
+					showSrpcfChunk );
 
 		if( !pSrpcfSvrRspExecute ) {
 
@@ -541,10 +740,16 @@ s32 main( s32 argc, s8 **argv ) {
 
 			printf( "%s\n", (s8 *)(&pSrpcfSvrRspExecute->dataPtr) );
 		}
+		else if( (pSrpcfSvrRspExecute->srpcfErrorCode == SRPCF_SUCCESSFUL) && srpcfStreamed == TRUE )
+			printf( "\n" );
 		else if( pSrpcfSvrRspExecute->srpcfErrorCode == SRPCF_SUCCESSFUL )
 			printf( "SUCCESSFUL\n" );
 		else
 			printf( "ERROR: %d\n", pSrpcfSvrRspExecute->srpcfErrorCode );
+		markSrpcfshPhase( "execute" );
+
+		// Large results may be mapped rather than allocated
+		releaseSrpcfResponse( pSrpcfSvrRspExecute );
 	}
 	else {
 
@@ -555,11 +760,19 @@ s32 main( s32 argc, s8 **argv ) {
 ErrExit1:
 
 	// Close the socket
-	deinitializeSocket( cfd );
+	if( cfd >= 0 )
+		deinitializeSocket( cfd );
+
+	// Plugin IDs were looked up in the support response
+	if( pSrpcfSvrSupportedSrpcf )
+		free( pSrpcfSvrSupportedSrpcf );
 
 	// Close plugin instance if any
 	if( handle )
 		dlclose( handle );
+
+	if( srpcfshTiming == TRUE )
+		fprintf( stderr, "srpcfsh: %-16s %8llu us\n", "total", getMonotonicMicroseconds() - srpcfshStart );
 	
 Exit:
     return ret;
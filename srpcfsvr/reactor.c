@@ -0,0 +1,522 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: reactor.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+#include "srpcfsvr.h"
+#include "netsock.h"
+
+
+//
+// Global variables
+//
+static srpcfSvrLoop_t *srpcfSvrLoopTbl = NULL;
+static s32 numOfSrpcfSvrLoops = 0;
+static u32 nextSrpcfSvrLoop = 0;
+static volatile s8 loopTerminate = 0;
+static u32 loopIdleTimeout = 0;
+
+
+static u64 getSrpcfSvrSeconds( void ) {
+
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec;
+}
+
+
+static void releaseSrpcfSvrConn( srpcfSvrConn_t *pSrpcfSvrConn ) {
+
+	// The last one out closes the connection
+	if( __atomic_sub_fetch( &pSrpcfSvrConn->refCount, 1, __ATOMIC_ACQ_REL ) )
+		return;
+
+	detachSrpcfOutput( pSrpcfSvrConn->cfd );
+	deinitializeSocket( pSrpcfSvrConn->cfd );
+
+	// Free memory
+	releaseSrpcfRing( &pSrpcfSvrConn->ring );
+	free( pSrpcfSvrConn );
+}
+
+
+// Caller holds connLock
+static void unlinkSrpcfSvrConn( srpcfSvrLoop_t *pSrpcfSvrLoop, srpcfSvrConn_t *pSrpcfSvrConn ) {
+
+	if( pSrpcfSvrConn->prev )
+		pSrpcfSvrConn->prev->next = pSrpcfSvrConn->next;
+	else
+		pSrpcfSvrLoop->connHead = pSrpcfSvrConn->next;
+	if( pSrpcfSvrConn->next )
+		pSrpcfSvrConn->next->prev = pSrpcfSvrConn->prev;
+
+	pSrpcfSvrConn->prev = NULL;
+	pSrpcfSvrConn->next = NULL;
+}
+
+
+static void closeSrpcfSvrConn( srpcfSvrLoop_t *pSrpcfSvrLoop, srpcfSvrConn_t *pSrpcfSvrConn ) {
+
+	// Stop watching, workers may still hold a reference and wait for room
+	epoll_ctl( pSrpcfSvrLoop->efd, EPOLL_CTL_DEL, pSrpcfSvrConn->cfd, NULL );
+	abortSrpcfOutput( pSrpcfSvrConn->cfd );
+
+	pthread_mutex_lock( &pSrpcfSvrLoop->connLock );
+	unlinkSrpcfSvrConn( pSrpcfSvrLoop, pSrpcfSvrConn );
+	pthread_mutex_unlock( &pSrpcfSvrLoop->connLock );
+
+	releaseSrpcfSvrConn( pSrpcfSvrConn );
+}
+
+
+static void completeSrpcfSvrConnTask( srpcfSvrTask_t *pSrpcfSvrTask ) {
+
+	srpcfSvrConn_t *pSrpcfSvrConn = (srpcfSvrConn_t *)pSrpcfSvrTask->priv;
+
+	// Hang up once the reply is out, the loop will notice and drop its reference
+	if( pSrpcfSvrTask->term == TRUE ) {
+
+		__atomic_store_n( &pSrpcfSvrConn->closing, TRUE, __ATOMIC_RELEASE );
+		lingerSrpcfOutput( pSrpcfSvrConn->cfd );
+	}
+
+	// Free resource
+	free( pSrpcfSvrTask->pktData );
+	free( pSrpcfSvrTask );
+	releaseSrpcfSvrConn( pSrpcfSvrConn );
+}
+
+
+static bool offloadSrpcfSvrConn( srpcfSvrConn_t *pSrpcfSvrConn, srpcfSvrCommPkt_t *pktData ) {
+
+	srpcfSvrTask_t *pSrpcfSvrTask;
+
+	pSrpcfSvrTask = (srpcfSvrTask_t *)malloc( sizeof( srpcfSvrTask_t ) );
+	if( !pSrpcfSvrTask )
+		return FALSE;
+
+	// Fill in the data
+	pSrpcfSvrTask->next = NULL;
+	pSrpcfSvrTask->pktData = pktData;
+	pSrpcfSvrTask->pMxqFd = &pSrpcfSvrConn->cfd;
+	pSrpcfSvrTask->capFlags = pSrpcfSvrConn->capFlags;
+	pSrpcfSvrTask->term = FALSE;
+	pSrpcfSvrTask->complete = completeSrpcfSvrConnTask;
+	pSrpcfSvrTask->priv = pSrpcfSvrConn;
+	__atomic_add_fetch( &pSrpcfSvrConn->refCount, 1, __ATOMIC_RELAXED );
+
+	// Run it here if the queue is full
+	if( submitSrpcfSvrTask( pSrpcfSvrTask ) == FALSE )
+		runSrpcfSvrTask( pSrpcfSvrTask );
+
+	return TRUE;
+}
+
+
+static bool executeSrpcfSvrConn( srpcfSvrConn_t *pSrpcfSvrConn, srpcfSvrCommPkt_t *pktData ) {
+
+	srpcfSvrCommPkt_t *pktCopy;
+	bool term;
+
+	// Hanging up, whatever the peer still sends is dropped
+	if( __atomic_load_n( &pSrpcfSvrConn->closing, __ATOMIC_ACQUIRE ) == TRUE )
+		return TRUE;
+
+	// Queue executions for the workers, the ring is reused for the next
+	// frame, so the task takes a copy
+	if( isSrpcfSvrOffload( pktData ) == TRUE ) {
+
+		pktCopy = detachSrpcfRing( &pSrpcfSvrConn->ring, pktData );
+		if( !pktCopy )
+			return FALSE;
+
+		if( offloadSrpcfSvrConn( pSrpcfSvrConn, pktCopy ) == TRUE )
+			return TRUE;
+
+		free( pktCopy );
+		return FALSE;
+	}
+
+	// Execute the request in place, the reply may still be queued when the
+	// connection is done with, so hang up only once it is out
+	term = dispatchSrpcfRequest( &pSrpcfSvrConn->cfd, &pSrpcfSvrConn->capFlags, pktData );
+	if( term == TRUE ) {
+
+		__atomic_store_n( &pSrpcfSvrConn->closing, TRUE, __ATOMIC_RELEASE );
+		lingerSrpcfOutput( pSrpcfSvrConn->cfd );
+	}
+
+	return TRUE;
+}
+
+
+static bool processSrpcfSvrConn( srpcfSvrConn_t *pSrpcfSvrConn ) {
+
+	srpcfSvrCommPkt_t *pktData;
+	bool invalid;
+	s32 rByte;
+
+	for( ; ; ) {
+
+		// Handle every complete request in the ring
+		while( (pktData = nextSrpcfRing( &pSrpcfSvrConn->ring, &invalid )) ) {
+
+			if( executeSrpcfSvrConn( pSrpcfSvrConn, pktData ) == FALSE )
+				return FALSE;
+		}
+
+		if( invalid == TRUE )
+			return FALSE;
+
+		// Drain the socket into the ring
+		rByte = fillSrpcfRing( pSrpcfSvrConn->cfd, &pSrpcfSvrConn->ring );
+		if( rByte == 0 )
+			return FALSE;
+
+		if( rByte < 0 ) {
+
+			if( errno == EINTR )
+				continue;
+
+			if( errno == EAGAIN || errno == EWOULDBLOCK )
+				return TRUE;
+
+			return FALSE;
+		}
+		pSrpcfSvrConn->lastActive = getSrpcfSvrSeconds();
+	}
+}
+
+
+static void sweepSrpcfSvrLoop( srpcfSvrLoop_t *pSrpcfSvrLoop ) {
+
+	srpcfSvrConn_t *pSrpcfSvrConn, *pNext, *pIdle = NULL;
+	u64 now = getSrpcfSvrSeconds();
+
+	// Once a second is plenty
+	if( now == pSrpcfSvrLoop->lastSweep )
+		return;
+	pSrpcfSvrLoop->lastSweep = now;
+
+	// Pick out idle sessions, skip the ones with executions in flight
+	pthread_mutex_lock( &pSrpcfSvrLoop->connLock );
+	for( pSrpcfSvrConn = pSrpcfSvrLoop->connHead ; pSrpcfSvrConn ; pSrpcfSvrConn = pNext ) {
+
+		pNext = pSrpcfSvrConn->next;
+
+		if( !(pSrpcfSvrConn->capFlags & SRPCF_CAP_SESSION)
+			|| __atomic_load_n( &pSrpcfSvrConn->refCount, __ATOMIC_ACQUIRE ) > 1
+			|| (now - pSrpcfSvrConn->lastActive) < loopIdleTimeout )
+			continue;
+
+		// Move it to the idle list
+		unlinkSrpcfSvrConn( pSrpcfSvrLoop, pSrpcfSvrConn );
+		pSrpcfSvrConn->next = pIdle;
+		pIdle = pSrpcfSvrConn;
+	}
+	pthread_mutex_unlock( &pSrpcfSvrLoop->connLock );
+
+	// Close them outside of the lock
+	for( pSrpcfSvrConn = pIdle ; pSrpcfSvrConn ; pSrpcfSvrConn = pNext ) {
+
+		pNext = pSrpcfSvrConn->next;
+		DBGPRINT( "Session on socket %d idle, closing\n", pSrpcfSvrConn->cfd );
+
+		epoll_ctl( pSrpcfSvrLoop->efd, EPOLL_CTL_DEL, pSrpcfSvrConn->cfd, NULL );
+		releaseSrpcfSvrConn( pSrpcfSvrConn );
+	}
+}
+
+
+static void notifySrpcfSvrConn( void *arg, bool pending ) {
+
+	srpcfSvrConn_t *pSrpcfSvrConn = (srpcfSvrConn_t *)arg;
+	srpcfSvrLoop_t *pSrpcfSvrLoop = &srpcfSvrLoopTbl[ pSrpcfSvrConn->loop ];
+	struct epoll_event event;
+	u64 one = 1;
+
+	// Kernel sockets say when they have room again
+	if( pSrpcfSvrConn->pollOut == TRUE ) {
+
+		memset( &event, 0, sizeof( event ) );
+		event.events = EPOLLIN | EPOLLRDHUP | (pending ? EPOLLOUT : 0);
+		event.data.ptr = pSrpcfSvrConn;
+		epoll_ctl( pSrpcfSvrLoop->efd, EPOLL_CTL_MOD, pSrpcfSvrConn->cfd, &event );
+		return;
+	}
+
+	// Loopback and ring handles cannot, the loop retries them on a short timer
+	if( pending == FALSE ) {
+
+		__atomic_sub_fetch( &pSrpcfSvrLoop->numOfStalled, 1, __ATOMIC_RELEASE );
+		return;
+	}
+
+	__atomic_add_fetch( &pSrpcfSvrLoop->numOfStalled, 1, __ATOMIC_RELEASE );
+	if( write( pSrpcfSvrLoop->wfd, &one, sizeof( one ) ) < 0 )
+		DBGPRINT( "Cannot wake up loop %d\n", pSrpcfSvrLoop->id );
+}
+
+
+static void flushSrpcfSvrLoop( srpcfSvrLoop_t *pSrpcfSvrLoop ) {
+
+	srpcfSvrConn_t *pSrpcfSvrConn;
+
+	// A broken one is shut down and turns readable, the next round closes it
+	pthread_mutex_lock( &pSrpcfSvrLoop->connLock );
+	for( pSrpcfSvrConn = pSrpcfSvrLoop->connHead ; pSrpcfSvrConn ; pSrpcfSvrConn = pSrpcfSvrConn->next ) {
+
+		if( pSrpcfSvrConn->pollOut == FALSE )
+			flushSrpcfOutput( pSrpcfSvrConn->cfd );
+	}
+	pthread_mutex_unlock( &pSrpcfSvrLoop->connLock );
+}
+
+
+static void *runSrpcfSvrLoop( void *arg ) {
+
+	srpcfSvrLoop_t *pSrpcfSvrLoop = (srpcfSvrLoop_t *)arg;
+	struct epoll_event events[ SRPCFSVR_EVENTS_MAX ];
+	srpcfSvrConn_t *pSrpcfSvrConn;
+	s32 i, num, msec;
+	u64 count;
+
+	// Replies never wait on a socket in here
+	configureSrpcfOutputThread( FALSE );
+
+	// Event loop
+	while( !loopTerminate ) {
+
+		msec = loopIdleTimeout ? SRPCFSVR_SWEEP_MS : -1;
+		if( __atomic_load_n( &pSrpcfSvrLoop->numOfStalled, __ATOMIC_ACQUIRE ) )
+			msec = SRPCFSVR_RETRY_MS;
+
+		num = epoll_wait( pSrpcfSvrLoop->efd, events, SRPCFSVR_EVENTS_MAX, msec );
+		if( num < 0 ) {
+
+			if( errno == EINTR )
+				continue;
+
+			DBGPRINT( "epoll_wait failed on loop %d\n", pSrpcfSvrLoop->id );
+			break;
+		}
+
+		for( i = 0 ; i < num ; i++ ) {
+
+			pSrpcfSvrConn = (srpcfSvrConn_t *)events[ i ].data.ptr;
+
+			// Woken up to retry handles with queued replies
+			if( !pSrpcfSvrConn ) {
+
+				if( read( pSrpcfSvrLoop->wfd, &count, sizeof( count ) ) < 0 )
+					DBGPRINT( "Cannot clear the wakeup of loop %d\n", pSrpcfSvrLoop->id );
+				continue;
+			}
+
+			// Peer has gone or an error occurred
+			if( events[ i ].events & (EPOLLERR | EPOLLHUP) ) {
+
+				closeSrpcfSvrConn( pSrpcfSvrLoop, pSrpcfSvrConn );
+				continue;
+			}
+
+			// Room for queued replies
+			if( (events[ i ].events & EPOLLOUT) && flushSrpcfOutput( pSrpcfSvrConn->cfd ) < 0 ) {
+
+				closeSrpcfSvrConn( pSrpcfSvrLoop, pSrpcfSvrConn );
+				continue;
+			}
+
+			if( !(events[ i ].events & (EPOLLIN | EPOLLRDHUP)) )
+				continue;
+
+			// Read & execute
+			if( processSrpcfSvrConn( pSrpcfSvrConn ) == FALSE )
+				closeSrpcfSvrConn( pSrpcfSvrLoop, pSrpcfSvrConn );
+		}
+
+		// Retry handles that cannot tell when they have room
+		if( __atomic_load_n( &pSrpcfSvrLoop->numOfStalled, __ATOMIC_ACQUIRE ) )
+			flushSrpcfSvrLoop( pSrpcfSvrLoop );
+
+		// Drop sessions nobody has used for a while
+		if( loopIdleTimeout )
+			sweepSrpcfSvrLoop( pSrpcfSvrLoop );
+	}
+
+	pthread_exit( 0 );
+}
+
+
+bool initializeSrpcfSvrLoops( s32 numOfLoops, u32 idleTimeout ) {
+
+	struct epoll_event event;
+	s32 i;
+
+	loopIdleTimeout = idleTimeout;
+
+	// Allocate loop contexts
+	srpcfSvrLoopTbl = (srpcfSvrLoop_t *)malloc( sizeof( srpcfSvrLoop_t ) * numOfLoops );
+	if( !srpcfSvrLoopTbl )
+		return FALSE;
+	memset( srpcfSvrLoopTbl, 0, sizeof( srpcfSvrLoop_t ) * numOfLoops );
+
+	for( i = 0 ; i < numOfLoops ; i++ ) {
+
+		srpcfSvrLoopTbl[ i ].id = i;
+		pthread_mutex_init( &srpcfSvrLoopTbl[ i ].connLock, NULL );
+
+		// Create an epoll instance for each loop
+		srpcfSvrLoopTbl[ i ].efd = epoll_create1( EPOLL_CLOEXEC );
+		if( srpcfSvrLoopTbl[ i ].efd < 0 ) {
+
+			DBGPRINT( "Cannot create epoll instance\n" );
+			return FALSE;
+		}
+
+		// Workers wake the loop when a handle it has to retry is stalled
+		srpcfSvrLoopTbl[ i ].wfd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+		memset( &event, 0, sizeof( event ) );
+		event.events = EPOLLIN;
+		event.data.ptr = NULL;
+		if( srpcfSvrLoopTbl[ i ].wfd < 0
+			|| epoll_ctl( srpcfSvrLoopTbl[ i ].efd, EPOLL_CTL_ADD, srpcfSvrLoopTbl[ i ].wfd, &event ) < 0 ) {
+
+			DBGPRINT( "Cannot create the wakeup of loop %d\n", i );
+			return FALSE;
+		}
+
+		// Create a thread
+		if( pthread_create( &srpcfSvrLoopTbl[ i ].pth,
+				NULL,
+				runSrpcfSvrLoop,
+				(void *)&srpcfSvrLoopTbl[ i ] ) ) {
+
+			fprintf( stderr, "Failed to create an event loop thread\n" );
+			close( srpcfSvrLoopTbl[ i ].wfd );
+			close( srpcfSvrLoopTbl[ i ].efd );
+			return FALSE;
+		}
+
+		numOfSrpcfSvrLoops++;
+	}
+
+	return TRUE;
+}
+
+
+bool attachSrpcfSvrLoop( s32 cfd ) {
+
+	srpcfSvrConn_t *pSrpcfSvrConn;
+	struct epoll_event event;
+	s32 loop;
+
+	// Non-blocking from now on
+	if( setNonblockSocket( cfd ) < 0 )
+		return FALSE;
+
+	// Allocate a connection context
+	pSrpcfSvrConn = (srpcfSvrConn_t *)malloc( sizeof( srpcfSvrConn_t ) );
+	if( !pSrpcfSvrConn ) {
+
+		DBGPRINT( "Out of memory\n" );
+		return FALSE;
+	}
+
+	// Pick up a loop in round robin
+	loop = __sync_fetch_and_add( &nextSrpcfSvrLoop, 1 ) % numOfSrpcfSvrLoops;
+
+	// Fill in the data
+	pSrpcfSvrConn->next = NULL;
+	pSrpcfSvrConn->prev = NULL;
+	pSrpcfSvrConn->cfd = cfd;
+	pSrpcfSvrConn->loop = loop;
+	initializeSrpcfRing( &pSrpcfSvrConn->ring, pSrpcfSvrConn->packet, sizeof( pSrpcfSvrConn->packet ) );
+	pSrpcfSvrConn->refCount = 1;
+	pSrpcfSvrConn->capFlags = 0;
+	pSrpcfSvrConn->lastActive = getSrpcfSvrSeconds();
+	pSrpcfSvrConn->pollOut = (lookupSrpcfTransport( cfd ) == &srpcfTcpTransport) ? TRUE : FALSE;
+	pSrpcfSvrConn->closing = FALSE;
+
+	// Replies that do not fit are queued instead of blocking the loop
+	if( attachSrpcfOutput( cfd, SRPCFSVR_OUTPUT_MSGS * (u64)limitOfSrpcfMessage(), TRUE,
+			notifySrpcfSvrConn, pSrpcfSvrConn ) == FALSE ) {
+
+		free( pSrpcfSvrConn );
+		return FALSE;
+	}
+
+	// Link it to the loop before any event can close it
+	pthread_mutex_lock( &srpcfSvrLoopTbl[ loop ].connLock );
+	pSrpcfSvrConn->next = srpcfSvrLoopTbl[ loop ].connHead;
+	if( pSrpcfSvrConn->next )
+		pSrpcfSvrConn->next->prev = pSrpcfSvrConn;
+	srpcfSvrLoopTbl[ loop ].connHead = pSrpcfSvrConn;
+	pthread_mutex_unlock( &srpcfSvrLoopTbl[ loop ].connLock );
+
+	// Watch this connection
+	memset( &event, 0, sizeof( event ) );
+	event.events = EPOLLIN | EPOLLRDHUP;
+	event.data.ptr = pSrpcfSvrConn;
+	if( epoll_ctl( srpcfSvrLoopTbl[ loop ].efd, EPOLL_CTL_ADD, cfd, &event ) < 0 ) {
+
+		pthread_mutex_lock( &srpcfSvrLoopTbl[ loop ].connLock );
+		unlinkSrpcfSvrConn( &srpcfSvrLoopTbl[ loop ], pSrpcfSvrConn );
+		pthread_mutex_unlock( &srpcfSvrLoopTbl[ loop ].connLock );
+
+		detachSrpcfOutput( cfd );
+		free( pSrpcfSvrConn );
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+void deinitializeSrpcfSvrLoops( void ) {
+
+	s32 i;
+
+	// Stop all loops, connections will be released by the OS
+	loopTerminate = 1;
+	for( i = 0 ; i < numOfSrpcfSvrLoops ; i++ ) {
+
+		pthread_cancel( srpcfSvrLoopTbl[ i ].pth );
+		close( srpcfSvrLoopTbl[ i ].wfd );
+		close( srpcfSvrLoopTbl[ i ].efd );
+	}
+
+	free( srpcfSvrLoopTbl );
+	srpcfSvrLoopTbl = NULL;
+	numOfSrpcfSvrLoops = 0;
+}
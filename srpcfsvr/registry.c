@@ -0,0 +1,593 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: registry.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// memfd_create()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <sys/inotify.h>
+#include <time.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+#include "srpcfsvr.h"
+
+
+//
+// Global variables
+//
+static srpcfSvrPlugin_t *srpcfSvrPluginTbl[ SRPCFSVR_PLUGIN_BUCKETS ];
+static pthread_rwlock_t pluginLock = PTHREAD_RWLOCK_INITIALIZER;
+static srpcfSvrPluginSlot_t srpcfSvrPluginSlotTbl[ SRPCFSVR_PLUGIN_MAX ];
+static u32 numOfSrpcfSvrPluginSlots = 0;
+static pthread_t pluginWatcher;
+static s32 pluginNotifyFd = -1;
+static u32 srpcfSvrPluginGeneration = 0;
+
+
+static u32 hashSrpcfSvrPlugin( const s8 *srpcfName ) {
+
+	u32 hash = 2166136261U;
+
+	// FNV-1a
+	for( ; *srpcfName ; srpcfName++ ) {
+
+		hash ^= (u8)*srpcfName;
+		hash *= 16777619U;
+	}
+
+	return hash & (SRPCFSVR_PLUGIN_BUCKETS - 1);
+}
+
+
+static srpcfSvrPlugin_t *findSrpcfSvrPlugin( const s8 *srpcfName ) {
+
+	srpcfSvrPlugin_t *pSrpcfSvrPlugin;
+
+	for( pSrpcfSvrPlugin = srpcfSvrPluginTbl[ hashSrpcfSvrPlugin( srpcfName ) ] ;
+			pSrpcfSvrPlugin ;
+			pSrpcfSvrPlugin = pSrpcfSvrPlugin->next ) {
+
+		if( !strcmp( pSrpcfSvrPlugin->name, srpcfName ) )
+			return pSrpcfSvrPlugin;
+	}
+
+	return NULL;
+}
+
+
+// Anonymous memory does not care how /tmp is mounted. Without it the copy goes
+// next to the plugin, a directory that must allow executables anyway.
+static s32 openSrpcfSvrStage( const s8 *srpcfName, s8 *stage ) {
+
+	u32 flags = MFD_CLOEXEC;
+	s32 fd;
+
+#ifdef MFD_EXEC
+	flags |= MFD_EXEC;
+#endif
+	fd = memfd_create( srpcfName, flags );
+	if( fd >= 0 ) {
+
+		snprintf( stage, LIBSRPCF_MAX_PATH, SRPCFSVR_PLUGIN_MEMFD, fd );
+		return fd;
+	}
+
+	snprintf( stage, LIBSRPCF_MAX_PATH, SRPCFSVR_PLUGIN_STAGE, srpcfName );
+	return mkostemp( stage, O_CLOEXEC );
+}
+
+
+// The loader tells objects apart by path, a memfd path stays taken while its
+// descriptor is open. So it is kept until the plugin is unloaded, a file on
+// disk has a unique name and goes right away.
+static s32 releaseSrpcfSvrStage( s32 fd, const s8 *stage ) {
+
+	if( !strncmp( stage, "/proc/", 6 ) )
+		return fd;
+
+	unlink( stage );
+	close( fd );
+	return -1;
+}
+
+
+// Returns the descriptor of the copy, it stays open until the copy is loaded
+static s32 stageSrpcfSvrPlugin( const s8 *path, const s8 *srpcfName, s8 *stage ) {
+
+	s8 buf[ LIBSRPCF_MSG_SIZE ];
+	s32 ifd, ofd;
+	ssize_t rbyte;
+
+	ifd = open( path, O_RDONLY );
+	if( ifd < 0 )
+		return -1;
+
+	ofd = openSrpcfSvrStage( srpcfName, stage );
+	if( ofd < 0 )
+		goto ErrExit;
+
+	for( ; ; ) {
+
+		rbyte = read( ifd, buf, sizeof( buf ) );
+		if( rbyte < 0 && errno == EINTR )
+			continue;
+		if( rbyte <= 0 )
+			break;
+
+		if( write( ofd, buf, rbyte ) != rbyte ) {
+
+			rbyte = -1;
+			break;
+		}
+	}
+
+	if( rbyte < 0 ) {
+
+		if( releaseSrpcfSvrStage( ofd, stage ) >= 0 )
+			close( ofd );
+		ofd = -1;
+	}
+
+ErrExit:
+	close( ifd );
+	return ofd;
+}
+
+
+static srpcfSvrPlugin_t *loadSrpcfSvrPlugin( const s8 *srpcfName ) {
+
+	srpcfSvrPlugin_t *pSrpcfSvrPlugin;
+	s8 path[ LIBSRPCF_MAX_PATH ], stage[ LIBSRPCF_MAX_PATH ];
+	struct stat srpcfStat;
+	s32 sfd;
+
+	// Names come from the wire, keep them inside the plugin directory
+	if( !*srpcfName || strchr( srpcfName, '/' ) || strlen( srpcfName ) >= SRPCF_FUNC_MAXLEN )
+		return NULL;
+
+	// Get fullpath
+	snprintf( path, LIBSRPCF_MAX_PATH, LIBSRPCF_PLUGIN_PATH "/%s" LIBSRPCF_PLUGIN_SUFFIX, srpcfName );
+	if( stat( path, &srpcfStat ) < 0 )
+		return NULL;
+
+	// Load from a private copy, dlopen hands back the old image for a path it already has
+	sfd = stageSrpcfSvrPlugin( path, srpcfName, stage );
+	if( sfd < 0 ) {
+
+		DBGPRINT( "Cannot stage plugin %s\n", path );
+		return NULL;
+	}
+
+	pSrpcfSvrPlugin = (srpcfSvrPlugin_t *)malloc( sizeof( srpcfSvrPlugin_t ) );
+	if( !pSrpcfSvrPlugin ) {
+
+		if( releaseSrpcfSvrStage( sfd, stage ) >= 0 )
+			close( sfd );
+		return NULL;
+	}
+
+	// Bind everything now, the mapping outlives the staged file
+	pSrpcfSvrPlugin->handle = dlopen( stage, RTLD_NOW );
+	pSrpcfSvrPlugin->stageFd = releaseSrpcfSvrStage( sfd, stage );
+	if( !pSrpcfSvrPlugin->handle ) {
+
+		DBGPRINT( "Cannot open plugin %s: %s\n", path, dlerror() );
+		if( pSrpcfSvrPlugin->stageFd >= 0 )
+			close( pSrpcfSvrPlugin->stageFd );
+		free( pSrpcfSvrPlugin );
+		return NULL;
+	}
+
+	strcpy( pSrpcfSvrPlugin->name, srpcfName );
+	resolveSrpcfDispatch( pSrpcfSvrPlugin->handle, srpcfName, &pSrpcfSvrPlugin->dispatch );
+
+	// Let the plugin warm up once, a failure keeps it out of service
+	pSrpcfSvrPlugin->pContext = NULL;
+	if( pSrpcfSvrPlugin->dispatch.srpcfFuncInit
+		&& pSrpcfSvrPlugin->dispatch.srpcfFuncInit( &pSrpcfSvrPlugin->pContext ) == FALSE ) {
+
+		DBGPRINT( "Plugin %s failed to initialize\n", srpcfName );
+		dlclose( pSrpcfSvrPlugin->handle );
+		if( pSrpcfSvrPlugin->stageFd >= 0 )
+			close( pSrpcfSvrPlugin->stageFd );
+		free( pSrpcfSvrPlugin );
+		return NULL;
+	}
+
+	// The registry holds the first reference
+	pSrpcfSvrPlugin->next = NULL;
+	pSrpcfSvrPlugin->id = LIBSRPCF_PLUGIN_NONE;
+	pSrpcfSvrPlugin->refCount = 1;
+
+	return pSrpcfSvrPlugin;
+}
+
+
+static void unloadSrpcfSvrPlugin( srpcfSvrPlugin_t *pSrpcfSvrPlugin ) {
+
+	// No call holds it anymore
+	if( pSrpcfSvrPlugin->dispatch.srpcfFuncFini )
+		pSrpcfSvrPlugin->dispatch.srpcfFuncFini( pSrpcfSvrPlugin->pContext );
+
+	dlclose( pSrpcfSvrPlugin->handle );
+	if( pSrpcfSvrPlugin->stageFd >= 0 )
+		close( pSrpcfSvrPlugin->stageFd );
+	free( pSrpcfSvrPlugin );
+}
+
+
+static srpcfSvrPlugin_t *insertSrpcfSvrPlugin( srpcfSvrPlugin_t *pSrpcfSvrPlugin ) {
+
+	srpcfSvrPlugin_t *pExisting;
+	u32 bucket, i;
+
+	// Someone else may have loaded the same plugin meanwhile
+	pExisting = findSrpcfSvrPlugin( pSrpcfSvrPlugin->name );
+	if( pExisting )
+		return pExisting;
+
+	bucket = hashSrpcfSvrPlugin( pSrpcfSvrPlugin->name );
+	pSrpcfSvrPlugin->next = srpcfSvrPluginTbl[ bucket ];
+	srpcfSvrPluginTbl[ bucket ] = pSrpcfSvrPlugin;
+	__atomic_add_fetch( &srpcfSvrPluginGeneration, 1, __ATOMIC_RELEASE );
+
+	// A name keeps its ID for the life of the server, across reloads
+	for( i = 0 ; i < numOfSrpcfSvrPluginSlots ; i++ )
+		if( !strcmp( srpcfSvrPluginSlotTbl[ i ].name, pSrpcfSvrPlugin->name ) )
+			break;
+
+	if( i == numOfSrpcfSvrPluginSlots ) {
+
+		// Out of IDs, it can still be called by name
+		if( i == SRPCFSVR_PLUGIN_MAX )
+			return pSrpcfSvrPlugin;
+
+		strcpy( srpcfSvrPluginSlotTbl[ i ].name, pSrpcfSvrPlugin->name );
+		numOfSrpcfSvrPluginSlots++;
+	}
+
+	srpcfSvrPluginSlotTbl[ i ].pSrpcfSvrPlugin = pSrpcfSvrPlugin;
+	pSrpcfSvrPlugin->id = i;
+
+	return pSrpcfSvrPlugin;
+}
+
+
+static srpcfSvrPlugin_t *removeSrpcfSvrPlugin( const s8 *srpcfName ) {
+
+	srpcfSvrPlugin_t **ppSrpcfSvrPlugin, *pSrpcfSvrPlugin;
+
+	for( ppSrpcfSvrPlugin = &srpcfSvrPluginTbl[ hashSrpcfSvrPlugin( srpcfName ) ] ;
+			*ppSrpcfSvrPlugin ;
+			ppSrpcfSvrPlugin = &(*ppSrpcfSvrPlugin)->next ) {
+
+		if( !strcmp( (*ppSrpcfSvrPlugin)->name, srpcfName ) ) {
+
+			pSrpcfSvrPlugin = *ppSrpcfSvrPlugin;
+			*ppSrpcfSvrPlugin = pSrpcfSvrPlugin->next;
+			__atomic_add_fetch( &srpcfSvrPluginGeneration, 1, __ATOMIC_RELEASE );
+
+			// The ID stays reserved for this name
+			if( pSrpcfSvrPlugin->id != LIBSRPCF_PLUGIN_NONE )
+				srpcfSvrPluginSlotTbl[ pSrpcfSvrPlugin->id ].pSrpcfSvrPlugin = NULL;
+
+			return pSrpcfSvrPlugin;
+		}
+	}
+
+	return NULL;
+}
+
+
+static void reloadSrpcfSvrPlugin( const s8 *fileName, bool removed ) {
+
+	srpcfSvrPlugin_t *pSrpcfSvrPlugin = NULL, *pRetired;
+	s8 srpcfName[ SRPCF_FUNC_MAXLEN ];
+	size_t len, suffixLen = strlen( LIBSRPCF_PLUGIN_SUFFIX );
+
+	// Only plugin files
+	len = strlen( fileName );
+	if( len <= suffixLen || len - suffixLen >= SRPCF_FUNC_MAXLEN
+		|| strcmp( fileName + len - suffixLen, LIBSRPCF_PLUGIN_SUFFIX ) )
+		return;
+
+	memcpy( srpcfName, fileName, len - suffixLen );
+	srpcfName[ len - suffixLen ] = '\0';
+
+	// Load the new image before taking the lock, a broken file keeps the old one
+	if( removed == FALSE ) {
+
+		pSrpcfSvrPlugin = loadSrpcfSvrPlugin( srpcfName );
+		if( !pSrpcfSvrPlugin )
+			return;
+	}
+
+	// Swap, new requests see the new image from here on
+	pthread_rwlock_wrlock( &pluginLock );
+	pRetired = removeSrpcfSvrPlugin( srpcfName );
+	if( pSrpcfSvrPlugin )
+		insertSrpcfSvrPlugin( pSrpcfSvrPlugin );
+	pthread_rwlock_unlock( &pluginLock );
+
+	// The old image is closed once the calls still running on it finish
+	if( pRetired )
+		releaseSrpcfSvrPlugin( pRetired );
+
+	DBGPRINT( "Plugin %s %s\n", srpcfName, pSrpcfSvrPlugin ? "reloaded" : "removed" );
+}
+
+
+static void *watchSrpcfSvrPlugins( void *arg ) {
+
+	s8 buf[ SRPCFSVR_NOTIFY_BUF ] __attribute__((aligned( __alignof__( struct inotify_event ) )));
+	struct inotify_event *pEvent;
+	ssize_t rbyte;
+	s8 *p;
+
+	for( ; ; ) {
+
+		rbyte = read( pluginNotifyFd, buf, sizeof( buf ) );
+		if( rbyte <= 0 ) {
+
+			if( rbyte < 0 && errno == EINTR )
+				continue;
+			break;
+		}
+
+		// Do not get cancelled in the middle of a swap
+		pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+		for( p = buf ; p < buf + rbyte ; p += sizeof( struct inotify_event ) + pEvent->len ) {
+
+			pEvent = (struct inotify_event *)p;
+			if( !pEvent->len )
+				continue;
+
+			reloadSrpcfSvrPlugin( pEvent->name,
+				(pEvent->mask & (IN_DELETE | IN_MOVED_FROM)) ? TRUE : FALSE );
+		}
+		pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
+	}
+
+	pthread_exit( 0 );
+}
+
+
+bool initializeSrpcfSvrPlugins( void ) {
+
+	DIR *dir;
+	struct dirent *pEnt;
+	srpcfSvrPlugin_t *pSrpcfSvrPlugin, *pExisting;
+	s8 srpcfName[ SRPCF_FUNC_MAXLEN ];
+	size_t len, suffixLen = strlen( LIBSRPCF_PLUGIN_SUFFIX );
+	s32 numOfPlugins = 0;
+
+	memset( srpcfSvrPluginTbl, 0, sizeof( srpcfSvrPluginTbl ) );
+	memset( srpcfSvrPluginSlotTbl, 0, sizeof( srpcfSvrPluginSlotTbl ) );
+	numOfSrpcfSvrPluginSlots = 0;
+
+	// A restarted server must not repeat the generations of the last one
+	srpcfSvrPluginGeneration = (u32)time( NULL ) ^ ((u32)getpid() << 16);
+
+	// Watch first, so nothing written during the scan is missed
+	pluginNotifyFd = inotify_init1( IN_CLOEXEC );
+	if( pluginNotifyFd >= 0
+		&& inotify_add_watch( pluginNotifyFd, LIBSRPCF_PLUGIN_PATH,
+			IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE ) < 0 ) {
+
+		close( pluginNotifyFd );
+		pluginNotifyFd = -1;
+	}
+
+	if( pluginNotifyFd >= 0
+		&& pthread_create( &pluginWatcher, NULL, watchSrpcfSvrPlugins, NULL ) ) {
+
+		close( pluginNotifyFd );
+		pluginNotifyFd = -1;
+	}
+
+	if( pluginNotifyFd < 0 )
+		DBGPRINT( "Plugins are not watched, changes need a restart\n" );
+
+	// No plugin directory is fine, there is just nothing to preload
+	dir = opendir( LIBSRPCF_PLUGIN_PATH );
+	if( !dir )
+		return TRUE;
+
+	while( (pEnt = readdir( dir )) ) {
+
+		// Only plugin files
+		len = strlen( pEnt->d_name );
+		if( len <= suffixLen || len - suffixLen >= SRPCF_FUNC_MAXLEN
+			|| strcmp( pEnt->d_name + len - suffixLen, LIBSRPCF_PLUGIN_SUFFIX ) )
+			continue;
+
+		memcpy( srpcfName, pEnt->d_name, len - suffixLen );
+		srpcfName[ len - suffixLen ] = '\0';
+
+		pSrpcfSvrPlugin = loadSrpcfSvrPlugin( srpcfName );
+		if( !pSrpcfSvrPlugin )
+			continue;
+
+		// The watcher may have been quicker
+		pthread_rwlock_wrlock( &pluginLock );
+		pExisting = insertSrpcfSvrPlugin( pSrpcfSvrPlugin );
+		pthread_rwlock_unlock( &pluginLock );
+		if( pExisting != pSrpcfSvrPlugin )
+			unloadSrpcfSvrPlugin( pSrpcfSvrPlugin );
+		numOfPlugins++;
+	}
+	closedir( dir );
+
+	DBGPRINT( "Preloaded %d plugins\n", numOfPlugins );
+	return TRUE;
+}
+
+
+srpcfSvrPlugin_t *acquireSrpcfSvrPlugin( const s8 *srpcfName ) {
+
+	srpcfSvrPlugin_t *pSrpcfSvrPlugin, *pLoaded;
+
+	// Fast path, the plugin is registered already
+	pthread_rwlock_rdlock( &pluginLock );
+	pSrpcfSvrPlugin = findSrpcfSvrPlugin( srpcfName );
+	if( pSrpcfSvrPlugin )
+		__atomic_add_fetch( &pSrpcfSvrPlugin->refCount, 1, __ATOMIC_RELAXED );
+	pthread_rwlock_unlock( &pluginLock );
+
+	if( pSrpcfSvrPlugin )
+		return pSrpcfSvrPlugin;
+
+	// Plugins installed after startup are loaded on first use
+	pLoaded = loadSrpcfSvrPlugin( srpcfName );
+	if( !pLoaded )
+		return NULL;
+
+	pthread_rwlock_wrlock( &pluginLock );
+	pSrpcfSvrPlugin = insertSrpcfSvrPlugin( pLoaded );
+	__atomic_add_fetch( &pSrpcfSvrPlugin->refCount, 1, __ATOMIC_RELAXED );
+	pthread_rwlock_unlock( &pluginLock );
+
+	// Lost the race, drop our copy
+	if( pSrpcfSvrPlugin != pLoaded )
+		unloadSrpcfSvrPlugin( pLoaded );
+
+	return pSrpcfSvrPlugin;
+}
+
+
+srpcfSvrPlugin_t *acquireSrpcfSvrPluginById( u32 srpcfPluginId ) {
+
+	srpcfSvrPlugin_t *pSrpcfSvrPlugin;
+
+	if( srpcfPluginId >= SRPCFSVR_PLUGIN_MAX )
+		return NULL;
+
+	// Same cost as a built-in command, an index and a reference
+	pthread_rwlock_rdlock( &pluginLock );
+	pSrpcfSvrPlugin = srpcfSvrPluginSlotTbl[ srpcfPluginId ].pSrpcfSvrPlugin;
+	if( pSrpcfSvrPlugin )
+		__atomic_add_fetch( &pSrpcfSvrPlugin->refCount, 1, __ATOMIC_RELAXED );
+	pthread_rwlock_unlock( &pluginLock );
+
+	return pSrpcfSvrPlugin;
+}
+
+
+s8 *listSrpcfSvrPlugins( u32 *pLength ) {
+
+	srpcfSupportedPlugin_t *pSrpcfSupportedPlugin;
+	u32 i, numOfPlugins = 0, length = sizeof( u32 );
+	s8 *pList, *p;
+
+	pthread_rwlock_rdlock( &pluginLock );
+
+	// Size the list of loaded plugins
+	for( i = 0 ; i < numOfSrpcfSvrPluginSlots ; i++ )
+		if( srpcfSvrPluginSlotTbl[ i ].pSrpcfSvrPlugin )
+			length += sizeof( srpcfSupportedPlugin_t ) - sizeof( s8 * ) + strlen( srpcfSvrPluginSlotTbl[ i ].name ) + 1;
+
+	pList = (s8 *)malloc( length );
+	if( !pList ) {
+
+		pthread_rwlock_unlock( &pluginLock );
+		return NULL;
+	}
+
+	// Count, then ID, name length and name of each
+	p = pList + sizeof( u32 );
+	for( i = 0 ; i < numOfSrpcfSvrPluginSlots ; i++ ) {
+
+		if( !srpcfSvrPluginSlotTbl[ i ].pSrpcfSvrPlugin )
+			continue;
+
+		pSrpcfSupportedPlugin = (srpcfSupportedPlugin_t *)p;
+		pSrpcfSupportedPlugin->srpcfPluginId = i;
+		pSrpcfSupportedPlugin->nameLength = strlen( srpcfSvrPluginSlotTbl[ i ].name ) + 1;
+		memcpy( &pSrpcfSupportedPlugin->namePtr, srpcfSvrPluginSlotTbl[ i ].name, pSrpcfSupportedPlugin->nameLength );
+
+		p = (s8 *)&pSrpcfSupportedPlugin->namePtr + pSrpcfSupportedPlugin->nameLength;
+		numOfPlugins++;
+	}
+	*(u32 *)pList = numOfPlugins;
+
+	pthread_rwlock_unlock( &pluginLock );
+
+	*pLength = length;
+	return pList;
+}
+
+
+u32 generationOfSrpcfSvrPlugins( void ) {
+
+	// Moves whenever the list handed out by listSrpcfSvrPlugins() may differ
+	return __atomic_load_n( &srpcfSvrPluginGeneration, __ATOMIC_ACQUIRE );
+}
+
+
+void releaseSrpcfSvrPlugin( srpcfSvrPlugin_t *pSrpcfSvrPlugin ) {
+
+	// The last reference unloads it, that is only possible once it left the registry,
+	// so a swapped out image stays mapped until every call holding it returns
+	if( !__atomic_sub_fetch( &pSrpcfSvrPlugin->refCount, 1, __ATOMIC_ACQ_REL ) )
+		unloadSrpcfSvrPlugin( pSrpcfSvrPlugin );
+}
+
+
+void deinitializeSrpcfSvrPlugins( void ) {
+
+	srpcfSvrPlugin_t *pSrpcfSvrPlugin, *pNext;
+	s32 i;
+
+	// Stop watching
+	if( pluginNotifyFd >= 0 ) {
+
+		pthread_cancel( pluginWatcher );
+		pthread_join( pluginWatcher, NULL );
+		close( pluginNotifyFd );
+		pluginNotifyFd = -1;
+	}
+
+	// Drop the registry references, plugins still running go away when they finish
+	pthread_rwlock_wrlock( &pluginLock );
+	for( i = 0 ; i < SRPCFSVR_PLUGIN_BUCKETS ; i++ ) {
+
+		for( pSrpcfSvrPlugin = srpcfSvrPluginTbl[ i ] ; pSrpcfSvrPlugin ; pSrpcfSvrPlugin = pNext ) {
+
+			pNext = pSrpcfSvrPlugin->next;
+			releaseSrpcfSvrPlugin( pSrpcfSvrPlugin );
+		}
+		srpcfSvrPluginTbl[ i ] = NULL;
+	}
+	for( i = 0 ; i < numOfSrpcfSvrPluginSlots ; i++ )
+		srpcfSvrPluginSlotTbl[ i ].pSrpcfSvrPlugin = NULL;
+	pthread_rwlock_unlock( &pluginLock );
+}
@@ -0,0 +1,563 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: relay.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+#include "srpcfsvr.h"
+#include "netsock.h"
+
+
+//
+// Global variables
+//
+static srpcfSvrRelayPool_t *srpcfSvrRelayPoolTbl[ SRPCFSVR_RELAY_BUCKETS ];
+static pthread_rwlock_t relayLock = PTHREAD_RWLOCK_INITIALIZER;
+static u32 numOfSrpcfSvrRelayPools = 0;
+static u32 relayFanout = 0;
+
+
+//
+// A relay runs one command on a list of downstream servers and answers with
+// a single batch, one result per leaf. Downstreams are reached through a
+// session pool each, and all calls of a request are driven together by one
+// event loop, so a request costs no threads however wide it is.
+//
+static u64 getMonotonicMilliseconds( void ) {
+
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (u64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static u32 hashSrpcfSvrRelay( const s8 *addr, s32 port ) {
+
+	u32 hash = 2166136261U;
+
+	// FNV-1a
+	for( ; *addr ; addr++ ) {
+
+		hash ^= (u8)*addr;
+		hash *= 16777619U;
+	}
+	hash ^= (u32)port;
+	hash *= 16777619U;
+
+	return hash & (SRPCFSVR_RELAY_BUCKETS - 1);
+}
+
+
+// Called with the lock held
+static srpcfSvrRelayPool_t *findSrpcfSvrRelayPool( u32 idx, const s8 *addr, s32 port ) {
+
+	srpcfSvrRelayPool_t *pSrpcfSvrRelayPool;
+
+	for( pSrpcfSvrRelayPool = srpcfSvrRelayPoolTbl[ idx ] ;
+			pSrpcfSvrRelayPool ;
+			pSrpcfSvrRelayPool = pSrpcfSvrRelayPool->next ) {
+
+		if( pSrpcfSvrRelayPool->port == port && !strcmp( pSrpcfSvrRelayPool->addr, addr ) )
+			return pSrpcfSvrRelayPool;
+	}
+
+	return NULL;
+}
+
+
+// Called with the write lock held
+static bool evictSrpcfSvrRelayPool( void ) {
+
+	srpcfSvrRelayPool_t **ppSrpcfSvrRelayPool, **ppOldest = NULL, *pSrpcfSvrRelayPool;
+	u32 i;
+
+	// The pool left unused the longest goes, one in use stays
+	for( i = 0 ; i < SRPCFSVR_RELAY_BUCKETS ; i++ ) {
+
+		for( ppSrpcfSvrRelayPool = &srpcfSvrRelayPoolTbl[ i ] ;
+				*ppSrpcfSvrRelayPool ;
+				ppSrpcfSvrRelayPool = &(*ppSrpcfSvrRelayPool)->next ) {
+
+			if( __atomic_load_n( &(*ppSrpcfSvrRelayPool)->numOfUsers, __ATOMIC_ACQUIRE ) )
+				continue;
+
+			if( !ppOldest || (*ppSrpcfSvrRelayPool)->lastUsed < (*ppOldest)->lastUsed )
+				ppOldest = ppSrpcfSvrRelayPool;
+		}
+	}
+
+	if( !ppOldest )
+		return FALSE;
+
+	pSrpcfSvrRelayPool = *ppOldest;
+	*ppOldest = pSrpcfSvrRelayPool->next;
+	numOfSrpcfSvrRelayPools--;
+
+	DBGPRINT( "Evicting relay pool %s:%d\n", pSrpcfSvrRelayPool->addr, pSrpcfSvrRelayPool->port );
+	destroySrpcfPool( pSrpcfSvrRelayPool->pSrpcfPool );
+	free( pSrpcfSvrRelayPool );
+
+	return TRUE;
+}
+
+
+static srpcfSvrRelayPool_t *acquireSrpcfSvrRelayPool( const s8 *addr, s32 port ) {
+
+	srpcfSvrRelayPool_t *pSrpcfSvrRelayPool;
+	u32 idx = hashSrpcfSvrRelay( addr, port );
+
+	// Downstreams are few and long lived, almost every lookup hits
+	pthread_rwlock_rdlock( &relayLock );
+	pSrpcfSvrRelayPool = findSrpcfSvrRelayPool( idx, addr, port );
+	if( pSrpcfSvrRelayPool )
+		__atomic_fetch_add( &pSrpcfSvrRelayPool->numOfUsers, 1, __ATOMIC_ACQUIRE );
+	pthread_rwlock_unlock( &relayLock );
+
+	if( pSrpcfSvrRelayPool )
+		return pSrpcfSvrRelayPool;
+
+	pthread_rwlock_wrlock( &relayLock );
+
+	// Someone else may have added it meanwhile
+	pSrpcfSvrRelayPool = findSrpcfSvrRelayPool( idx, addr, port );
+	if( pSrpcfSvrRelayPool ) {
+
+		__atomic_fetch_add( &pSrpcfSvrRelayPool->numOfUsers, 1, __ATOMIC_ACQUIRE );
+		goto Exit;
+	}
+
+	// A full table makes room first, busy downstreams are never dropped
+	if( numOfSrpcfSvrRelayPools >= SRPCFSVR_RELAY_POOLS && evictSrpcfSvrRelayPool() == FALSE )
+		goto Exit;
+
+	pSrpcfSvrRelayPool = (srpcfSvrRelayPool_t *)malloc( sizeof( srpcfSvrRelayPool_t ) );
+	if( !pSrpcfSvrRelayPool )
+		goto Exit;
+
+	// Fill in the data
+	strncpy( pSrpcfSvrRelayPool->addr, addr, LIBSRPCF_RELAY_ADDR_MAX - 1 );
+	pSrpcfSvrRelayPool->addr[ LIBSRPCF_RELAY_ADDR_MAX - 1 ] = '\0';
+	pSrpcfSvrRelayPool->port = port;
+	pSrpcfSvrRelayPool->numOfUsers = 1;
+	pSrpcfSvrRelayPool->lastUsed = getMonotonicMilliseconds();
+	pSrpcfSvrRelayPool->pSrpcfPool = createSrpcfPool( pSrpcfSvrRelayPool->addr, port,
+			SRPCFSVR_RELAY_IDLE, SRPCFSVR_RELAY_TOTAL );
+	if( !pSrpcfSvrRelayPool->pSrpcfPool ) {
+
+		free( pSrpcfSvrRelayPool );
+		pSrpcfSvrRelayPool = NULL;
+		goto Exit;
+	}
+
+	pSrpcfSvrRelayPool->next = srpcfSvrRelayPoolTbl[ idx ];
+	srpcfSvrRelayPoolTbl[ idx ] = pSrpcfSvrRelayPool;
+	numOfSrpcfSvrRelayPools++;
+
+Exit:
+
+	pthread_rwlock_unlock( &relayLock );
+	return pSrpcfSvrRelayPool;
+}
+
+
+static void releaseSrpcfSvrRelayPool( srpcfSvrRelayPool_t *pSrpcfSvrRelayPool ) {
+
+	// Stamped before letting go, eviction picks the oldest unused
+	__atomic_store_n( &pSrpcfSvrRelayPool->lastUsed, getMonotonicMilliseconds(), __ATOMIC_RELAXED );
+	__atomic_fetch_sub( &pSrpcfSvrRelayPool->numOfUsers, 1, __ATOMIC_RELEASE );
+}
+
+
+static cmdOpt_t *copySrpcfSvrOptions( cmdOpt_t *pCmdOptPkt ) {
+
+	cmdOpt_t *head = NULL, *tail = NULL, *pCmdOpt;
+
+	// Sending consumes the list, the values stay in the request packet
+	for( ; pCmdOptPkt ; pCmdOptPkt = pCmdOptPkt->next ) {
+
+		pCmdOpt = (cmdOpt_t *)calloc( 1, sizeof( cmdOpt_t ) );
+		if( !pCmdOpt ) {
+
+			freeCmdOptList( head );
+			return NULL;
+		}
+
+		pCmdOpt->value = (s8 *)&pCmdOptPkt->dataPtr;
+		if( tail )
+			tail->next = pCmdOpt;
+		else
+			head = pCmdOpt;
+		tail = pCmdOpt;
+	}
+
+	return head;
+}
+
+
+static void completeSrpcfSvrRelay( void *pArg, u32 srpcfReqId, srpcfSvrRspExecute_t *pSrpcfSvrRspExecute ) {
+
+	srpcfSvrRelayCall_t *pSrpcfSvrRelayCall = (srpcfSvrRelayCall_t *)pArg;
+	u32 pktLen;
+
+	// Given up on already
+	if( pSrpcfSvrRelayCall->done == TRUE )
+		return;
+
+	pSrpcfSvrRelayCall->done = TRUE;
+	(*pSrpcfSvrRelayCall->pNumOfWaiting)--;
+
+	// The connection was lost
+	if( !pSrpcfSvrRspExecute ) {
+
+		pSrpcfSvrRelayCall->errorCode = SRPCF_FAILED_NODEV;
+		return;
+	}
+
+	// The response only lives in the session's ring
+	pktLen = pSrpcfSvrRspExecute->srpcfSvrCommHdr.srpcfPktLen;
+	pSrpcfSvrRelayCall->pRsp = (srpcfSvrCommPkt_t *)malloc( pktLen + 1 );
+	if( !pSrpcfSvrRelayCall->pRsp ) {
+
+		pSrpcfSvrRelayCall->errorCode = SRPCF_FAILED_NOMEM;
+		return;
+	}
+	memcpy( pSrpcfSvrRelayCall->pRsp, pSrpcfSvrRspExecute, pktLen );
+	((s8 *)pSrpcfSvrRelayCall->pRsp)[ pktLen ] = '\0';
+
+	pSrpcfSvrRelayCall->errorCode = SRPCF_SUCCESSFUL;
+}
+
+
+static bool startSrpcfSvrRelay( srpcfAsync_t *pSrpcfAsync, srpcfSvrRelayCall_t *pSrpcfSvrRelayCall, srpcfSvrReqExecuteRelay_t *pSrpcfSvrReqExecuteRelay, cmdOpt_t *pCmdOptPkt, u32 deadline ) {
+
+	srpcfRelayTarget_t *pTarget = &pSrpcfSvrRelayCall->target;
+	cmdOpt_t *pCmdOpt;
+	u32 srpcfReqId;
+
+	// Never wait for a session, busy downstreams are reported as such
+	pSrpcfSvrRelayCall->errorCode = SRPCF_FAILED_BUSY;
+	pSrpcfSvrRelayCall->pSrpcfSvrRelayPool = acquireSrpcfSvrRelayPool( pTarget->addr, pTarget->port );
+	if( !pSrpcfSvrRelayCall->pSrpcfSvrRelayPool )
+		return FALSE;
+
+	pSrpcfSvrRelayCall->pSrpcfSession = checkoutSrpcfPool( pSrpcfSvrRelayCall->pSrpcfSvrRelayPool->pSrpcfPool, 0 );
+	if( !pSrpcfSvrRelayCall->pSrpcfSession )
+		return FALSE;
+
+	pSrpcfSvrRelayCall->errorCode = SRPCF_FAILED_NOMEM;
+	if( attachSrpcfAsync( pSrpcfAsync, pSrpcfSvrRelayCall->pSrpcfSession ) == FALSE )
+		return FALSE;
+
+	pCmdOpt = copySrpcfSvrOptions( pSrpcfSvrReqExecuteRelay->numOfCmdOptList ? pCmdOptPkt : NULL );
+	if( pSrpcfSvrReqExecuteRelay->numOfCmdOptList && !pCmdOpt )
+		return FALSE;
+
+	// Relays below get their list and a share of the time, leaves the command
+	if( pTarget->subTargets )
+		srpcfReqId = submitSrpcfAsyncRelay( pSrpcfSvrRelayCall->pSrpcfSession,
+				pTarget->subTargets, pTarget->subLength, LIBSRPCF_RELAY_DEADLINE( deadline ),
+				pSrpcfSvrReqExecuteRelay->srpcfCmdNo, pCmdOpt,
+				pSrpcfSvrReqExecuteRelay->srpcfName[ 0 ] ? pSrpcfSvrReqExecuteRelay->srpcfName : NULL,
+				completeSrpcfSvrRelay, pSrpcfSvrRelayCall );
+	else if( pSrpcfSvrReqExecuteRelay->srpcfName[ 0 ] )
+		srpcfReqId = submitSrpcfAsyncPlugin( pSrpcfSvrRelayCall->pSrpcfSession,
+				pSrpcfSvrReqExecuteRelay->srpcfCmdNo, pCmdOpt, pSrpcfSvrReqExecuteRelay->srpcfName,
+				completeSrpcfSvrRelay, pSrpcfSvrRelayCall );
+	else
+		srpcfReqId = submitSrpcfAsync( pSrpcfSvrRelayCall->pSrpcfSession,
+				pSrpcfSvrReqExecuteRelay->srpcfCmdNo, pCmdOpt,
+				completeSrpcfSvrRelay, pSrpcfSvrRelayCall );
+
+	// A lost connection may have completed it already
+	if( !srpcfReqId ) {
+
+		pSrpcfSvrRelayCall->errorCode = SRPCF_FAILED_NODEV;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+static s8 *dataOfSrpcfSvrRelay( s8 *data, u32 dataLength ) {
+
+	// Results are strings, anything else is dropped
+	if( !dataLength || data[ dataLength - 1 ] != '\0' )
+		return NULL;
+
+	return data;
+}
+
+
+static srpcfSvrRspExecuteBatch_t *mergeSrpcfSvrRelay( srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch, u32 *pSize, srpcfSvrRelayCall_t *pSrpcfSvrRelayCall ) {
+
+	srpcfSvrCommPkt_t *pRsp = pSrpcfSvrRelayCall->pRsp;
+	srpcfBatchResult_t *pSrpcfBatchResult = NULL;
+	u32 i, hdrLen, errorCode = pSrpcfSvrRelayCall->errorCode;
+
+	if( pRsp && !pSrpcfSvrRelayCall->target.subTargets ) {
+
+		// A leaf answers for itself
+		hdrLen = sizeof( srpcfSvrRspExecute_t ) - sizeof( s8 * );
+		if( (u32)pRsp->srpcfSvrCommHdr.srpcfOpCode == SRPCF_RSP_EXECUTE
+			&& pRsp->srpcfSvrRspExecute.dataLength <= (pRsp->srpcfSvrCommHdr.srpcfPktLen - hdrLen) )
+			return appendSrpcfSvrBatch( pSrpcfSvrRspExecuteBatch, pSize,
+					pRsp->srpcfSvrRspExecute.srpcfErrorCode,
+					dataOfSrpcfSvrRelay( (s8 *)&pRsp->srpcfSvrRspExecute.dataPtr, pRsp->srpcfSvrRspExecute.dataLength ) );
+
+		errorCode = SRPCF_FAILED_INVALID;
+	}
+	else if( pRsp && (u32)pRsp->srpcfSvrCommHdr.srpcfOpCode != SRPCF_RSP_EXECUTE_BATCH )
+		errorCode = SRPCF_FAILED_INVALID;
+
+	// A relay answers for every leaf below it, whatever is missing failed
+	for( i = 0 ; i < pSrpcfSvrRelayCall->target.numOfLeaves ; i++ ) {
+
+		if( errorCode == SRPCF_SUCCESSFUL ) {
+
+			pSrpcfBatchResult = nextSrpcfBatchResult( &pRsp->srpcfSvrRspExecuteBatch, pSrpcfBatchResult );
+			if( !pSrpcfBatchResult )
+				errorCode = SRPCF_FAILED_UNKNOWN;
+		}
+
+		if( errorCode == SRPCF_SUCCESSFUL )
+			pSrpcfSvrRspExecuteBatch = appendSrpcfSvrBatch( pSrpcfSvrRspExecuteBatch, pSize,
+					pSrpcfBatchResult->srpcfErrorCode,
+					dataOfSrpcfSvrRelay( (s8 *)&pSrpcfBatchResult->dataPtr, pSrpcfBatchResult->dataLength ) );
+		else
+			pSrpcfSvrRspExecuteBatch = appendSrpcfSvrBatch( pSrpcfSvrRspExecuteBatch, pSize, errorCode, NULL );
+	}
+
+	return pSrpcfSvrRspExecuteBatch;
+}
+
+
+static srpcfSvrRspExecuteBatch_t *runSrpcfSvrRelay( srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch, u32 *pSize, srpcfSvrReqExecuteRelay_t *pSrpcfSvrReqExecuteRelay, const s8 *targets, u32 targetLength, cmdOpt_t *pCmdOptPkt ) {
+
+	srpcfSvrRelayCall_t *pSrpcfSvrRelayCall;
+	srpcfRelayTarget_t srpcfRelayTarget;
+	srpcfAsync_t *pSrpcfAsync;
+	const s8 *cursor, *end = targets + targetLength;
+	u32 i, numOfCalls = 0, numOfWaiting = 0, deadline;
+	u64 start = getMonotonicMilliseconds(), elapsed;
+
+	deadline = pSrpcfSvrReqExecuteRelay->srpcfDeadline ? pSrpcfSvrReqExecuteRelay->srpcfDeadline : SRPCFSVR_RELAY_DEADLINE_DEF;
+
+	// One call per entry, a relay below stands for all of its leaves
+	for( cursor = targets ; parseSrpcfRelayTarget( &cursor, end, &srpcfRelayTarget ) == TRUE ; numOfCalls++ );
+
+	pSrpcfSvrRelayCall = (srpcfSvrRelayCall_t *)calloc( numOfCalls, sizeof( srpcfSvrRelayCall_t ) );
+	if( !pSrpcfSvrRelayCall )
+		return pSrpcfSvrRspExecuteBatch;
+
+	for( cursor = targets, i = 0 ; i < numOfCalls ; i++ )
+		parseSrpcfRelayTarget( &cursor, end, &pSrpcfSvrRelayCall[ i ].target );
+
+	pSrpcfAsync = createSrpcfAsync();
+
+	// Send everything out first, so the downstreams work in parallel
+	for( i = 0 ; i < numOfCalls ; i++ ) {
+
+		pSrpcfSvrRelayCall[ i ].pNumOfWaiting = &numOfWaiting;
+		pSrpcfSvrRelayCall[ i ].done = TRUE;
+
+		// The fan-out of a relay is bounded, a wider list needs another level
+		if( i >= relayFanout ) {
+
+			pSrpcfSvrRelayCall[ i ].errorCode = SRPCF_FAILED_BUSY;
+			continue;
+		}
+
+		if( !pSrpcfAsync ) {
+
+			pSrpcfSvrRelayCall[ i ].errorCode = SRPCF_FAILED_NOMEM;
+			continue;
+		}
+
+		pSrpcfSvrRelayCall[ i ].done = FALSE;
+		numOfWaiting++;
+		if( startSrpcfSvrRelay( pSrpcfAsync, &pSrpcfSvrRelayCall[ i ], pSrpcfSvrReqExecuteRelay, pCmdOptPkt, deadline ) == FALSE
+			&& pSrpcfSvrRelayCall[ i ].done == FALSE ) {
+
+			pSrpcfSvrRelayCall[ i ].done = TRUE;
+			numOfWaiting--;
+		}
+	}
+
+	// Collect the responses until the deadline
+	while( numOfWaiting ) {
+
+		elapsed = getMonotonicMilliseconds() - start;
+		if( elapsed >= deadline )
+			break;
+
+		if( dispatchSrpcfAsync( pSrpcfAsync, deadline - elapsed ) < 0 )
+			break;
+	}
+
+	for( i = 0 ; i < numOfCalls ; i++ ) {
+
+		// Too late, whatever it still sends is thrown away with its connection
+		if( pSrpcfSvrRelayCall[ i ].done == FALSE ) {
+
+			pSrpcfSvrRelayCall[ i ].done = TRUE;
+			pSrpcfSvrRelayCall[ i ].errorCode = SRPCF_FAILED_AGAIN;
+		}
+
+		if( pSrpcfSvrRelayCall[ i ].pSrpcfSession ) {
+
+			detachSrpcfAsync( pSrpcfSvrRelayCall[ i ].pSrpcfSession );
+			checkinSrpcfPool( pSrpcfSvrRelayCall[ i ].pSrpcfSvrRelayPool->pSrpcfPool, pSrpcfSvrRelayCall[ i ].pSrpcfSession );
+		}
+
+		if( pSrpcfSvrRelayCall[ i ].pSrpcfSvrRelayPool )
+			releaseSrpcfSvrRelayPool( pSrpcfSvrRelayCall[ i ].pSrpcfSvrRelayPool );
+	}
+	destroySrpcfAsync( pSrpcfAsync );
+
+	// Merge in the order of the list
+	for( i = 0 ; i < numOfCalls ; i++ ) {
+
+		pSrpcfSvrRspExecuteBatch = mergeSrpcfSvrRelay( pSrpcfSvrRspExecuteBatch, pSize, &pSrpcfSvrRelayCall[ i ] );
+
+		// Free resource
+		if( pSrpcfSvrRelayCall[ i ].pRsp )
+			free( pSrpcfSvrRelayCall[ i ].pRsp );
+	}
+
+	free( pSrpcfSvrRelayCall );
+	return pSrpcfSvrRspExecuteBatch;
+}
+
+
+bool executeSrpcfRelay( s32 *pMxqFd, srpcfSvrReqExecuteRelay_t *pSrpcfSvrReqExecuteRelay ) {
+
+	srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch;
+	cmdOpt_t *pCmdOptPkt;
+	const s8 *targets;
+	u32 i, hdrLen, targetLength, numOfLeaves, size;
+	bool ret;
+
+	pSrpcfSvrRspExecuteBatch = createSrpcfSvrBatch( pSrpcfSvrReqExecuteRelay->srpcfSvrCommHdr.srpcfReqId, &size );
+	if( !pSrpcfSvrRspExecuteBatch )
+		return FALSE;
+
+	// Nothing past the header can be read from a frame this short
+	hdrLen = sizeof( srpcfSvrReqExecuteRelay_t ) - sizeof( s8 * );
+	if( pSrpcfSvrReqExecuteRelay->srpcfSvrCommHdr.srpcfPktLen < hdrLen ) {
+
+		DBGPRINT( "Relay request too short\n" );
+		goto Send;
+	}
+
+	// The list must be terminated within the frame, an empty batch tells it was not
+	targetLength = pSrpcfSvrReqExecuteRelay->targetLength;
+	targets = (const s8 *)&pSrpcfSvrReqExecuteRelay->targetPtr;
+	if( !targetLength
+		|| targetLength > (pSrpcfSvrReqExecuteRelay->srpcfSvrCommHdr.srpcfPktLen - hdrLen)
+		|| targets[ targetLength - 1 ] != '\0' ) {
+
+		DBGPRINT( "Invalid relay target list\n" );
+		goto Send;
+	}
+
+	numOfLeaves = countSrpcfRelayLeaves( targets, targetLength - 1 );
+	if( !numOfLeaves ) {
+
+		DBGPRINT( "Malformed relay target list\n" );
+		goto Send;
+	}
+
+	// Not a relay, every leaf is refused
+	if( !relayFanout ) {
+
+		for( i = 0 ; i < numOfLeaves ; i++ )
+			pSrpcfSvrRspExecuteBatch = appendSrpcfSvrBatch( pSrpcfSvrRspExecuteBatch, &size, SRPCF_FAILED_PERM, NULL );
+		goto Send;
+	}
+
+	// Never trust the peer to terminate the name
+	pSrpcfSvrReqExecuteRelay->srpcfName[ SRPCF_FUNC_MAXLEN - 1 ] = '\0';
+
+	// Options follow the target list, each one within the frame and terminated
+	pCmdOptPkt = (cmdOpt_t *)(targets + targetLength);
+	if( !pSrpcfSvrReqExecuteRelay->numOfCmdOptList )
+		pCmdOptPkt = NULL;
+	else if( deserializeCmdOptObject( pCmdOptPkt, pSrpcfSvrReqExecuteRelay->numOfCmdOptList,
+			(s8 *)pSrpcfSvrReqExecuteRelay + pSrpcfSvrReqExecuteRelay->srpcfSvrCommHdr.srpcfPktLen ) == FALSE ) {
+
+		DBGPRINT( "Invalid relay options\n" );
+		for( i = 0 ; i < numOfLeaves ; i++ )
+			pSrpcfSvrRspExecuteBatch = appendSrpcfSvrBatch( pSrpcfSvrRspExecuteBatch, &size, SRPCF_FAILED_INVALID, NULL );
+		goto Send;
+	}
+
+	pSrpcfSvrRspExecuteBatch = runSrpcfSvrRelay( pSrpcfSvrRspExecuteBatch, &size, pSrpcfSvrReqExecuteRelay,
+			targets, targetLength - 1, pCmdOptPkt );
+
+Send:
+
+	// Send out the merged response, missing results count as failed
+	ret = sendSrpcfPacket( pMxqFd, (srpcfSvrCommPkt_t *)pSrpcfSvrRspExecuteBatch );
+
+	free( pSrpcfSvrRspExecuteBatch );
+	return ret;
+}
+
+
+bool initializeSrpcfSvrRelay( u32 fanout ) {
+
+	// Downstreams are dialled without blocking, the request deadline bounds them
+	relayFanout = fanout;
+
+	return TRUE;
+}
+
+
+// Every request must have finished
+void deinitializeSrpcfSvrRelay( void ) {
+
+	srpcfSvrRelayPool_t *pSrpcfSvrRelayPool, *pNext;
+	u32 i;
+
+	pthread_rwlock_wrlock( &relayLock );
+
+	for( i = 0 ; i < SRPCFSVR_RELAY_BUCKETS ; i++ ) {
+
+		for( pSrpcfSvrRelayPool = srpcfSvrRelayPoolTbl[ i ] ; pSrpcfSvrRelayPool ; pSrpcfSvrRelayPool = pNext ) {
+
+			pNext = pSrpcfSvrRelayPool->next;
+			destroySrpcfPool( pSrpcfSvrRelayPool->pSrpcfPool );
+			free( pSrpcfSvrRelayPool );
+		}
+		srpcfSvrRelayPoolTbl[ i ] = NULL;
+	}
+	numOfSrpcfSvrRelayPools = 0;
+
+	pthread_rwlock_unlock( &relayLock );
+}
+
+
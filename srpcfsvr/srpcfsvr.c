@@ -25,13 +25,15 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <pthread.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <time.h>
 #include <dlfcn.h>
 
 #include "srpcf_types.h"
 #include "srpcf.h"
 #include "srpcf_err.h"
 #include "libsrpcf.h"
-#include "srpcf_support.h"
 #include "srpcfsvr.h"
 #include "netsock.h"
 
@@ -42,235 +44,651 @@
 static srpcfSvrThd_t *srpcfSvrThdHead = NULL;
 static pthread_mutex_t threadLock = PTHREAD_MUTEX_INITIALIZER;
 static volatile s8 terminate = 0;
+static u32 idleTimeout = SRPCFSVR_IDLE_DEF;
+static u32 benchRequests = 0;
 
 
 static void usage( void ) {
 
     fprintf( stderr, "\n""\n" );
     fprintf( stderr, "Simple Remote Procedure Command Framework Server\n\n" );
-    fprintf( stderr, "Usage: srpcfsvr [-h]\n" );
+    fprintf( stderr, "Usage: srpcfsvr [-c] [-m thread|epoll] [-l loops] [-w workers] [-q depth] [-x shared|steal] [-t seconds] [-M bytes] [-b requests] [-p port] [-r fanout] [-h]\n" );
+    fprintf( stderr, "\t-c\trun in the foreground.\n");
+    fprintf( stderr, "\t-m\tconnection model, a thread per connection (default) or epoll event loops.\n");
+    fprintf( stderr, "\t-l\tnumber of event loop threads in epoll mode (default %d).\n", SRPCFSVR_EVLOOP_DEF );
+    fprintf( stderr, "\t-w\tnumber of worker threads executing commands (default one per CPU in epoll mode, else 0).\n");
+    fprintf( stderr, "\t\t0 runs commands on the connection thread, in epoll mode that stalls the loop and suits cheap commands only.\n");
+    fprintf( stderr, "\t-q\tdepth of the worker request queue, a power of two (default %d).\n", SRPCFSVR_QUEUE_DEF );
+    fprintf( stderr, "\t-x\tworker scheduler, one shared queue (default) or per-worker work-stealing deques.\n");
+    fprintf( stderr, "\t-t\tidle timeout of persistent sessions in seconds (default %d).\n", SRPCFSVR_IDLE_DEF );
+    fprintf( stderr, "\t-M\tlargest request accepted in bytes (default %d).\n", LIBSRPCF_MSG_LIMIT );
+    fprintf( stderr, "\t-b\ttime this many pipelined requests over the in-process loopback " SRPCFSVR_BENCH_ADDR " and exit.\n");
+    fprintf( stderr, "\t-p\tTCP port to listen on (default %d).\n", SRPCF_DEF_PORT );
+    fprintf( stderr, "\t-r\trelay requests to at most this many downstream servers each (default 0, no relay).\n");
+    fprintf( stderr, "\tClients on this host may also connect to the abstract socket " SRPCF_UNIX_NAME ".\n", SRPCF_DEF_PORT );
+    fprintf( stderr, "\tLocal clients connecting to \"" SRPCF_SHM_PREFIX "\" get shared memory rings through " SRPCF_SHM_NAME ".\n", SRPCF_DEF_PORT );
+    fprintf( stderr, "\tSend SIGUSR1 to print the worker scheduler statistics.\n");
+    fprintf( stderr, "\tPlugins under " LIBSRPCF_PLUGIN_PATH "/ are reloaded when they are rewritten or renamed into place.\n");
     fprintf( stderr, "\t-h\tprint this message.\n");
     fprintf( stderr, "\n");
 }
 
 
-static bool executeSrpcfPluginFunction( s32 *pMxqFd, srpcfSvrReqExecutePlugin_t *pSrpcfSvrReqExecutePlugin ) {
+static s8 *invokeSrpcfExecutor( const srpcfDispatch_t *pSrpcfDispatch, void *pContext, cmdOpt_t *pCmdOpt, u32 numOfCmdOpt, const s8 *optEnd, srpcfSink_t *pSink, u32 *errorCode ) {
 
-	s32 ret;
-	u32 errorCode;
-    void *handle;
+	bool ret;
 	s8 *rstData;
-    s8 execute[ SRPCF_FUNC_MAXLEN ];
-	s8 *(*pSrpcfFuncExecutor)(cmdOpt_t*, u32, u32*);
-	s8 path[ LIBSRPCF_MAX_PATH ];
-	struct stat srpcfStat;
-
-    // Get fullpath
-    snprintf( path, 
-		LIBSRPCF_MAX_PATH, 
-		LIBSRPCF_PLUGIN_PATH "/%s" LIBSRPCF_PLUGIN_SUFFIX,
-		pSrpcfSvrReqExecutePlugin->srpcfName );
-
-    // Check for exist
-    ret = stat( path, &srpcfStat );
-    if( ret < 0 )
-        return XR_END_SRPCF;
-
-    // Open instance itself
-    handle = dlopen( path, RTLD_LAZY );
-    if( !handle ) {
-
-		fprintf( stderr, "Internal error: cannot open executing instance\n" );
-        goto ErrExit;
-    }
 
-    // Lookup Symbols
-	snprintf( execute, SRPCF_FUNC_MAXLEN, SRPCF_EXECUTOR_PREFIX "%s", pSrpcfSvrReqExecutePlugin->srpcfName );
-    pSrpcfFuncExecutor = dlsym( handle, execute );
-    if( !pSrpcfFuncExecutor ) {
+    // A command either returns its result or streams it
+    if( !pSrpcfDispatch->srpcfFuncExecutor
+		&& !pSrpcfDispatch->srpcfFuncContextExecutor
+		&& !pSrpcfDispatch->srpcfFuncStreamer ) {
 
 		fprintf( stderr, "Internal error: cannot find the symbol of SRPCF executor\n" );
-		goto ErrExit;
+		return NULL;
     }
 
-	// Deserialize CmdOpt object
-	if( pSrpcfSvrReqExecutePlugin->numOfCmdOptList ) {
+	// Deserialize CmdOpt object, never past the request
+	if( numOfCmdOpt ) {
 
-		ret = deserializeCmdOptObject(
-				(cmdOpt_t *)&pSrpcfSvrReqExecutePlugin->listOfCmdOpt, 
-				pSrpcfSvrReqExecutePlugin->numOfCmdOptList );
+		ret = deserializeCmdOptObject( pCmdOpt, numOfCmdOpt, optEnd );
 		if( ret == FALSE ) {
 
 			fprintf( stderr, "Internal error: cannot convert serialize object to linklist\n" );
-			goto ErrExit1;
+			*errorCode = SRPCF_FAILED_INVALID;
+			return NULL;
 		}
 	}
 
 	// Execute SRPCF function
-	rstData = pSrpcfFuncExecutor( 
-			(cmdOpt_t *)&pSrpcfSvrReqExecutePlugin->listOfCmdOpt, 
-			pSrpcfSvrReqExecutePlugin->numOfCmdOptList, 
+	if( pSrpcfDispatch->srpcfFuncContextExecutor )
+		return pSrpcfDispatch->srpcfFuncContextExecutor( pContext, numOfCmdOpt ? pCmdOpt : NULL, numOfCmdOpt, errorCode );
+
+	if( pSrpcfDispatch->srpcfFuncExecutor )
+		return pSrpcfDispatch->srpcfFuncExecutor( numOfCmdOpt ? pCmdOpt : NULL, numOfCmdOpt, errorCode );
+
+	pSrpcfDispatch->srpcfFuncStreamer( numOfCmdOpt ? pCmdOpt : NULL, numOfCmdOpt, pSink, errorCode );
+
+	// Whatever was not streamed yet goes with the final response
+	if( pSink->failed == TRUE )
+		*errorCode = SRPCF_FAILED_NOMEM;
+	rstData = closeSrpcfSink( pSink );
+
+	return rstData;
+}
+
+
+static s8 *runSrpcfPlugin( srpcfSvrPlugin_t *pSrpcfSvrPlugin, cmdOpt_t *pCmdOpt, u32 numOfCmdOpt, const s8 *optEnd, srpcfSink_t *pSink, u32 *errorCode ) {
+
+	s8 *rstData;
+
+	*errorCode = SRPCF_FAILED_NODEV;
+	if( !pSrpcfSvrPlugin )
+		return NULL;
+
+	// Execute SRPCF function, the reference keeps the image loaded while it runs
+	rstData = invokeSrpcfExecutor( &pSrpcfSvrPlugin->dispatch, pSrpcfSvrPlugin->pContext, pCmdOpt, numOfCmdOpt, optEnd, pSink, errorCode );
+
+	releaseSrpcfSvrPlugin( pSrpcfSvrPlugin );
+	return rstData;
+}
+
+
+static s8 *runSrpcfPluginFunction( s8 *srpcfName, cmdOpt_t *pCmdOpt, u32 numOfCmdOpt, const s8 *optEnd, srpcfSink_t *pSink, u32 *errorCode ) {
+
+	// Plugins stay loaded in the registry, look it up by name
+	return runSrpcfPlugin( acquireSrpcfSvrPlugin( srpcfName ), pCmdOpt, numOfCmdOpt, optEnd, pSink, errorCode );
+}
+
+
+static s8 *runSrpcfPluginIdFunction( u32 srpcfPluginId, cmdOpt_t *pCmdOpt, u32 numOfCmdOpt, const s8 *optEnd, srpcfSink_t *pSink, u32 *errorCode ) {
+
+	// IDs handed out by the support query index the registry directly
+	return runSrpcfPlugin( acquireSrpcfSvrPluginById( srpcfPluginId ), pCmdOpt, numOfCmdOpt, optEnd, pSink, errorCode );
+}
+
+
+static s8 *runSrpcfFunction( u32 srpcfCmdNo, cmdOpt_t *pCmdOpt, u32 numOfCmdOpt, const s8 *optEnd, srpcfSink_t *pSink, u32 *errorCode ) {
+
+	const srpcfCmdDesc_t *pSrpcfCmdDesc;
+
+	*errorCode = SRPCF_FAILED_NODEV;
+
+	// Built-in commands were bound at link time
+	pSrpcfCmdDesc = lookupSrpcfCmd( srpcfCmdNo );
+	if( !pSrpcfCmdDesc ) {
+
+		fprintf( stderr, "Internal error: cannot find corresponding SRPCF function\n" );
+		return NULL;
+	}
+
+	return invokeSrpcfExecutor( &pSrpcfCmdDesc->dispatch, NULL, pCmdOpt, numOfCmdOpt, optEnd, pSink, errorCode );
+}
+
+
+// Same-host clients that can take a descriptor get large results mapped
+static bool respondSrpcfExecute( s32 *pMxqFd, u32 capFlags, u32 srpcfReqId, u32 srpcfCmdNo, u32 errorCode, s8 *rstData ) {
+
+	if( capFlags & SRPCF_CAP_MAPPED )
+		return responseSrpcfExecuteMapped( pMxqFd, srpcfReqId, srpcfCmdNo, errorCode, rstData );
+
+	return responseSrpcfExecute( pMxqFd, srpcfReqId, srpcfCmdNo, errorCode, rstData );
+}
+
+
+static bool executeSrpcfPluginFunction( s32 *pMxqFd, u32 capFlags, srpcfSvrReqExecutePlugin_t *pSrpcfSvrReqExecutePlugin ) {
+
+	bool ret;
+	u32 errorCode;
+	s8 *rstData;
+	srpcfSink_t srpcfSink;
+
+	// Never trust the peer to terminate the name
+	pSrpcfSvrReqExecutePlugin->srpcfName[ SRPCF_FUNC_MAXLEN - 1 ] = '\0';
+
+	// Execute SRPCF function, streamed chunks go out as they are emitted
+	openSrpcfSink( &srpcfSink, pMxqFd,
+			pSrpcfSvrReqExecutePlugin->srpcfSvrCommHdr.srpcfReqId,
+			(capFlags & SRPCF_CAP_STREAM) ? TRUE : FALSE );
+	rstData = runSrpcfPluginFunction( pSrpcfSvrReqExecutePlugin->srpcfName,
+			(cmdOpt_t *)&pSrpcfSvrReqExecutePlugin->listOfCmdOpt,
+			pSrpcfSvrReqExecutePlugin->numOfCmdOptList,
+			(s8 *)pSrpcfSvrReqExecutePlugin + pSrpcfSvrReqExecutePlugin->srpcfSvrCommHdr.srpcfPktLen,
+			&srpcfSink,
 			&errorCode );
 
-	// Response for this SRPCF command
-    ret = responseSrpcfExecute( pMxqFd, pSrpcfSvrReqExecutePlugin->srpcfCmdNo, errorCode, rstData );
+	// Response for this SRPCF command, pipelined clients wait for every ID even on failure
+    ret = respondSrpcfExecute( pMxqFd,
+			capFlags,
+			pSrpcfSvrReqExecutePlugin->srpcfSvrCommHdr.srpcfReqId,
+			pSrpcfSvrReqExecutePlugin->srpcfCmdNo,
+			errorCode,
+			rstData );
 
 	// Free resource
 	if( rstData )
 		free( rstData );
 
-ErrExit1:
-
-    // Release resources
-    dlclose( handle );
 	return ret;
+}
 
-ErrExit:
 
-    return FALSE;
+static bool executeSrpcfPluginIdFunction( s32 *pMxqFd, u32 capFlags, srpcfSvrReqExecutePluginId_t *pSrpcfSvrReqExecutePluginId ) {
+
+	bool ret;
+	u32 errorCode;
+	s8 *rstData;
+	srpcfSink_t srpcfSink;
+
+	// Execute SRPCF function, streamed chunks go out as they are emitted
+	openSrpcfSink( &srpcfSink, pMxqFd,
+			pSrpcfSvrReqExecutePluginId->srpcfSvrCommHdr.srpcfReqId,
+			(capFlags & SRPCF_CAP_STREAM) ? TRUE : FALSE );
+	rstData = runSrpcfPluginIdFunction( pSrpcfSvrReqExecutePluginId->srpcfPluginId,
+			(cmdOpt_t *)&pSrpcfSvrReqExecutePluginId->listOfCmdOpt,
+			pSrpcfSvrReqExecutePluginId->numOfCmdOptList,
+			(s8 *)pSrpcfSvrReqExecutePluginId + pSrpcfSvrReqExecutePluginId->srpcfSvrCommHdr.srpcfPktLen,
+			&srpcfSink,
+			&errorCode );
+
+	// Response for this SRPCF command, pipelined clients wait for every ID even on failure
+    ret = respondSrpcfExecute( pMxqFd,
+			capFlags,
+			pSrpcfSvrReqExecutePluginId->srpcfSvrCommHdr.srpcfReqId,
+			XR_START_SRPCF,
+			errorCode,
+			rstData );
+
+	// Free resource
+	if( rstData )
+		free( rstData );
+
+	return ret;
 }
 
 
-static bool executeSrpcfFunction( s32 *pMxqFd, srpcfSvrReqExecute_t *pSrpcfSvrReqExecute ) {
+static bool executeSrpcfFunction( s32 *pMxqFd, u32 capFlags, srpcfSvrReqExecute_t *pSrpcfSvrReqExecute ) {
 
-	bool found = FALSE, ret;
-    s32 i;
+	bool ret;
 	u32 errorCode;
-    void *handle;
 	s8 *rstData;
-    s8 execute[ SRPCF_FUNC_MAXLEN ];
-	s8 *(*pSrpcfFuncExecutor)(cmdOpt_t*, u32, u32*);
+	srpcfSink_t srpcfSink;
+
+	// Execute SRPCF function, streamed chunks go out as they are emitted
+	openSrpcfSink( &srpcfSink, pMxqFd,
+			pSrpcfSvrReqExecute->srpcfSvrCommHdr.srpcfReqId,
+			(capFlags & SRPCF_CAP_STREAM) ? TRUE : FALSE );
+	rstData = runSrpcfFunction( pSrpcfSvrReqExecute->srpcfCmdNo,
+			(cmdOpt_t *)&pSrpcfSvrReqExecute->listOfCmdOpt,
+			pSrpcfSvrReqExecute->numOfCmdOptList,
+			(s8 *)pSrpcfSvrReqExecute + pSrpcfSvrReqExecute->srpcfSvrCommHdr.srpcfPktLen,
+			&srpcfSink,
+			&errorCode );
 
-	for( i = 0 ; srpcfSupportedTbl[ i ].srpcfCmdNo != XR_END_SRPCF ; i++ ) {
+	// Response for this SRPCF command, pipelined clients wait for every ID even on failure
+    ret = respondSrpcfExecute( pMxqFd,
+			capFlags,
+			pSrpcfSvrReqExecute->srpcfSvrCommHdr.srpcfReqId,
+			pSrpcfSvrReqExecute->srpcfCmdNo,
+			errorCode,
+			rstData );
 
-		if( srpcfSupportedTbl[ i ].srpcfCmdNo == pSrpcfSvrReqExecute->srpcfCmdNo ) {
+	// Free resource
+	if( rstData )
+		free( rstData );
 
-			// Obtain function name
-			snprintf( execute, SRPCF_FUNC_MAXLEN, SRPCF_EXECUTOR_PREFIX "%s", srpcfSupportedTbl[ i ].srpcfFuncName );
-			found = TRUE;
-			break;
-		}
+	return ret;
+}
+
+
+srpcfSvrRspExecuteBatch_t *createSrpcfSvrBatch( u32 srpcfReqId, u32 *pSize ) {
+
+	srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch;
+
+	// Prepare the combined response, it grows as results are appended
+	*pSize = LIBSRPCF_MSG_SIZE;
+	pSrpcfSvrRspExecuteBatch = (srpcfSvrRspExecuteBatch_t *)malloc( *pSize );
+	if( !pSrpcfSvrRspExecuteBatch )
+		return NULL;
+	memset( pSrpcfSvrRspExecuteBatch, 0, sizeof( srpcfSvrRspExecuteBatch_t ) );
+	pSrpcfSvrRspExecuteBatch->srpcfSvrCommHdr.srpcfOpCode = SRPCF_RSP_EXECUTE_BATCH;
+	pSrpcfSvrRspExecuteBatch->srpcfSvrCommHdr.srpcfPktLen =
+		sizeof( srpcfSvrRspExecuteBatch_t ) - sizeof( srpcfBatchResult_t * );
+	pSrpcfSvrRspExecuteBatch->srpcfSvrCommHdr.srpcfReqId = srpcfReqId;
+
+	return pSrpcfSvrRspExecuteBatch;
+}
+
+
+srpcfSvrRspExecuteBatch_t *appendSrpcfSvrBatch( srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch, u32 *pSize, u32 errorCode, s8 *rstData ) {
+
+	srpcfSvrRspExecuteBatch_t *pNew;
+	u32 size;
+
+	if( appendSrpcfBatchResult( pSrpcfSvrRspExecuteBatch, *pSize, errorCode, rstData ) == TRUE )
+		return pSrpcfSvrRspExecuteBatch;
+
+	// Grow the response, up to the message limit
+	size = pSrpcfSvrRspExecuteBatch->srpcfSvrCommHdr.srpcfPktLen
+		+ sizeof( srpcfBatchResult_t ) + (rstData ? strlen( rstData ) + 1 : 0);
+	if( size < (*pSize * 2) )
+		size = *pSize * 2;
+	if( size > limitOfSrpcfMessage() )
+		size = limitOfSrpcfMessage();
+
+	pNew = (srpcfSvrRspExecuteBatch_t *)realloc( pSrpcfSvrRspExecuteBatch, size );
+	if( pNew ) {
+
+		pSrpcfSvrRspExecuteBatch = pNew;
+		*pSize = size;
+		if( appendSrpcfBatchResult( pSrpcfSvrRspExecuteBatch, *pSize, errorCode, rstData ) == TRUE )
+			return pSrpcfSvrRspExecuteBatch;
 	}
-	if( found == FALSE ) {
 
-		fprintf( stderr, "Internal error: cannot find corresponding SRPCF function\n" );
+	// A result that does not fit is reported without its data
+	appendSrpcfBatchResult( pSrpcfSvrRspExecuteBatch, *pSize, SRPCF_FAILED_NOMEM, NULL );
+	return pSrpcfSvrRspExecuteBatch;
+}
+
+
+static bool executeSrpcfBatch( s32 *pMxqFd, srpcfSvrReqExecuteBatch_t *pSrpcfSvrReqExecuteBatch ) {
+
+	bool ret;
+	u32 i, errorCode, size;
+	s8 *rstData;
+	srpcfSvrRspExecuteBatch_t *pSrpcfSvrRspExecuteBatch;
+	srpcfBatchEntry_t *pSrpcfBatchEntry = NULL;
+	srpcfSink_t srpcfSink;
+
+	// Prepare the combined response
+	pSrpcfSvrRspExecuteBatch = createSrpcfSvrBatch( pSrpcfSvrReqExecuteBatch->srpcfSvrCommHdr.srpcfReqId, &size );
+	if( !pSrpcfSvrRspExecuteBatch )
 		return FALSE;
+
+	// Run the entries in order, one result each
+	for( i = 0 ; i < pSrpcfSvrReqExecuteBatch->numOfEntries ; i++ ) {
+
+		pSrpcfBatchEntry = nextSrpcfBatchEntry( pSrpcfSvrReqExecuteBatch, pSrpcfBatchEntry );
+		if( !pSrpcfBatchEntry )
+			break;
+
+		// Results are combined, so streamed output is collected
+		openSrpcfSink( &srpcfSink, pMxqFd, pSrpcfSvrReqExecuteBatch->srpcfSvrCommHdr.srpcfReqId, FALSE );
+		if( pSrpcfBatchEntry->srpcfName[ 0 ] )
+			rstData = runSrpcfPluginFunction( pSrpcfBatchEntry->srpcfName,
+					(cmdOpt_t *)&pSrpcfBatchEntry->listOfCmdOpt,
+					pSrpcfBatchEntry->numOfCmdOptList,
+					(s8 *)pSrpcfBatchEntry + pSrpcfBatchEntry->entryLength,
+					&srpcfSink,
+					&errorCode );
+		else
+			rstData = runSrpcfFunction( pSrpcfBatchEntry->srpcfCmdNo,
+					(cmdOpt_t *)&pSrpcfBatchEntry->listOfCmdOpt,
+					pSrpcfBatchEntry->numOfCmdOptList,
+					(s8 *)pSrpcfBatchEntry + pSrpcfBatchEntry->entryLength,
+					&srpcfSink,
+					&errorCode );
+
+		pSrpcfSvrRspExecuteBatch = appendSrpcfSvrBatch( pSrpcfSvrRspExecuteBatch, &size, errorCode, rstData );
+
+		// Free resource
+		if( rstData )
+			free( rstData );
 	}
 
-    // Open instance itself
-    handle = dlopen( NULL, RTLD_LAZY );
-    if( !handle ) {
+	// Send out the combined response, missing results count as failed
+	ret = sendSrpcfPacket( pMxqFd, (srpcfSvrCommPkt_t *)pSrpcfSvrRspExecuteBatch );
 
-		fprintf( stderr, "Internal error: cannot open executing instance\n" );
-        goto ErrExit;
-    }
+	free( pSrpcfSvrRspExecuteBatch );
+	return ret;
+}
 
-    // Lookup Symbols
-    pSrpcfFuncExecutor = dlsym( handle, execute );
-    if( !pSrpcfFuncExecutor ) {
 
-		fprintf( stderr, "Internal error: cannot find the symbol of SRPCF executor\n" );
-		goto ErrExit;
-    }
+static u32 sizeOfSrpcfRequest( u32 srpcfOpCode ) {
 
-	// Deserialize CmdOpt object
-	if( pSrpcfSvrReqExecute->numOfCmdOptList ) {
+	// Fixed part of each request, whatever follows is checked as it is parsed
+	switch( srpcfOpCode ) {
 
-		ret = deserializeCmdOptObject(
-				(cmdOpt_t *)&pSrpcfSvrReqExecute->listOfCmdOpt, 
-				pSrpcfSvrReqExecute->numOfCmdOptList );
-		if( ret == FALSE ) {
+	case SRPCF_REQ_EXECUTE:
+		return sizeof( srpcfSvrReqExecute_t ) - sizeof( cmdOpt_t * );
 
-			fprintf( stderr, "Internal error: cannot convert serialize object to linklist\n" );
-			goto ErrExit1;
+	case SRPCF_REQ_EXECUTE_PLUGIN:
+		return sizeof( srpcfSvrReqExecutePlugin_t ) - sizeof( cmdOpt_t * );
+
+	case SRPCF_REQ_EXECUTE_PLUGIN_ID:
+		return sizeof( srpcfSvrReqExecutePluginId_t ) - sizeof( cmdOpt_t * );
+
+	case SRPCF_REQ_EXECUTE_BATCH:
+		return sizeof( srpcfSvrReqExecuteBatch_t ) - sizeof( srpcfBatchEntry_t * );
+
+	case SRPCF_REQ_EXECUTE_RELAY:
+		return sizeof( srpcfSvrReqExecuteRelay_t ) - sizeof( s8 * );
+
+	default:
+		return sizeof( srpcfSvrCommHdr_t );
+	}
+}
+
+
+static void rejectSrpcfRequest( s32 *pMxqFd, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt ) {
+
+	srpcfSvrRspExecuteBatch_t srpcfSvrRspExecuteBatch;
+
+	DBGPRINT( "Request %d too short, %d bytes\n",
+		pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfOpCode,
+		pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfPktLen );
+
+	switch( pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfOpCode ) {
+
+	// Only the header can be trusted, not even the command number
+	case SRPCF_REQ_EXECUTE:
+	case SRPCF_REQ_EXECUTE_PLUGIN:
+	case SRPCF_REQ_EXECUTE_PLUGIN_ID:
+		responseSrpcfExecute( pMxqFd,
+			pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfReqId,
+			0,
+			SRPCF_FAILED_INVALID,
+			NULL );
+		break;
+
+	// Nothing was run, answer with an empty batch
+	case SRPCF_REQ_EXECUTE_BATCH:
+	case SRPCF_REQ_EXECUTE_RELAY:
+		memset( &srpcfSvrRspExecuteBatch, 0, sizeof( srpcfSvrRspExecuteBatch ) );
+		srpcfSvrRspExecuteBatch.srpcfSvrCommHdr.srpcfOpCode = SRPCF_RSP_EXECUTE_BATCH;
+		srpcfSvrRspExecuteBatch.srpcfSvrCommHdr.srpcfPktLen =
+			sizeof( srpcfSvrRspExecuteBatch_t ) - sizeof( srpcfBatchResult_t * );
+		srpcfSvrRspExecuteBatch.srpcfSvrCommHdr.srpcfReqId =
+			pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfReqId;
+		sendSrpcfPacket( pMxqFd, (srpcfSvrCommPkt_t *)&srpcfSvrRspExecuteBatch );
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+static u32 grantSrpcfCaps( s32 *pMxqFd, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt ) {
+
+	u32 capFlags;
+
+	// Grant what both sides understand, a query without flags gets none
+	if( pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfPktLen < sizeof( srpcfSvrReqSupport_t ) )
+		return 0;
+
+	capFlags = pSrpcfSvrCommPkt->srpcfSvrReqSupport.srpcfCapFlags & SRPCFSVR_CAPS;
+
+	// Descriptors cannot cross TCP, the loopback or the ring
+	if( (capFlags & SRPCF_CAP_MAPPED) && canPassRightsSocket( *pMxqFd ) == FALSE )
+		capFlags &= ~SRPCF_CAP_MAPPED;
+
+	return capFlags;
+}
+
+
+bool dispatchSrpcfRequest( s32 *pMxqFd, u32 *pCapFlags, srpcfSvrCommPkt_t *pSrpcfSvrCommPkt ) {
+
+	bool term = FALSE;
+	s8 *pluginList = NULL;
+	u32 pluginListLen = 0;
+
+	// Frames shorter than their request are answered without being parsed
+	if( pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfPktLen
+		< sizeOfSrpcfRequest( pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfOpCode ) ) {
+
+		rejectSrpcfRequest( pMxqFd, pSrpcfSvrCommPkt );
+		return TRUE;
+	}
+
+	// Handle request
+	switch( pSrpcfSvrCommPkt->srpcfSvrReqPkt.srpcfSvrCommHdr.srpcfOpCode ) {
+
+	// SRPCF Support Query
+	case SRPCF_REQ_QUERY_SUPPORT:
+
+		*pCapFlags = grantSrpcfCaps( pMxqFd, pSrpcfSvrCommPkt );
+
+		// Number the loaded plugins for clients that call them by ID
+		if( *pCapFlags & SRPCF_CAP_PLUGIN_ID ) {
+
+			pluginList = listSrpcfSvrPlugins( &pluginListLen );
+			if( !pluginList )
+				*pCapFlags &= ~SRPCF_CAP_PLUGIN_ID;
 		}
+
+		responseSrpcfSupport( pMxqFd,
+			pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfReqId,
+			*pCapFlags,
+			idleTimeout,
+			pluginList,
+			pluginListLen );
+
+		if( pluginList )
+			free( pluginList );
+		break;
+
+	// SRPCF Generation Query, the client already holds the support response
+	case SRPCF_REQ_QUERY_GENERATION:
+
+		*pCapFlags = grantSrpcfCaps( pMxqFd, pSrpcfSvrCommPkt );
+		responseSrpcfGeneration( pMxqFd,
+			pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfReqId,
+			*pCapFlags,
+			idleTimeout,
+			generationOfSrpcfSvrPlugins() );
+		break;
+
+	// SRPCF Execute
+	case SRPCF_REQ_EXECUTE:
+		executeSrpcfFunction( pMxqFd, *pCapFlags, &pSrpcfSvrCommPkt->srpcfSvrReqExecute );
+		term = (*pCapFlags & SRPCF_CAP_SESSION) ? FALSE : TRUE;
+		break;
+
+	// SRPCF Execute Plugin
+	case SRPCF_REQ_EXECUTE_PLUGIN:
+		executeSrpcfPluginFunction( pMxqFd, *pCapFlags, &pSrpcfSvrCommPkt->srpcfSvrReqExecutePlugin );
+		term = (*pCapFlags & SRPCF_CAP_SESSION) ? FALSE : TRUE;
+		break;
+
+	// SRPCF Execute Plugin by ID
+	case SRPCF_REQ_EXECUTE_PLUGIN_ID:
+		executeSrpcfPluginIdFunction( pMxqFd, *pCapFlags, &pSrpcfSvrCommPkt->srpcfSvrReqExecutePluginId );
+		term = (*pCapFlags & SRPCF_CAP_SESSION) ? FALSE : TRUE;
+		break;
+
+	// SRPCF Execute Batch
+	case SRPCF_REQ_EXECUTE_BATCH:
+		executeSrpcfBatch( pMxqFd, &pSrpcfSvrCommPkt->srpcfSvrReqExecuteBatch );
+		term = (*pCapFlags & SRPCF_CAP_SESSION) ? FALSE : TRUE;
+		break;
+
+	// SRPCF Execute on downstream servers, merged into one batch
+	case SRPCF_REQ_EXECUTE_RELAY:
+		executeSrpcfRelay( pMxqFd, &pSrpcfSvrCommPkt->srpcfSvrReqExecuteRelay );
+		term = (*pCapFlags & SRPCF_CAP_SESSION) ? FALSE : TRUE;
+		break;
+
+	// Unknown
+	default:
+		DBGPRINT( "Unknown Operation Code %d\n",
+			pSrpcfSvrCommPkt->srpcfSvrReqPkt.srpcfSvrCommHdr.srpcfOpCode );
+		term = TRUE;
+		break;
 	}
 
-	// Execute SRPCF function
-	rstData = pSrpcfFuncExecutor( (cmdOpt_t *)&pSrpcfSvrReqExecute->listOfCmdOpt, pSrpcfSvrReqExecute->numOfCmdOptList, &errorCode );
+	return term;
+}
+
+
+bool isSrpcfSvrOffload( srpcfSvrCommPkt_t *pSrpcfSvrCommPkt ) {
+
+	if( isSrpcfSvrWorkersEnabled() == FALSE )
+		return FALSE;
+
+	// Frames too short for their request are rejected in place
+	if( pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfPktLen
+		< sizeOfSrpcfRequest( pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfOpCode ) )
+		return FALSE;
+
+	// Only command executions go to the workers, queries are answered in place
+	switch( pSrpcfSvrCommPkt->srpcfSvrCommHdr.srpcfOpCode ) {
+
+	case SRPCF_REQ_EXECUTE:
+	case SRPCF_REQ_EXECUTE_PLUGIN:
+	case SRPCF_REQ_EXECUTE_PLUGIN_ID:
+	case SRPCF_REQ_EXECUTE_BATCH:
+	case SRPCF_REQ_EXECUTE_RELAY:
+		return TRUE;
+
+	default:
+		return FALSE;
+	}
+}
+
+
+static void completeSrpcfSvrThdTask( srpcfSvrTask_t *pSrpcfSvrTask ) {
+
+	srpcfSvrThd_t *pSrpcfSvrThd = (srpcfSvrThd_t *)pSrpcfSvrTask->priv;
 
-	// Response for this SRPCF command
-    ret = responseSrpcfExecute( pMxqFd, pSrpcfSvrReqExecute->srpcfCmdNo, errorCode, rstData );
+	// Hang up, the connection thread will notice on its next receive
+	if( pSrpcfSvrTask->term == TRUE )
+		shutdownSocket( pSrpcfSvrThd->cfd );
 
 	// Free resource
-	if( rstData )
-		free( rstData );
+	free( pSrpcfSvrTask->pktData );
+	free( pSrpcfSvrTask );
 
-ErrExit1:
+	// Wake up the connection thread if it is draining
+	pthread_mutex_lock( &pSrpcfSvrThd->doneLock );
+	if( !--pSrpcfSvrThd->numOfPending )
+		pthread_cond_signal( &pSrpcfSvrThd->done );
+	pthread_mutex_unlock( &pSrpcfSvrThd->doneLock );
+}
 
-    // Release resources
-    dlclose( handle );
-	return ret;
 
-ErrExit:
+static bool offloadSrpcfSvrThd( srpcfSvrThd_t *pSrpcfSvrThd, srpcfSvrCommPkt_t *pktData ) {
+
+	srpcfSvrTask_t *pSrpcfSvrTask;
+
+	// Allocate a task, it is freed on completion
+	pSrpcfSvrTask = (srpcfSvrTask_t *)malloc( sizeof( srpcfSvrTask_t ) );
+	if( !pSrpcfSvrTask )
+		return FALSE;
+
+	// Fill in the data
+	pSrpcfSvrTask->next = NULL;
+	pSrpcfSvrTask->pktData = pktData;
+	pSrpcfSvrTask->pMxqFd = &pSrpcfSvrThd->cfd;
+	pSrpcfSvrTask->capFlags = pSrpcfSvrThd->capFlags;
+	pSrpcfSvrTask->term = FALSE;
+	pSrpcfSvrTask->complete = completeSrpcfSvrThdTask;
+	pSrpcfSvrTask->priv = pSrpcfSvrThd;
+
+	pthread_mutex_lock( &pSrpcfSvrThd->doneLock );
+	pSrpcfSvrThd->numOfPending++;
+	pthread_mutex_unlock( &pSrpcfSvrThd->doneLock );
 
-    return FALSE;
+	// Run it here if the queue is full
+	if( submitSrpcfSvrTask( pSrpcfSvrTask ) == FALSE )
+		runSrpcfSvrTask( pSrpcfSvrTask );
+
+	return TRUE;
 }
 
 
 static void *handleIncomingConnection( void *arg ) {
 
     srpcfSvrThd_t *pSrpcfSvrThd = (srpcfSvrThd_t *)arg;
-	srpcfSvrTask_t *pSrpcfSvrTask;
+	srpcfSvrCommPkt_t *pktData, *pktCopy;
 	s8 term = 0;
 
     // Sanity check
     if( !pSrpcfSvrThd )
         pthread_exit( 0 );
- 
-	// Allocate a empty task
-    pSrpcfSvrTask = (srpcfSvrTask_t *)malloc( sizeof( srpcfSvrTask_t ) );
-    if( !pSrpcfSvrTask )
-		pthread_exit( 0 );
 
     // Main thread loop
-    while( !terminate || !term ) {
+    while( !terminate && !term ) {
 
-		// Receive a packet
-        pSrpcfSvrTask->pktData = receiveSrpcfFrame( &pSrpcfSvrThd->cfd );
-        if( !pSrpcfSvrTask->pktData )
+		// Receive a packet, it is decoded in place from the connection buffer
+        pktData = receiveSrpcfRing( &pSrpcfSvrThd->cfd, &pSrpcfSvrThd->ring );
+        if( !pktData )
 			break;
 
-		// Handle request
-		switch( pSrpcfSvrTask->pktData->srpcfSvrReqPkt.srpcfSvrCommHdr.srpcfOpCode ) {
-
-        // SRPCF Support Query
-        case SRPCF_REQ_QUERY_SUPPORT:
-			responseSrpcfSupport( &pSrpcfSvrThd->cfd, srpcfSupportedTbl );
-			break;
-
-        // SRPCF Execute
-        case SRPCF_REQ_EXECUTE:
-			executeSrpcfFunction( &pSrpcfSvrThd->cfd, &pSrpcfSvrTask->pktData->srpcfSvrReqExecute );
-			term = 1;
-			break;
+		// Hand executions to the worker pool and go on with the next request,
+		// pipelined requests of this connection run in parallel
+		if( isSrpcfSvrOffload( pktData ) == TRUE ) {
 
-        // SRPCF Execute Plugin
-        case SRPCF_REQ_EXECUTE_PLUGIN:
-            executeSrpcfPluginFunction( &pSrpcfSvrThd->cfd, &pSrpcfSvrTask->pktData->srpcfSvrReqExecutePlugin );
-			term = 1;
-			break;
+			// The buffer is reused by the next receive, so the task takes a copy
+			pktCopy = detachSrpcfRing( &pSrpcfSvrThd->ring, pktData );
+			if( pktCopy && offloadSrpcfSvrThd( pSrpcfSvrThd, pktCopy ) == TRUE )
+				continue;
 
-        // Unknown
-        default:
-            DBGPRINT( "Unknown Operation Code %d\n",
-                pSrpcfSvrTask->pktData->srpcfSvrReqPkt.srpcfSvrCommHdr.srpcfOpCode );
-			term = 1;
-            break;
-    	}
+			// Out of memory, run it here
+			term = dispatchSrpcfRequest( &pSrpcfSvrThd->cfd, &pSrpcfSvrThd->capFlags, pktCopy ? pktCopy : pktData );
+			if( pktCopy )
+				free( pktCopy );
+		}
+		else {
 
-		// Free packet buffer
-		free( pSrpcfSvrTask->pktData );
+			// Handle request
+			term = dispatchSrpcfRequest( &pSrpcfSvrThd->cfd, &pSrpcfSvrThd->capFlags, pktData );
 
-		// Delay for a while
-        usleep( SRPCFSVR_SLEEP_MS );
+			// Sessions are dropped after being idle for a while
+			if( (pSrpcfSvrThd->capFlags & SRPCF_CAP_SESSION) && idleTimeout )
+				setTimeoutSocket( pSrpcfSvrThd->cfd, idleTimeout );
+		}
 	}
 
+	// Wait for executions still running on the workers
+	pthread_mutex_lock( &pSrpcfSvrThd->doneLock );
+	while( pSrpcfSvrThd->numOfPending )
+		pthread_cond_wait( &pSrpcfSvrThd->done, &pSrpcfSvrThd->doneLock );
+	pthread_mutex_unlock( &pSrpcfSvrThd->doneLock );
+
     // Close this connection
     deinitializeSocket( pSrpcfSvrThd->cfd );
-
-	// Free resource
-	free( pSrpcfSvrTask );
+    releaseSrpcfRing( &pSrpcfSvrThd->ring );
 
     // Detach my context
     pthread_mutex_lock( &threadLock );
@@ -278,6 +696,8 @@ static void *handleIncomingConnection( void *arg ) {
     pthread_mutex_unlock( &threadLock );
 
     // Free memory
+    pthread_cond_destroy( &pSrpcfSvrThd->done );
+    pthread_mutex_destroy( &pSrpcfSvrThd->doneLock );
     free( pSrpcfSvrThd );
 
     // Return
@@ -285,16 +705,126 @@ static void *handleIncomingConnection( void *arg ) {
 }
 
 
+static void *monitorSrpcfSvr( void *arg ) {
+
+	sigset_t *pSigSet = (sigset_t *)arg;
+	s32 sig;
+
+	// Print statistics on request
+	for( ; ; ) {
+
+		if( sigwait( pSigSet, &sig ) )
+			continue;
+
+		if( isSrpcfSvrWorkersEnabled() == TRUE )
+			dumpSrpcfSvrWorkers( stderr );
+	}
+
+	return NULL;
+}
+
+
+// Pipeline requests through the in-process loopback, only the framework is timed
+static void *benchmarkSrpcfSvr( void *arg ) {
+
+	srpcfSession_t *pSrpcfSession;
+	srpcfSvrRspExecute_t *pSrpcfSvrRspExecute;
+	u32 srpcfReqIds[ SRPCFSVR_BENCH_DEPTH ];
+	struct timespec start, end;
+	u32 i = 0, done, depth;
+	u64 usec;
+
+	pSrpcfSession = openSrpcfSession( SRPCFSVR_BENCH_ADDR, 0 );
+	if( !pSrpcfSession ) {
+
+		fprintf( stderr, "srpcfsvr: cannot open a session on %s\n", SRPCFSVR_BENCH_ADDR );
+		exit( 1 );
+	}
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	for( done = 0 ; done < benchRequests ; done += depth ) {
+
+		depth = benchRequests - done;
+		if( depth > SRPCFSVR_BENCH_DEPTH )
+			depth = SRPCFSVR_BENCH_DEPTH;
+
+		for( i = 0 ; i < depth ; i++ ) {
+
+			srpcfReqIds[ i ] = submitSrpcfSession( pSrpcfSession, xrTimeShow, NULL );
+			if( !srpcfReqIds[ i ] )
+				goto ErrExit;
+		}
+
+		for( i = 0 ; i < depth ; i++ ) {
+
+			pSrpcfSvrRspExecute = waitSrpcfSession( pSrpcfSession, srpcfReqIds[ i ] );
+			if( !pSrpcfSvrRspExecute )
+				goto ErrExit;
+			free( pSrpcfSvrRspExecute );
+		}
+	}
+	clock_gettime( CLOCK_MONOTONIC, &end );
+
+	usec = (end.tv_sec - start.tv_sec) * 1000000ULL + (end.tv_nsec - start.tv_nsec) / 1000;
+	fprintf( stderr, "%u requests over %s in %llu us, %.2f us per request\n",
+		benchRequests, SRPCFSVR_BENCH_ADDR, (unsigned long long)usec, (double)usec / benchRequests );
+
+	closeSrpcfSession( pSrpcfSession );
+	exit( 0 );
+
+ErrExit:
+	fprintf( stderr, "srpcfsvr: benchmark failed after %u requests\n", done + i );
+	exit( 1 );
+}
+
+
+static s32 acceptSrpcfSvrConnection( s32 *listenFd, s32 numOfListenFds, s32 *cfd ) {
+
+	struct pollfd pfd[ SRPCFSVR_LISTEN_MAX ];
+	s32 i;
+
+	// Only one, nothing to choose from
+	if( numOfListenFds == 1 )
+		return acceptSocket( listenFd[ 0 ], cfd );
+
+	for( i = 0 ; i < numOfListenFds ; i++ ) {
+
+		pfd[ i ].fd = listenFd[ i ];
+		pfd[ i ].events = POLLIN;
+	}
+	if( poll( pfd, numOfListenFds, -1 ) <= 0 )
+		return FALSE;
+
+	// Take one, whatever else is pending is there on the next round
+	for( i = 0 ; i < numOfListenFds ; i++ )
+		if( pfd[ i ].revents & POLLIN )
+			return acceptSocket( pfd[ i ].fd, cfd );
+
+	return FALSE;
+}
+
+
 s32 main( s32 argc, s8 **argv ) {
 
     s8 c;
     pid_t pid, sid;
 	s32 daemon = 1;
-	s32 sfd, cfd, ret;
+	s32 listenFd[ SRPCFSVR_LISTEN_MAX ], numOfListenFds = 0;
+	s32 cfd, ret, i;
+	s8 unixName[ SRPCF_UNIX_NAME_MAX ];
+	s32 numOfLoops = SRPCFSVR_EVLOOP_DEF;
+	s32 numOfWorkers = -1;
+	s32 port = SRPCF_DEF_PORT;
+	u32 relayFanout = 0;
+	u32 queueDepth = SRPCFSVR_QUEUE_DEF;
+	srpcfSvrSchedType_t sched = SRPCFSVR_SCHED_SHARED;
+	pthread_t monitor, bench;
+	static sigset_t sigSet;
+	srpcfSvrMode_t mode = SRPCFSVR_MODE_THREAD;
 	srpcfSvrThd_t *pSrpcfSvrThd;
 
 	// Parse options
-    while( (c = getopt( argc, argv, "ch" )) != EOF ) {
+    while( (c = getopt( argc, argv, "cm:l:w:q:x:t:M:b:p:r:h" )) != EOF ) {
 
         switch( c ) {
 
@@ -302,6 +832,77 @@ s32 main( s32 argc, s8 **argv ) {
 				daemon = 0;
 				break;
 
+			case 'm' :
+				if( !strcmp( optarg, "epoll" ) )
+					mode = SRPCFSVR_MODE_EPOLL;
+				else if( !strcmp( optarg, "thread" ) )
+					mode = SRPCFSVR_MODE_THREAD;
+				else {
+
+					usage();
+					return 1;
+				}
+				break;
+
+			case 'l' :
+				numOfLoops = strtol( optarg, NULL, 10 );
+				if( numOfLoops < 1 || numOfLoops > SRPCFSVR_EVLOOP_MAX ) {
+
+					usage();
+					return 1;
+				}
+				break;
+
+			case 'w' :
+				numOfWorkers = strtol( optarg, NULL, 10 );
+				if( numOfWorkers < 0 || numOfWorkers > SRPCFSVR_WORKER_MAX ) {
+
+					usage();
+					return 1;
+				}
+				break;
+
+			case 'q' :
+				queueDepth = strtoul( optarg, NULL, 10 );
+				break;
+
+			case 't' :
+				idleTimeout = strtoul( optarg, NULL, 10 );
+				break;
+
+			case 'M' :
+				configureSrpcfFrame( LIBSRPCF_FRAME_SIZE, strtoul( optarg, NULL, 10 ) );
+				break;
+
+			case 'b' :
+				benchRequests = strtoul( optarg, NULL, 10 );
+				break;
+
+			case 'p' :
+				port = strtol( optarg, NULL, 10 );
+				if( port <= 0 || port > 65535 ) {
+
+					usage();
+					return 1;
+				}
+				break;
+
+			case 'r' :
+				relayFanout = strtoul( optarg, NULL, 10 );
+				break;
+
+			case 'x' :
+				if( !strcmp( optarg, "steal" ) )
+					sched = SRPCFSVR_SCHED_STEAL;
+				else if( !strcmp( optarg, "shared" ) )
+					sched = SRPCFSVR_SCHED_SHARED;
+				else {
+
+					usage();
+					return 1;
+				}
+				break;
+
             case 'h' :
             default:
                 usage();
@@ -353,20 +954,116 @@ s32 main( s32 argc, s8 **argv ) {
 
 NoDaemon:
 
+	// SIGUSR1 is only taken by the monitor thread, every thread started from
+	// here on inherits the mask, the plugin watcher included
+	sigemptyset( &sigSet );
+	sigaddset( &sigSet, SIGUSR1 );
+	pthread_sigmask( SIG_BLOCK, &sigSet, NULL );
+
+	// Preload plugins
+	if( initializeSrpcfSvrPlugins() == FALSE ) {
+
+		DBGPRINT( "Cannot initialize the plugin registry\n" );
+		exit( -1 );
+	}
+
+	// Downstream servers are only reached when relaying
+	if( relayFanout && initializeSrpcfSvrRelay( relayFanout ) == FALSE ) {
+
+		DBGPRINT( "Cannot initialize the relay\n" );
+		exit( -1 );
+	}
+
 	// Open a socket
-    if( initializeSocket( &sfd, NULL, SRPCF_DEF_PORT ) ) {
+    if( initializeSocket( &listenFd[ numOfListenFds++ ], NULL, port ) ) {
 
         DBGPRINT( "Cannot initialize socket\n" );
 		exit( -1 );
     }
 
+	// Clients on this host prefer the local socket, TCP keeps serving everyone else
+	snprintf( unixName, sizeof( unixName ), SRPCF_UNIX_NAME, port );
+	if( initializeSocket( &listenFd[ numOfListenFds ], unixName, 0 ) ) {
+
+		DBGPRINT( "Cannot initialize local socket %s, TCP only\n", unixName );
+	}
+	else
+		numOfListenFds++;
+
+	// Local agents polling often may ask for shared memory rings instead
+	if( initializeSocket( &listenFd[ numOfListenFds ], SRPCF_SHM_PREFIX, port ) ) {
+
+		DBGPRINT( "Cannot initialize shared memory rings\n" );
+	}
+	else
+		numOfListenFds++;
+
+	// The benchmark talks to us without leaving the process
+	if( benchRequests ) {
+
+		if( initializeSocket( &listenFd[ numOfListenFds++ ], SRPCFSVR_BENCH_ADDR, 0 ) ) {
+
+			DBGPRINT( "Cannot initialize %s\n", SRPCFSVR_BENCH_ADDR );
+			exit( -1 );
+		}
+	}
+
+	// Statistics are printed on SIGUSR1
+	pthread_create( &monitor, NULL, monitorSrpcfSvr, (void *)&sigSet );
+
+	// A loop must not run commands of any length, leave them to one worker per CPU
+	if( numOfWorkers < 0 ) {
+
+		numOfWorkers = 0;
+		if( mode == SRPCFSVR_MODE_EPOLL ) {
+
+			numOfWorkers = sysconf( _SC_NPROCESSORS_ONLN );
+			if( numOfWorkers < 1 )
+				numOfWorkers = 1;
+			if( numOfWorkers > SRPCFSVR_WORKER_MAX )
+				numOfWorkers = SRPCFSVR_WORKER_MAX;
+		}
+	}
+
+	// Start workers
+	if( numOfWorkers ) {
+
+		if( initializeSrpcfSvrWorkers( numOfWorkers, queueDepth, sched ) == FALSE ) {
+
+			DBGPRINT( "Cannot initialize worker threads\n" );
+			exit( -1 );
+		}
+	}
+
+	// Start event loops
+	if( mode == SRPCFSVR_MODE_EPOLL ) {
+
+		if( initializeSrpcfSvrLoops( numOfLoops, idleTimeout ) == FALSE ) {
+
+			DBGPRINT( "Cannot initialize event loops\n" );
+			exit( -1 );
+		}
+	}
+
+	// Start the benchmark client once everything is in place
+	if( benchRequests )
+		pthread_create( &bench, NULL, benchmarkSrpcfSvr, NULL );
+
 	// Handle incoming connections
 	while( !terminate ) {
 
 		// Accept new connection
-		if( acceptSocket( sfd, &cfd ) != TRUE )
+		if( acceptSrpcfSvrConnection( listenFd, numOfListenFds, &cfd ) != TRUE )
 			continue;
 
+		// Hand it over to an event loop
+		if( mode == SRPCFSVR_MODE_EPOLL ) {
+
+			if( attachSrpcfSvrLoop( cfd ) == FALSE )
+				deinitializeSocket( cfd );
+			continue;
+		}
+
 		// Allocate a new thread context
 		pSrpcfSvrThd =(srpcfSvrThd_t *)malloc( sizeof( srpcfSvrThd_t ) );
         if( !pSrpcfSvrThd ) {
@@ -377,14 +1074,20 @@ NoDaemon:
             continue;
         }
 
+		// Fill in the data
+        pSrpcfSvrThd->next = NULL;
+        pSrpcfSvrThd->cfd = cfd;
+        pSrpcfSvrThd->numOfPending = 0;
+        pSrpcfSvrThd->capFlags = 0;
+        initializeSrpcfRing( &pSrpcfSvrThd->ring, pSrpcfSvrThd->packet, sizeof( pSrpcfSvrThd->packet ) );
+        pthread_mutex_init( &pSrpcfSvrThd->doneLock, NULL );
+        pthread_cond_init( &pSrpcfSvrThd->done, NULL );
+
 		// Attach the thread context
 		pthread_mutex_lock( &threadLock );
 		appendLinklist( (commonLinklist_t **)&srpcfSvrThdHead, (commonLinklist_t *)pSrpcfSvrThd );
         pthread_mutex_unlock( &threadLock );
 
-		// Fill in the data
-        pSrpcfSvrThd->cfd = cfd;
-
         // Create a thread
         ret = pthread_create(
             &pSrpcfSvrThd->pth,
@@ -401,12 +1104,28 @@ NoDaemon:
 		usleep( SRPCFSVR_SLEEP_MS );
 	}
 
+	// Stop event loops
+	if( mode == SRPCFSVR_MODE_EPOLL )
+		deinitializeSrpcfSvrLoops();
+
+	// Stop workers
+	if( numOfWorkers )
+		deinitializeSrpcfSvrWorkers();
+
 	// Cancel all running threads, but don't free, the OS will do
 	for( pSrpcfSvrThd = srpcfSvrThdHead ; pSrpcfSvrThd ; pSrpcfSvrThd = pSrpcfSvrThd->next )
 		pthread_cancel( pSrpcfSvrThd->pth );
 
-	// Close the socket
-	deinitializeSocket( sfd );
+	// Unload plugins
+	deinitializeSrpcfSvrPlugins();
+
+	// Drop the downstream connections
+	if( relayFanout )
+		deinitializeSrpcfSvrRelay();
+
+	// Close the sockets
+	for( i = 0 ; i < numOfListenFds ; i++ )
+		deinitializeSocket( listenFd[ i ] );
 
 	// Return
     return 0;
@@ -0,0 +1,321 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: workpool.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+#include "srpcfsvr.h"
+
+
+//
+// Global variables
+//
+static srpcfSvrQueue_t srpcfSvrQueue;
+static pthread_t *srpcfSvrWorkerTbl = NULL;
+static s32 numOfSrpcfSvrWorkers = 0;
+static sem_t taskReady;
+static volatile s8 workerTerminate = 0;
+static srpcfSvrSched_t *pSrpcfSvrSched = NULL;
+
+
+static bool initializeSrpcfSvrQueue( srpcfSvrQueue_t *pSrpcfSvrQueue, u32 depth ) {
+
+	u32 i;
+
+	// Depth must be a power of two
+	if( depth < 2 || (depth & (depth - 1)) )
+		return FALSE;
+
+	pSrpcfSvrQueue->cells = (srpcfSvrQueueCell_t *)malloc( sizeof( srpcfSvrQueueCell_t ) * depth );
+	if( !pSrpcfSvrQueue->cells )
+		return FALSE;
+
+	// Each cell starts out free for the lap that begins at its own index
+	for( i = 0 ; i < depth ; i++ ) {
+
+		pSrpcfSvrQueue->cells[ i ].sequence = i;
+		pSrpcfSvrQueue->cells[ i ].pTask = NULL;
+	}
+
+	pSrpcfSvrQueue->mask = depth - 1;
+	pSrpcfSvrQueue->enqueuePos = 0;
+	pSrpcfSvrQueue->dequeuePos = 0;
+	pSrpcfSvrQueue->highWater = 0;
+	pSrpcfSvrQueue->numOfFull = 0;
+
+	return TRUE;
+}
+
+
+static bool enqueueSrpcfSvrQueue( srpcfSvrQueue_t *pSrpcfSvrQueue, srpcfSvrTask_t *pSrpcfSvrTask ) {
+
+	srpcfSvrQueueCell_t *pCell;
+	u64 pos, seq, depth;
+	s64 diff;
+
+	pos = __atomic_load_n( &pSrpcfSvrQueue->enqueuePos, __ATOMIC_RELAXED );
+	for( ; ; ) {
+
+		pCell = &pSrpcfSvrQueue->cells[ pos & pSrpcfSvrQueue->mask ];
+		seq = __atomic_load_n( &pCell->sequence, __ATOMIC_ACQUIRE );
+		diff = (s64)seq - (s64)pos;
+
+		// The cell is free, try to claim this position
+		if( !diff ) {
+
+			if( __atomic_compare_exchange_n( &pSrpcfSvrQueue->enqueuePos,
+					&pos, pos + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+				break;
+		}
+		else if( diff < 0 ) {
+
+			// A full lap behind, the queue is full
+			__atomic_fetch_add( &pSrpcfSvrQueue->numOfFull, 1, __ATOMIC_RELAXED );
+			return FALSE;
+		}
+		else
+			pos = __atomic_load_n( &pSrpcfSvrQueue->enqueuePos, __ATOMIC_RELAXED );
+	}
+
+	// Publish the task
+	pCell->pTask = pSrpcfSvrTask;
+	__atomic_store_n( &pCell->sequence, pos + 1, __ATOMIC_RELEASE );
+
+	// Track the deepest backlog seen so far
+	depth = pos + 1 - __atomic_load_n( &pSrpcfSvrQueue->dequeuePos, __ATOMIC_RELAXED );
+	seq = __atomic_load_n( &pSrpcfSvrQueue->highWater, __ATOMIC_RELAXED );
+	while( depth > seq
+		&& !__atomic_compare_exchange_n( &pSrpcfSvrQueue->highWater,
+			&seq, depth, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+
+	return TRUE;
+}
+
+
+static srpcfSvrTask_t *dequeueSrpcfSvrQueue( srpcfSvrQueue_t *pSrpcfSvrQueue ) {
+
+	srpcfSvrQueueCell_t *pCell;
+	srpcfSvrTask_t *pSrpcfSvrTask;
+	u64 pos, seq;
+	s64 diff;
+
+	pos = __atomic_load_n( &pSrpcfSvrQueue->dequeuePos, __ATOMIC_RELAXED );
+	for( ; ; ) {
+
+		pCell = &pSrpcfSvrQueue->cells[ pos & pSrpcfSvrQueue->mask ];
+		seq = __atomic_load_n( &pCell->sequence, __ATOMIC_ACQUIRE );
+		diff = (s64)seq - (s64)(pos + 1);
+
+		// The cell holds a task, try to claim this position
+		if( !diff ) {
+
+			if( __atomic_compare_exchange_n( &pSrpcfSvrQueue->dequeuePos,
+					&pos, pos + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+				break;
+		}
+		else if( diff < 0 )
+			return NULL;
+		else
+			pos = __atomic_load_n( &pSrpcfSvrQueue->dequeuePos, __ATOMIC_RELAXED );
+	}
+
+	// Take the task and hand the cell to the next lap
+	pSrpcfSvrTask = pCell->pTask;
+	__atomic_store_n( &pCell->sequence, pos + pSrpcfSvrQueue->mask + 1, __ATOMIC_RELEASE );
+
+	return pSrpcfSvrTask;
+}
+
+
+void runSrpcfSvrTask( srpcfSvrTask_t *pSrpcfSvrTask ) {
+
+	// Execute, then let the submitter clean up
+	pSrpcfSvrTask->term = dispatchSrpcfRequest( pSrpcfSvrTask->pMxqFd, &pSrpcfSvrTask->capFlags, pSrpcfSvrTask->pktData );
+	pSrpcfSvrTask->complete( pSrpcfSvrTask );
+}
+
+
+static void *runSrpcfSvrWorker( void *arg ) {
+
+	srpcfSvrTask_t *pSrpcfSvrTask;
+
+	while( !workerTerminate ) {
+
+		// Sleep until a task is queued
+		if( sem_wait( &taskReady ) < 0 )
+			continue;
+
+		// A task is counted, but its cell may still be being published
+		while( !(pSrpcfSvrTask = dequeueSrpcfSvrQueue( &srpcfSvrQueue )) )
+			sched_yield();
+
+		runSrpcfSvrTask( pSrpcfSvrTask );
+	}
+
+	pthread_exit( 0 );
+}
+
+
+static bool initializeSrpcfSvrShared( s32 numOfWorkers, u32 queueDepth ) {
+
+	s32 i;
+
+	// Prepare the request queue
+	if( initializeSrpcfSvrQueue( &srpcfSvrQueue, queueDepth ) == FALSE ) {
+
+		DBGPRINT( "Invalid queue depth %u\n", queueDepth );
+		return FALSE;
+	}
+	sem_init( &taskReady, 0, 0 );
+
+	// Allocate worker contexts
+	srpcfSvrWorkerTbl = (pthread_t *)malloc( sizeof( pthread_t ) * numOfWorkers );
+	if( !srpcfSvrWorkerTbl )
+		return FALSE;
+
+	for( i = 0 ; i < numOfWorkers ; i++ ) {
+
+		if( pthread_create( &srpcfSvrWorkerTbl[ i ], NULL, runSrpcfSvrWorker, NULL ) ) {
+
+			fprintf( stderr, "Failed to create a worker thread\n" );
+			return FALSE;
+		}
+		numOfSrpcfSvrWorkers++;
+	}
+
+	return TRUE;
+}
+
+
+static bool submitSrpcfSvrShared( srpcfSvrTask_t *pSrpcfSvrTask ) {
+
+	// Let the caller run it inline when there is no room
+	if( enqueueSrpcfSvrQueue( &srpcfSvrQueue, pSrpcfSvrTask ) == FALSE )
+		return FALSE;
+
+	// Wake up a worker
+	sem_post( &taskReady );
+	return TRUE;
+}
+
+
+static void dumpSrpcfSvrShared( FILE *fp ) {
+
+	u64 enqueuePos, dequeuePos;
+
+	enqueuePos = __atomic_load_n( &srpcfSvrQueue.enqueuePos, __ATOMIC_RELAXED );
+	dequeuePos = __atomic_load_n( &srpcfSvrQueue.dequeuePos, __ATOMIC_RELAXED );
+
+	fprintf( fp, "workers %d depth %llu high %llu capacity %llu queued %llu full %llu\n",
+		numOfSrpcfSvrWorkers,
+		enqueuePos - dequeuePos,
+		__atomic_load_n( &srpcfSvrQueue.highWater, __ATOMIC_RELAXED ),
+		srpcfSvrQueue.mask + 1,
+		enqueuePos,
+		__atomic_load_n( &srpcfSvrQueue.numOfFull, __ATOMIC_RELAXED ) );
+}
+
+
+static void deinitializeSrpcfSvrShared( void ) {
+
+	s32 i;
+
+	// Stop all workers, queued tasks are dropped
+	workerTerminate = 1;
+	for( i = 0 ; i < numOfSrpcfSvrWorkers ; i++ )
+		pthread_cancel( srpcfSvrWorkerTbl[ i ] );
+
+	// None may touch the queue once it is freed
+	for( i = 0 ; i < numOfSrpcfSvrWorkers ; i++ )
+		pthread_join( srpcfSvrWorkerTbl[ i ], NULL );
+
+	free( srpcfSvrWorkerTbl );
+	free( srpcfSvrQueue.cells );
+	srpcfSvrWorkerTbl = NULL;
+	numOfSrpcfSvrWorkers = 0;
+}
+
+
+static srpcfSvrSched_t srpcfSvrSharedSched = {
+
+	initializeSrpcfSvrShared,
+	submitSrpcfSvrShared,
+	dumpSrpcfSvrShared,
+	deinitializeSrpcfSvrShared,
+};
+
+
+bool initializeSrpcfSvrWorkers( s32 numOfWorkers, u32 queueDepth, srpcfSvrSchedType_t type ) {
+
+	// Pick up the scheduler
+	switch( type ) {
+
+	case SRPCFSVR_SCHED_STEAL:
+		pSrpcfSvrSched = &srpcfSvrStealSched;
+		break;
+
+	case SRPCFSVR_SCHED_SHARED:
+	default:
+		pSrpcfSvrSched = &srpcfSvrSharedSched;
+		break;
+	}
+
+	if( pSrpcfSvrSched->initialize( numOfWorkers, queueDepth ) == FALSE ) {
+
+		pSrpcfSvrSched = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+bool submitSrpcfSvrTask( srpcfSvrTask_t *pSrpcfSvrTask ) {
+
+	return pSrpcfSvrSched->submit( pSrpcfSvrTask );
+}
+
+
+bool isSrpcfSvrWorkersEnabled( void ) {
+
+	return pSrpcfSvrSched ? TRUE : FALSE;
+}
+
+
+void dumpSrpcfSvrWorkers( FILE *fp ) {
+
+	pSrpcfSvrSched->dump( fp );
+}
+
+
+void deinitializeSrpcfSvrWorkers( void ) {
+
+	pSrpcfSvrSched->deinitialize();
+	pSrpcfSvrSched = NULL;
+}
@@ -0,0 +1,336 @@
+/*
+ * SRPCF - Simple Remote Procedire Command Framework
+ * File: wsched.c
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "srpcf_types.h"
+#include "srpcf.h"
+#include "srpcf_err.h"
+#include "libsrpcf.h"
+#include "srpcfsvr.h"
+
+
+//
+// Global variables
+//
+static srpcfSvrStealer_t *srpcfSvrStealerTbl = NULL;
+static s32 numOfSrpcfSvrStealers = 0;
+static u32 nextSrpcfSvrStealer = 0;
+static volatile s8 stealTerminate = 0;
+static __thread srpcfSvrStealer_t *pCurrentSrpcfSvrStealer = NULL;
+
+
+static bool initializeSrpcfSvrDeque( srpcfSvrDeque_t *pSrpcfSvrDeque, u32 depth ) {
+
+	// Depth must be a power of two
+	if( depth < 2 || (depth & (depth - 1)) )
+		return FALSE;
+
+	pSrpcfSvrDeque->tasks = (srpcfSvrTask_t **)malloc( sizeof( srpcfSvrTask_t * ) * depth );
+	if( !pSrpcfSvrDeque->tasks )
+		return FALSE;
+
+	pthread_spin_init( &pSrpcfSvrDeque->lock, PTHREAD_PROCESS_PRIVATE );
+	pSrpcfSvrDeque->mask = depth - 1;
+	pSrpcfSvrDeque->head = 0;
+	pSrpcfSvrDeque->tail = 0;
+
+	return TRUE;
+}
+
+
+static bool pushSrpcfSvrDeque( srpcfSvrDeque_t *pSrpcfSvrDeque, srpcfSvrTask_t *pSrpcfSvrTask ) {
+
+	bool ret = FALSE;
+
+	pthread_spin_lock( &pSrpcfSvrDeque->lock );
+	if( (pSrpcfSvrDeque->tail - pSrpcfSvrDeque->head) <= pSrpcfSvrDeque->mask ) {
+
+		pSrpcfSvrDeque->tasks[ pSrpcfSvrDeque->tail++ & pSrpcfSvrDeque->mask ] = pSrpcfSvrTask;
+		ret = TRUE;
+	}
+	pthread_spin_unlock( &pSrpcfSvrDeque->lock );
+
+	return ret;
+}
+
+
+// The owner and thieves both take the oldest task. Requests are independent,
+// so there is no locality to win by LIFO, and the oldest task is the one whose
+// latency suffers most when it is stuck behind a slow command.
+static srpcfSvrTask_t *popSrpcfSvrDeque( srpcfSvrDeque_t *pSrpcfSvrDeque ) {
+
+	srpcfSvrTask_t *pSrpcfSvrTask = NULL;
+
+	// Cheap check before taking the lock
+	if( __atomic_load_n( &pSrpcfSvrDeque->head, __ATOMIC_RELAXED )
+		== __atomic_load_n( &pSrpcfSvrDeque->tail, __ATOMIC_RELAXED ) )
+		return NULL;
+
+	pthread_spin_lock( &pSrpcfSvrDeque->lock );
+	if( pSrpcfSvrDeque->head != pSrpcfSvrDeque->tail )
+		pSrpcfSvrTask = pSrpcfSvrDeque->tasks[ pSrpcfSvrDeque->head++ & pSrpcfSvrDeque->mask ];
+	pthread_spin_unlock( &pSrpcfSvrDeque->lock );
+
+	return pSrpcfSvrTask;
+}
+
+
+static u32 randomSrpcfSvrStealer( srpcfSvrStealer_t *pSrpcfSvrStealer ) {
+
+	u32 x = pSrpcfSvrStealer->seed;
+
+	// xorshift32
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	pSrpcfSvrStealer->seed = x;
+
+	return x;
+}
+
+
+static srpcfSvrTask_t *findSrpcfSvrTask( srpcfSvrStealer_t *pSrpcfSvrStealer ) {
+
+	srpcfSvrTask_t *pSrpcfSvrTask;
+	s32 i, victim;
+
+	// Own deque first
+	pSrpcfSvrTask = popSrpcfSvrDeque( &pSrpcfSvrStealer->deque );
+	if( pSrpcfSvrTask ) {
+
+		pSrpcfSvrStealer->numOfLocal++;
+		return pSrpcfSvrTask;
+	}
+
+	// Then steal from random victims
+	for( i = 0 ; i < numOfSrpcfSvrStealers ; i++ ) {
+
+		victim = randomSrpcfSvrStealer( pSrpcfSvrStealer ) % numOfSrpcfSvrStealers;
+		if( victim == pSrpcfSvrStealer->id )
+			continue;
+
+		pSrpcfSvrTask = popSrpcfSvrDeque( &srpcfSvrStealerTbl[ victim ].deque );
+		if( pSrpcfSvrTask ) {
+
+			pSrpcfSvrStealer->numOfStolen++;
+			return pSrpcfSvrTask;
+		}
+	}
+
+	pSrpcfSvrStealer->numOfMissed++;
+	return NULL;
+}
+
+
+// Only the worker that was found asleep gets the signal
+static bool wakeSrpcfSvrStealer( srpcfSvrStealer_t *pSrpcfSvrStealer ) {
+
+	if( !__atomic_exchange_n( &pSrpcfSvrStealer->sleeping, 0, __ATOMIC_SEQ_CST ) )
+		return FALSE;
+
+	pthread_mutex_lock( &pSrpcfSvrStealer->sleepLock );
+	pthread_cond_signal( &pSrpcfSvrStealer->sleepCond );
+	pthread_mutex_unlock( &pSrpcfSvrStealer->sleepLock );
+
+	return TRUE;
+}
+
+
+static void sleepSrpcfSvrStealer( srpcfSvrStealer_t *pSrpcfSvrStealer ) {
+
+	pthread_mutex_lock( &pSrpcfSvrStealer->sleepLock );
+	while( __atomic_load_n( &pSrpcfSvrStealer->sleeping, __ATOMIC_SEQ_CST ) )
+		pthread_cond_wait( &pSrpcfSvrStealer->sleepCond, &pSrpcfSvrStealer->sleepLock );
+	pthread_mutex_unlock( &pSrpcfSvrStealer->sleepLock );
+}
+
+
+static void *runSrpcfSvrStealer( void *arg ) {
+
+	srpcfSvrStealer_t *pSrpcfSvrStealer = (srpcfSvrStealer_t *)arg;
+	srpcfSvrTask_t *pSrpcfSvrTask;
+
+	// Tasks submitted from here go to our own deque
+	pCurrentSrpcfSvrStealer = pSrpcfSvrStealer;
+
+	while( !stealTerminate ) {
+
+		// Own deque first, steal only once it has run dry
+		pSrpcfSvrTask = findSrpcfSvrTask( pSrpcfSvrStealer );
+		if( pSrpcfSvrTask ) {
+
+			runSrpcfSvrTask( pSrpcfSvrTask );
+			continue;
+		}
+
+		// Say we are going to sleep, then look once more so a task pushed
+		// in between is not left waiting for the next one
+		__atomic_store_n( &pSrpcfSvrStealer->sleeping, 1, __ATOMIC_SEQ_CST );
+		pSrpcfSvrTask = findSrpcfSvrTask( pSrpcfSvrStealer );
+		if( pSrpcfSvrTask ) {
+
+			__atomic_store_n( &pSrpcfSvrStealer->sleeping, 0, __ATOMIC_SEQ_CST );
+			runSrpcfSvrTask( pSrpcfSvrTask );
+			continue;
+		}
+
+		sleepSrpcfSvrStealer( pSrpcfSvrStealer );
+	}
+
+	pthread_exit( 0 );
+}
+
+
+static bool initializeSrpcfSvrSteal( s32 numOfWorkers, u32 queueDepth ) {
+
+	s32 i;
+
+	// Allocate worker contexts
+	srpcfSvrStealerTbl = (srpcfSvrStealer_t *)aligned_alloc( SRPCFSVR_CACHELINE,
+			sizeof( srpcfSvrStealer_t ) * numOfWorkers );
+	if( !srpcfSvrStealerTbl )
+		return FALSE;
+	memset( srpcfSvrStealerTbl, 0, sizeof( srpcfSvrStealer_t ) * numOfWorkers );
+
+	for( i = 0 ; i < numOfWorkers ; i++ ) {
+
+		srpcfSvrStealerTbl[ i ].id = i;
+		srpcfSvrStealerTbl[ i ].seed = 2463534242U + i * 2654435761U;
+		pthread_mutex_init( &srpcfSvrStealerTbl[ i ].sleepLock, NULL );
+		pthread_cond_init( &srpcfSvrStealerTbl[ i ].sleepCond, NULL );
+
+		if( initializeSrpcfSvrDeque( &srpcfSvrStealerTbl[ i ].deque, queueDepth ) == FALSE ) {
+
+			DBGPRINT( "Invalid queue depth %u\n", queueDepth );
+			return FALSE;
+		}
+	}
+
+	// All deques must exist before anyone starts stealing
+	numOfSrpcfSvrStealers = numOfWorkers;
+	for( i = 0 ; i < numOfWorkers ; i++ ) {
+
+		if( pthread_create( &srpcfSvrStealerTbl[ i ].pth,
+				NULL,
+				runSrpcfSvrStealer,
+				(void *)&srpcfSvrStealerTbl[ i ] ) ) {
+
+			fprintf( stderr, "Failed to create a worker thread\n" );
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+
+static bool submitSrpcfSvrSteal( srpcfSvrTask_t *pSrpcfSvrTask ) {
+
+	srpcfSvrStealer_t *pSrpcfSvrStealer;
+	u32 start;
+	s32 i, target = -1;
+
+	// A worker keeps what it submits, everyone else spreads tasks in round
+	// robin. Full deques are skipped over.
+	if( pCurrentSrpcfSvrStealer )
+		start = pCurrentSrpcfSvrStealer->id;
+	else
+		start = __atomic_fetch_add( &nextSrpcfSvrStealer, 1, __ATOMIC_RELAXED );
+
+	for( i = 0 ; i < numOfSrpcfSvrStealers ; i++ ) {
+
+		if( pushSrpcfSvrDeque( &srpcfSvrStealerTbl[ (start + i) % numOfSrpcfSvrStealers ].deque,
+				pSrpcfSvrTask ) == TRUE ) {
+
+			target = (start + i) % numOfSrpcfSvrStealers;
+			break;
+		}
+	}
+
+	if( target < 0 )
+		return FALSE;
+
+	// The owner takes it if it is idle
+	pSrpcfSvrStealer = &srpcfSvrStealerTbl[ target ];
+	if( pSrpcfSvrStealer == pCurrentSrpcfSvrStealer || wakeSrpcfSvrStealer( pSrpcfSvrStealer ) == TRUE )
+		return TRUE;
+
+	// The owner is busy, wake one idle worker, it runs dry and steals the task
+	for( i = 1 ; i < numOfSrpcfSvrStealers ; i++ ) {
+
+		if( wakeSrpcfSvrStealer( &srpcfSvrStealerTbl[ (target + i) % numOfSrpcfSvrStealers ] ) == TRUE )
+			break;
+	}
+
+	return TRUE;
+}
+
+
+static void dumpSrpcfSvrSteal( FILE *fp ) {
+
+	srpcfSvrStealer_t *pSrpcfSvrStealer;
+	s32 i;
+
+	for( i = 0 ; i < numOfSrpcfSvrStealers ; i++ ) {
+
+		pSrpcfSvrStealer = &srpcfSvrStealerTbl[ i ];
+		fprintf( fp, "worker %d local %llu stolen %llu missed %llu depth %u\n",
+			i,
+			__atomic_load_n( &pSrpcfSvrStealer->numOfLocal, __ATOMIC_RELAXED ),
+			__atomic_load_n( &pSrpcfSvrStealer->numOfStolen, __ATOMIC_RELAXED ),
+			__atomic_load_n( &pSrpcfSvrStealer->numOfMissed, __ATOMIC_RELAXED ),
+			__atomic_load_n( &pSrpcfSvrStealer->deque.tail, __ATOMIC_RELAXED )
+				- __atomic_load_n( &pSrpcfSvrStealer->deque.head, __ATOMIC_RELAXED ) );
+	}
+}
+
+
+static void deinitializeSrpcfSvrSteal( void ) {
+
+	s32 i;
+
+	// Stop all workers, queued tasks are dropped
+	stealTerminate = 1;
+	for( i = 0 ; i < numOfSrpcfSvrStealers ; i++ )
+		pthread_cancel( srpcfSvrStealerTbl[ i ].pth );
+
+	// Any of them may still steal from another deque until it is gone
+	for( i = 0 ; i < numOfSrpcfSvrStealers ; i++ )
+		pthread_join( srpcfSvrStealerTbl[ i ].pth, NULL );
+	for( i = 0 ; i < numOfSrpcfSvrStealers ; i++ )
+		free( srpcfSvrStealerTbl[ i ].deque.tasks );
+
+	free( srpcfSvrStealerTbl );
+	srpcfSvrStealerTbl = NULL;
+	numOfSrpcfSvrStealers = 0;
+}
+
+
+srpcfSvrSched_t srpcfSvrStealSched = {
+
+	initializeSrpcfSvrSteal,
+	submitSrpcfSvrSteal,
+	dumpSrpcfSvrSteal,
+	deinitializeSrpcfSvrSteal,
+};
@@ -14,17 +14,32 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 #
+# Usage: gen_cmd.sh <SrpcfCmd>
+#
+# Generate a stub for a new built-in command under the next free number,
+# the build picks it up from its LIBSRPCF_REGISTER line.
+#
 
-SRPCF_FILE="templates/cmds.txt"
+CMD_DIR="../libsrpcf/cmds"
 TEMPLATE_FILE="templates/CMD_TEMP.c"
 
-rm -f *.c
-for cmd in `cat ${SRPCF_FILE}`
-do
-	echo "Generate SRPCF source code for ${cmd}"
-	SRPCFNAME=${cmd}
-	FILENAME=${cmd}.c
-	cat $TEMPLATE_FILE | sed -e s/#FILENAME#/${FILENAME}/g | sed -e s/#SRPCFNAME#/${SRPCFNAME}/g > ${FILENAME}
+SRPCFNAME=$1
+FILENAME=${SRPCFNAME}.c
+if [ -z "${SRPCFNAME}" ]; then
+
+	echo "Usage: $0 <SrpcfCmd>"
+	exit 1
+fi
+
+if [ -e ${CMD_DIR}/${FILENAME} ]; then
+
+	echo "${CMD_DIR}/${FILENAME} already exists"
+	exit 1
+fi
 
-done
+# Numbers go over the wire, always take a new one
+SRPCFNUMBER=`sed -n 's/^LIBSRPCF_REGISTER( *[A-Za-z0-9_]* *, *\([0-9]*\) *).*/\1/p' ${CMD_DIR}/*.c | sort -n | tail -1`
+SRPCFNUMBER=$(( ${SRPCFNUMBER:-0} + 1 ))
 
+echo "Generate SRPCF source code for ${SRPCFNAME} #${SRPCFNUMBER}"
+cat $TEMPLATE_FILE | sed -e s/#FILENAME#/${FILENAME}/g | sed -e s/#SRPCFNAME#/${SRPCFNAME}/g | sed -e s/#SRPCFNUMBER#/${SRPCFNUMBER}/g > ${CMD_DIR}/${FILENAME}
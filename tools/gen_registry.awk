@@ -0,0 +1,237 @@
+#
+# SRPCF - Simple Remote Procedire Command Framework
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Build the built-in command registry from LIBSRPCF_REGISTER( NAME, NUMBER )
+# lines in libsrpcf/cmds/*.c.
+#
+#   awk -v out=header -f gen_registry.awk cmds/*.c > srpcf_cmds.h
+#   awk -v out=table -f gen_registry.awk cmds/*.c > cmdtbl.c
+#   awk -v out=names -f gen_registry.awk cmds/*.c
+#
+# The table is sorted by name and comes with a perfect hash, the hash must
+# match hashSrpcfCmd() in libsrpcf/srpcf.c.
+#
+
+BEGIN {
+
+	numOfCmds = 0
+	maxCmdNo = 0
+
+	# mawk has no ord()
+	for( i = 32 ; i < 127 ; i++ )
+		chars = chars sprintf( "%c", i )
+}
+
+
+/^LIBSRPCF_REGISTER\(/ {
+
+	line = $0
+	sub( /^LIBSRPCF_REGISTER\([ \t]*/, "", line )
+	sub( /[ \t]*\).*$/, "", line )
+	split( line, field, /[ \t]*,[ \t]*/ )
+
+	name = field[ 1 ]
+	num = field[ 2 ] + 0
+	if( name !~ /^[A-Za-z_][A-Za-z0-9_]*$/ || num < 1 ) {
+
+		printf( "%s:%d: bad registration\n", FILENAME, FNR ) > "/dev/stderr"
+		failed = 1
+		exit 1
+	}
+
+	if( name in byName || num in byNum ) {
+
+		printf( "%s:%d: %s #%d registered twice\n", FILENAME, FNR, name, num ) > "/dev/stderr"
+		failed = 1
+		exit 1
+	}
+
+	byName[ name ] = num
+	byNum[ num ] = name
+	cmdName[ numOfCmds++ ] = name
+	if( num > maxCmdNo )
+		maxCmdNo = num
+}
+
+
+function hash( str, seed, size,    h, i ) {
+
+	h = 0
+	for( i = 1 ; i <= length( str ) ; i++ )
+		h = (h * seed + index( chars, substr( str, i, 1 ) ) + 31) % size
+
+	return h
+}
+
+
+END {
+
+	if( failed )
+		exit 1
+
+	# Sort by name
+	for( i = 1 ; i < numOfCmds ; i++ ) {
+
+		name = cmdName[ i ]
+		for( j = i - 1 ; j >= 0 && cmdName[ j ] > name ; j-- )
+			cmdName[ j + 1 ] = cmdName[ j ]
+		cmdName[ j + 1 ] = name
+	}
+
+	if( out == "names" ) {
+
+		for( i = 0 ; i < numOfCmds ; i++ )
+			print cmdName[ i ]
+		exit 0
+	}
+
+	if( out == "header" ) {
+
+		print "/*"
+		print " * SRPCF - Simple Remote Procedire Command Framework"
+		print " * File: srpcf_cmds.h"
+		print " *"
+		print " * Generated by tools/gen_registry.awk from libsrpcf/cmds, do not edit."
+		print " *"
+		print " */"
+		print ""
+		print "#ifndef __SRPCF_CMDS_H__"
+		print "#define __SRPCF_CMDS_H__"
+		print ""
+		print ""
+		print "//"
+		print "// Enumernations"
+		print "//"
+		print "typedef enum _srpcfCmds {"
+		print ""
+		print "\t// Start of SRPCF commands, also marks plugins"
+		print "\tXR_START_SRPCF = 0,"
+		print ""
+		for( num = 1 ; num <= maxCmdNo ; num++ )
+			if( num in byNum )
+				printf( "\t%s = %d,\n", byNum[ num ], num )
+		print ""
+		print "\t// End of SRPCF commands"
+		printf( "\tXR_END_SRPCF = %d,\n", maxCmdNo + 1 )
+		print ""
+		print "} srpcfCmds;"
+		print ""
+		print ""
+		print "#endif"
+		exit 0
+	}
+
+	# Smallest power of two with room to spare, then the first seed without collisions
+	for( size = 2 ; size < numOfCmds * 2 ; size *= 2 );
+	for( seed = 1 ; ; seed++ ) {
+
+		split( "", slot )
+		for( i = 0 ; i < numOfCmds ; i++ ) {
+
+			h = hash( cmdName[ i ], seed, size )
+			if( h in slot )
+				break
+			slot[ h ] = i
+		}
+
+		if( i == numOfCmds )
+			break
+
+		# Grow the table rather than search forever
+		if( seed == 65535 ) {
+
+			size *= 2
+			seed = 0
+		}
+	}
+
+	print "/*"
+	print " * SRPCF - Simple Remote Procedire Command Framework"
+	print " * File: cmdtbl.c"
+	print " *"
+	print " * Generated by tools/gen_registry.awk from libsrpcf/cmds, do not edit."
+	print " *"
+	print " */"
+	print ""
+	print "#include \"srpcf_types.h\""
+	print "#include \"srpcf.h\""
+	print "#include \"libsrpcf.h\""
+	print ""
+	print ""
+	print "//"
+	print "// Command functions, whatever a command does not implement stays NULL"
+	print "//"
+	for( i = 0 ; i < numOfCmds ; i++ ) {
+
+		name = cmdName[ i ]
+		printf( "extern s8 *srpcfExecutor_%s( cmdOpt_t *, u32, u32 * ) __attribute__((weak));\n", name )
+		printf( "extern void srpcfStreamer_%s( cmdOpt_t *, u32, srpcfSink_t *, u32 * ) __attribute__((weak));\n", name )
+		printf( "extern s8 *srpcfContextExecutor_%s( void *, cmdOpt_t *, u32, u32 * ) __attribute__((weak));\n", name )
+		printf( "extern bool srpcfInit_%s( void ** ) __attribute__((weak));\n", name )
+		printf( "extern void srpcfFini_%s( void * ) __attribute__((weak));\n", name )
+		printf( "extern bool srpcfParser_%s( cmdOpt_t *, u32 ) __attribute__((weak));\n", name )
+		printf( "extern s8 *srpcfHelper_%s( void ) __attribute__((weak));\n", name )
+		printf( "extern void srpcfError_%s( s32 ) __attribute__((weak));\n", name )
+		print ""
+	}
+	print ""
+	print "//"
+	print "// Descriptors, sorted by name"
+	print "//"
+	print "const srpcfCmdDesc_t srpcfCmdDescTbl[] = {"
+	print ""
+	for( i = 0 ; i < numOfCmds ; i++ ) {
+
+		name = cmdName[ i ]
+		printf( "\t{ %s, \"%s\", {\n", name, name )
+		printf( "\t\t.srpcfFuncExecutor = srpcfExecutor_%s,\n", name )
+		printf( "\t\t.srpcfFuncStreamer = srpcfStreamer_%s,\n", name )
+		printf( "\t\t.srpcfFuncContextExecutor = srpcfContextExecutor_%s,\n", name )
+		printf( "\t\t.srpcfFuncInit = srpcfInit_%s,\n", name )
+		printf( "\t\t.srpcfFuncFini = srpcfFini_%s,\n", name )
+		printf( "\t\t.srpcfFuncParser = srpcfParser_%s,\n", name )
+		printf( "\t\t.srpcfFuncHelper = srpcfHelper_%s,\n", name )
+		printf( "\t\t.srpcfFuncError = srpcfError_%s,\n", name )
+		print "\t} },"
+	}
+	print "};"
+	print ""
+	printf( "const u32 numOfSrpcfCmdDescs = %d;\n", numOfCmds )
+	print ""
+	print ""
+	print "//"
+	print "// Perfect hash of the names, slots hold a descriptor index or -1"
+	print "//"
+	printf( "const u32 srpcfCmdHashSeed = %d;\n", seed )
+	printf( "const u32 srpcfCmdHashSize = %d;\n", size )
+	printf( "const s16 srpcfCmdHashTbl[ %d ] = {\n", size )
+	for( h = 0 ; h < size ; h++ )
+		printf( "\t%d,\n", (h in slot) ? slot[ h ] : -1 )
+	print "};"
+	print ""
+	print ""
+	print "//"
+	print "// Descriptor index by command number, -1 for numbers not in use"
+	print "//"
+	printf( "const s16 srpcfCmdNoTbl[ %d ] = {\n", maxCmdNo + 1 )
+	for( num = 0 ; num <= maxCmdNo ; num++ ) {
+
+		for( i = 0 ; i < numOfCmds ; i++ )
+			if( byName[ cmdName[ i ] ] == num )
+				break
+		printf( "\t%d,\n", (i < numOfCmds) ? i : -1 )
+	}
+	print "};"
+}